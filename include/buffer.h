@@ -11,19 +11,44 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+// most control packets fit in this many bytes, which are kept inline in
+// the buffer so that building them doesn't touch the heap...
+#define BUFFER_INLINE_SIZE 128
+
+// a 64 bit value takes at most ten bytes as a varint...
+#define BUFFER_MAX_VARINT_SIZE 10
+
+// the data is either the inline storage, a block of capacity bytes from
+// the buffer pool which grows geometrically, or when the capacity is zero,
+// memory the buffer doesn't own and only reads from...
 typedef struct Buffer
 {
   unsigned char *data;
   int size;
   int offset;
+  int capacity;
+  unsigned char inline_data[BUFFER_INLINE_SIZE];
 } buffer_t;
 
+// a view of bytes within a buffer, which is only valid for as long as
+// the buffer's data is...
+typedef struct BufferSlice
+{
+  const unsigned char *data;
+  int size;
+} buffer_slice_t;
+
+// counts the blocks taken for buffer data, whether pooled or not...
+static atomic_long buffer_num_allocations = 0;
+
 buffer_t* buffer_init_data(int offset, const unsigned char *data, int size);
 buffer_t* buffer_init_size(int offset, int size);
 buffer_t* buffer_init_offset(int offset);
@@ -31,11 +56,17 @@ buffer_t* buffer_init(void);
 void buffer_copy(buffer_t *buffer, buffer_t *other_buffer);
 void buffer_free(buffer_t *buffer);
 
+void buffer_reserve(buffer_t *buffer, int capacity);
 void buffer_realloc(buffer_t *buffer, int size);
+int buffer_get_capacity(buffer_t *buffer);
+long buffer_get_num_allocations(void);
 void buffer_write(buffer_t *buffer, const unsigned char *data, int size);
+unsigned char* buffer_claim(buffer_t *buffer, int size);
 char* buffer_read(buffer_t *buffer, int size);
 int buffer_get_size(buffer_t *buffer);
 int buffer_get_remaining_size(buffer_t *buffer);
+int buffer_get_offset(buffer_t *buffer);
+void buffer_set_offset(buffer_t *buffer, int offset);
 const unsigned char* buffer_get_data(buffer_t *buffer);
 const unsigned char* buffer_get_remaining_data(buffer_t *buffer);
 
@@ -62,6 +93,21 @@ int64_t buffer_read_int64(buffer_t *buffer);
 void buffer_write_string(buffer_t *buffer, const char *string, int size);
 char* buffer_read_string(buffer_t *buffer);
 
+void buffer_write_uint16_le(buffer_t *buffer, uint16_t value);
+bool buffer_read_uint16_le(buffer_t *buffer, uint16_t *value);
+void buffer_write_uint32_le(buffer_t *buffer, uint32_t value);
+bool buffer_read_uint32_le(buffer_t *buffer, uint32_t *value);
+void buffer_write_uint64_le(buffer_t *buffer, uint64_t value);
+bool buffer_read_uint64_le(buffer_t *buffer, uint64_t *value);
+
+int buffer_get_varint_size(uint64_t value);
+void buffer_write_varint(buffer_t *buffer, uint64_t value);
+bool buffer_read_varint(buffer_t *buffer, uint64_t *value);
+
+bool buffer_read_slice(buffer_t *buffer, int size, buffer_slice_t *slice);
+bool buffer_read_string_slice(buffer_t *buffer, buffer_slice_t *slice);
+bool buffer_slice_copy_string(const buffer_slice_t *slice, char *string, int size);
+
 #ifdef __cplusplus
 }
 #endif
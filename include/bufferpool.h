@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// blocks are pooled in power of two size classes, from 256 bytes up to
+// 64 KiB, anything larger comes straight from the heap...
+#define BUFFER_POOL_MIN_BLOCK_SIZE 256
+#define BUFFER_POOL_NUM_CLASSES 9
+
+// each thread keeps up to this many blocks of a class to itself, handing
+// half of them over to the depot when it has too many, and taking half as
+// many back from the depot when it runs out...
+#define BUFFER_POOL_CACHE_SIZE 32
+#define BUFFER_POOL_DEPOT_SIZE 512
+
+typedef struct BufferPoolBlock
+{
+  struct BufferPoolBlock *next;
+} buffer_pool_block_t;
+
+typedef struct BufferPoolList
+{
+  buffer_pool_block_t *head;
+  int size;
+} buffer_pool_list_t;
+
+typedef struct BufferPoolCache
+{
+  buffer_pool_list_t lists[BUFFER_POOL_NUM_CLASSES];
+} buffer_pool_cache_t;
+
+static _Thread_local buffer_pool_cache_t *buffer_pool_current_cache = NULL;
+static pthread_key_t buffer_pool_cache_key;
+static pthread_once_t buffer_pool_cache_key_once = PTHREAD_ONCE_INIT;
+
+static buffer_pool_list_t buffer_pool_depot[BUFFER_POOL_NUM_CLASSES];
+static pthread_mutex_t buffer_pool_depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_long buffer_pool_num_hits = 0;
+static atomic_long buffer_pool_num_misses = 0;
+
+int buffer_pool_get_block_size(int size);
+
+void* buffer_pool_alloc(int size);
+void buffer_pool_free(void *block, int size);
+void buffer_pool_clear(void);
+
+long buffer_pool_get_num_hits(void);
+long buffer_pool_get_num_misses(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -27,6 +27,19 @@ typedef int dyad_Socket;
 struct dyad_Stream;
 typedef struct dyad_Stream dyad_Stream;
 
+struct dyad_Reactor;
+typedef struct dyad_Reactor dyad_Reactor;
+
+/* Refers to a stream without keeping it alive, dyad_getStream() returns NULL
+ * once the stream has been destroyed. Valid until the stream's reactor is
+ * shut down; other threads write through it with dyad_writeHandle() and
+ * dyad_writeRefHandle(), which drop the write once the stream is gone */
+typedef struct {
+  dyad_Reactor *reactor;
+  int slot;
+  unsigned generation;
+} dyad_Handle;
+
 typedef struct {
   int type;
   void *udata;
@@ -39,6 +52,7 @@ typedef struct {
 
 typedef void (*dyad_Callback)(dyad_Event*);
 typedef void (*dyad_PanicCallback)(const char*);
+typedef void (*dyad_ReleaseCallback)(void*);
 
 enum {
   DYAD_EVENT_NULL,
@@ -52,7 +66,14 @@ enum {
   DYAD_EVENT_LINE,
   DYAD_EVENT_ERROR,
   DYAD_EVENT_TIMEOUT,
-  DYAD_EVENT_TICK
+  DYAD_EVENT_TICK,
+  DYAD_EVENT_DRAIN
+};
+
+enum {
+  DYAD_BACKEND_SELECT,
+  DYAD_BACKEND_EPOLL,
+  DYAD_BACKEND_URING
 };
 
 enum {
@@ -71,8 +92,17 @@ double dyad_getTime(void);
 int  dyad_getStreamCount(void);
 void dyad_setTickInterval(double seconds);
 void dyad_setUpdateTimeout(double seconds);
+void dyad_setAcceptBudget(int count);
+int  dyad_setBackend(int backend);
+int  dyad_getBackend(void);
 dyad_PanicCallback dyad_atPanic(dyad_PanicCallback func);
 
+dyad_Reactor *dyad_newReactor(void);
+void dyad_destroyReactor(dyad_Reactor *reactor);
+void dyad_setReactor(dyad_Reactor *reactor);
+dyad_Reactor *dyad_getReactor(void);
+void dyad_wakeReactor(dyad_Reactor *reactor);
+
 dyad_Stream *dyad_newStream(void);
 int  dyad_listen(dyad_Stream *stream, int port);
 int  dyad_listenEx(dyad_Stream *stream, const char *host, int port,
@@ -86,16 +116,28 @@ void dyad_removeAllListeners(dyad_Stream *stream, int event);
 void dyad_end(dyad_Stream *stream);
 void dyad_close(dyad_Stream *stream);
 void dyad_write(dyad_Stream *stream, const void *data, int size);
+void dyad_writeRef(dyad_Stream *stream, const void *data, int size,
+                   dyad_ReleaseCallback release, void *udata);
 void dyad_vwritef(dyad_Stream *stream, const char *fmt, va_list args);
 void dyad_writef(dyad_Stream *stream, const char *fmt, ...);
 void dyad_setTimeout(dyad_Stream *stream, double seconds);
 void dyad_setNoDelay(dyad_Stream *stream, int opt);
+void dyad_setWatermarks(dyad_Stream *stream, int low, int high);
+int  dyad_setReusePort(dyad_Stream *stream, int opt);
 int  dyad_getState(dyad_Stream *stream);
 const char *dyad_getAddress(dyad_Stream *stream);
 int  dyad_getPort(dyad_Stream *stream);
 int  dyad_getBytesSent(dyad_Stream *stream);
 int  dyad_getBytesReceived(dyad_Stream *stream);
+int  dyad_getPendingBytes(dyad_Stream *stream);
+int  dyad_getWritable(dyad_Stream *stream);
 dyad_Socket dyad_getSocket(dyad_Stream *stream);
+dyad_Reactor *dyad_getStreamReactor(dyad_Stream *stream);
+dyad_Handle dyad_getHandle(dyad_Stream *stream);
+dyad_Stream *dyad_getStream(dyad_Handle handle);
+int  dyad_writeHandle(dyad_Handle handle, const void *data, int size);
+int  dyad_writeRefHandle(dyad_Handle handle, const void *data, int size,
+                         dyad_ReleaseCallback release, void *udata);
 
 #ifdef __cplusplus
 } // extern "C"
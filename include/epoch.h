@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define EPOCH_RECLAIM_THRESHOLD 64
+
+// epoch based reclamation, for objects which are read without locking
+// while writers replace them. readers enter a critical section, in which
+// anything they load stays valid, and writers retire what they replace
+// instead of freeing it. an object retired in one epoch is only freed once
+// the global epoch has moved on twice, which it can only do once every
+// thread in a critical section has seen the current epoch...
+typedef void (*epoch_free_func_t)(void *object);
+
+// one per thread which has entered a critical section, the records of
+// threads which have exited are reused...
+typedef struct EpochRecord
+{
+  atomic_uint_fast64_t epoch;
+  atomic_bool active;
+  atomic_bool in_use;
+  int depth;
+  struct EpochRecord *next;
+} epoch_record_t;
+
+typedef struct EpochRetired
+{
+  void *object;
+  epoch_free_func_t free_func;
+  uint64_t epoch;
+  struct EpochRetired *next;
+} epoch_retired_t;
+
+static atomic_uint_fast64_t epoch_global = 0;
+static _Atomic(epoch_record_t*) epoch_records = NULL;
+static _Thread_local epoch_record_t *epoch_current_record = NULL;
+static pthread_key_t epoch_record_key;
+static pthread_once_t epoch_record_key_once = PTHREAD_ONCE_INIT;
+
+static epoch_retired_t *epoch_retired_head = NULL;
+static int epoch_num_retired = 0;
+static pthread_mutex_t epoch_retired_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void epoch_enter(void);
+void epoch_exit(void);
+
+void epoch_retire(void *object, epoch_free_func_t free_func);
+void epoch_collect(void);
+void epoch_collect_all(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,8 +10,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
-#include "queue.h"
+#include "registry.h"
 #include "task.h"
 
 #ifdef __cplusplus
@@ -27,8 +28,8 @@ typedef struct KeypairStorage
   keypair_info_t *keypair_info;
 } keypair_storage_t;
 
-static int keypairinterface_next_id = -1;
-static queue_t *keypairinterface_queue;
+static atomic_int keypairinterface_next_id = -1;
+static registry_t *keypairinterface_registry;
 
 bool keypairinterface_init(int num_keypair_entries, keypair_info_t keypair_entries[]);
 bool keypairinterface_shutdown(void);
@@ -45,6 +46,7 @@ void remove_keypair(keypair_storage_t *keypair_storage);
 void remove_keypair_by_id(int id);
 
 keypair_storage_t* get_keypair_from_id(int id);
+keypair_storage_t* get_keypair_from_index(int index);
 
 void free_keypair(keypair_storage_t *keypair_storage);
 void free_keypair_by_id(int id);
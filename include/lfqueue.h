@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define LF_QUEUE_CACHE_LINE_SIZE 64
+
+// bounded lock-free queues of object pointers for handing work from one
+// thread to another. the capacity is rounded up to a power of two, a push
+// fails once the queue is full and a pop returns NULL once it's empty, so
+// objects must not be NULL. each queue is only safe with the number of
+// producers and consumers its name says, for any more use queue_t...
+
+// a slot of the queues with several producers or consumers, its sequence
+// tells whether it's ready to be written or read at a given position...
+typedef struct LFQueueCell
+{
+  atomic_size_t sequence;
+  void *object;
+} lf_queue_cell_t;
+
+// many producers, one consumer, such as threads submitting work to a
+// thread which runs it...
+typedef struct MPSCQueue
+{
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t tail;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t head;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) size_t mask;
+  lf_queue_cell_t *cells;
+} mpsc_queue_t;
+
+// one producer, one consumer, such as the stages of a pipeline. each side
+// keeps a copy of the other's position, which it only reads again once the
+// copy says the queue is full or empty...
+typedef struct SPSCQueue
+{
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t tail;
+  size_t cached_head;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t head;
+  size_t cached_tail;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) size_t mask;
+  void **objects;
+} spsc_queue_t;
+
+// one producer, many consumers, such as a thread fanning work out to
+// several others...
+typedef struct SPMCQueue
+{
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t tail;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) atomic_size_t head;
+  _Alignas(LF_QUEUE_CACHE_LINE_SIZE) size_t mask;
+  lf_queue_cell_t *cells;
+} spmc_queue_t;
+
+mpsc_queue_t* mpsc_queue_init(size_t capacity);
+void mpsc_queue_free(mpsc_queue_t *queue);
+size_t mpsc_queue_get_capacity(mpsc_queue_t *queue);
+size_t mpsc_queue_get_size(mpsc_queue_t *queue);
+bool mpsc_queue_push(mpsc_queue_t *queue, void *object);
+void* mpsc_queue_pop(mpsc_queue_t *queue);
+
+spsc_queue_t* spsc_queue_init(size_t capacity);
+void spsc_queue_free(spsc_queue_t *queue);
+size_t spsc_queue_get_capacity(spsc_queue_t *queue);
+size_t spsc_queue_get_size(spsc_queue_t *queue);
+bool spsc_queue_push(spsc_queue_t *queue, void *object);
+void* spsc_queue_pop(spsc_queue_t *queue);
+
+spmc_queue_t* spmc_queue_init(size_t capacity);
+void spmc_queue_free(spmc_queue_t *queue);
+size_t spmc_queue_get_capacity(spmc_queue_t *queue);
+size_t spmc_queue_get_size(spmc_queue_t *queue);
+bool spmc_queue_push(spmc_queue_t *queue, void *object);
+void* spmc_queue_pop(spmc_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,9 +9,11 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <time.h>
 
-#include "queue.h"
+#include "registry.h"
 #include "task.h"
 
 #ifdef __cplusplus
@@ -20,17 +22,23 @@ extern "C"
 #endif
 
 #define DEFAULT_MSG_DELAY 60.0
+#define MSGINTERFACE_POLL_DELAY 1.0
+#define MSG_CHECKSUM_SIZE 32
 
 typedef struct PendingMsg
 {
   int id;
-  const char *checksum;
+  char checksum[MSG_CHECKSUM_SIZE];
   int size;
   time_t timestamp;
 } pending_msg_t;
 
-static int msginterface_next_id = -1;
-static queue_t *msginterface_queue;
+// messages are added by the reactors' threads and expired by a scheduler's,
+// looking a message up by its checksum and adding or removing it are done
+// under the mutex so no message is freed while it's being looked at...
+static atomic_int msginterface_next_id = -1;
+static registry_t *msginterface_registry;
+static pthread_mutex_t msginterface_mutex = PTHREAD_MUTEX_INITIALIZER;
 static task_t *msginterface_poll_task;
 
 bool msginterface_init(void);
@@ -52,7 +60,7 @@ bool get_msg_has_expired(time_t timestamp);
 void free_msg(pending_msg_t *pending_msg);
 void free_msg_by_id(int id);
 
-task_result_t poll_msginterface(task_t *task, va_list args);
+task_result_t poll_msginterface(task_t *task);
 
 #ifdef __cplusplus
 }
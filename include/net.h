@@ -9,11 +9,13 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "dyad.h"
 #include "queue.h"
 #include "task.h"
 #include "netbase.h"
+#include "wire.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -24,13 +26,33 @@ static const char *net_bind_address = DEFAULT_ADDRESS;
 static int net_bind_port = DEFAULT_PORT;
 static int net_backlog = DEFAULT_BACKLOG;
 static bool net_want_port_mapping = true;
+static int net_event_backend = DEFAULT_EVENT_BACKEND;
+static int net_num_reactors = DEFAULT_NUM_REACTORS;
+static int net_max_wire_version = WIRE_VERSION_LATEST;
+static size_t net_max_frame_size = DEFAULT_MAX_FRAME_SIZE;
 
-static dyad_Stream *net_stream;
+typedef struct NetReactor
+{
+  int id;
+  dyad_Reactor *reactor;
+  dyad_Stream *stream;
+  pthread_t thread;
+} net_reactor_t;
+
+static net_reactor_t *net_reactors;
+static int net_num_running_reactors = 0;
+static bool net_reactors_terminated = false;
+
+static int net_num_connection_entries = 0;
+static connection_entry_t *net_connection_entries;
 
 static queue_t *net_accept_queue;
 static queue_t *net_connection_queue;
 
-static task_t *net_poll_events_task;
+static connection_t *net_connection_pool = NULL;
+static int net_connection_pool_size = 0;
+static pthread_mutex_t net_connection_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static task_t *net_poll_resync_task;
 
 bool net_init(int num_connection_entries, connection_entry_t connection_entries[]);
@@ -48,21 +70,47 @@ int net_get_backlog(void);
 void net_set_want_port_mapping(bool want_port_mapping);
 bool net_get_want_port_mapping(void);
 
+void net_set_event_backend(int event_backend);
+int net_get_event_backend(void);
+
+void net_set_num_reactors(int num_reactors);
+int net_get_num_reactors(void);
+
+void net_set_max_wire_version(int wire_version);
+int net_get_max_wire_version(void);
+
+void net_set_max_frame_size(size_t max_frame_size);
+size_t net_get_max_frame_size(void);
+
+bool net_init_reactor(net_reactor_t *net_reactor);
+void* net_reactor_run(void *arg);
+
+void net_init_connection_pool(int size);
+void net_free_connection_pool(void);
+
 connection_t* net_init_connection(dyad_Stream *stream, dyad_Stream *remote);
 void net_free_connection(connection_t *connection);
 void net_setup_portmapping(int port);
 
 void net_on_connect(dyad_Event *event);
+size_t net_get_frame_size(const unsigned char *header, size_t size, void *arg);
+bool net_handle_frame(const unsigned char *frame, size_t size, void *arg);
+
 void net_on_data(dyad_Event *event);
 void net_on_close(dyad_Event *event);
 void net_on_error(dyad_Event *event);
+void net_on_drain(dyad_Event *event);
 void net_on_accept(dyad_Event *event);
 
+bool net_get_connection_writable(connection_t *connection);
+
 bool net_open_tcp_server(dyad_Stream *stream, const char *address, int port, size_t backlog);
 bool net_open_tcp_connection(dyad_Stream *stream, const char *address, int port);
 
-task_result_t net_poll_events(task_t *task, va_list args);
-task_result_t net_poll_resync_peers(task_t *task, va_list args);
+void net_wait_events(double timeout);
+void net_wake_events(void);
+
+task_result_t net_poll_resync_peers(task_t *task);
 
 #ifdef __cplusplus
 }
@@ -8,28 +8,42 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <arpa/inet.h>
 
 #include "dyad.h"
 #include "crypto.h"
+#include "ringbuffer.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-#define DEFAULT_SOCKET_TIMEOUT 0.001
+#define DEFAULT_REACTOR_TIMEOUT 1.0
 
 #define DEFAULT_LOCAL_ADDRESS "127.0.0.1"
 #define DEFAULT_ADDRESS "0.0.0.0"
 
 #define DEFAULT_PORT 5000
 #define DEFAULT_BACKLOG 10000
+#define DEFAULT_EVENT_BACKEND DYAD_BACKEND_EPOLL
+#define DEFAULT_NUM_REACTORS 0
 
 #define PEERLIST_RESYNC_DELAY 15
 
 #define MAX_CONNECTION_ENTRIES 1000
 
+#define RECV_BUFFER_SIZE 4096
+#define RECV_BUFFER_MAX_IDLE_SIZE (256 * 1024)
+
+#define DEFAULT_MAX_FRAME_SIZE (16 * 1024 * 1024)
+
+#define CONNECTION_POOL_SIZE 1024
+
+#define CONNECTION_LOW_WATERMARK (64 * 1024)
+#define CONNECTION_HIGH_WATERMARK (256 * 1024)
+
 typedef struct ConnectionEntry
 {
   const char *address;
@@ -40,9 +54,15 @@ typedef struct Connection
 {
   dyad_Stream *stream;
   dyad_Stream *remote;
+  dyad_Handle handle;
   bool authenticated;
   keypair_info_t *keypair_info;
-  bool encrypted;
+  // the wire state is switched by the reactor owning the connection and
+  // read by other threads relaying to it, encrypted is set last...
+  atomic_bool encrypted;
+  atomic_int wire_version;
+  ring_buffer_t *recv_buffer;
+  struct Connection *next;
 } connection_t;
 
 bool netbase_get_is_valid_address(const char *address);
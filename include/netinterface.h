@@ -9,8 +9,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
-#include "queue.h"
+#include "registry.h"
 #include "crypto.h"
 
 #ifdef __cplusplus
@@ -24,8 +26,12 @@ typedef struct TransportConn
   keypair_info_t *keypair_info;
 } transport_conn_t;
 
-static int netinterface_next_id = -1;
-static queue_t *netinterface_queue;
+// transports are added by whichever reactor's thread first decrypts a
+// message for their keypair, looking one up and adding it is done under the
+// mutex so there's only ever one per keypair...
+static atomic_int netinterface_next_id = -1;
+static registry_t *netinterface_registry;
+static pthread_mutex_t netinterface_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 bool netinterface_init(void);
 bool netinterface_shutdown(void);
@@ -8,10 +8,11 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include "dyad.h"
-#include "queue.h"
+#include "registry.h"
 #include "buffer.h"
 #include "netbase.h"
 
@@ -28,8 +29,20 @@ typedef struct Peer
   connection_t *connection;
 } peer_t;
 
+// the peers as of some point in time, readers iterate over one without
+// locking from within an epoch critical section. a writer copies the
+// current snapshot with its change made, publishes the copy and retires
+// the old one, along with any peer it removed...
+typedef struct PeerSnapshot
+{
+  int num_peers;
+  peer_t *peers[];
+} peer_snapshot_t;
+
 static int p2p_next_peer_id = -1;
-static queue_t *p2p_peer_queue;
+static registry_t *p2p_peer_registry;
+static _Atomic(peer_snapshot_t*) p2p_peer_snapshot = NULL;
+static pthread_mutex_t p2p_peer_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t p2p_file_mutex = PTHREAD_MUTEX_INITIALIZER;
 static const char *peer_filename = "peerlist.bin";
 static bool p2p_allow_local_ip = false;
@@ -58,11 +71,14 @@ void remove_peer_by_address(const char *address, int port);
 peer_t* get_peer_from_id(int id);
 peer_t* get_peer_from_address(const char *address, int port);
 
+peer_snapshot_t* acquire_peer_snapshot(void);
+void release_peer_snapshot(peer_snapshot_t *peer_snapshot);
+
 void free_peer(peer_t *peer);
 void free_peer_by_id(int id);
 
-bool serialize_peerlist_to_buffer(buffer_t *buffer);
-bool deserialize_peerlist_from_buffer(buffer_t *buffer);
+bool serialize_peerlist_to_buffer(buffer_t *buffer, int wire_version);
+bool deserialize_peerlist_from_buffer(buffer_t *buffer, int wire_version);
 
 #ifdef __cplusplus
 }
@@ -21,25 +21,35 @@ extern "C"
 {
 #endif
 
-bool write_connect_req(connection_t *connection, va_list args);
-bool write_connect_resp(connection_t *connection, va_list args);
-bool write_keypair_req(connection_t *connection, va_list args);
-bool write_keypair_resp(connection_t *connection, va_list args);
-bool write_peerlist_req(connection_t *connection, va_list args);
-bool write_peerlist_resp(connection_t *connection, va_list args);
-bool write_relaymsg(connection_t *connection, va_list args);
-
-bool on_connect_req(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_connect_resp(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_keypair_req(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_keypair_resp(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_peerlist_req(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_peerlist_resp(connection_t *connection, buffer_t *buffer, va_list args);
-bool on_relaymsg(connection_t *connection, buffer_t *buffer, va_list args);
+#define PKT_HANDLER_DECLARE(type, name, authenticated) \
+  bool write_##name(connection_t *connection, va_list args); \
+  bool on_##name(connection_t *connection, buffer_t *buffer, va_list args);
+
+PKT_TYPES(PKT_HANDLER_DECLARE)
+
+#undef PKT_HANDLER_DECLARE
+
+typedef struct PacketHandler
+{
+  const char *name;
+  bool authenticated;
+  bool (*write_packet)(connection_t *connection, va_list args);
+  bool (*on_packet)(connection_t *connection, buffer_t *buffer, va_list args);
+} pkt_handler_t;
+
+#define PKT_HANDLER_DEFINE(type, name, authenticated) \
+  [PKT_TYPE_##type] = {#name, authenticated, write_##name, on_##name},
+
+static const pkt_handler_t pkt_handlers[PKT_TYPE_COUNT] = {
+  PKT_TYPES(PKT_HANDLER_DEFINE)
+};
+
+#undef PKT_HANDLER_DEFINE
 
 keypair_info_t* get_keypair_from_sig(int signature_size, const char* signature);
 
 bool handle_write_packet(connection_t *connection, buffer_t *other_buffer);
+bool handle_write_packet_data(connection_t *connection, const unsigned char *packet, int packet_size);
 bool handle_packet_recv_authenticated(connection_t *connection, pkt_type_t pkt_type, buffer_t *buffer, va_list args);
 bool handle_packet_recv_unauthenticated(connection_t *connection, pkt_type_t pkt_type, buffer_t *buffer, va_list args);
 bool handle_packet_send(connection_t *connection, pkt_type_t pkt_type, va_list args);
@@ -12,23 +12,36 @@ extern "C"
 {
 #endif
 
+#define MAX_VERSION_LENGTH 64
+
 typedef enum PacketDirection
 {
   PKT_DIRECTION_RECV = 0,
   PKT_DIRECTION_SEND
 } pkt_direction_t;
 
+// every packet type in the order of its value on the wire, along with its
+// name and whether it's only accepted once the peer has been authenticated.
+// the enum, the packet names and the dispatch table are all built from it...
+#define PKT_TYPES(X) \
+  X(CONNECT_REQ, connect_req, false) \
+  X(CONNECT_RESP, connect_resp, false) \
+  X(KEYPAIR_REQ, keypair_req, true) \
+  X(KEYPAIR_RESP, keypair_resp, true) \
+  X(PEERLIST_REQ, peerlist_req, true) \
+  X(PEERLIST_RESP, peerlist_resp, true) \
+  X(RELAYMSG, relaymsg, true)
+
+#define PKT_TYPE_DECLARE(type, name, authenticated) PKT_TYPE_##type,
+
 typedef enum PacketType
 {
-  PKT_TYPE_CONNECT_REQ = 0,
-  PKT_TYPE_CONNECT_RESP,
-  PKT_TYPE_KEYPAIR_REQ,
-  PKT_TYPE_KEYPAIR_RESP,
-  PKT_TYPE_PEERLIST_REQ,
-  PKT_TYPE_PEERLIST_RESP,
-  PKT_TYPE_RELAYMSG
+  PKT_TYPES(PKT_TYPE_DECLARE)
+  PKT_TYPE_COUNT
 } pkt_type_t;
 
+#undef PKT_TYPE_DECLARE
+
 #ifdef __cplusplus
 }
 #endif
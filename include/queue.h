@@ -16,13 +16,19 @@ extern "C"
 {
 #endif
 
-#define MAX_QUEUE_SIZE 100000
+#define QUEUE_MIN_CAPACITY 16
 
+// a growable ring of object pointers, pushing and popping at either end
+// takes constant time and the ring grows and shrinks with its contents.
+// the objects are kept without gaps, so the max index is always one less
+// than the number of objects...
 typedef struct Queue
 {
   int num_objects;
   int max_index;
-  void *queue_objects[MAX_QUEUE_SIZE];
+  int head;
+  int capacity;
+  void **queue_objects;
   pthread_mutex_t mutex;
 } queue_t;
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define REGISTRY_MIN_CAPACITY 16
+
+// a slot of the hash table, which points at the object's place in the
+// dense arrays, or is empty when the index is -1...
+typedef struct RegistrySlot
+{
+  int id;
+  int index;
+} registry_slot_t;
+
+// maps ids to objects through an open addressing hash table, whose slots
+// point into the dense arrays of ids and objects. the dense arrays are
+// kept packed so that the objects can be walked by index, removing an
+// object moves the last one into its place. the table's capacity is
+// always a power of two, at least twice the number of objects...
+typedef struct Registry
+{
+  int num_objects;
+  int capacity;
+  registry_slot_t *slots;
+  int *ids;
+  void **objects;
+  pthread_mutex_t mutex;
+} registry_t;
+
+registry_t* registry_init(void);
+void registry_free(registry_t *registry);
+
+int registry_get_size(registry_t *registry);
+bool registry_has(registry_t *registry, int id);
+
+bool registry_add(registry_t *registry, int id, void *object);
+void* registry_get(registry_t *registry, int id);
+void* registry_get_at(registry_t *registry, int index);
+void* registry_remove(registry_t *registry, int id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define RING_BUFFER_MAX_HEADER_SIZE 16
+#define RING_BUFFER_INVALID_FRAME_SIZE SIZE_MAX
+
+typedef struct RingBuffer
+{
+  unsigned char *data;
+  size_t capacity;
+  size_t head;
+  size_t size;
+} ring_buffer_t;
+
+// returns the size of the whole frame described by the header bytes, zero
+// if more bytes are needed to tell, or RING_BUFFER_INVALID_FRAME_SIZE for a
+// frame which is refused, in which case reading stops the same way as when
+// the frame handler returns false...
+typedef size_t (*ring_buffer_frame_size_func_t)(const unsigned char *header, size_t size, void *arg);
+
+// handles a complete frame, returns false to stop reading frames in which
+// case the ring buffer must not be touched again, as the frame handler
+// may have freed it...
+typedef bool (*ring_buffer_frame_func_t)(const unsigned char *frame, size_t size, void *arg);
+
+ring_buffer_t* ring_buffer_init(size_t capacity);
+void ring_buffer_free(ring_buffer_t *ring_buffer);
+void ring_buffer_clear(ring_buffer_t *ring_buffer);
+
+size_t ring_buffer_get_size(ring_buffer_t *ring_buffer);
+size_t ring_buffer_get_capacity(ring_buffer_t *ring_buffer);
+bool ring_buffer_get_empty(ring_buffer_t *ring_buffer);
+
+void ring_buffer_reserve(ring_buffer_t *ring_buffer, size_t size);
+void ring_buffer_write(ring_buffer_t *ring_buffer, const unsigned char *data, size_t size);
+size_t ring_buffer_peek(ring_buffer_t *ring_buffer, unsigned char *data, size_t size);
+const unsigned char* ring_buffer_get_data(ring_buffer_t *ring_buffer, size_t size);
+void ring_buffer_consume(ring_buffer_t *ring_buffer, size_t size);
+
+bool ring_buffer_read_frames(ring_buffer_t *ring_buffer, const unsigned char *data, size_t size,
+  ring_buffer_frame_size_func_t frame_size_func, ring_buffer_frame_func_t frame_func, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
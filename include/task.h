@@ -7,17 +7,40 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
-#include <stdarg.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
-#include "queue.h"
+#include "timerwheel.h"
+#include "lfqueue.h"
+#include "registry.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+#define TASKMGR_MAX_WAIT 1.0
+#define TASKMGR_TIMER_RESOLUTION 0.001
+#define TASKMGR_NSEC_PER_SEC 1000000000ULL
+
+#define TASKMGR_DEFAULT_NUM_SCHEDULERS 0
+#define TASKMGR_MAX_SCHEDULERS 64
+#define TASKMGR_MAX_RUN 64
+#define TASKMGR_MAX_BATCH 32
+#define TASKMGR_DEQUE_SIZE 64
+#define TASKMGR_INBOX_SIZE 1024
+#define TASKMGR_TASK_POOL_SIZE 4096
+#define TASKMGR_DEADLINE_SLACK 0.001
+
+#define TASKMGR_HIGH_PRIORITY_WEIGHT 16
+#define TASKMGR_NORMAL_PRIORITY_WEIGHT 4
+#define TASKMGR_LOW_PRIORITY_WEIGHT 1
+
+#define TASK_PAYLOAD_SIZE 64
+
 typedef enum TaskResult
 {
   TASK_RESULT_DONE = 0,
@@ -25,49 +48,222 @@ typedef enum TaskResult
   TASK_RESULT_WAIT
 } task_result_t;
 
-typedef task_result_t (*callable_func_t)();
+typedef enum TaskState
+{
+  TASK_STATE_WAITING = 0,
+  TASK_STATE_QUEUED,
+  TASK_STATE_RUNNING,
+  TASK_STATE_REMOVED
+} task_state_t;
+
+// how a periodic task which returns TASK_RESULT_WAIT is scheduled again,
+// a fixed rate task keeps to the times it was first scheduled at, skipping
+// those it has missed, while a fixed delay task waits for its period after
+// each run...
+typedef enum TaskPeriod
+{
+  TASK_PERIOD_NONE = 0,
+  TASK_PERIOD_FIXED_RATE,
+  TASK_PERIOD_FIXED_DELAY
+} task_period_t;
+
+// the class a task is scheduled in, with strict priorities a class only
+// runs while the classes above it have nothing ready, while weighted ones
+// give each class a share of the runs by its weight...
+typedef enum TaskPriority
+{
+  TASK_PRIORITY_HIGH = 0,
+  TASK_PRIORITY_NORMAL,
+  TASK_PRIORITY_LOW,
+  TASK_PRIORITY_COUNT
+} task_priority_t;
+
+typedef enum TaskPriorityPolicy
+{
+  TASK_PRIORITY_POLICY_STRICT = 0,
+  TASK_PRIORITY_POLICY_WEIGHTED
+} task_priority_policy_t;
+
+typedef struct Task task_t;
 
-typedef struct Task
+typedef task_result_t (*callable_func_t)(task_t *task);
+
+// called with the task's payload when the task is freed, to release
+// anything the payload holds on to...
+typedef void (*task_payload_free_func_t)(void *payload);
+
+// blocks the task manager until the timeout expires, or until it's woken up
+// by the wake function, used to wait on other events such as network
+// activity at the same time...
+typedef void (*taskmgr_wait_func_t)(double timeout);
+typedef void (*taskmgr_wake_func_t)(void);
+
+// a task waits on the timer wheel until it's due, it's then queued on the
+// ready list, from which the schedulers take the tasks they run. a task
+// which is removed while it's queued or running is freed by the scheduler
+// which comes across it next. the times are in nanoseconds of the task
+// manager's clock, the lag being how late the task's last run started.
+// the payload is copied into the task when it's added, inline unless it's
+// larger than TASK_PAYLOAD_SIZE. a task with a deadline should start
+// within it of becoming due, such tasks are run in deadline order once
+// their deadline comes close, or earlier when there's nothing else to run...
+struct Task
 {
   int id;
   callable_func_t func;
-  va_list *args;
-  bool delayable;
+  union
+  {
+    unsigned char data[TASK_PAYLOAD_SIZE];
+    max_align_t align;
+  } payload;
+  void *payload_data;
+  size_t payload_size;
+  task_payload_free_func_t payload_free_func;
   double delay;
-  time_t timestamp;
+  uint64_t due;
+  uint64_t period;
+  task_period_t period_mode;
+  task_priority_t priority;
+  uint64_t deadline;
+  uint64_t due_by;
+  atomic_int num_missed_deadlines;
+  atomic_uint_fast64_t lag;
+  atomic_uint_fast64_t max_lag;
+  atomic_int state;
+  timer_wheel_timer_t timer;
+  struct Task *ready_next;
   pthread_mutex_t mutex;
-} task_t;
+};
+
+// every scheduler has a deque of tasks of its own for each priority, it
+// pushes and pops at the back of them while the other schedulers steal
+// from the front...
+typedef struct TaskDeque
+{
+  task_t **tasks;
+  size_t capacity;
+  size_t head;
+  size_t size;
+} task_deque_t;
 
 typedef struct TaskScheduler
 {
   int id;
   pthread_t thread;
   pthread_attr_t thread_attr;
+  bool has_thread;
+  atomic_bool terminated;
+  task_deque_t deques[TASK_PRIORITY_COUNT];
+  pthread_mutex_t deque_mutex;
+  int credits[TASK_PRIORITY_COUNT];
+  unsigned int seed;
 } task_scheduler_t;
 
 static int taskmgr_next_task_id = -1;
 static int taskmgr_next_scheduler_id = -1;
 
-static queue_t *taskmgr_task_queue;
-static queue_t *taskmgr_scheduler_queue;
+static registry_t *taskmgr_task_registry = NULL;
+static task_t *taskmgr_ready_head[TASK_PRIORITY_COUNT];
+static task_t *taskmgr_ready_tail[TASK_PRIORITY_COUNT];
+static atomic_int taskmgr_num_ready_by_priority[TASK_PRIORITY_COUNT];
+static atomic_int taskmgr_num_ready = 0;
+
+// the tasks added by threads which aren't schedulers, without a delay or a
+// deadline, are handed over here without locking the task manager, the
+// scheduler which holds the draining flag moves them to its deques...
+static mpsc_queue_t *taskmgr_inbox = NULL;
+static atomic_flag taskmgr_inbox_draining = ATOMIC_FLAG_INIT;
+
+// the ready tasks which have a deadline, in deadline order...
+static task_t *taskmgr_deadline_head = NULL;
+static atomic_int taskmgr_num_deadline_ready = 0;
+static atomic_uint_fast64_t taskmgr_next_due_by = UINT64_MAX;
+
+static task_priority_policy_t taskmgr_priority_policy = TASK_PRIORITY_POLICY_WEIGHTED;
+static int taskmgr_priority_weights[TASK_PRIORITY_COUNT] = {
+  TASKMGR_HIGH_PRIORITY_WEIGHT,
+  TASKMGR_NORMAL_PRIORITY_WEIGHT,
+  TASKMGR_LOW_PRIORITY_WEIGHT
+};
+
+static timer_wheel_t *taskmgr_timer_wheel = NULL;
+static pthread_mutex_t taskmgr_mutex;
+
+// freed tasks are kept for reuse, so that adding a task doesn't have to
+// allocate one...
+static task_t *taskmgr_task_pool = NULL;
+static int taskmgr_task_pool_size = 0;
+static pthread_mutex_t taskmgr_task_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// the scheduler which runs on the thread that calls taskmgr_run, and the
+// ones added on threads of their own...
+static int taskmgr_num_schedulers = TASKMGR_DEFAULT_NUM_SCHEDULERS;
+static task_scheduler_t *taskmgr_main_scheduler = NULL;
+static task_scheduler_t *taskmgr_schedulers[TASKMGR_MAX_SCHEDULERS];
+static registry_t *taskmgr_scheduler_registry = NULL;
+static atomic_int taskmgr_num_running_schedulers = 0;
+static pthread_mutex_t taskmgr_scheduler_mutex;
+static _Thread_local task_scheduler_t *taskmgr_current_scheduler = NULL;
+
+static atomic_bool taskmgr_terminated = false;
 
-static bool taskmgr_terminated = false;
+static taskmgr_wait_func_t taskmgr_wait_func = NULL;
+static taskmgr_wake_func_t taskmgr_wake_func = NULL;
+
+static bool taskmgr_wake_pending = false;
+static int taskmgr_num_idle = 0;
+static atomic_bool taskmgr_main_idle = false;
+static pthread_mutex_t taskmgr_wait_mutex;
+static pthread_cond_t taskmgr_wait_cond;
+
+uint64_t taskmgr_get_time_ns(void);
+double taskmgr_get_time(void);
+
+void taskmgr_set_num_schedulers(int num_schedulers);
+int taskmgr_get_num_schedulers(void);
+
+void taskmgr_set_priority_policy(task_priority_policy_t priority_policy);
+task_priority_policy_t taskmgr_get_priority_policy(void);
+void taskmgr_set_priority_weight(task_priority_t priority, int weight);
+int taskmgr_get_priority_weight(task_priority_t priority);
 
 bool taskmgr_init(void);
 void taskmgr_run(void);
-void* taskmgr_scheduler_run();
+double taskmgr_run_pending(void);
+void* taskmgr_scheduler_run(void *arg);
 bool taskmgr_shutdown(void);
 
+void taskmgr_set_wait_func(taskmgr_wait_func_t wait_func, taskmgr_wake_func_t wake_func);
+void taskmgr_wait(double timeout);
+void taskmgr_wake(void);
+
 bool has_task(task_t *task);
 bool has_task_by_id(int id);
 
-task_t* add_task(callable_func_t func, double delay, ...);
+task_t* add_task(callable_func_t func, double delay);
+task_t* add_task_with_payload(callable_func_t func, double delay, const void *payload, size_t size,
+  task_payload_free_func_t free_func);
+task_t* add_periodic_task(callable_func_t func, double period, task_period_t period_mode);
+task_t* add_periodic_task_with_payload(callable_func_t func, double period, task_period_t period_mode,
+  const void *payload, size_t size, task_payload_free_func_t free_func);
+task_t* add_task_ex(callable_func_t func, double delay, task_priority_t priority, double deadline,
+  const void *payload, size_t size, task_payload_free_func_t free_func);
+task_t* add_periodic_task_ex(callable_func_t func, double period, task_period_t period_mode,
+  task_priority_t priority, double deadline, const void *payload, size_t size,
+  task_payload_free_func_t free_func);
 
 task_t* get_task_by_id(int id);
 
 void remove_task(task_t *task);
 void remove_task_by_id(int id);
 
+void* task_get_payload(task_t *task);
+size_t task_get_payload_size(task_t *task);
+
+double task_get_lag(task_t *task);
+double task_get_max_lag(task_t *task);
+int task_get_missed_deadlines(task_t *task);
+
 void free_task(task_t *task);
 void free_task_by_id(int id);
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_NUM_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_NUM_SLOTS - 1)
+#define TIMER_WHEEL_NUM_LEVELS 4
+#define TIMER_WHEEL_EXPIRED_SLOT (TIMER_WHEEL_NUM_LEVELS * TIMER_WHEEL_NUM_SLOTS)
+
+typedef struct TimerWheelTimer timer_wheel_timer_t;
+
+// called once the timer's deadline has passed, the timer is no longer
+// armed by then so it may be added again or freed...
+typedef void (*timer_wheel_func_t)(timer_wheel_timer_t *timer, void *arg);
+
+typedef struct TimerWheelTimer
+{
+  timer_wheel_timer_t *next;
+  timer_wheel_timer_t *prev;
+  uint64_t expires;
+  int slot;
+  timer_wheel_func_t func;
+  void *arg;
+} timer_wheel_timer_t;
+
+// every level has a slot per tick of the level below it, a timer is kept in
+// the lowest level which reaches its deadline and moves down a level each
+// time its slot comes around, until it expires from the lowest one, timers
+// added with a deadline that has already passed wait in a slot of their own
+// for the next advance...
+typedef struct TimerWheel
+{
+  double resolution;
+  uint64_t current;
+  size_t num_timers;
+  uint64_t occupied[TIMER_WHEEL_NUM_LEVELS];
+  timer_wheel_timer_t slots[TIMER_WHEEL_EXPIRED_SLOT + 1];
+} timer_wheel_t;
+
+timer_wheel_t* timer_wheel_init(double resolution, double now);
+void timer_wheel_free(timer_wheel_t *timer_wheel);
+
+size_t timer_wheel_get_size(timer_wheel_t *timer_wheel);
+bool timer_wheel_get_empty(timer_wheel_t *timer_wheel);
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_func_t func, void *arg);
+bool timer_wheel_timer_get_armed(timer_wheel_timer_t *timer);
+
+void timer_wheel_add(timer_wheel_t *timer_wheel, timer_wheel_timer_t *timer, double deadline);
+void timer_wheel_remove(timer_wheel_t *timer_wheel, timer_wheel_timer_t *timer);
+
+size_t timer_wheel_advance(timer_wheel_t *timer_wheel, double now);
+double timer_wheel_get_next_deadline(timer_wheel_t *timer_wheel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// the first wire format writes integers in the host's byte order, strings
+// with a pointer's worth of padding after them, and peers as an address
+// string with a 32 bit port. the second writes sizes, counts and times as
+// LEB128 varints, fixed size fields in little endian, keys and signatures
+// without a length, and peers as four address bytes with a 16 bit port.
+// the third is the second with 32 bit frame sizes, so that frames and the
+// messages relayed in them aren't held to 64 KiB.
+//
+// packets start with their type in a byte, which is the same in both and
+// is written and read by the protocol, the functions below only deal with
+// what comes after it.
+//
+// the connect request and response are always in the first format. a node
+// which knows of a later one puts the latest it can speak after the padding
+// of its release name, which older nodes skip over, and the response ends
+// with the one both sides go on to use when it isn't the first...
+#define WIRE_VERSION_1 1
+#define WIRE_VERSION_2 2
+#define WIRE_VERSION_3 3
+#define WIRE_VERSION_LATEST WIRE_VERSION_3
+
+// sizes of the crypto fields, which the second format leaves out...
+#define WIRE_KEY_SIZE 32
+#define WIRE_NONCE_SIZE 24
+#define WIRE_SIGN_SIZE 64
+#define WIRE_MAC_SIZE 16
+
+#define WIRE_MAX_STRING_LENGTH 64
+
+// every frame is a fixed header followed by its body. in the first format
+// the header is the body size and, once encrypted, the decrypted size. in
+// the second it's only the little endian body size, the decrypted size
+// follows from it, and the third widens that to 32 bits...
+#define WIRE_V1_FRAME_HEADER_SIZE (sizeof(uint16_t))
+#define WIRE_V1_ENCRYPTED_FRAME_HEADER_SIZE (sizeof(uint16_t) * 2)
+#define WIRE_V2_FRAME_HEADER_SIZE (sizeof(uint16_t))
+#define WIRE_V3_FRAME_HEADER_SIZE (sizeof(uint32_t))
+
+// the largest frame body of the third format, sizes are held in an int...
+#define WIRE_V3_MAX_BODY_SIZE INT32_MAX
+
+// the kinds of field a packet is made up of, and the type each is held in
+// once decoded. the handshake kinds only have the one layout...
+typedef buffer_slice_t wire_string_t;
+typedef uint32_t wire_uint32_t;
+typedef int wire_version_t;
+typedef buffer_slice_t wire_key_t;
+typedef buffer_slice_t wire_nonce_t;
+typedef int wire_count_t;
+typedef char wire_address_t[WIRE_MAX_STRING_LENGTH];
+typedef uint32_t wire_port_t;
+typedef int64_t wire_timestamp_t;
+
+// the release name, with the wire version a node offers tucked in after
+// its padding...
+typedef struct WireRelease
+{
+  buffer_slice_t name;
+  int wire_version;
+} wire_release_t;
+
+// a message signed and encrypted by the sender, both of which are the
+// size of the data plus the overhead of the signature or the mac...
+typedef struct WireSealed
+{
+  int data_size;
+  buffer_slice_t signed_message;
+  buffer_slice_t ciphertext;
+} wire_sealed_t;
+
+// the fields of every record after the packet type, in the order they're
+// on the wire. the peerlist response is followed by num_peers peers...
+#define WIRE_CONNECT_REQ_FIELDS(X) \
+  X(string, version) \
+  X(release, release) \
+  X(uint32, port)
+
+#define WIRE_CONNECT_RESP_FIELDS(X) \
+  X(uint32, port) \
+  X(version, wire_version)
+
+#define WIRE_KEYPAIR_REQ_FIELDS(X) \
+  X(key, public_key) \
+  X(key, private_key) \
+  X(nonce, nonce)
+
+#define WIRE_KEYPAIR_RESP_FIELDS(X) \
+  X(key, public_key) \
+  X(key, private_key)
+
+#define WIRE_PEERLIST_RESP_FIELDS(X) \
+  X(count, num_peers)
+
+#define WIRE_PEER_FIELDS(X) \
+  X(address, address) \
+  X(port, port)
+
+#define WIRE_RELAYMSG_FIELDS(X) \
+  X(sealed, message) \
+  X(timestamp, timestamp)
+
+#define WIRE_RECORDS(X) \
+  X(connect_req, CONNECT_REQ, WireConnectReq) \
+  X(connect_resp, CONNECT_RESP, WireConnectResp) \
+  X(keypair_req, KEYPAIR_REQ, WireKeypairReq) \
+  X(keypair_resp, KEYPAIR_RESP, WireKeypairResp) \
+  X(peerlist_resp, PEERLIST_RESP, WirePeerlistResp) \
+  X(peer, PEER, WirePeer) \
+  X(relaymsg, RELAYMSG, WireRelayMsg)
+
+// each record gets a struct with its fields, the exact size it encodes to,
+// the least it can decode from, and its encoder and decoder. a decoder
+// which fails leaves the offset where it was...
+#define WIRE_FIELD_DECLARE(kind, name) wire_##kind##_t name;
+#define WIRE_RECORD_DECLARE(name, NAME, Name) \
+  typedef struct Name \
+  { \
+    WIRE_##NAME##_FIELDS(WIRE_FIELD_DECLARE) \
+  } wire_##name##_t; \
+  int wire_get_##name##_size(int wire_version, const wire_##name##_t *name); \
+  int wire_get_##name##_min_size(int wire_version); \
+  void wire_write_##name(buffer_t *buffer, int wire_version, const wire_##name##_t *name); \
+  bool wire_read_##name(buffer_t *buffer, int wire_version, wire_##name##_t *name);
+
+WIRE_RECORDS(WIRE_RECORD_DECLARE)
+
+#undef WIRE_RECORD_DECLARE
+#undef WIRE_FIELD_DECLARE
+
+int wire_get_frame_header_size(int wire_version, bool encrypted);
+int wire_get_max_body_size(int wire_version);
+size_t wire_get_frame_size(int wire_version, bool encrypted, const unsigned char *header, size_t size);
+void wire_write_frame_header(buffer_t *buffer, int wire_version, bool encrypted, int body_size, int payload_size);
+bool wire_read_frame_header(buffer_t *buffer, int wire_version, bool encrypted, int *body_size, int *payload_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,23 +11,29 @@
 #include <string.h>
 
 #include "log.h"
+#include "bufferpool.h"
 
 #include "buffer.h"
 
 buffer_t* buffer_init_data(int offset, const unsigned char *data, int size)
 {
-  buffer_t *buffer = malloc(sizeof(buffer_t));
-  buffer->data = NULL;
+  buffer_t *buffer = buffer_pool_alloc(sizeof(buffer_t));
+  buffer->data = buffer->inline_data;
+  buffer->size = 0;
+  buffer->offset = offset;
+  buffer->capacity = BUFFER_INLINE_SIZE;
 
   // only copy the data over if the array actually
   // contains any data...
   if (size > 0)
   {
-    buffer->data = malloc(size);
-    memcpy(buffer->data, data, size);
+    buffer_reserve(buffer, size);
+    if (data != NULL)
+    {
+      memcpy(buffer->data, data, size);
+    }
   }
   buffer->size = size;
-  buffer->offset = offset;
   return buffer;
 }
 
@@ -49,7 +55,7 @@ buffer_t* buffer_init(void)
 
 void buffer_copy(buffer_t *buffer, buffer_t *other_buffer)
 {
-  buffer_realloc(buffer, other_buffer->size);
+  buffer_reserve(buffer, other_buffer->size);
   memcpy(buffer->data, other_buffer->data, other_buffer->size);
   buffer->size = other_buffer->size;
   buffer->offset = other_buffer->offset;
@@ -57,27 +63,71 @@ void buffer_copy(buffer_t *buffer, buffer_t *other_buffer)
 
 void buffer_free(buffer_t *buffer)
 {
-  if (buffer->data != NULL)
+  if (buffer->data != buffer->inline_data && buffer->capacity > 0)
   {
-    free(buffer->data);
-    buffer->data = NULL;
+    buffer_pool_free(buffer->data, buffer->capacity);
   }
+  buffer->data = NULL;
   buffer->size = 0;
   buffer->offset = 0;
-  free(buffer);
+  buffer->capacity = 0;
+  buffer_pool_free(buffer, sizeof(buffer_t));
 }
 
-void buffer_realloc(buffer_t *buffer, int size)
+void buffer_reserve(buffer_t *buffer, int capacity)
 {
-  // resize the array if there isn't enough memory
-  // pre-allocated...
-  if (buffer_get_remaining_size(buffer) < size)
+  if (capacity <= buffer->capacity)
+  {
+    return;
+  }
+
+  // grow at least twofold, up to the size of the pooled block, so a
+  // packet written a field at a time only moves its data a handful of
+  // times...
+  int new_capacity = buffer->capacity * 2;
+  if (new_capacity < capacity)
+  {
+    new_capacity = capacity;
+  }
+  new_capacity = buffer_pool_get_block_size(new_capacity);
+
+  unsigned char *data = buffer_pool_alloc(new_capacity);
+  if (buffer->size > 0)
   {
-    unsigned char *data = malloc(buffer->size + size);
     memcpy(data, buffer->data, buffer->size);
-    buffer->data = data;
-    buffer->size += size;
   }
+
+  // the inline storage and memory the buffer doesn't own are left as
+  // they are...
+  if (buffer->data != buffer->inline_data && buffer->capacity > 0)
+  {
+    buffer_pool_free(buffer->data, buffer->capacity);
+  }
+  buffer->data = data;
+  buffer->capacity = new_capacity;
+  atomic_fetch_add_explicit(&buffer_num_allocations, 1, memory_order_relaxed);
+}
+
+void buffer_realloc(buffer_t *buffer, int size)
+{
+  // make room for size bytes at the offset, the data written
+  // extends up to the end of them...
+  int end = buffer->offset + size;
+  buffer_reserve(buffer, end);
+  if (buffer->size < end)
+  {
+    buffer->size = end;
+  }
+}
+
+int buffer_get_capacity(buffer_t *buffer)
+{
+  return buffer->capacity;
+}
+
+long buffer_get_num_allocations(void)
+{
+  return atomic_load_explicit(&buffer_num_allocations, memory_order_relaxed);
 }
 
 void buffer_write(buffer_t *buffer, const unsigned char *data, int size)
@@ -87,6 +137,16 @@ void buffer_write(buffer_t *buffer, const unsigned char *data, int size)
   buffer->offset += size;
 }
 
+unsigned char* buffer_claim(buffer_t *buffer, int size)
+{
+  // hands out size bytes at the offset for the caller to write into, for
+  // data which is produced in place rather than copied in...
+  buffer_realloc(buffer, size);
+  unsigned char *data = buffer->data + buffer->offset;
+  buffer->offset += size;
+  return data;
+}
+
 char* buffer_read(buffer_t *buffer, int size)
 {
   unsigned char *data = malloc(size);
@@ -105,6 +165,16 @@ int buffer_get_remaining_size(buffer_t *buffer)
   return buffer_get_size(buffer) - buffer->offset;
 }
 
+int buffer_get_offset(buffer_t *buffer)
+{
+  return buffer->offset;
+}
+
+void buffer_set_offset(buffer_t *buffer, int offset)
+{
+  buffer->offset = offset;
+}
+
 const unsigned char* buffer_get_data(buffer_t *buffer)
 {
   return buffer->data;
@@ -237,12 +307,180 @@ int64_t buffer_read_int64(buffer_t *buffer)
 
 void buffer_write_string(buffer_t *buffer, const char *string, int size)
 {
-  int actual_size = sizeof(unsigned char*) + size;
-  buffer_write_uint16(buffer, actual_size);
-  buffer_write(buffer, (const unsigned char*)string, actual_size);
+  // the length takes a pointer's worth of bytes more than the string, and
+  // readers of the first wire format expect them. they're zeroed rather
+  // than read from past the end of the string...
+  int padding_size = sizeof(unsigned char*);
+  buffer_write_uint16(buffer, size + padding_size);
+  buffer_write(buffer, (const unsigned char*)string, size);
+  memset(buffer_claim(buffer, padding_size), 0, padding_size);
 }
 
 char* buffer_read_string(buffer_t *buffer)
 {
   return (char*)buffer_read(buffer, buffer_read_uint16(buffer));
 }
+
+void buffer_write_uint16_le(buffer_t *buffer, uint16_t value)
+{
+  unsigned char *data = buffer_claim(buffer, sizeof(uint16_t));
+  data[0] = (unsigned char)value;
+  data[1] = (unsigned char)(value >> 8);
+}
+
+bool buffer_read_uint16_le(buffer_t *buffer, uint16_t *value)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_slice(buffer, sizeof(uint16_t), &slice))
+  {
+    return false;
+  }
+  *value = (uint16_t)(slice.data[0] | (slice.data[1] << 8));
+  return true;
+}
+
+void buffer_write_uint32_le(buffer_t *buffer, uint32_t value)
+{
+  unsigned char *data = buffer_claim(buffer, sizeof(uint32_t));
+  for (int i = 0; i < sizeof(uint32_t); i++)
+  {
+    data[i] = (unsigned char)(value >> (i * 8));
+  }
+}
+
+bool buffer_read_uint32_le(buffer_t *buffer, uint32_t *value)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_slice(buffer, sizeof(uint32_t), &slice))
+  {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0; i < sizeof(uint32_t); i++)
+  {
+    *value |= (uint32_t)slice.data[i] << (i * 8);
+  }
+  return true;
+}
+
+void buffer_write_uint64_le(buffer_t *buffer, uint64_t value)
+{
+  unsigned char *data = buffer_claim(buffer, sizeof(uint64_t));
+  for (int i = 0; i < sizeof(uint64_t); i++)
+  {
+    data[i] = (unsigned char)(value >> (i * 8));
+  }
+}
+
+bool buffer_read_uint64_le(buffer_t *buffer, uint64_t *value)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_slice(buffer, sizeof(uint64_t), &slice))
+  {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0; i < sizeof(uint64_t); i++)
+  {
+    *value |= (uint64_t)slice.data[i] << (i * 8);
+  }
+  return true;
+}
+
+int buffer_get_varint_size(uint64_t value)
+{
+  int size = 1;
+  while (value >>= 7)
+  {
+    size++;
+  }
+  return size;
+}
+
+void buffer_write_varint(buffer_t *buffer, uint64_t value)
+{
+  // seven bits to a byte, least significant first, with the top bit set
+  // on every byte but the last...
+  unsigned char data[BUFFER_MAX_VARINT_SIZE];
+  int size = 0;
+  do
+  {
+    data[size] = value & 0x7f;
+    value >>= 7;
+    if (value)
+    {
+      data[size] |= 0x80;
+    }
+    size++;
+  } while (value);
+  buffer_write(buffer, data, size);
+}
+
+bool buffer_read_varint(buffer_t *buffer, uint64_t *value)
+{
+  // a varint which runs past the end of the buffer, or past 64 bits, is
+  // rejected without moving the offset...
+  const unsigned char *data = buffer_get_remaining_data(buffer);
+  int remaining_size = buffer_get_remaining_size(buffer);
+  uint64_t result = 0;
+  for (int i = 0; i < BUFFER_MAX_VARINT_SIZE && i < remaining_size; i++)
+  {
+    if (i == BUFFER_MAX_VARINT_SIZE - 1 && data[i] > 1)
+    {
+      return false;
+    }
+    result |= (uint64_t)(data[i] & 0x7f) << (i * 7);
+    if (!(data[i] & 0x80))
+    {
+      buffer->offset += i + 1;
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool buffer_read_slice(buffer_t *buffer, int size, buffer_slice_t *slice)
+{
+  // the offset is left alone when there isn't enough data left, so a
+  // truncated packet can't be read past the end of...
+  if (size < 0 || buffer_get_remaining_size(buffer) < size)
+  {
+    return false;
+  }
+  slice->data = buffer->data + buffer->offset;
+  slice->size = size;
+  buffer->offset += size;
+  return true;
+}
+
+bool buffer_read_string_slice(buffer_t *buffer, buffer_slice_t *slice)
+{
+  uint16_t size = 0;
+  if (buffer_get_remaining_size(buffer) < (int)sizeof(uint16_t))
+  {
+    return false;
+  }
+  memcpy(&size, buffer->data + buffer->offset, sizeof(uint16_t));
+  if (buffer_get_remaining_size(buffer) - (int)sizeof(uint16_t) < size)
+  {
+    return false;
+  }
+  buffer->offset += sizeof(uint16_t);
+  return buffer_read_slice(buffer, size, slice);
+}
+
+bool buffer_slice_copy_string(const buffer_slice_t *slice, char *string, int size)
+{
+  // strings are written with trailing bytes after them, so only what
+  // comes before the terminator is copied...
+  const unsigned char *end = memchr(slice->data, '\0', slice->size);
+  int length = end ? (int)(end - slice->data) : slice->size;
+  if (length >= size)
+  {
+    return false;
+  }
+  memcpy(string, slice->data, length);
+  string[length] = '\0';
+  return true;
+}
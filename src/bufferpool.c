@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "bufferpool.h"
+
+static int buffer_pool_get_class(int size)
+{
+  int block_size = BUFFER_POOL_MIN_BLOCK_SIZE;
+  for (int size_class = 0; size_class < BUFFER_POOL_NUM_CLASSES; size_class++)
+  {
+    if (size <= block_size)
+    {
+      return size_class;
+    }
+    block_size <<= 1;
+  }
+  return -1;
+}
+
+static void buffer_pool_push(buffer_pool_list_t *list, buffer_pool_block_t *block)
+{
+  block->next = list->head;
+  list->head = block;
+  list->size++;
+}
+
+static buffer_pool_block_t* buffer_pool_pop(buffer_pool_list_t *list)
+{
+  buffer_pool_block_t *block = list->head;
+  if (block)
+  {
+    list->head = block->next;
+    list->size--;
+  }
+  return block;
+}
+
+static void buffer_pool_move(buffer_pool_list_t *list, buffer_pool_list_t *other_list, int count)
+{
+  for (int i = 0; i < count && list->head; i++)
+  {
+    buffer_pool_push(other_list, buffer_pool_pop(list));
+  }
+}
+
+static void buffer_pool_flush(int size_class, buffer_pool_list_t *list, int count)
+{
+  // hand blocks over to the depot while it has room for them, the rest
+  // go back to the heap...
+  pthread_mutex_lock(&buffer_pool_depot_mutex);
+  buffer_pool_list_t *depot_list = &buffer_pool_depot[size_class];
+  int num_kept = BUFFER_POOL_DEPOT_SIZE - depot_list->size;
+  buffer_pool_move(list, depot_list, count < num_kept ? count : num_kept);
+  pthread_mutex_unlock(&buffer_pool_depot_mutex);
+
+  for (int i = num_kept; i < count && list->head; i++)
+  {
+    free(buffer_pool_pop(list));
+  }
+}
+
+static void buffer_pool_release_cache(void *arg)
+{
+  // called as the thread exits, leaving its blocks to the other threads...
+  buffer_pool_cache_t *cache = arg;
+  for (int size_class = 0; size_class < BUFFER_POOL_NUM_CLASSES; size_class++)
+  {
+    buffer_pool_list_t *list = &cache->lists[size_class];
+    buffer_pool_flush(size_class, list, list->size);
+  }
+  free(cache);
+}
+
+static void buffer_pool_init_cache_key(void)
+{
+  pthread_key_create(&buffer_pool_cache_key, buffer_pool_release_cache);
+}
+
+static buffer_pool_cache_t* buffer_pool_get_cache(void)
+{
+  if (buffer_pool_current_cache)
+  {
+    return buffer_pool_current_cache;
+  }
+
+  buffer_pool_cache_t *cache = calloc(1, sizeof(buffer_pool_cache_t));
+  pthread_once(&buffer_pool_cache_key_once, buffer_pool_init_cache_key);
+  pthread_setspecific(buffer_pool_cache_key, cache);
+  buffer_pool_current_cache = cache;
+  return cache;
+}
+
+int buffer_pool_get_block_size(int size)
+{
+  int size_class = buffer_pool_get_class(size);
+  if (size_class == -1)
+  {
+    return size;
+  }
+  return BUFFER_POOL_MIN_BLOCK_SIZE << size_class;
+}
+
+void* buffer_pool_alloc(int size)
+{
+  int size_class = buffer_pool_get_class(size);
+  if (size_class == -1)
+  {
+    atomic_fetch_add_explicit(&buffer_pool_num_misses, 1, memory_order_relaxed);
+    return malloc(size);
+  }
+
+  // take a batch from the depot when this thread has run out, so that
+  // the depot is only locked every so often...
+  buffer_pool_list_t *list = &buffer_pool_get_cache()->lists[size_class];
+  if (!list->head)
+  {
+    pthread_mutex_lock(&buffer_pool_depot_mutex);
+    buffer_pool_move(&buffer_pool_depot[size_class], list, BUFFER_POOL_CACHE_SIZE / 2);
+    pthread_mutex_unlock(&buffer_pool_depot_mutex);
+  }
+
+  buffer_pool_block_t *block = buffer_pool_pop(list);
+  if (block)
+  {
+    atomic_fetch_add_explicit(&buffer_pool_num_hits, 1, memory_order_relaxed);
+    return block;
+  }
+  atomic_fetch_add_explicit(&buffer_pool_num_misses, 1, memory_order_relaxed);
+  return malloc(BUFFER_POOL_MIN_BLOCK_SIZE << size_class);
+}
+
+void buffer_pool_free(void *block, int size)
+{
+  if (block == NULL)
+  {
+    return;
+  }
+
+  int size_class = buffer_pool_get_class(size);
+  if (size_class == -1)
+  {
+    free(block);
+    return;
+  }
+
+  buffer_pool_list_t *list = &buffer_pool_get_cache()->lists[size_class];
+  buffer_pool_push(list, block);
+  if (list->size > BUFFER_POOL_CACHE_SIZE)
+  {
+    buffer_pool_flush(size_class, list, BUFFER_POOL_CACHE_SIZE / 2);
+  }
+}
+
+void buffer_pool_clear(void)
+{
+  // frees the blocks held by the depot and the calling thread, the other
+  // threads leave theirs to the depot as they exit...
+  buffer_pool_cache_t *cache = buffer_pool_current_cache;
+  pthread_mutex_lock(&buffer_pool_depot_mutex);
+  for (int size_class = 0; size_class < BUFFER_POOL_NUM_CLASSES; size_class++)
+  {
+    if (cache)
+    {
+      buffer_pool_move(&cache->lists[size_class], &buffer_pool_depot[size_class],
+        cache->lists[size_class].size);
+    }
+    while (buffer_pool_depot[size_class].head)
+    {
+      free(buffer_pool_pop(&buffer_pool_depot[size_class]));
+    }
+  }
+  pthread_mutex_unlock(&buffer_pool_depot_mutex);
+}
+
+long buffer_pool_get_num_hits(void)
+{
+  return atomic_load_explicit(&buffer_pool_num_hits, memory_order_relaxed);
+}
+
+long buffer_pool_get_num_misses(void)
+{
+  return atomic_load_explicit(&buffer_pool_num_misses, memory_order_relaxed);
+}
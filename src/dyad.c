@@ -15,6 +15,9 @@
   #include <windows.h>
 #else
   #define _POSIX_C_SOURCE 200809L
+  #ifdef __linux__
+    #define _GNU_SOURCE
+  #endif
   #ifdef __APPLE__
     #define _DARWIN_UNLIMITED_SELECT
   #endif
@@ -24,9 +27,32 @@
   #include <sys/types.h>
   #include <sys/socket.h>
   #include <sys/time.h>
+  #include <sys/uio.h>
   #include <netinet/in.h>
   #include <netinet/tcp.h>
   #include <arpa/inet.h>
+  #include <pthread.h>
+  #ifdef __linux__
+    #include <sys/eventfd.h>
+  #endif
+  #if defined(__linux__) && !defined(DYAD_NO_EPOLL)
+    #define DYAD_HAS_EPOLL
+    #include <sys/epoll.h>
+  #endif
+  #if defined(__linux__) && !defined(DYAD_NO_URING) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+      #include <linux/io_uring.h>
+      /* Provided buffer rings are required for receiving; they arrived in
+       * the same kernel release as IORING_SETUP_COOP_TASKRUN, which unlike
+       * them can be tested for with the preprocessor */
+      #ifdef IORING_SETUP_COOP_TASKRUN
+        #define DYAD_HAS_URING
+        #include <poll.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+      #endif
+    #endif
+  #endif
 #endif
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,9 +63,19 @@
 #include <limits.h>
 
 #include "dyad.h"
+#include "timerwheel.h"
 
 #define DYAD_VERSION "0.2.1"
 
+/* Granularity of the tick and stream timeouts, in seconds */
+#define DYAD_TIMER_RESOLUTION 0.001
+
+/* Number of streams allocated together in a reactor's stream table */
+#define DYAD_SLAB_SIZE 256
+#define DYAD_ACCEPT_BUDGET 64
+#define DYAD_HIGH_WATERMARK (64 * 1024)
+#define DYAD_LOW_WATERMARK  (16 * 1024)
+
 
 #ifdef _WIN32
   #define close(a) closesocket(a)
@@ -76,6 +112,12 @@
   #define INVALID_SOCKET -1
 #endif
 
+#ifdef _MSC_VER
+  #define DYAD_THREAD_LOCAL __declspec(thread)
+#else
+  #define DYAD_THREAD_LOCAL _Thread_local
+#endif
+
 
 /*===========================================================================*/
 /* Memory                                                                    */
@@ -153,6 +195,252 @@ static void vec_splice(
 
 
 
+/*===========================================================================*/
+/* Mutex                                                                     */
+/*===========================================================================*/
+
+/* Each reactor is driven by a single thread, and a stream's state is only
+ * ever touched by the thread driving the stream's reactor. The exceptions are
+ * the queue of requests made to a stream from other threads, which is
+ * guarded by its reactor's mutex, and the count of the stream's bytes waiting
+ * to be sent, which is only changed atomically. */
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION Mutex;
+#else
+typedef pthread_mutex_t Mutex;
+#endif
+
+
+static void mutex_init(Mutex *m) {
+#ifdef _WIN32
+  InitializeCriticalSection(m);
+#else
+  pthread_mutex_init(m, NULL);
+#endif
+}
+
+
+static void mutex_deinit(Mutex *m) {
+#ifdef _WIN32
+  DeleteCriticalSection(m);
+#else
+  pthread_mutex_destroy(m);
+#endif
+}
+
+
+static void mutex_lock(Mutex *m) {
+#ifdef _WIN32
+  EnterCriticalSection(m);
+#else
+  pthread_mutex_lock(m);
+#endif
+}
+
+
+static void mutex_unlock(Mutex *m) {
+#ifdef _WIN32
+  LeaveCriticalSection(m);
+#else
+  pthread_mutex_unlock(m);
+#endif
+}
+
+
+/* Both return the value from before the addition */
+#ifdef _WIN32
+  #define atomic_addInt(p, n) InterlockedExchangeAdd((volatile LONG*) (p), (n))
+  #define atomic_loadInt(p)   InterlockedCompareExchange((volatile LONG*) (p), 0, 0)
+#else
+  #define atomic_addInt(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+  #define atomic_loadInt(p)   __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+
+
+/*===========================================================================*/
+/* SegmentQueue                                                              */
+/*===========================================================================*/
+
+/* A stream's pending output is kept as a chain of segments rather than as one
+ * contiguous buffer. Written data is copied onto the end of the last segment
+ * while it has room; data passed to dyad_writeRef() instead gets a segment of
+ * its own which points at the caller's memory, and the caller's release
+ * callback is called once the segment has been sent or discarded.
+ *
+ * The segments are handed to the kernel in batches with a single sendmsg(),
+ * and sent data is consumed by advancing the offset into the first segment or
+ * dropping whole segments, so nothing is moved after a partial send. Data is
+ * only ever appended past the end of a segment, so memory which the kernel is
+ * sending from stays put while further writes are queued.
+ */
+
+#define DYAD_SEGMENT_SIZE 4096
+#define DYAD_IOV_MAX      64
+
+typedef struct Segment {
+  struct Segment *next;
+  char *data;
+  int offset, length, capacity;
+  dyad_ReleaseCallback release;
+  void *udata;
+} Segment;
+
+typedef struct {
+  Segment *head, *tail;
+  int length;
+} SegmentQueue;
+
+
+static void segments_link(SegmentQueue *q, Segment *seg) {
+  seg->next = NULL;
+  if (q->tail) {
+    q->tail->next = seg;
+  } else {
+    q->head = seg;
+  }
+  q->tail = seg;
+  q->length += seg->length - seg->offset;
+}
+
+
+static void segment_free(Segment *seg) {
+  if (seg->release) {
+    seg->release(seg->udata);
+  }
+  dyad_free(seg);
+}
+
+
+static void segments_push(SegmentQueue *q, const void *data, int size) {
+  const char *p = data;
+  while (size > 0) {
+    Segment *seg = q->tail;
+    int n;
+    /* Referenced segments never have room as their length is their capacity,
+     * so copied data always gets a segment of its own after one */
+    if (!seg || seg->length == seg->capacity) {
+      int capacity = size > DYAD_SEGMENT_SIZE ? size : DYAD_SEGMENT_SIZE;
+      seg = dyad_realloc(NULL, sizeof(*seg) + capacity);
+      memset(seg, 0, sizeof(*seg));
+      seg->data = (char*) (seg + 1);
+      seg->capacity = capacity;
+      segments_link(q, seg);
+    }
+    n = seg->capacity - seg->length;
+    if (n > size) n = size;
+    memcpy(seg->data + seg->length, p, n);
+    seg->length += n;
+    q->length += n;
+    p += n;
+    size -= n;
+  }
+}
+
+
+static void segments_pushRef(
+  SegmentQueue *q, const void *data, int size,
+  dyad_ReleaseCallback release, void *udata
+) {
+  Segment *seg = dyad_realloc(NULL, sizeof(*seg));
+  memset(seg, 0, sizeof(*seg));
+  seg->data = (char*) data;
+  seg->length = seg->capacity = size;
+  seg->release = release;
+  seg->udata = udata;
+  segments_link(q, seg);
+}
+
+
+static void segments_consume(SegmentQueue *q, int n) {
+  q->length -= n;
+  while (q->head) {
+    Segment *seg = q->head;
+    int avail = seg->length - seg->offset;
+    if (n < avail) {
+      seg->offset += n;
+      return;
+    }
+    n -= avail;
+    /* Keep an emptied copy segment of the usual size around for reuse rather
+     * than freeing it only to allocate another on the next write */
+    if (seg == q->tail && !seg->release &&
+        seg->capacity == DYAD_SEGMENT_SIZE) {
+      seg->offset = seg->length = 0;
+      return;
+    }
+    q->head = seg->next;
+    if (!q->head) q->tail = NULL;
+    segment_free(seg);
+  }
+}
+
+
+static void segments_clear(SegmentQueue *q) {
+  Segment *seg = q->head;
+  while (seg) {
+    Segment *next = seg->next;
+    segment_free(seg);
+    seg = next;
+  }
+  memset(q, 0, sizeof(*q));
+}
+
+
+/* Moves every segment of `src` onto the end of `dst` */
+static void segments_append(SegmentQueue *dst, SegmentQueue *src) {
+  if (!src->head) return;
+  if (dst->tail) {
+    dst->tail->next = src->head;
+  } else {
+    dst->head = src->head;
+  }
+  dst->tail = src->tail;
+  dst->length += src->length;
+  memset(src, 0, sizeof(*src));
+}
+
+
+#ifndef _WIN32
+static int segments_fillIov(SegmentQueue *q, struct iovec *iov, int max) {
+  Segment *seg;
+  int n = 0;
+  for (seg = q->head; seg && n < max; seg = seg->next) {
+    if (seg->offset == seg->length) continue;
+    iov[n].iov_base = seg->data + seg->offset;
+    iov[n].iov_len = seg->length - seg->offset;
+    n++;
+  }
+  return n;
+}
+#endif
+
+
+/* Sends as much of the queue as one call will take, consuming what was sent;
+ * returns the result of the send call */
+static int segments_send(SegmentQueue *q, dyad_Socket sockfd) {
+  int size;
+#ifdef _WIN32
+  Segment *seg = q->head;
+  while (seg->offset == seg->length) seg = seg->next;
+  size = send(sockfd, seg->data + seg->offset, seg->length - seg->offset, 0);
+#else
+  struct iovec iov[DYAD_IOV_MAX];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = segments_fillIov(q, iov, DYAD_IOV_MAX);
+  size = sendmsg(sockfd, &msg, 0);
+#endif
+  if (size > 0) {
+    segments_consume(q, size);
+  }
+  return size;
+}
+
+
+
 /*===========================================================================*/
 /* SelectSet                                                                 */
 /*===========================================================================*/
@@ -265,6 +553,56 @@ static int select_has(SelectSet *s, int set, dyad_Socket fd) {
 }
 
 
+/*===========================================================================*/
+/* Epoll                                                                     */
+/*===========================================================================*/
+
+/* When built on Linux the default backend is edge-triggered epoll. Unlike the
+ * SelectSet, which is rebuilt from every stream on each update, a stream's
+ * interest set is registered once and only modified when its state or its
+ * write-pending status changes. dyad_update() then only touches the streams
+ * which the kernel reports as ready, plus the streams that were written to
+ * since the last update.
+ */
+
+#define DYAD_EPOLL_MAXEVENTS 256
+
+
+/*===========================================================================*/
+/* io_uring                                                                  */
+/*===========================================================================*/
+
+/* The state of a reactor's io_uring instance; the backend itself lives with
+ * the rest of the stream handling further down */
+
+#ifdef DYAD_HAS_URING
+
+#define DYAD_URING_ENTRIES      4096
+#define DYAD_URING_CQ_ENTRIES   32768
+#define DYAD_URING_BUFFERS      1024
+#define DYAD_URING_BUFFER_SIZE  8192
+#define DYAD_URING_BUFFER_GROUP 0
+#define DYAD_URING_ACCEPTS      16
+#define DYAD_URING_IOVS         8
+
+typedef struct {
+  int fd;
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned sqEntries, sqLocalTail;
+  struct io_uring_sqe *sqes;
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_cqe *cqes;
+  void *ring;
+  size_t ringSize, sqesSize;
+  struct io_uring_buf_ring *bufRing;
+  size_t bufRingSize;
+  char *bufs;
+  unsigned short bufTail;
+} Uring;
+
+#endif
+
+
 /*===========================================================================*/
 /* Core                                                                      */
 /*===========================================================================*/
@@ -276,31 +614,121 @@ typedef struct {
 } Listener;
 
 
+typedef Vec(char) CharVec;
+
+
 struct dyad_Stream {
   int state, flags;
   dyad_Socket sockfd;
-  char *address;
+  char address[INET6_ADDRSTRLEN];
   int port;
   int bytesSent, bytesReceived;
+  int pendingBytes, lowWatermark, highWatermark;
   double lastActivity, timeout;
+  timer_wheel_timer_t timeoutTimer;
+  int events;
+  int uringOps, uringAccepts;
+  int remoteRequests, handlingRequests;
+  dyad_Reactor *reactor;
   Vec(Listener) listeners;
-  Vec(char) lineBuffer;
-  Vec(char) writeBuffer;
-  dyad_Stream *next;
+  CharVec lineBuffer;
+  SegmentQueue writeQueue;
+  SegmentQueue remoteQueue;
+#ifdef DYAD_HAS_URING
+  /* Describes the in-flight send, must stay put until it completes */
+  struct msghdr uringMsg;
+  struct iovec uringIov[DYAD_URING_IOVS];
+#endif
+  int index, slot;
+  unsigned generation;
 };
 
-#define DYAD_FLAG_READY   (1 << 0)
-#define DYAD_FLAG_WRITTEN (1 << 1)
+#define DYAD_FLAG_READY     (1 << 0)
+#define DYAD_FLAG_WRITTEN   (1 << 1)
+#define DYAD_FLAG_REARM     (1 << 2)
+#define DYAD_FLAG_REUSEPORT (1 << 3)
+#define DYAD_FLAG_WAKE      (1 << 4)
+#define DYAD_FLAG_CLOSED    (1 << 5)
+#define DYAD_FLAG_ACCEPT    (1 << 6)
+#define DYAD_FLAG_FULL      (1 << 7)
+
+/* Requests made to a stream from a thread other than its reactor's */
+#define DYAD_REMOTE_QUEUED  (1 << 0)
+#define DYAD_REMOTE_END     (1 << 1)
+#define DYAD_REMOTE_CLOSE   (1 << 2)
+#define DYAD_REMOTE_FULL    (1 << 3)
+
+typedef Vec(dyad_Stream*) StreamVec;
+
+/* Streams in a slab are kept as aligned as malloc() would have them, the
+ * io_uring backend keeps its operation in the low bits of stream pointers */
+#define DYAD_STREAM_STRIDE  ((sizeof(dyad_Stream) + 15) & ~(size_t) 15)
+
+#define slab_getStream(slab, i)\
+  ((dyad_Stream*) ((char*) (slab) + (i) * DYAD_STREAM_STRIDE))
+
+
+/* A reactor owns a table of streams and the backend which waits on them.
+ * Every thread has a current reactor: dyad_newStream() and dyad_update() act
+ * on it, and a thread which never sets one uses the default reactor. Only
+ * the thread a reactor is bound to, by setting it or by updating the default
+ * reactor, touches its streams directly; any other thread, including one
+ * which merely falls back to the default reactor, hands its writes and
+ * closes over to the reactor under its mutex. The tick
+ * and the stream timeouts are kept on a timer wheel, so an update only does
+ * work for the timers which expire.
+ *
+ * The streams are allocated from slabs of DYAD_SLAB_SIZE and reused once
+ * destroyed, each slot counting how often it has been reused so that a
+ * dyad_Handle to a destroyed stream can be told apart from one to the
+ * stream now using its slot. The live streams are also kept in a dense array
+ * which is what gets iterated, removing one moves the last into its place.
+ *
+ * An update accepts no more than the accept budget of connections across all
+ * of its listening streams; those with connections still waiting are listed
+ * and carry on accepting on the next update, which doesn't block. Those which
+ * ran out of descriptors or memory are listed apart and retried on the next
+ * update without hurrying it along. */
+struct dyad_Reactor {
+  int initialized;
+  StreamVec streams;
+  StreamVec slabs;
+  StreamVec freeStreams;
+  int streamCount;
+  StreamVec writtenStreams;
+  StreamVec flushingStreams;
+  StreamVec rearmStreams;
+  StreamVec closedStreams;
+  StreamVec acceptStreams;
+  StreamVec acceptRetryStreams;
+  int acceptBudget, acceptCount;
+  SelectSet selectSet;
+  double updateTimeout;
+  double tickInterval;
+  double lastTick;
+  timer_wheel_t *timers;
+  timer_wheel_timer_t tickTimer;
+  int backend;
+#ifdef DYAD_HAS_EPOLL
+  int epollFd;
+#endif
+#ifdef DYAD_HAS_URING
+  Uring uring;
+#endif
+  /* Guards the remote fields below and each stream's remote fields */
+  Mutex mutex;
+  StreamVec remoteStreams;
+  StreamVec handlingStreams;
+  int wakePending;
+  dyad_Stream *wakeStream;
+  dyad_Socket wakeSockfd;
+};
 
 
-static dyad_Stream *dyad_streams;
-static int dyad_streamCount;
+static dyad_Reactor dyad_defaultReactor;
+static DYAD_THREAD_LOCAL dyad_Reactor *dyad_currentReactor;
 static char dyad_panicMsgBuffer[128];
 static dyad_PanicCallback panicCallback;
-static SelectSet dyad_selectSet;
-static double dyad_updateTimeout = 1;
-static double dyad_tickInterval = 1;
-static double dyad_lastTick = 0;
 
 
 static void panic(const char *fmt, ...) {
@@ -325,59 +753,150 @@ static dyad_Event createEvent(int type) {
 }
 
 
+static void reactor_onTick(timer_wheel_timer_t *timer, void *udata);
+
+static void reactor_init(dyad_Reactor *r) {
+  memset(r, 0, sizeof(*r));
+  r->initialized = 1;
+  r->updateTimeout = 1;
+  r->tickInterval = 1;
+  r->acceptBudget = DYAD_ACCEPT_BUDGET;
+#ifdef DYAD_HAS_EPOLL
+  r->backend = DYAD_BACKEND_EPOLL;
+  r->epollFd = -1;
+#else
+  r->backend = DYAD_BACKEND_SELECT;
+#endif
+#ifdef DYAD_HAS_URING
+  r->uring.fd = -1;
+#endif
+  r->wakeSockfd = INVALID_SOCKET;
+  mutex_init(&r->mutex);
+  /* The first tick is emitted on the first update */
+  r->lastTick = dyad_getTime();
+  r->timers = timer_wheel_init(DYAD_TIMER_RESOLUTION, r->lastTick);
+  timer_wheel_timer_init(&r->tickTimer, reactor_onTick, r);
+  timer_wheel_add(r->timers, &r->tickTimer, r->lastTick);
+}
+
+
+static int reactor_isLocal(dyad_Reactor *r) {
+  return r == dyad_currentReactor;
+}
+
+
+static dyad_Reactor *getReactor(void) {
+  dyad_Reactor *r = dyad_currentReactor;
+  if (!r) {
+    r = &dyad_defaultReactor;
+  }
+  if (!r->initialized) {
+    reactor_init(r);
+  }
+  return r;
+}
+
+
+#ifdef DYAD_HAS_EPOLL
+static int epoll_getFd(dyad_Reactor *r) {
+  if (r->epollFd == -1) {
+    r->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epollFd == -1) {
+      panic("could not create epoll instance (%s)", strerror(errno));
+    }
+  }
+  return r->epollFd;
+}
+
+
+static void epoll_deinit(dyad_Reactor *r) {
+  if (r->epollFd != -1) {
+    close(r->epollFd);
+    r->epollFd = -1;
+  }
+}
+#endif
+
+
 static void stream_destroy(dyad_Stream *stream);
+static dyad_Stream *reactor_newStream(dyad_Reactor *r);
 
-static void destroyClosedStreams(void) {
-  dyad_Stream *stream = dyad_streams;
-  while (stream) {
-    if (stream->state == DYAD_STATE_CLOSED) {
-      dyad_Stream *next = stream->next;
+static void destroyClosedStreams(dyad_Reactor *r) {
+  int i = r->closedStreams.length;
+  while (i--) {
+    dyad_Stream *stream = r->closedStreams.data[i];
+    /* A stream with operations still queued in the kernel is kept alive until
+     * their completions have been reaped, and one which has been opened again
+     * since it was listed is just dropped from the list */
+    if (stream->state != DYAD_STATE_CLOSED) {
+      stream->flags &= ~DYAD_FLAG_CLOSED;
+      vec_splice(&r->closedStreams, i, 1);
+    } else if (stream->uringOps == 0 && stream->uringAccepts == 0) {
+      vec_splice(&r->closedStreams, i, 1);
       stream_destroy(stream);
-      stream = next;
-    } else {
-      stream = stream->next;
     }
   }
 }
 
 
+static void reactor_listClosed(dyad_Reactor *r, dyad_Stream *stream) {
+  if (~stream->flags & DYAD_FLAG_CLOSED) {
+    stream->flags |= DYAD_FLAG_CLOSED;
+    vec_push(&r->closedStreams, stream);
+  }
+}
+
+
 static void stream_emitEvent(dyad_Stream *stream, dyad_Event *e);
 
-static void updateTickTimer(void) {
-  /* Update tick timer */
-  if (dyad_lastTick == 0) {
-    dyad_lastTick = dyad_getTime();
-  }
-  while (dyad_lastTick < dyad_getTime()) {
+static void reactor_onTick(timer_wheel_timer_t *timer, void *udata) {
+  dyad_Reactor *r = udata;
+  double currentTime = dyad_getTime();
+  while (r->lastTick <= currentTime) {
     /* Emit event on all streams */
-    dyad_Stream *stream;
+    int i, n = r->streams.length;
     dyad_Event e = createEvent(DYAD_EVENT_TICK);
     e.msg = "a tick has occured";
-    stream = dyad_streams;
-    while (stream) {
-      stream_emitEvent(stream, &e);
-      stream = stream->next;
+    for (i = 0; i < n; i++) {
+      stream_emitEvent(r->streams.data[i], &e);
     }
-    dyad_lastTick += dyad_tickInterval;
+    r->lastTick += r->tickInterval;
   }
+  timer_wheel_add(r->timers, timer, r->lastTick);
 }
 
 
-static void updateStreamTimeouts(void) {
-  double currentTime = dyad_getTime();
-  dyad_Stream *stream;
-  dyad_Event e = createEvent(DYAD_EVENT_TIMEOUT);
+static void stream_onTimeout(timer_wheel_timer_t *timer, void *udata) {
+  dyad_Stream *stream = udata;
+  double deadline = stream->lastActivity + stream->timeout;
+  dyad_Event e;
+  /* Activity doesn't touch the timer, so it may have expired at a deadline
+   * which has since moved on */
+  if (dyad_getTime() < deadline) {
+    timer_wheel_add(stream->reactor->timers, timer, deadline);
+    return;
+  }
+  e = createEvent(DYAD_EVENT_TIMEOUT);
   e.msg = "stream timed out";
-  stream = dyad_streams;
-  while (stream) {
-    if (stream->timeout) {
-      if (currentTime - stream->lastActivity > stream->timeout) {
-        stream_emitEvent(stream, &e);
-        dyad_close(stream);
-      }
-    }
-    stream = stream->next;
+  stream_emitEvent(stream, &e);
+  dyad_close(stream);
+}
+
+
+static double reactor_getWaitTime(dyad_Reactor *r) {
+  /* Wait no longer than the update timeout, and wake up in time for the next
+   * timer, which is at most the next tick */
+  double wait = r->updateTimeout;
+  double deadline = timer_wheel_get_next_deadline(r->timers);
+  if (deadline >= 0 && deadline - dyad_getTime() < wait) {
+    wait = deadline - dyad_getTime();
   }
+  /* Don't block if there is written data waiting to be flushed or
+   * connections waiting to be accepted */
+  if (wait < 0 || r->writtenStreams.length > 0 || r->acceptStreams.length > 0) {
+    wait = 0;
+  }
+  return wait;
 }
 
 
@@ -387,8 +906,8 @@ static void updateStreamTimeouts(void) {
 /*===========================================================================*/
 
 static void stream_destroy(dyad_Stream *stream) {
+  dyad_Reactor *r = stream->reactor;
   dyad_Event e;
-  dyad_Stream **next;
   /* Close socket */
   if (stream->sockfd != INVALID_SOCKET) {
     close(stream->sockfd);
@@ -397,19 +916,70 @@ static void stream_destroy(dyad_Stream *stream) {
   e = createEvent(DYAD_EVENT_DESTROY);
   e.msg = "the stream has been destroyed";
   stream_emitEvent(stream, &e);
-  /* Remove from list and decrement count */
-  next = &dyad_streams;
-  while (*next != stream) {
-    next = &(*next)->next;
-  }
-  *next = stream->next;
-  dyad_streamCount--;
-  /* Destroy and free */
-  vec_deinit(&stream->listeners);
+  /* Remove from the table and decrement count */
+  r->streams.data[stream->index] = r->streams.data[r->streams.length - 1];
+  r->streams.data[stream->index]->index = stream->index;
+  r->streams.length--;
+  timer_wheel_remove(r->timers, &stream->timeoutTimer);
+  if (stream == r->wakeStream) {
+    r->wakeStream = NULL;
+  } else {
+    r->streamCount--;
+  }
+  /* Remove from the written list if it is still waiting to be flushed */
+  if (stream->flags & DYAD_FLAG_WRITTEN) {
+    int i = r->writtenStreams.length;
+    while (i--) {
+      if (r->writtenStreams.data[i] == stream) {
+        vec_splice(&r->writtenStreams, i, 1);
+      }
+    }
+  }
+  if (stream->flags & DYAD_FLAG_REARM) {
+    int i = r->rearmStreams.length;
+    while (i--) {
+      if (r->rearmStreams.data[i] == stream) {
+        vec_splice(&r->rearmStreams, i, 1);
+      }
+    }
+  }
+  if (stream->flags & DYAD_FLAG_ACCEPT) {
+    int i = r->acceptStreams.length;
+    while (i--) {
+      if (r->acceptStreams.data[i] == stream) {
+        vec_splice(&r->acceptStreams, i, 1);
+      }
+    }
+    i = r->acceptRetryStreams.length;
+    while (i--) {
+      if (r->acceptRetryStreams.data[i] == stream) {
+        vec_splice(&r->acceptRetryStreams, i, 1);
+      }
+    }
+  }
+  /* Remove from the remote list if another thread made a request to it */
+  mutex_lock(&r->mutex);
+  if (stream->remoteRequests & DYAD_REMOTE_QUEUED) {
+    int i = r->remoteStreams.length;
+    while (i--) {
+      if (r->remoteStreams.data[i] == stream) {
+        vec_splice(&r->remoteStreams, i, 1);
+      }
+    }
+  }
+  /* Handles to the stream no longer resolve; done under the mutex, which
+   * other threads resolve them under, so no write gets queued on the stream
+   * once it's given back */
+  stream->generation++;
+  mutex_unlock(&r->mutex);
+  /* Destroy and free; the listener list keeps its memory for the next stream
+   * to use the slot */
+  vec_clear(&stream->listeners);
   vec_deinit(&stream->lineBuffer);
-  vec_deinit(&stream->writeBuffer);
-  dyad_free(stream->address);
-  dyad_free(stream);
+  segments_clear(&stream->writeQueue);
+  segments_clear(&stream->remoteQueue);
+  /* Give the slot back */
+  vec_push(&r->freeStreams, stream);
 }
 
 
@@ -445,29 +1015,37 @@ static void stream_error(dyad_Stream *stream, const char *msg, int err) {
 }
 
 
+typedef union {
+  struct sockaddr sa; struct sockaddr_storage sas;
+  struct sockaddr_in sai; struct sockaddr_in6 sai6;
+} SocketAddress;
+
+
+static void stream_setAddress(dyad_Stream *stream, SocketAddress *addr) {
+  if (addr->sas.ss_family == AF_INET6) {
+    inet_ntop(AF_INET6, &addr->sai6.sin6_addr, stream->address,
+              sizeof(stream->address));
+    stream->port = ntohs(addr->sai6.sin6_port);
+  } else {
+    inet_ntop(AF_INET, &addr->sai.sin_addr, stream->address,
+              sizeof(stream->address));
+    stream->port = ntohs(addr->sai.sin_port);
+  }
+}
+
+
 static void stream_initAddress(dyad_Stream *stream) {
-  union { struct sockaddr sa; struct sockaddr_storage sas;
-          struct sockaddr_in sai; struct sockaddr_in6 sai6; } addr;
+  SocketAddress addr;
   socklen_t size;
   memset(&addr, 0, sizeof(addr));
   size = sizeof(addr);
-  dyad_free(stream->address);
-  stream->address = NULL;
+  stream->address[0] = '\0';
   if (getpeername(stream->sockfd, &addr.sa, &size) == -1) {
     if (getsockname(stream->sockfd, &addr.sa, &size) == -1) {
       return;
     }
   }
-  if (addr.sas.ss_family == AF_INET6) {
-    stream->address = dyad_realloc(NULL, INET6_ADDRSTRLEN);
-    inet_ntop(AF_INET6, &addr.sai6.sin6_addr, stream->address,
-              INET6_ADDRSTRLEN);
-    stream->port = ntohs(addr.sai6.sin6_port);
-  } else {
-    stream->address = dyad_realloc(NULL, INET_ADDRSTRLEN);
-    inet_ntop(AF_INET, &addr.sai.sin_addr, stream->address, INET_ADDRSTRLEN);
-    stream->port = ntohs(addr.sai.sin_port);
-  }
+  stream_setAddress(stream, &addr);
 }
 
 
@@ -485,6 +1063,7 @@ static void stream_setSocketNonBlocking(dyad_Stream *stream, int opt) {
 
 static void stream_setSocket(dyad_Stream *stream, dyad_Socket sockfd) {
   stream->sockfd = sockfd;
+  stream->events = 0;
   stream_setSocketNonBlocking(stream, 1);
   stream_initAddress(stream);
 }
@@ -515,199 +1094,980 @@ static int stream_hasListenerForEvent(dyad_Stream *stream, int event) {
 }
 
 
-static void stream_handleReceivedData(dyad_Stream *stream) {
-  for (;;) {
-    /* Receive data */
-    dyad_Event e;
-    char data[8192];
-    int size = recv(stream->sockfd, data, sizeof(data) - 1, 0);
-    if (size <= 0) {
-      if (size == 0 || errno != EWOULDBLOCK) {
-        /* Handle disconnect */
-        dyad_close(stream);
-        return;
-      } else {
-        /* No more data */
-        return;
-      }
-    }
-    data[size] = 0;
-    /* Update status */
-    stream->bytesReceived += size;
-    stream->lastActivity = dyad_getTime();
-    /* Emit data event */
-    e = createEvent(DYAD_EVENT_DATA);
-    e.msg = "received data";
-    e.data = data;
-    e.size = size;
-    stream_emitEvent(stream, &e);
-    /* Check stream state in case it was closed during one of the data event
-     * handlers. */
-    if (stream->state != DYAD_STATE_CONNECTED) {
-      return;
-    }
+static int stream_wantsWrite(dyad_Stream *stream) {
+  return !(stream->flags & DYAD_FLAG_READY) || stream->writeQueue.length != 0;
+}
 
-    /* Handle line event */
-    if (stream_hasListenerForEvent(stream, DYAD_EVENT_LINE)) {
-      int i, start;
-      char *buf;
-      for (i = 0; i < size; i++) {
-        vec_push(&stream->lineBuffer, data[i]);
-      }
-      start = 0;
-      buf = stream->lineBuffer.data;
-      for (i = 0; i < stream->lineBuffer.length; i++) {
-        if (buf[i] == '\n') {
-          dyad_Event e;
-          buf[i] = '\0';
-          e = createEvent(DYAD_EVENT_LINE);
-          e.msg = "received line";
-          e.data = &buf[start];
-          e.size = i - start;
-          /* Check and strip carriage return */
-          if (e.size > 0 && e.data[e.size - 1] == '\r') {
-            e.data[--e.size] = '\0';
-          }
-          stream_emitEvent(stream, &e);
-          start = i + 1;
-          /* Check stream state in case it was closed during one of the line
-           * event handlers. */
-          if (stream->state != DYAD_STATE_CONNECTED) {
-            return;
-          }
-        }
-      }
-      if (start == stream->lineBuffer.length) {
-        vec_clear(&stream->lineBuffer);
-      } else {
-        vec_splice(&stream->lineBuffer, 0, start);
+
+#ifdef DYAD_HAS_URING
+static void uring_arm(dyad_Stream *stream);
+#endif
+
+static void stream_updateInterest(dyad_Stream *stream) {
+#ifdef DYAD_HAS_EPOLL
+  struct epoll_event ev;
+  int events = 0;
+#endif
+#ifdef DYAD_HAS_URING
+  if (stream->reactor->backend == DYAD_BACKEND_URING) {
+    uring_arm(stream);
+    return;
+  }
+#endif
+#ifdef DYAD_HAS_EPOLL
+  if (stream->reactor->backend != DYAD_BACKEND_EPOLL) return;
+  if (stream->sockfd == INVALID_SOCKET) return;
+  switch (stream->state) {
+    case DYAD_STATE_CONNECTED:
+      events = EPOLLIN;
+      if (stream_wantsWrite(stream)) {
+        events |= EPOLLOUT;
       }
-    }
+      break;
+    case DYAD_STATE_CLOSING:
+    case DYAD_STATE_CONNECTING:
+      events = EPOLLOUT;
+      break;
+    case DYAD_STATE_LISTENING:
+      events = EPOLLIN;
+      break;
   }
+  /* Only touch the kernel's interest list if something actually changed */
+  if (events == stream->events) return;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events | EPOLLET;
+  ev.data.ptr = stream;
+  if (epoll_ctl(epoll_getFd(stream->reactor), stream->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                stream->sockfd, &ev) == -1) {
+    stream_error(stream, "could not register socket with epoll", errno);
+    return;
+  }
+  stream->events = events;
+#else
+  (void) stream;
+#endif
 }
 
 
-static void stream_acceptPendingConnections(dyad_Stream *stream) {
-  for (;;) {
-    dyad_Stream *remote;
+static void stream_markWritten(dyad_Stream *stream) {
+  if (stream->flags & DYAD_FLAG_WRITTEN) return;
+  stream->flags |= DYAD_FLAG_WRITTEN;
+  vec_push(&stream->reactor->writtenStreams, stream);
+}
+
+
+static int stream_emitReceivedData(dyad_Stream *stream, char *data, int size) {
+  dyad_Event e;
+  /* Update status */
+  stream->bytesReceived += size;
+  stream->lastActivity = dyad_getTime();
+  /* Emit data event */
+  e = createEvent(DYAD_EVENT_DATA);
+  e.msg = "received data";
+  e.data = data;
+  e.size = size;
+  stream_emitEvent(stream, &e);
+  /* Check stream state in case it was closed during one of the data event
+   * handlers. */
+  if (stream->state != DYAD_STATE_CONNECTED) {
+    return 0;
+  }
+
+  /* Handle line event */
+  if (stream_hasListenerForEvent(stream, DYAD_EVENT_LINE)) {
+    int i, start;
+    char *buf;
+    for (i = 0; i < size; i++) {
+      vec_push(&stream->lineBuffer, data[i]);
+    }
+    start = 0;
+    buf = stream->lineBuffer.data;
+    for (i = 0; i < stream->lineBuffer.length; i++) {
+      if (buf[i] == '\n') {
+        dyad_Event e;
+        buf[i] = '\0';
+        e = createEvent(DYAD_EVENT_LINE);
+        e.msg = "received line";
+        e.data = &buf[start];
+        e.size = i - start;
+        /* Check and strip carriage return */
+        if (e.size > 0 && e.data[e.size - 1] == '\r') {
+          e.data[--e.size] = '\0';
+        }
+        stream_emitEvent(stream, &e);
+        start = i + 1;
+        /* Check stream state in case it was closed during one of the line
+         * event handlers. */
+        if (stream->state != DYAD_STATE_CONNECTED) {
+          return 0;
+        }
+      }
+    }
+    if (start == stream->lineBuffer.length) {
+      vec_clear(&stream->lineBuffer);
+    } else {
+      vec_splice(&stream->lineBuffer, 0, start);
+    }
+  }
+  return 1;
+}
+
+
+static int stream_recv(dyad_Stream *stream, char *data, int size) {
+#ifdef __linux__
+  /* The reactor's wake up stream is an eventfd rather than a socket */
+  if (stream->flags & DYAD_FLAG_WAKE) {
+    return read(stream->sockfd, data, size);
+  }
+#endif
+  return recv(stream->sockfd, data, size, 0);
+}
+
+
+static void stream_handleReceivedData(dyad_Stream *stream) {
+  for (;;) {
+    /* Receive data */
+    char data[8192];
+    int size = stream_recv(stream, data, sizeof(data) - 1);
+    if (size <= 0) {
+      if (size == 0 || errno != EWOULDBLOCK) {
+        /* Handle disconnect */
+        dyad_close(stream);
+        return;
+      } else {
+        /* No more data */
+        return;
+      }
+    }
+    data[size] = 0;
+    if (!stream_emitReceivedData(stream, data, size)) {
+      return;
+    }
+  }
+}
+
+
+static void reactor_listAccept(dyad_Reactor *r, dyad_Stream *stream) {
+  if (stream->flags & DYAD_FLAG_ACCEPT) return;
+  stream->flags |= DYAD_FLAG_ACCEPT;
+  vec_push(&r->acceptStreams, stream);
+}
+
+
+static void reactor_listAcceptRetry(dyad_Reactor *r, dyad_Stream *stream) {
+  if (stream->flags & DYAD_FLAG_ACCEPT) return;
+  stream->flags |= DYAD_FLAG_ACCEPT;
+  vec_push(&r->acceptRetryStreams, stream);
+}
+
+
+static void stream_acceptPendingConnections(dyad_Stream *stream) {
+  dyad_Reactor *r = stream->reactor;
+  for (;;) {
+    dyad_Stream *remote;
     dyad_Event e;
+    SocketAddress addr;
+    socklen_t size = sizeof(addr);
+    char buf[128];
     int err = 0;
-    dyad_Socket sockfd = accept(stream->sockfd, NULL, NULL);
+    dyad_Socket sockfd;
+    /* Leave the rest for the next update once the budget is spent */
+    if (r->acceptCount >= r->acceptBudget) {
+      reactor_listAccept(r, stream);
+      return;
+    }
+    /* The accepted socket comes with its address, and on Linux already
+     * nonblocking */
+#ifdef __linux__
+    sockfd = accept4(stream->sockfd, &addr.sa, &size,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    sockfd = accept(stream->sockfd, &addr.sa, &size);
+#endif
     if (sockfd == INVALID_SOCKET) {
       err = errno;
       if (err == EWOULDBLOCK) {
         /* No more waiting sockets */
         return;
       }
+      r->acceptCount++;
+      if (err == ECONNABORTED || err == EINTR || err == EPROTO) {
+        /* The connection went away before it was accepted, or the call was
+         * interrupted -- the rest are still waiting behind it */
+        continue;
+      }
+      /* Nothing was accepted, so there is no stream to make; the error is
+       * reported on the listener, which stays open */
+      sprintf(buf, "failed to accept connection (%.80s)", strerror(err));
+      e = createEvent(DYAD_EVENT_ERROR);
+      e.msg = buf;
+      stream_emitEvent(stream, &e);
+      if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM) {
+        /* Out of descriptors or memory; under edge-triggered polling the
+         * waiting connections won't be signalled again, so try them again
+         * on the next update */
+        reactor_listAcceptRetry(r, stream);
+      }
+      return;
     }
+    r->acceptCount++;
     /* Create client stream */
-    remote = dyad_newStream();
+    remote = reactor_newStream(r);
     remote->state = DYAD_STATE_CONNECTED;
     /* Set stream's socket */
-    stream_setSocket(remote, sockfd);
+    remote->sockfd = sockfd;
+#ifndef __linux__
+    stream_setSocketNonBlocking(remote, 1);
+#endif
+    stream_setAddress(remote, &addr);
     /* Emit accept event */
     e = createEvent(DYAD_EVENT_ACCEPT);
     e.msg = "accepted connection";
     e.remote = remote;
     stream_emitEvent(stream, &e);
-    /* Handle invalid socket -- the stream is still made and the ACCEPT event
-     * is still emitted, but its shut immediately with an error */
-    if (remote->sockfd == INVALID_SOCKET) {
-      stream_error(remote, "failed to create socket on accept", err);
-      return;
+    stream_updateInterest(remote);
+  }
+}
+
+
+static void reactor_acceptPendingList(dyad_Reactor *r, StreamVec *list) {
+  int i, n = list->length;
+  for (i = 0; i < n; i++) {
+    dyad_Stream *stream = list->data[i];
+    stream->flags &= ~DYAD_FLAG_ACCEPT;
+    if (stream->state == DYAD_STATE_LISTENING) {
+      stream_acceptPendingConnections(stream);
     }
   }
+  if (n > 0) {
+    vec_splice(list, 0, n);
+  }
+}
+
+
+static void reactor_acceptPending(dyad_Reactor *r) {
+  /* Each update gets a new budget; the listening streams which were left
+   * with connections waiting on the last one go first, those retrying after
+   * running out of descriptors ahead of the rest so that one which fails
+   * again waits for the next update */
+  r->acceptCount = 0;
+  reactor_acceptPendingList(r, &r->acceptRetryStreams);
+  reactor_acceptPendingList(r, &r->acceptStreams);
+}
+
+
+static void stream_sent(dyad_Stream *stream, int size) {
+  /* A stream which went over its high watermark emits a 'drain' event once
+   * it's down to its low watermark, so that its writers can carry on */
+  dyad_Event e;
+  int pending = atomic_addInt(&stream->pendingBytes, -size) - size;
+  if (!(stream->flags & DYAD_FLAG_FULL) || pending > stream->lowWatermark) {
+    return;
+  }
+  stream->flags &= ~DYAD_FLAG_FULL;
+  e = createEvent(DYAD_EVENT_DRAIN);
+  e.msg = "stream has drained to its low watermark";
+  stream_emitEvent(stream, &e);
 }
 
 
 static int stream_flushWriteBuffer(dyad_Stream *stream) {
   stream->flags &= ~DYAD_FLAG_WRITTEN;
-  if (stream->writeBuffer.length > 0) {
-    /* Send data */
-    int size = send(stream->sockfd, stream->writeBuffer.data,
-                    stream->writeBuffer.length, 0);
-    if (size <= 0) {
-      if (errno == EWOULDBLOCK) {
-        /* No more data can be written */
-        return 0;
-      } else {
-        /* Handle disconnect */
-        dyad_close(stream);
-        return 0;
+  if (stream->writeQueue.length > 0) {
+    /* Send data until the queue is empty or the socket would block; an
+     * edge-triggered poller won't report the socket as writable again until
+     * the kernel's send buffer has been filled */
+    int sent = 0;
+    while (stream->writeQueue.length > 0) {
+      int size = segments_send(&stream->writeQueue, stream->sockfd);
+      if (size <= 0) {
+        if (errno == EWOULDBLOCK) {
+          /* No more data can be written */
+          break;
+        } else {
+          /* Handle disconnect */
+          dyad_close(stream);
+          return 0;
+        }
+      }
+      sent += size;
+    }
+    if (sent == 0) {
+      return 0;
+    }
+    /* Update status */
+    stream->bytesSent += sent;
+    stream->lastActivity = dyad_getTime();
+    stream_sent(stream, sent);
+    if (stream->state == DYAD_STATE_CLOSED) {
+      return 0;
+    }
+  }
+
+  if (stream->writeQueue.length == 0) {
+    dyad_Event e;
+    /* If this is a 'closing' stream we can properly close it now */
+    if (stream->state == DYAD_STATE_CLOSING) {
+      dyad_close(stream);
+      return 0;
+    }
+    /* Set ready flag and emit 'ready for data' event */
+    stream->flags |= DYAD_FLAG_READY;
+    e = createEvent(DYAD_EVENT_READY);
+    e.msg = "stream is ready for more data";
+    stream_emitEvent(stream, &e);
+  }
+  /* Return 1 to indicate that more data can immediately be written to the
+   * stream's socket */
+  return 1;
+}
+
+
+static void stream_handleConnect(dyad_Stream *stream) {
+  /* Check socket for error */
+  int optval = 0;
+  socklen_t optlen = sizeof(optval);
+  dyad_Event e;
+  getsockopt(stream->sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen);
+  if (optval != 0) {
+    /* Handle failed connection */
+    stream_error(stream, "could not connect to server", 0);
+    return;
+  }
+  /* Handle succeselful connection */
+  stream->state = DYAD_STATE_CONNECTED;
+  stream->lastActivity = dyad_getTime();
+  stream_initAddress(stream);
+  /* Emit connect event */
+  e = createEvent(DYAD_EVENT_CONNECT);
+  e.msg = "connected to server";
+  stream_emitEvent(stream, &e);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* io_uring                                                                  */
+/*---------------------------------------------------------------------------*/
+
+/* The io_uring backend is completion based: rather than waiting for a socket
+ * to become ready and then calling recv(), send() or accept() on it, each
+ * stream keeps its operations queued in the kernel's submission ring. Every
+ * operation queued during an update is submitted, and every completion is
+ * reaped, with a single io_uring_enter() call.
+ *
+ * Received data is written by the kernel into a ring of provided buffers
+ * which is registered once at startup, so an idle connection doesn't pin a
+ * receive buffer of its own. Data being sent is moved from the stream's write
+ * buffer into its send buffer, which isn't touched again until the kernel has
+ * completed the send.
+ *
+ * The user data of each operation is the stream's pointer with the operation
+ * type stored in the low bits.
+ */
+
+#ifdef DYAD_HAS_URING
+
+enum {
+  URING_OP_RECV    = 1 << 0,
+  URING_OP_SEND    = 1 << 1,
+  URING_OP_POLL    = 1 << 2,
+  URING_OP_ACCEPT  = 1 << 3,
+  URING_OP_MASK    = 15
+};
+
+static void flushWrittenStreams(dyad_Reactor *r);
+
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int uring_enterSyscall(
+  Uring *u, unsigned toSubmit, unsigned minComplete, unsigned flags,
+  void *arg, size_t argSize
+) {
+  return (int) syscall(__NR_io_uring_enter, u->fd, toSubmit, minComplete,
+                       flags, arg, argSize);
+}
+
+
+static int uring_register(
+  Uring *u, unsigned opcode, void *arg, unsigned nargs
+) {
+  return (int) syscall(__NR_io_uring_register, u->fd, opcode, arg, nargs);
+}
+
+
+static void uring_deinit(Uring *u) {
+  if (u->fd == -1) return;
+  close(u->fd);
+  if (u->sqes) munmap(u->sqes, u->sqesSize);
+  if (u->ring) munmap(u->ring, u->ringSize);
+  if (u->bufRing) munmap(u->bufRing, u->bufRingSize);
+  dyad_free(u->bufs);
+  memset(u, 0, sizeof(*u));
+  u->fd = -1;
+}
+
+
+static void uring_recycleBuffer(Uring *u, unsigned short bid) {
+  struct io_uring_buf *buf;
+  buf = &u->bufRing->bufs[u->bufTail & (DYAD_URING_BUFFERS - 1)];
+  buf->addr = (unsigned long) (u->bufs + (size_t) bid * DYAD_URING_BUFFER_SIZE);
+  /* Leave room for the null terminator added to received data */
+  buf->len = DYAD_URING_BUFFER_SIZE - 1;
+  buf->bid = bid;
+  u->bufTail++;
+  __atomic_store_n(&u->bufRing->tail, u->bufTail, __ATOMIC_RELEASE);
+}
+
+
+static int uring_init(Uring *u) {
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  size_t sqSize, cqSize;
+  unsigned i;
+
+  memset(u, 0, sizeof(*u));
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = DYAD_URING_CQ_ENTRIES;
+  u->fd = uring_setup(DYAD_URING_ENTRIES, &p);
+  if (u->fd < 0) {
+    u->fd = -1;
+    return -1;
+  }
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) goto fail;
+  if (!(p.features & IORING_FEAT_EXT_ARG)) goto fail;
+
+  /* Map the submission and completion rings, which share one mapping */
+  sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->ringSize = sqSize > cqSize ? sqSize : cqSize;
+  u->ring = mmap(NULL, u->ringSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->ring == MAP_FAILED) {
+    u->ring = NULL;
+    goto fail;
+  }
+  u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    goto fail;
+  }
+  u->sqHead = (unsigned*) ((char*) u->ring + p.sq_off.head);
+  u->sqTail = (unsigned*) ((char*) u->ring + p.sq_off.tail);
+  u->sqMask = (unsigned*) ((char*) u->ring + p.sq_off.ring_mask);
+  u->sqArray = (unsigned*) ((char*) u->ring + p.sq_off.array);
+  u->sqEntries = p.sq_entries;
+  u->sqLocalTail = *u->sqTail;
+  u->cqHead = (unsigned*) ((char*) u->ring + p.cq_off.head);
+  u->cqTail = (unsigned*) ((char*) u->ring + p.cq_off.tail);
+  u->cqMask = (unsigned*) ((char*) u->ring + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe*) ((char*) u->ring + p.cq_off.cqes);
+
+  /* Register the ring of provided receive buffers */
+  u->bufRingSize = DYAD_URING_BUFFERS * sizeof(struct io_uring_buf);
+  u->bufRing = mmap(NULL, u->bufRingSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (u->bufRing == MAP_FAILED) {
+    u->bufRing = NULL;
+    goto fail;
+  }
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long) u->bufRing;
+  reg.ring_entries = DYAD_URING_BUFFERS;
+  reg.bgid = DYAD_URING_BUFFER_GROUP;
+  if (uring_register(u, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) goto fail;
+  u->bufs = dyad_realloc(NULL, DYAD_URING_BUFFERS * DYAD_URING_BUFFER_SIZE);
+  for (i = 0; i < DYAD_URING_BUFFERS; i++) {
+    uring_recycleBuffer(u, i);
+  }
+  return 0;
+
+fail:
+  uring_deinit(u);
+  return -1;
+}
+
+
+static int uring_enter(Uring *u, unsigned minComplete) {
+  unsigned toSubmit;
+  int res;
+  __atomic_store_n(u->sqTail, u->sqLocalTail, __ATOMIC_RELEASE);
+  toSubmit = u->sqLocalTail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE);
+  if (toSubmit == 0 && minComplete == 0) return 0;
+  do {
+    res = uring_enterSyscall(u, toSubmit, minComplete,
+                             minComplete ? IORING_ENTER_GETEVENTS : 0,
+                             NULL, 0);
+  } while (res < 0 && errno == EINTR);
+  return res;
+}
+
+
+static int uring_wait(Uring *u, double seconds) {
+  /* Submits the queued entries and waits for a completion, or until the
+   * timeout expires; a signal also ends the wait */
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  ts.tv_sec = (long long) seconds;
+  ts.tv_nsec = (long long) ((seconds - ts.tv_sec) * 1e9);
+  memset(&arg, 0, sizeof(arg));
+  arg.ts = (unsigned long) &ts;
+  __atomic_store_n(u->sqTail, u->sqLocalTail, __ATOMIC_RELEASE);
+  return uring_enterSyscall(
+    u, u->sqLocalTail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE), 1,
+    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+
+static struct io_uring_sqe *uring_getSqe(Uring *u) {
+  struct io_uring_sqe *sqe;
+  unsigned index;
+  /* Hand the queued entries over to the kernel if the ring is full */
+  while (u->sqLocalTail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE) >=
+         u->sqEntries) {
+    if (uring_enter(u, 0) < 0 && errno != EAGAIN && errno != EBUSY) {
+      panic("could not submit to io_uring (%s)", strerror(errno));
+    }
+  }
+  index = u->sqLocalTail & *u->sqMask;
+  sqe = &u->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sqArray[index] = index;
+  u->sqLocalTail++;
+  return sqe;
+}
+
+
+static void uring_queue(
+  dyad_Stream *stream, int op, int opcode, void *addr, unsigned len
+) {
+  struct io_uring_sqe *sqe = uring_getSqe(&stream->reactor->uring);
+  sqe->opcode = opcode;
+  sqe->fd = stream->sockfd;
+  sqe->addr = (unsigned long) addr;
+  sqe->len = len;
+  sqe->user_data = (unsigned long) stream | op;
+  switch (op) {
+    case URING_OP_RECV:
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = DYAD_URING_BUFFER_GROUP;
+      break;
+    case URING_OP_SEND:
+      sqe->msg_flags = MSG_NOSIGNAL;
+      break;
+    case URING_OP_POLL:
+      sqe->poll32_events = POLLOUT;
+      break;
+    case URING_OP_ACCEPT:
+      sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+      break;
+  }
+  if (op == URING_OP_ACCEPT) {
+    stream->uringAccepts++;
+  } else {
+    stream->uringOps |= op;
+  }
+}
+
+
+static void uring_rearmLater(dyad_Stream *stream) {
+  if (stream->flags & DYAD_FLAG_REARM) return;
+  stream->flags |= DYAD_FLAG_REARM;
+  vec_push(&stream->reactor->rearmStreams, stream);
+}
+
+
+static void uring_arm(dyad_Stream *stream) {
+  if (stream->sockfd == INVALID_SOCKET) return;
+  switch (stream->state) {
+    case DYAD_STATE_CONNECTED:
+      if (!(stream->uringOps & URING_OP_RECV)) {
+        uring_queue(stream, URING_OP_RECV,
+                    stream->flags & DYAD_FLAG_WAKE ? IORING_OP_READ
+                                                   : IORING_OP_RECV,
+                    NULL, DYAD_URING_BUFFER_SIZE - 1);
+      }
+      break;
+    case DYAD_STATE_CONNECTING:
+      if (!(stream->uringOps & URING_OP_POLL)) {
+        uring_queue(stream, URING_OP_POLL, IORING_OP_POLL_ADD, NULL, 0);
       }
+      break;
+    case DYAD_STATE_LISTENING:
+      while (stream->uringAccepts < DYAD_URING_ACCEPTS) {
+        uring_queue(stream, URING_OP_ACCEPT, IORING_OP_ACCEPT, NULL, 0);
+      }
+      break;
+  }
+}
+
+
+static void uring_emitReady(dyad_Stream *stream) {
+  dyad_Event e;
+  /* If this is a 'closing' stream we can properly close it now */
+  if (stream->state == DYAD_STATE_CLOSING) {
+    dyad_close(stream);
+    return;
+  }
+  /* Set ready flag and emit 'ready for data' event */
+  stream->flags |= DYAD_FLAG_READY;
+  e = createEvent(DYAD_EVENT_READY);
+  e.msg = "stream is ready for more data";
+  stream_emitEvent(stream, &e);
+}
+
+
+static void uring_flush(dyad_Stream *stream) {
+  stream->flags &= ~DYAD_FLAG_WRITTEN;
+  if (
+    stream->state != DYAD_STATE_CONNECTED &&
+    stream->state != DYAD_STATE_CLOSING
+  ) {
+    return;
+  }
+  /* The send completion picks up anything written in the meantime */
+  if (stream->uringOps & URING_OP_SEND) return;
+  if (stream->writeQueue.length > 0) {
+    struct msghdr *msg = &stream->uringMsg;
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_iov = stream->uringIov;
+    msg->msg_iovlen = segments_fillIov(&stream->writeQueue, stream->uringIov,
+                                       DYAD_URING_IOVS);
+    uring_queue(stream, URING_OP_SEND, IORING_OP_SENDMSG, msg, 1);
+  } else if (!(stream->flags & DYAD_FLAG_READY)) {
+    uring_emitReady(stream);
+  } else if (stream->state == DYAD_STATE_CLOSING) {
+    dyad_close(stream);
+  }
+}
+
+
+static void uring_handleRecv(dyad_Stream *stream, int res, unsigned flags) {
+  Uring *u = &stream->reactor->uring;
+  char *data = NULL;
+  unsigned short bid = 0;
+  if (flags & IORING_CQE_F_BUFFER) {
+    bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    data = u->bufs + (size_t) bid * DYAD_URING_BUFFER_SIZE;
+  }
+  if (stream->state != DYAD_STATE_CONNECTED) {
+    /* Nothing to do: a closing stream doesn't handle received data */
+  } else if (res > 0 && data) {
+    data[res] = 0;
+    if (stream_emitReceivedData(stream, data, res)) {
+      uring_arm(stream);
     }
-    if (size == stream->writeBuffer.length) {
-      vec_clear(&stream->writeBuffer);
+  } else if (res == -ENOBUFS) {
+    /* Every provided buffer is in use, try again on the next update */
+    uring_rearmLater(stream);
+  } else if (res == -EAGAIN || res == -EINTR) {
+    uring_arm(stream);
+  } else {
+    /* Handle disconnect */
+    dyad_close(stream);
+  }
+  if (data) {
+    uring_recycleBuffer(u, bid);
+  }
+}
+
+
+static void uring_handleSend(dyad_Stream *stream, int res) {
+  if (
+    stream->state != DYAD_STATE_CONNECTED &&
+    stream->state != DYAD_STATE_CLOSING
+  ) {
+    atomic_addInt(&stream->pendingBytes, -stream->writeQueue.length);
+    segments_clear(&stream->writeQueue);
+    return;
+  }
+  if (res < 0) {
+    if (res == -EAGAIN || res == -EINTR) {
+      uring_flush(stream);
     } else {
-      vec_splice(&stream->writeBuffer, 0, size);
+      /* Handle disconnect */
+      dyad_close(stream);
+    }
+    return;
+  }
+  segments_consume(&stream->writeQueue, res);
+  /* Update status */
+  stream->bytesSent += res;
+  stream->lastActivity = dyad_getTime();
+  stream_sent(stream, res);
+  if (stream->state == DYAD_STATE_CLOSED) return;
+  if (stream->writeQueue.length == 0) {
+    uring_emitReady(stream);
+  } else {
+    uring_flush(stream);
+  }
+}
+
+
+static void uring_handleAccept(dyad_Stream *stream, int res) {
+  dyad_Stream *remote;
+  dyad_Event e;
+  if (stream->state != DYAD_STATE_LISTENING) {
+    if (res >= 0) close(res);
+    return;
+  }
+  if (res == -EAGAIN || res == -EINTR || res == -ECONNABORTED || res == -EPROTO) {
+    uring_arm(stream);
+    return;
+  }
+  if (res < 0) {
+    /* Nothing was accepted, so there is no stream to make; the error is
+     * reported on the listener, which is given a break until the next
+     * update */
+    char buf[128];
+    sprintf(buf, "failed to accept connection (%.80s)", strerror(-res));
+    e = createEvent(DYAD_EVENT_ERROR);
+    e.msg = buf;
+    stream_emitEvent(stream, &e);
+    uring_rearmLater(stream);
+    return;
+  }
+  /* Create client stream; the socket was created nonblocking by the kernel,
+   * so it only needs its address looked up */
+  stream->reactor->acceptCount++;
+  remote = reactor_newStream(stream->reactor);
+  remote->state = DYAD_STATE_CONNECTED;
+  remote->sockfd = res;
+  stream_initAddress(remote);
+  /* Emit accept event */
+  e = createEvent(DYAD_EVENT_ACCEPT);
+  e.msg = "accepted connection";
+  e.remote = remote;
+  stream_emitEvent(stream, &e);
+  if (remote->state == DYAD_STATE_CONNECTED) {
+    uring_arm(remote);
+    uring_flush(remote);
+  }
+  /* Once the update's budget is spent the accepts are queued again on the
+   * next one */
+  if (stream->reactor->acceptCount >= stream->reactor->acceptBudget) {
+    uring_rearmLater(stream);
+  } else {
+    uring_arm(stream);
+  }
+}
+
+
+static void uring_handlePoll(dyad_Stream *stream) {
+  if (stream->state != DYAD_STATE_CONNECTING) return;
+  stream_handleConnect(stream);
+  if (stream->state == DYAD_STATE_CONNECTED) {
+    uring_arm(stream);
+    uring_flush(stream);
+  }
+}
+
+
+static void uring_reap(Uring *u) {
+  unsigned head = *u->cqHead;
+  for (;;) {
+    struct io_uring_cqe *cqe;
+    unsigned long userData;
+    dyad_Stream *stream;
+    unsigned flags;
+    int res, op;
+    if (head == __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    cqe = &u->cqes[head & *u->cqMask];
+    userData = cqe->user_data;
+    res = cqe->res;
+    flags = cqe->flags;
+    /* Release the completion entry before calling into any handlers */
+    head++;
+    __atomic_store_n(u->cqHead, head, __ATOMIC_RELEASE);
+
+    op = userData & URING_OP_MASK;
+    stream = (dyad_Stream*) (userData & ~(unsigned long) URING_OP_MASK);
+    if (op == URING_OP_ACCEPT) {
+      stream->uringAccepts--;
+    } else {
+      stream->uringOps &= ~op;
+    }
+    switch (op) {
+      case URING_OP_RECV:   uring_handleRecv(stream, res, flags); break;
+      case URING_OP_SEND:   uring_handleSend(stream, res);        break;
+      case URING_OP_ACCEPT: uring_handleAccept(stream, res);      break;
+      case URING_OP_POLL:   uring_handlePoll(stream);             break;
+    }
+  }
+}
+
+
+static void uring_update(dyad_Reactor *r) {
+  Uring *u = &r->uring;
+  int i;
+
+  /* Re-queue the operations which couldn't be queued on the last update */
+  for (i = 0; i < r->rearmStreams.length; i++) {
+    dyad_Stream *stream = r->rearmStreams.data[i];
+    stream->flags &= ~DYAD_FLAG_REARM;
+    uring_arm(stream);
+  }
+  vec_clear(&r->rearmStreams);
+
+  /* Queue sends for the streams which were written to */
+  flushWrittenStreams(r);
+
+  uring_wait(u, reactor_getWaitTime(r));
+  uring_reap(u);
+}
+
+
+static void uring_drain(dyad_Reactor *r) {
+  /* Wait for the operations of closed streams to complete so that the kernel
+   * is no longer using any of their memory */
+  int i, pending, tries = 0;
+  do {
+    pending = 0;
+    for (i = 0; i < r->streams.length; i++) {
+      dyad_Stream *stream = r->streams.data[i];
+      /* Closing an eventfd doesn't end the read queued on it; the wake up
+       * stream is left to the teardown of the ring instead */
+      if (stream != r->wakeStream) {
+        pending += stream->uringOps != 0 || stream->uringAccepts != 0;
+      }
+    }
+    if (pending) {
+      uring_wait(&r->uring, 0.01);
+      uring_reap(&r->uring);
+    }
+  } while (pending && ++tries < 1000);
+}
+
+#endif
+
+
+static void flushWrittenStreams(dyad_Reactor *r) {
+  /* Swap the written list out first: streams written to by the handlers of
+   * the events emitted below are picked up on the next update */
+  int i;
+  StreamVec tmp = r->flushingStreams;
+  r->flushingStreams = r->writtenStreams;
+  r->writtenStreams = tmp;
+  vec_clear(&r->writtenStreams);
+  for (i = 0; i < r->flushingStreams.length; i++) {
+    dyad_Stream *stream = r->flushingStreams.data[i];
+    if (
+      stream->flags & DYAD_FLAG_WRITTEN &&
+      stream->state != DYAD_STATE_CLOSED
+    ) {
+#ifdef DYAD_HAS_URING
+      if (r->backend == DYAD_BACKEND_URING) {
+        uring_flush(stream);
+        continue;
+      }
+#endif
+      stream_flushWriteBuffer(stream);
+      stream_updateInterest(stream);
+    }
+  }
+  vec_clear(&r->flushingStreams);
+}
+
+
+#ifdef DYAD_HAS_EPOLL
+static void epoll_update(dyad_Reactor *r) {
+  struct epoll_event events[DYAD_EPOLL_MAXEVENTS];
+  int i, n, timeout;
+  double wait = reactor_getWaitTime(r);
+
+  /* Round up, so as not to wake up just before the deadline */
+  timeout = (int) (wait * 1000);
+  if (timeout < wait * 1000) {
+    timeout++;
+  }
+
+  n = epoll_wait(epoll_getFd(r), events, DYAD_EPOLL_MAXEVENTS, timeout);
+
+  /* Handle ready streams */
+  for (i = 0; i < n; i++) {
+    dyad_Stream *stream = events[i].data.ptr;
+    int ev = events[i].events;
+    switch (stream->state) {
+
+      case DYAD_STATE_CONNECTED:
+        if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          stream_handleReceivedData(stream);
+          if (stream->state == DYAD_STATE_CLOSED) {
+            break;
+          }
+        }
+        /* Fall through */
+
+      case DYAD_STATE_CLOSING:
+        if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+          stream_flushWriteBuffer(stream);
+        }
+        break;
+
+      case DYAD_STATE_CONNECTING:
+        if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+          stream_handleConnect(stream);
+        }
+        break;
+
+      case DYAD_STATE_LISTENING:
+        if (ev & EPOLLIN) {
+          stream_acceptPendingConnections(stream);
+        }
+        break;
     }
-    /* Update status */
-    stream->bytesSent += size;
-    stream->lastActivity = dyad_getTime();
-  }
 
-  if (stream->writeBuffer.length == 0) {
-    dyad_Event e;
-    /* If this is a 'closing' stream we can properly close it now */
-    if (stream->state == DYAD_STATE_CLOSING) {
-      dyad_close(stream);
-      return 0;
+    if (stream->state != DYAD_STATE_CLOSED) {
+      stream_updateInterest(stream);
     }
-    /* Set ready flag and emit 'ready for data' event */
-    stream->flags |= DYAD_FLAG_READY;
-    e = createEvent(DYAD_EVENT_READY);
-    e.msg = "stream is ready for more data";
-    stream_emitEvent(stream, &e);
   }
-  /* Return 1 to indicate that more data can immediately be written to the
-   * stream's socket */
-  return 1;
-}
-
-
 
-/*===========================================================================*/
-/* API                                                                       */
-/*===========================================================================*/
+  /* Any stream which was just now written to should immediately try to send
+   * its data */
+  flushWrittenStreams(r);
+}
+#endif
 
-/*---------------------------------------------------------------------------*/
-/* Core                                                                      */
-/*---------------------------------------------------------------------------*/
 
-void dyad_update(void) {
+static void select_update(dyad_Reactor *r) {
   dyad_Stream *stream;
   struct timeval tv;
-
-  destroyClosedStreams();
-  updateTickTimer();
-  updateStreamTimeouts();
+  double wait;
+  int i, n;
 
   /* Create fd sets for select() */
-  select_zero(&dyad_selectSet);
+  select_zero(&r->selectSet);
 
-  stream = dyad_streams;
-  while (stream) {
+  for (i = 0; i < r->streams.length; i++) {
+    stream = r->streams.data[i];
     switch (stream->state) {
       case DYAD_STATE_CONNECTED:
-        select_add(&dyad_selectSet, SELECT_READ, stream->sockfd);
+        select_add(&r->selectSet, SELECT_READ, stream->sockfd);
         if (!(stream->flags & DYAD_FLAG_READY) ||
-            stream->writeBuffer.length != 0
+            stream->writeQueue.length != 0
         ) {
-          select_add(&dyad_selectSet, SELECT_WRITE, stream->sockfd);
+          select_add(&r->selectSet, SELECT_WRITE, stream->sockfd);
         }
         break;
       case DYAD_STATE_CLOSING:
-        select_add(&dyad_selectSet, SELECT_WRITE, stream->sockfd);
+        select_add(&r->selectSet, SELECT_WRITE, stream->sockfd);
         break;
       case DYAD_STATE_CONNECTING:
-        select_add(&dyad_selectSet, SELECT_WRITE, stream->sockfd);
-        select_add(&dyad_selectSet, SELECT_EXCEPT, stream->sockfd);
+        select_add(&r->selectSet, SELECT_WRITE, stream->sockfd);
+        select_add(&r->selectSet, SELECT_EXCEPT, stream->sockfd);
         break;
       case DYAD_STATE_LISTENING:
-        select_add(&dyad_selectSet, SELECT_READ, stream->sockfd);
+        select_add(&r->selectSet, SELECT_READ, stream->sockfd);
         break;
     }
-    stream = stream->next;
   }
 
   /* Init timeout value and do select */
@@ -717,25 +2077,27 @@ void dyad_update(void) {
      * because the type of timeval's fields don't agree across platforms */
     #pragma warning(disable: 4244)
   #endif
-  tv.tv_sec = dyad_updateTimeout;
-  tv.tv_usec = (dyad_updateTimeout - tv.tv_sec) * 1e6;
+  wait = reactor_getWaitTime(r);
+  tv.tv_sec = wait;
+  tv.tv_usec = (wait - tv.tv_sec) * 1e6;
   #ifdef _MSC_VER
     #pragma warning(pop)
   #endif
 
-  select(dyad_selectSet.maxfd + 1,
-         dyad_selectSet.fds[SELECT_READ],
-         dyad_selectSet.fds[SELECT_WRITE],
-         dyad_selectSet.fds[SELECT_EXCEPT],
+  select(r->selectSet.maxfd + 1,
+         r->selectSet.fds[SELECT_READ],
+         r->selectSet.fds[SELECT_WRITE],
+         r->selectSet.fds[SELECT_EXCEPT],
          &tv);
 
-  /* Handle streams */
-  stream = dyad_streams;
-  while (stream) {
+  /* Handle streams; those accepted meanwhile are added after the end */
+  n = r->streams.length;
+  for (i = 0; i < n; i++) {
+    stream = r->streams.data[i];
     switch (stream->state) {
 
       case DYAD_STATE_CONNECTED:
-        if (select_has(&dyad_selectSet, SELECT_READ, stream->sockfd)) {
+        if (select_has(&r->selectSet, SELECT_READ, stream->sockfd)) {
           stream_handleReceivedData(stream);
           if (stream->state == DYAD_STATE_CLOSED) {
             break;
@@ -744,38 +2106,24 @@ void dyad_update(void) {
         /* Fall through */
 
       case DYAD_STATE_CLOSING:
-        if (select_has(&dyad_selectSet, SELECT_WRITE, stream->sockfd)) {
+        if (select_has(&r->selectSet, SELECT_WRITE, stream->sockfd)) {
           stream_flushWriteBuffer(stream);
         }
         break;
 
       case DYAD_STATE_CONNECTING:
-        if (select_has(&dyad_selectSet, SELECT_WRITE, stream->sockfd)) {
-          /* Check socket for error */
-          int optval = 0;
-          socklen_t optlen = sizeof(optval);
-          dyad_Event e;
-          getsockopt(stream->sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen);
-          if (optval != 0) goto connectFailed;
-          /* Handle succeselful connection */
-          stream->state = DYAD_STATE_CONNECTED;
-          stream->lastActivity = dyad_getTime();
-          stream_initAddress(stream);
-          /* Emit connect event */
-          e = createEvent(DYAD_EVENT_CONNECT);
-          e.msg = "connected to server";
-          stream_emitEvent(stream, &e);
+        if (select_has(&r->selectSet, SELECT_WRITE, stream->sockfd)) {
+          stream_handleConnect(stream);
         } else if (
-          select_has(&dyad_selectSet, SELECT_EXCEPT, stream->sockfd)
+          select_has(&r->selectSet, SELECT_EXCEPT, stream->sockfd)
         ) {
           /* Handle failed connection */
-connectFailed:
           stream_error(stream, "could not connect to server", 0);
         }
         break;
 
       case DYAD_STATE_LISTENING:
-        if (select_has(&dyad_selectSet, SELECT_READ, stream->sockfd)) {
+        if (select_has(&r->selectSet, SELECT_READ, stream->sockfd)) {
           stream_acceptPendingConnections(stream);
         }
         break;
@@ -789,9 +2137,339 @@ connectFailed:
     ) {
       stream_flushWriteBuffer(stream);
     }
+  }
+
+  /* Every stream has been visited, so the written list is no longer needed */
+  vec_clear(&r->writtenStreams);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* Reactor                                                                   */
+/*---------------------------------------------------------------------------*/
+
+/* Other threads can't touch a stream directly, as it belongs to the thread
+ * driving its reactor. Instead their writes are appended to the stream's
+ * remote queue and the stream is queued on its reactor, which moves the
+ * data over to the write queue on its next update. The reactor is woken up
+ * from its wait through an eventfd, or a socket pair where there is none,
+ * the reading end of which is an internal stream not counted by
+ * dyad_getStreamCount(). */
+
+static dyad_Stream *reactor_newStream(dyad_Reactor *r) {
+  dyad_Stream *stream;
+  int slot;
+  unsigned generation;
+  Listener *listeners;
+  int listenerCapacity;
+  if (r->freeStreams.length == 0) {
+    /* Allocate another slab, its slots are handed out lowest first */
+    int i;
+    dyad_Stream *slab = dyad_realloc(NULL, DYAD_SLAB_SIZE * DYAD_STREAM_STRIDE);
+    memset(slab, 0, DYAD_SLAB_SIZE * DYAD_STREAM_STRIDE);
+    for (i = DYAD_SLAB_SIZE - 1; i >= 0; i--) {
+      stream = slab_getStream(slab, i);
+      stream->slot = r->slabs.length * DYAD_SLAB_SIZE + i;
+      stream->generation = 1;
+      vec_push(&r->freeStreams, stream);
+    }
+    /* Other threads look handles up in the slabs under the mutex */
+    mutex_lock(&r->mutex);
+    vec_push(&r->slabs, slab);
+    mutex_unlock(&r->mutex);
+  }
+  stream = r->freeStreams.data[--r->freeStreams.length];
+  slot = stream->slot;
+  generation = stream->generation ? stream->generation : 1;
+  listeners = stream->listeners.data;
+  listenerCapacity = stream->listeners.capacity;
+  memset(stream, 0, sizeof(*stream));
+  stream->slot = slot;
+  stream->generation = generation;
+  stream->listeners.data = listeners;
+  stream->listeners.capacity = listenerCapacity;
+  stream->state = DYAD_STATE_CLOSED;
+  stream->sockfd = INVALID_SOCKET;
+  stream->lastActivity = dyad_getTime();
+  stream->lowWatermark = DYAD_LOW_WATERMARK;
+  stream->highWatermark = DYAD_HIGH_WATERMARK;
+  stream->reactor = r;
+  timer_wheel_timer_init(&stream->timeoutTimer, stream_onTimeout, stream);
+  /* Add to the table and increment count */
+  stream->index = r->streams.length;
+  vec_push(&r->streams, stream);
+  r->streamCount++;
+  /* Destroyed on the next update unless it's opened before then */
+  reactor_listClosed(r, stream);
+  return stream;
+}
+
+
+static void reactor_wake(dyad_Reactor *r) {
+  /* Expects the reactor's mutex to be held */
+#ifdef __linux__
+  unsigned long long one = 1;
+  int res;
+#endif
+  if (r->wakePending || r->wakeSockfd == INVALID_SOCKET) return;
+  r->wakePending = 1;
+#ifdef __linux__
+  res = write(r->wakeSockfd, &one, sizeof(one));
+  (void) res;
+#else
+  send(r->wakeSockfd, "", 1, 0);
+#endif
+}
+
+
+static void stream_requestRemote(dyad_Stream *stream, int request) {
+  /* Expects the reactor's mutex to be held */
+  dyad_Reactor *r = stream->reactor;
+  if (!(stream->remoteRequests & DYAD_REMOTE_QUEUED)) {
+    vec_push(&r->remoteStreams, stream);
+  }
+  stream->remoteRequests |= DYAD_REMOTE_QUEUED | request;
+  reactor_wake(r);
+}
+
+
+static void stream_clearWriteQueue(dyad_Stream *stream) {
+#ifdef DYAD_HAS_URING
+  /* The kernel may still be reading the queued segments; the send's
+   * completion clears the queue instead */
+  if (stream->uringOps & URING_OP_SEND) return;
+#endif
+  atomic_addInt(&stream->pendingBytes, -stream->writeQueue.length);
+  segments_clear(&stream->writeQueue);
+}
+
+
+static SegmentQueue *stream_beginWrite(dyad_Stream *stream) {
+  dyad_Reactor *r = stream->reactor;
+  if (reactor_isLocal(r)) {
+    return &stream->writeQueue;
+  }
+  mutex_lock(&r->mutex);
+  return &stream->remoteQueue;
+}
+
+
+static void stream_endWrite(dyad_Stream *stream, int size) {
+  dyad_Reactor *r = stream->reactor;
+  int full = atomic_addInt(&stream->pendingBytes, size) + size >=
+             stream->highWatermark;
+  if (reactor_isLocal(r)) {
+    if (full) stream->flags |= DYAD_FLAG_FULL;
+    stream_markWritten(stream);
+    return;
+  }
+  stream_requestRemote(stream, full ? DYAD_REMOTE_FULL : 0);
+  mutex_unlock(&r->mutex);
+}
+
+
+static void reactor_handleRemoteRequests(dyad_Reactor *r) {
+  int i;
+  StreamVec tmp;
+  /* Take the queued streams, their data and their requests while holding the
+   * mutex, and only then act on them, as that emits events. The requests are
+   * cleared along with the data so any made after re-queue the stream */
+  mutex_lock(&r->mutex);
+  r->wakePending = 0;
+  tmp = r->handlingStreams;
+  r->handlingStreams = r->remoteStreams;
+  r->remoteStreams = tmp;
+  vec_clear(&r->remoteStreams);
+  for (i = 0; i < r->handlingStreams.length; i++) {
+    dyad_Stream *stream = r->handlingStreams.data[i];
+    segments_append(&stream->writeQueue, &stream->remoteQueue);
+    stream->handlingRequests = stream->remoteRequests;
+    stream->remoteRequests = 0;
+  }
+  mutex_unlock(&r->mutex);
+
+  for (i = 0; i < r->handlingStreams.length; i++) {
+    dyad_Stream *stream = r->handlingStreams.data[i];
+    int requests = stream->handlingRequests;
+    stream->handlingRequests = 0;
+    if (stream->state == DYAD_STATE_CLOSED) {
+      stream_clearWriteQueue(stream);
+      continue;
+    }
+    if (stream->writeQueue.length > 0) {
+      stream_markWritten(stream);
+    }
+    if (requests & DYAD_REMOTE_FULL) {
+      /* It may have drained already while the request was queued */
+      stream->flags |= DYAD_FLAG_FULL;
+      stream_sent(stream, 0);
+    }
+    if (requests & DYAD_REMOTE_CLOSE) {
+      dyad_close(stream);
+    } else if (requests & DYAD_REMOTE_END) {
+      dyad_end(stream);
+    }
+  }
+  vec_clear(&r->handlingStreams);
+}
+
+
+static void reactor_onWake(dyad_Event *e) {
+  reactor_handleRemoteRequests(e->stream->reactor);
+}
+
+
+static void reactor_initWake(dyad_Reactor *r) {
+#ifndef _WIN32
+  dyad_Socket fds[2];
+  dyad_Stream *stream;
+  if (r->wakeSockfd != INVALID_SOCKET) {
+    close(r->wakeSockfd);
+    r->wakeSockfd = INVALID_SOCKET;
+  }
+#ifdef __linux__
+  /* Both ends share the one eventfd; writes to it just add to its counter */
+  fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fds[0] == -1) {
+    return;
+  }
+  fds[1] = dup(fds[0]);
+  if (fds[1] == -1) {
+    close(fds[0]);
+    return;
+  }
+#else
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    return;
+  }
+#endif
+  stream = reactor_newStream(r);
+  r->streamCount--;
+  r->wakeStream = stream;
+  stream->sockfd = fds[0];
+  stream->state = DYAD_STATE_CONNECTED;
+  stream->flags |= DYAD_FLAG_READY | DYAD_FLAG_WAKE;
+  stream_setSocketNonBlocking(stream, 1);
+  dyad_addListener(stream, DYAD_EVENT_DATA, reactor_onWake, NULL);
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+  mutex_lock(&r->mutex);
+  r->wakeSockfd = fds[1];
+  mutex_unlock(&r->mutex);
+  stream_updateInterest(stream);
+#else
+  /* Without a wake up socket requests from other threads are handled once
+   * the reactor's wait times out */
+  (void) r;
+#endif
+}
+
+
+static void reactor_closeWake(dyad_Reactor *r) {
+  if (r->wakeStream) {
+    dyad_Stream *stream = r->wakeStream;
+    dyad_close(stream);
+    /* Only called once the ring has been or is about to be torn down */
+    stream->uringOps = 0;
+    stream_destroy(stream);
+  }
+  mutex_lock(&r->mutex);
+  if (r->wakeSockfd != INVALID_SOCKET) {
+    close(r->wakeSockfd);
+    r->wakeSockfd = INVALID_SOCKET;
+  }
+  mutex_unlock(&r->mutex);
+}
+
+
+static void reactor_shutdown(dyad_Reactor *r) {
+  int i;
+  /* Handle anything other threads requested before the streams are closed */
+  reactor_handleRemoteRequests(r);
+  /* Close and destroy all the streams */
+#ifdef DYAD_HAS_URING
+  if (r->backend == DYAD_BACKEND_URING) {
+    for (i = 0; i < r->streams.length; i++) {
+      dyad_close(r->streams.data[i]);
+    }
+    uring_drain(r);
+  }
+#endif
+  while (r->streams.length > 0) {
+    dyad_Stream *stream = r->streams.data[r->streams.length - 1];
+    dyad_close(stream);
+    stream_destroy(stream);
+  }
+  reactor_closeWake(r);
+  /* Clear up everything */
+  select_deinit(&r->selectSet);
+#ifdef DYAD_HAS_EPOLL
+  epoll_deinit(r);
+#endif
+#ifdef DYAD_HAS_URING
+  uring_deinit(&r->uring);
+#endif
+  while (r->slabs.length > 0) {
+    dyad_Stream *slab = r->slabs.data[--r->slabs.length];
+    for (i = 0; i < DYAD_SLAB_SIZE; i++) {
+      vec_deinit(&slab_getStream(slab, i)->listeners);
+    }
+    dyad_free(slab);
+  }
+  vec_deinit(&r->streams);
+  vec_deinit(&r->slabs);
+  vec_deinit(&r->freeStreams);
+  vec_deinit(&r->writtenStreams);
+  vec_deinit(&r->flushingStreams);
+  vec_deinit(&r->rearmStreams);
+  vec_deinit(&r->closedStreams);
+  vec_deinit(&r->acceptStreams);
+  vec_deinit(&r->acceptRetryStreams);
+  vec_deinit(&r->remoteStreams);
+  vec_deinit(&r->handlingStreams);
+  mutex_deinit(&r->mutex);
+  timer_wheel_free(r->timers);
+  r->timers = NULL;
+  /* The reactor is initialized again if it's used after this */
+  r->initialized = 0;
+}
+
+
+
+/*===========================================================================*/
+/* API                                                                       */
+/*===========================================================================*/
+
+/*---------------------------------------------------------------------------*/
+/* Core                                                                      */
+/*---------------------------------------------------------------------------*/
 
-    stream = stream->next;
+void dyad_update(void) {
+  dyad_Reactor *r = getReactor();
+  /* The thread which updates the default reactor is the one it's bound to */
+  dyad_currentReactor = r;
+#ifndef _WIN32
+  if (!r->wakeStream) {
+    reactor_initWake(r);
+  }
+#endif
+  destroyClosedStreams(r);
+  timer_wheel_advance(r->timers, dyad_getTime());
+  reactor_handleRemoteRequests(r);
+  reactor_acceptPending(r);
+
+#ifdef DYAD_HAS_URING
+  if (r->backend == DYAD_BACKEND_URING) {
+    uring_update(r);
+    return;
+  }
+#endif
+#ifdef DYAD_HAS_EPOLL
+  if (r->backend == DYAD_BACKEND_EPOLL) {
+    epoll_update(r);
+    return;
   }
+#endif
+  select_update(r);
 }
 
 
@@ -806,17 +2484,18 @@ void dyad_init(void) {
   /* Stops the SIGPIPE signal being raised when writing to a closed socket */
   signal(SIGPIPE, SIG_IGN);
 #endif
+  /* The initializing thread runs the default reactor unless it sets another */
+  if (!dyad_currentReactor) {
+    dyad_currentReactor = &dyad_defaultReactor;
+  }
 }
 
 
 void dyad_shutdown(void) {
-  /* Close and destroy all the streams */
-  while (dyad_streams) {
-    dyad_close(dyad_streams);
-    stream_destroy(dyad_streams);
-  }
-  /* Clear up everything */
-  select_deinit(&dyad_selectSet);
+  /* The streams are closed from here, so the reactor is bound to the thread
+   * shutting it down */
+  dyad_currentReactor = getReactor();
+  reactor_shutdown(dyad_currentReactor);
 #ifdef _WIN32
   WSACleanup();
 #endif
@@ -842,17 +2521,119 @@ double dyad_getTime(void) {
 
 
 int dyad_getStreamCount(void) {
-  return dyad_streamCount;
+  return getReactor()->streamCount;
 }
 
 
 void dyad_setTickInterval(double seconds) {
-  dyad_tickInterval = seconds;
+  getReactor()->tickInterval = seconds;
 }
 
 
 void dyad_setUpdateTimeout(double seconds) {
-  dyad_updateTimeout = seconds;
+  getReactor()->updateTimeout = seconds;
+}
+
+
+void dyad_setAcceptBudget(int count) {
+  getReactor()->acceptBudget = count > 0 ? count : 1;
+}
+
+
+int dyad_setBackend(int backend) {
+  dyad_Reactor *r = getReactor();
+  dyad_Stream *stream;
+  int i;
+  switch (backend) {
+    case DYAD_BACKEND_SELECT:
+#ifdef DYAD_HAS_EPOLL
+    case DYAD_BACKEND_EPOLL:
+#endif
+#ifdef DYAD_HAS_URING
+    case DYAD_BACKEND_URING:
+#endif
+      break;
+    default:
+      return -1;
+  }
+#ifdef DYAD_HAS_URING
+  /* Operations queued in the kernel can't be moved to another backend, so
+   * io_uring can only be switched to or from before any streams exist. The
+   * ring is torn down by dyad_shutdown() and made again here */
+  if (backend == DYAD_BACKEND_URING || r->backend == DYAD_BACKEND_URING) {
+    if (backend == r->backend && r->uring.fd != -1) return 0;
+    if (r->streamCount > 0) return -1;
+    /* The wake up stream is made again on the next update */
+    reactor_closeWake(r);
+    uring_deinit(&r->uring);
+    if (backend == DYAD_BACKEND_URING && uring_init(&r->uring) != 0) {
+      if (r->backend == DYAD_BACKEND_URING) {
+        r->backend = DYAD_BACKEND_SELECT;
+      }
+      return -1;
+    }
+  }
+#endif
+  if (backend == r->backend) return 0;
+#ifdef DYAD_HAS_EPOLL
+  epoll_deinit(r);
+#endif
+  r->backend = backend;
+  /* Register the existing streams with the new backend */
+  vec_clear(&r->writtenStreams);
+  for (i = 0; i < r->streams.length; i++) {
+    stream = r->streams.data[i];
+    stream->events = 0;
+    stream_updateInterest(stream);
+    if (stream->flags & DYAD_FLAG_WRITTEN) {
+      vec_push(&r->writtenStreams, stream);
+    }
+  }
+  return 0;
+}
+
+
+int dyad_getBackend(void) {
+  return getReactor()->backend;
+}
+
+
+dyad_Reactor *dyad_newReactor(void) {
+  dyad_Reactor *r = dyad_realloc(NULL, sizeof(*r));
+  reactor_init(r);
+  return r;
+}
+
+
+void dyad_destroyReactor(dyad_Reactor *reactor) {
+  /* The reactor is made current while it shuts down so that the handlers of
+   * the CLOSE and DESTROY events act on it */
+  dyad_Reactor *prev = dyad_currentReactor;
+  dyad_currentReactor = reactor;
+  if (reactor->initialized) {
+    reactor_shutdown(reactor);
+  }
+  dyad_currentReactor = (prev == reactor) ? NULL : prev;
+  if (reactor != &dyad_defaultReactor) {
+    dyad_free(reactor);
+  }
+}
+
+
+void dyad_setReactor(dyad_Reactor *reactor) {
+  dyad_currentReactor = reactor;
+}
+
+
+dyad_Reactor *dyad_getReactor(void) {
+  return getReactor();
+}
+
+
+void dyad_wakeReactor(dyad_Reactor *reactor) {
+  mutex_lock(&reactor->mutex);
+  reactor_wake(reactor);
+  mutex_unlock(&reactor->mutex);
 }
 
 
@@ -868,16 +2649,7 @@ dyad_PanicCallback dyad_atPanic(dyad_PanicCallback func) {
 /*---------------------------------------------------------------------------*/
 
 dyad_Stream *dyad_newStream(void) {
-  dyad_Stream *stream = dyad_realloc(NULL, sizeof(*stream));
-  memset(stream, 0, sizeof(*stream));
-  stream->state = DYAD_STATE_CLOSED;
-  stream->sockfd = INVALID_SOCKET;
-  stream->lastActivity = dyad_getTime();
-  /* Add to list and increment count */
-  stream->next = dyad_streams;
-  dyad_streams = stream;
-  dyad_streamCount++;
-  return stream;
+  return reactor_newStream(getReactor());
 }
 
 
@@ -921,10 +2693,25 @@ void dyad_removeAllListeners(dyad_Stream *stream, int event) {
 
 void dyad_close(dyad_Stream *stream) {
   dyad_Event e;
+  if (!reactor_isLocal(stream->reactor)) {
+    mutex_lock(&stream->reactor->mutex);
+    stream_requestRemote(stream, DYAD_REMOTE_CLOSE);
+    mutex_unlock(&stream->reactor->mutex);
+    return;
+  }
   if (stream->state == DYAD_STATE_CLOSED) return;
   stream->state = DYAD_STATE_CLOSED;
+  timer_wheel_remove(stream->reactor->timers, &stream->timeoutTimer);
+  reactor_listClosed(stream->reactor, stream);
   /* Close socket */
   if (stream->sockfd != INVALID_SOCKET) {
+#ifdef DYAD_HAS_URING
+    /* The kernel holds on to the socket while it has operations queued for
+     * it; shutting it down makes them complete */
+    if (stream->uringOps || stream->uringAccepts) {
+      shutdown(stream->sockfd, SHUT_RDWR);
+    }
+#endif
     close(stream->sockfd);
     stream->sockfd = INVALID_SOCKET;
   }
@@ -934,14 +2721,21 @@ void dyad_close(dyad_Stream *stream) {
   stream_emitEvent(stream, &e);
   /* Clear buffers */
   vec_clear(&stream->lineBuffer);
-  vec_clear(&stream->writeBuffer);
+  stream_clearWriteQueue(stream);
 }
 
 
 void dyad_end(dyad_Stream *stream) {
+  if (!reactor_isLocal(stream->reactor)) {
+    mutex_lock(&stream->reactor->mutex);
+    stream_requestRemote(stream, DYAD_REMOTE_END);
+    mutex_unlock(&stream->reactor->mutex);
+    return;
+  }
   if (stream->state == DYAD_STATE_CLOSED) return;
-  if (stream->writeBuffer.length > 0) {
+  if (stream->writeQueue.length > 0) {
     stream->state = DYAD_STATE_CLOSING;
+    stream_updateInterest(stream);
   } else {
     dyad_close(stream);
   }
@@ -976,6 +2770,15 @@ int dyad_listenEx(
   optval = 1;
   setsockopt(stream->sockfd, SOL_SOCKET, SO_REUSEADDR,
              &optval, sizeof(optval));
+#ifdef SO_REUSEPORT
+  /* Set SO_REUSEPORT if asked to so that several sockets, usually one per
+   * reactor, can listen on the same port; the kernel spreads the incoming
+   * connections across them */
+  if (stream->flags & DYAD_FLAG_REUSEPORT) {
+    setsockopt(stream->sockfd, SOL_SOCKET, SO_REUSEPORT,
+               &optval, sizeof(optval));
+  }
+#endif
   /* Bind and listen */
   err = bind(stream->sockfd, ai->ai_addr, ai->ai_addrlen);
   if (err) {
@@ -990,6 +2793,7 @@ int dyad_listenEx(
   stream->state = DYAD_STATE_LISTENING;
   stream->port = port;
   stream_initAddress(stream);
+  stream_updateInterest(stream);
   /* Emit listening event */
   e = createEvent(DYAD_EVENT_LISTEN);
   e.msg = "socket is listening";
@@ -1028,6 +2832,7 @@ int dyad_connect(dyad_Stream *stream, const char *host, int port) {
   if (err) goto fail;
   connect(stream->sockfd, ai->ai_addr, ai->ai_addrlen);
   stream->state = DYAD_STATE_CONNECTING;
+  stream_updateInterest(stream);
   freeaddrinfo(ai);
   return 0;
 fail:
@@ -1037,11 +2842,17 @@ fail:
 
 
 void dyad_write(dyad_Stream *stream, const void *data, int size) {
-  const char *p = data;
-  while (size--) {
-    vec_push(&stream->writeBuffer, *p++);
-  }
-  stream->flags |= DYAD_FLAG_WRITTEN;
+  segments_push(stream_beginWrite(stream), data, size);
+  stream_endWrite(stream, size);
+}
+
+
+void dyad_writeRef(
+  dyad_Stream *stream, const void *data, int size,
+  dyad_ReleaseCallback release, void *udata
+) {
+  segments_pushRef(stream_beginWrite(stream), data, size, release, udata);
+  stream_endWrite(stream, size);
 }
 
 
@@ -1051,6 +2862,9 @@ void dyad_vwritef(dyad_Stream *stream, const char *fmt, va_list args) {
   char f[] = "%_";
   FILE *fp;
   int c;
+  char ch;
+  SegmentQueue *out = stream_beginWrite(stream);
+  int start = out->length;
   while (*fmt) {
     if (*fmt == '%') {
       fmt++;
@@ -1061,27 +2875,24 @@ void dyad_vwritef(dyad_Stream *stream, const char *fmt, va_list args) {
             str = "(null)";
             goto writeStr;
           }
-          while ((c = fgetc(fp)) != EOF) {
-            vec_push(&stream->writeBuffer, c);
+          while ((c = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            segments_push(out, buf, c);
           }
           break;
         case 'c':
-          vec_push(&stream->writeBuffer, va_arg(args, int));
+          ch = va_arg(args, int);
+          segments_push(out, &ch, 1);
           break;
         case 's':
           str = va_arg(args, char*);
           if (str == NULL) str = "(null)";
           writeStr:
-          while (*str) {
-            vec_push(&stream->writeBuffer, *str++);
-          }
+          segments_push(out, str, strlen(str));
           break;
         case 'b':
           str = va_arg(args, char*);
           c = va_arg(args, int);
-          while (c--) {
-            vec_push(&stream->writeBuffer, *str++);
-          }
+          segments_push(out, str, c);
           break;
         default:
           f[1] = *fmt;
@@ -1099,11 +2910,11 @@ void dyad_vwritef(dyad_Stream *stream, const char *fmt, va_list args) {
           goto writeStr;
       }
     } else {
-      vec_push(&stream->writeBuffer, *fmt);
+      segments_push(out, fmt, 1);
     }
     fmt++;
   }
-  stream->flags |= DYAD_FLAG_WRITTEN;
+  stream_endWrite(stream, out->length - start);
 }
 
 
@@ -1116,7 +2927,13 @@ void dyad_writef(dyad_Stream *stream, const char *fmt, ...) {
 
 
 void dyad_setTimeout(dyad_Stream *stream, double seconds) {
+  dyad_Reactor *r = stream->reactor;
   stream->timeout = seconds;
+  if (seconds) {
+    timer_wheel_add(r->timers, &stream->timeoutTimer, stream->lastActivity + seconds);
+  } else {
+    timer_wheel_remove(r->timers, &stream->timeoutTimer);
+  }
 }
 
 
@@ -1126,13 +2943,38 @@ void dyad_setNoDelay(dyad_Stream *stream, int opt) {
 }
 
 
+void dyad_setWatermarks(dyad_Stream *stream, int low, int high) {
+  if (high < 1) high = 1;
+  if (low > high - 1) low = high - 1;
+  if (low < 0) low = 0;
+  stream->lowWatermark = low;
+  stream->highWatermark = high;
+}
+
+
+int dyad_setReusePort(dyad_Stream *stream, int opt) {
+#ifdef SO_REUSEPORT
+  if (opt) {
+    stream->flags |= DYAD_FLAG_REUSEPORT;
+  } else {
+    stream->flags &= ~DYAD_FLAG_REUSEPORT;
+  }
+  return 0;
+#else
+  (void) stream;
+  (void) opt;
+  return -1;
+#endif
+}
+
+
 int dyad_getState(dyad_Stream *stream) {
   return stream->state;
 }
 
 
 const char *dyad_getAddress(dyad_Stream *stream) {
-  return stream->address ? stream->address : "";
+  return stream->address;
 }
 
 
@@ -1151,6 +2993,108 @@ int dyad_getBytesReceived(dyad_Stream *stream) {
 }
 
 
+/* Safe to call from any thread, as the count of bytes waiting to be sent
+ * includes what other threads have written to the stream */
+int dyad_getPendingBytes(dyad_Stream *stream) {
+  return atomic_loadInt(&stream->pendingBytes);
+}
+
+
+int dyad_getWritable(dyad_Stream *stream) {
+  return dyad_getPendingBytes(stream) < stream->highWatermark;
+}
+
+
 dyad_Socket dyad_getSocket(dyad_Stream *stream) {
   return stream->sockfd;
 }
+
+
+dyad_Reactor *dyad_getStreamReactor(dyad_Stream *stream) {
+  return stream->reactor;
+}
+
+
+dyad_Handle dyad_getHandle(dyad_Stream *stream) {
+  dyad_Handle handle;
+  handle.reactor = stream->reactor;
+  handle.slot = stream->slot;
+  handle.generation = stream->generation;
+  return handle;
+}
+
+
+static dyad_Stream *reactor_resolveHandle(dyad_Handle handle) {
+  /* Expects the reactor's mutex to be held unless it's local */
+  dyad_Reactor *r = handle.reactor;
+  dyad_Stream *stream;
+  if (handle.slot < 0 || handle.slot >= r->slabs.length * DYAD_SLAB_SIZE) {
+    return NULL;
+  }
+  stream = slab_getStream(r->slabs.data[handle.slot / DYAD_SLAB_SIZE],
+                          handle.slot % DYAD_SLAB_SIZE);
+  return stream->generation == handle.generation ? stream : NULL;
+}
+
+
+dyad_Stream *dyad_getStream(dyad_Handle handle) {
+  /* On another thread the stream may be destroyed as soon as this returns;
+   * the memory stays valid, but writes should go through the handle */
+  dyad_Reactor *r = handle.reactor;
+  dyad_Stream *stream;
+  if (!r) return NULL;
+  if (reactor_isLocal(r)) return reactor_resolveHandle(handle);
+  mutex_lock(&r->mutex);
+  stream = reactor_resolveHandle(handle);
+  mutex_unlock(&r->mutex);
+  return stream;
+}
+
+
+static dyad_Stream *stream_beginWriteHandle(dyad_Handle handle,
+                                            SegmentQueue **queue) {
+  /* The handle is resolved under the mutex the write is queued under, which
+   * the reactor also holds while giving the stream's slot back, so the data
+   * can't end up on the stream which reuses it. Returns NULL without the
+   * mutex held if the stream is gone */
+  dyad_Reactor *r = handle.reactor;
+  dyad_Stream *stream;
+  if (!r) return NULL;
+  if (reactor_isLocal(r)) {
+    stream = reactor_resolveHandle(handle);
+    if (stream) *queue = &stream->writeQueue;
+    return stream;
+  }
+  mutex_lock(&r->mutex);
+  stream = reactor_resolveHandle(handle);
+  if (!stream) {
+    mutex_unlock(&r->mutex);
+    return NULL;
+  }
+  *queue = &stream->remoteQueue;
+  return stream;
+}
+
+
+int dyad_writeHandle(dyad_Handle handle, const void *data, int size) {
+  SegmentQueue *queue;
+  dyad_Stream *stream = stream_beginWriteHandle(handle, &queue);
+  if (!stream) return -1;
+  segments_push(queue, data, size);
+  stream_endWrite(stream, size);
+  return 0;
+}
+
+
+int dyad_writeRefHandle(
+  dyad_Handle handle, const void *data, int size,
+  dyad_ReleaseCallback release, void *udata
+) {
+  /* The reference isn't taken if the stream is gone */
+  SegmentQueue *queue;
+  dyad_Stream *stream = stream_beginWriteHandle(handle, &queue);
+  if (!stream) return -1;
+  segments_pushRef(queue, data, size, release, udata);
+  stream_endWrite(stream, size);
+  return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "epoch.h"
+
+static void epoch_release_record(void *arg)
+{
+  // called as the thread exits, leaving its record to the next thread...
+  epoch_record_t *record = arg;
+  atomic_store(&record->active, false);
+  atomic_store(&record->in_use, false);
+}
+
+static void epoch_init_record_key(void)
+{
+  pthread_key_create(&epoch_record_key, epoch_release_record);
+}
+
+static epoch_record_t* epoch_get_record(void)
+{
+  if (epoch_current_record)
+  {
+    return epoch_current_record;
+  }
+
+  // take over the record of a thread which has exited, or add one...
+  epoch_record_t *record = NULL;
+  for (epoch_record_t *other = atomic_load(&epoch_records); other; other = other->next)
+  {
+    bool in_use = false;
+    if (atomic_compare_exchange_strong(&other->in_use, &in_use, true))
+    {
+      record = other;
+      break;
+    }
+  }
+  if (!record)
+  {
+    record = malloc(sizeof(epoch_record_t));
+    atomic_init(&record->epoch, 0);
+    atomic_init(&record->active, false);
+    atomic_init(&record->in_use, true);
+    record->next = atomic_load(&epoch_records);
+    while (!atomic_compare_exchange_weak(&epoch_records, &record->next, record))
+    {
+    }
+  }
+  record->depth = 0;
+
+  pthread_once(&epoch_record_key_once, epoch_init_record_key);
+  pthread_setspecific(epoch_record_key, record);
+  epoch_current_record = record;
+  return record;
+}
+
+static bool epoch_try_advance(void)
+{
+  // the epoch only moves on once every thread in a critical section has
+  // seen the current one...
+  uint64_t global = atomic_load(&epoch_global);
+  for (epoch_record_t *record = atomic_load(&epoch_records); record; record = record->next)
+  {
+    if (atomic_load(&record->active) && atomic_load(&record->epoch) != global)
+    {
+      return false;
+    }
+  }
+  return atomic_compare_exchange_strong(&epoch_global, &global, global + 1);
+}
+
+static void epoch_free_retired(epoch_retired_t *retired)
+{
+  while (retired)
+  {
+    epoch_retired_t *next = retired->next;
+    retired->free_func(retired->object);
+    free(retired);
+    retired = next;
+  }
+}
+
+static epoch_retired_t* epoch_take_reclaimable(void)
+{
+  // expects the retired list to be locked, takes the objects retired at
+  // least two epochs ago...
+  uint64_t global = atomic_load(&epoch_global);
+  epoch_retired_t *reclaimable = NULL;
+  epoch_retired_t **next = &epoch_retired_head;
+  while (*next)
+  {
+    epoch_retired_t *retired = *next;
+    if (retired->epoch + 2 <= global)
+    {
+      *next = retired->next;
+      retired->next = reclaimable;
+      reclaimable = retired;
+      epoch_num_retired--;
+    }
+    else
+    {
+      next = &retired->next;
+    }
+  }
+  return reclaimable;
+}
+
+void epoch_enter(void)
+{
+  // critical sections nest, only the outermost one is announced. the
+  // record is marked active before the epoch is read, so that the epoch
+  // can't move on twice without it being seen...
+  epoch_record_t *record = epoch_get_record();
+  if (record->depth++ > 0)
+  {
+    return;
+  }
+  atomic_store(&record->active, true);
+  atomic_store(&record->epoch, atomic_load(&epoch_global));
+}
+
+void epoch_exit(void)
+{
+  epoch_record_t *record = epoch_get_record();
+  if (--record->depth > 0)
+  {
+    return;
+  }
+  atomic_store_explicit(&record->active, false, memory_order_release);
+}
+
+void epoch_retire(void *object, epoch_free_func_t free_func)
+{
+  if (!object)
+  {
+    return;
+  }
+
+  epoch_retired_t *retired = malloc(sizeof(epoch_retired_t));
+  retired->object = object;
+  retired->free_func = free_func;
+
+  pthread_mutex_lock(&epoch_retired_mutex);
+  retired->epoch = atomic_load(&epoch_global);
+  retired->next = epoch_retired_head;
+  epoch_retired_head = retired;
+  epoch_num_retired++;
+  bool collect = epoch_num_retired >= EPOCH_RECLAIM_THRESHOLD;
+  pthread_mutex_unlock(&epoch_retired_mutex);
+
+  if (collect)
+  {
+    epoch_collect();
+  }
+}
+
+void epoch_collect(void)
+{
+  epoch_try_advance();
+  pthread_mutex_lock(&epoch_retired_mutex);
+  epoch_retired_t *reclaimable = epoch_take_reclaimable();
+  pthread_mutex_unlock(&epoch_retired_mutex);
+  epoch_free_retired(reclaimable);
+}
+
+void epoch_collect_all(void)
+{
+  // frees everything that has been retired, for when no other thread can
+  // be in a critical section anymore...
+  pthread_mutex_lock(&epoch_retired_mutex);
+  epoch_retired_t *reclaimable = epoch_retired_head;
+  epoch_retired_head = NULL;
+  epoch_num_retired = 0;
+  pthread_mutex_unlock(&epoch_retired_mutex);
+  epoch_free_retired(reclaimable);
+}
@@ -11,14 +11,14 @@
 
 #include "log.h"
 #include "crypto.h"
-#include "queue.h"
+#include "registry.h"
 #include "task.h"
 
 #include "keypairinterface.h"
 
 bool keypairinterface_init(int num_keypair_entries, keypair_info_t keypair_entries[])
 {
-  keypairinterface_queue = queue_init();
+  keypairinterface_registry = registry_init();
 
   // initialize keypairs
   for (int i = 0; i < num_keypair_entries; i++)
@@ -37,7 +37,7 @@ bool keypairinterface_init(int num_keypair_entries, keypair_info_t keypair_entri
 
 bool keypairinterface_shutdown(void)
 {
-  queue_free(keypairinterface_queue);
+  registry_free(keypairinterface_registry);
 
   log_info("Shutdown keypair interface.");
   return true;
@@ -45,17 +45,17 @@ bool keypairinterface_shutdown(void)
 
 int get_next_keypair_id(void)
 {
-  return keypairinterface_next_id;
+  return atomic_load(&keypairinterface_next_id);
 }
 
 int get_num_keypairs(void)
 {
-  return queue_get_size(keypairinterface_queue);
+  return registry_get_size(keypairinterface_registry);
 }
 
 bool has_keypair(keypair_storage_t *keypair_storage)
 {
-  return queue_get_index(keypairinterface_queue, keypair_storage) != -1;
+  return keypair_storage && registry_get(keypairinterface_registry, keypair_storage->id) == keypair_storage;
 }
 
 bool has_keypair_by_id(int id)
@@ -65,13 +65,11 @@ bool has_keypair_by_id(int id)
 
 keypair_storage_t* add_keypair(keypair_info_t *keypair_info)
 {
-  keypairinterface_next_id++;
-
   keypair_storage_t *keypair_storage = malloc(sizeof(keypair_storage_t));
-  keypair_storage->id = keypairinterface_next_id;
+  keypair_storage->id = atomic_fetch_add(&keypairinterface_next_id, 1) + 1;
   keypair_storage->keypair_info = keypair_info;
 
-  queue_push_right(keypairinterface_queue, keypair_storage);
+  registry_add(keypairinterface_registry, keypair_storage->id, keypair_storage);
   return keypair_storage;
 }
 
@@ -81,7 +79,7 @@ void remove_keypair(keypair_storage_t *keypair_storage)
   {
     return;
   }
-  queue_remove_object(keypairinterface_queue, keypair_storage);
+  registry_remove(keypairinterface_registry, keypair_storage->id);
   free_keypair(keypair_storage);
 }
 
@@ -97,15 +95,12 @@ void remove_keypair_by_id(int id)
 
 keypair_storage_t* get_keypair_from_id(int id)
 {
-  for (int i = 0; i <= keypairinterface_queue->max_index; i++)
-  {
-    keypair_storage_t *keypair_storage = queue_get(keypairinterface_queue, i);
-    if (keypair_storage->id == id)
-    {
-      return keypair_storage;
-    }
-  }
-  return NULL;
+  return registry_get(keypairinterface_registry, id);
+}
+
+keypair_storage_t* get_keypair_from_index(int index)
+{
+  return registry_get_at(keypairinterface_registry, index);
 }
 
 void free_keypair(keypair_storage_t *keypair_storage)
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "lfqueue.h"
+
+static size_t lf_queue_get_capacity(size_t capacity)
+{
+  size_t rounded = 2;
+  while (rounded < capacity)
+  {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+static void* lf_queue_alloc(size_t size)
+{
+  // aligned to a cache line, so that the positions which the producers
+  // and consumers write don't share one...
+  size_t aligned_size = (size + LF_QUEUE_CACHE_LINE_SIZE - 1) & ~(size_t)(LF_QUEUE_CACHE_LINE_SIZE - 1);
+  return aligned_alloc(LF_QUEUE_CACHE_LINE_SIZE, aligned_size);
+}
+
+static lf_queue_cell_t* lf_queue_init_cells(size_t capacity)
+{
+  lf_queue_cell_t *cells = lf_queue_alloc(sizeof(lf_queue_cell_t) * capacity);
+  for (size_t i = 0; i < capacity; i++)
+  {
+    atomic_init(&cells[i].sequence, i);
+    cells[i].object = NULL;
+  }
+  return cells;
+}
+
+static size_t lf_queue_get_size(atomic_size_t *head, atomic_size_t *tail, size_t capacity)
+{
+  // only a snapshot while the other threads carry on...
+  size_t head_position = atomic_load_explicit(head, memory_order_acquire);
+  size_t tail_position = atomic_load_explicit(tail, memory_order_acquire);
+  size_t size = tail_position - head_position;
+  return size > capacity ? (tail_position < head_position ? 0 : capacity) : size;
+}
+
+mpsc_queue_t* mpsc_queue_init(size_t capacity)
+{
+  capacity = lf_queue_get_capacity(capacity);
+  mpsc_queue_t *queue = lf_queue_alloc(sizeof(mpsc_queue_t));
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  queue->mask = capacity - 1;
+  queue->cells = lf_queue_init_cells(capacity);
+  return queue;
+}
+
+void mpsc_queue_free(mpsc_queue_t *queue)
+{
+  free(queue->cells);
+  free(queue);
+}
+
+size_t mpsc_queue_get_capacity(mpsc_queue_t *queue)
+{
+  return queue->mask + 1;
+}
+
+size_t mpsc_queue_get_size(mpsc_queue_t *queue)
+{
+  return lf_queue_get_size(&queue->head, &queue->tail, queue->mask + 1);
+}
+
+bool mpsc_queue_push(mpsc_queue_t *queue, void *object)
+{
+  // claim the tail position once its cell has been read by the consumer,
+  // the cell is then published by moving its sequence on...
+  size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  lf_queue_cell_t *cell;
+  for (;;)
+  {
+    cell = &queue->cells[position & queue->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+    if (difference == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1,
+        memory_order_relaxed, memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      return false;
+    }
+    else
+    {
+      position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+
+  cell->object = object;
+  atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+  return true;
+}
+
+void* mpsc_queue_pop(mpsc_queue_t *queue)
+{
+  size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  lf_queue_cell_t *cell = &queue->cells[position & queue->mask];
+  if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != position + 1)
+  {
+    return NULL;
+  }
+
+  void *object = cell->object;
+  atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+  atomic_store_explicit(&queue->head, position + 1, memory_order_release);
+  return object;
+}
+
+spsc_queue_t* spsc_queue_init(size_t capacity)
+{
+  capacity = lf_queue_get_capacity(capacity);
+  spsc_queue_t *queue = lf_queue_alloc(sizeof(spsc_queue_t));
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  queue->cached_head = 0;
+  queue->cached_tail = 0;
+  queue->mask = capacity - 1;
+  queue->objects = lf_queue_alloc(sizeof(void*) * capacity);
+  return queue;
+}
+
+void spsc_queue_free(spsc_queue_t *queue)
+{
+  free(queue->objects);
+  free(queue);
+}
+
+size_t spsc_queue_get_capacity(spsc_queue_t *queue)
+{
+  return queue->mask + 1;
+}
+
+size_t spsc_queue_get_size(spsc_queue_t *queue)
+{
+  return lf_queue_get_size(&queue->head, &queue->tail, queue->mask + 1);
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, void *object)
+{
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail - queue->cached_head > queue->mask)
+  {
+    queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - queue->cached_head > queue->mask)
+    {
+      return false;
+    }
+  }
+
+  queue->objects[tail & queue->mask] = object;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+void* spsc_queue_pop(spsc_queue_t *queue)
+{
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head == queue->cached_tail)
+  {
+    queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == queue->cached_tail)
+    {
+      return NULL;
+    }
+  }
+
+  void *object = queue->objects[head & queue->mask];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return object;
+}
+
+spmc_queue_t* spmc_queue_init(size_t capacity)
+{
+  capacity = lf_queue_get_capacity(capacity);
+  spmc_queue_t *queue = lf_queue_alloc(sizeof(spmc_queue_t));
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  queue->mask = capacity - 1;
+  queue->cells = lf_queue_init_cells(capacity);
+  return queue;
+}
+
+void spmc_queue_free(spmc_queue_t *queue)
+{
+  free(queue->cells);
+  free(queue);
+}
+
+size_t spmc_queue_get_capacity(spmc_queue_t *queue)
+{
+  return queue->mask + 1;
+}
+
+size_t spmc_queue_get_size(spmc_queue_t *queue)
+{
+  return lf_queue_get_size(&queue->head, &queue->tail, queue->mask + 1);
+}
+
+bool spmc_queue_push(spmc_queue_t *queue, void *object)
+{
+  size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  lf_queue_cell_t *cell = &queue->cells[position & queue->mask];
+  if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != position)
+  {
+    return false;
+  }
+
+  cell->object = object;
+  atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+  atomic_store_explicit(&queue->tail, position + 1, memory_order_release);
+  return true;
+}
+
+void* spmc_queue_pop(spmc_queue_t *queue)
+{
+  // claim the head position once its cell has been published, the cell
+  // is then handed back to the producer for the next turn of the ring...
+  size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  lf_queue_cell_t *cell;
+  for (;;)
+  {
+    cell = &queue->cells[position & queue->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+    if (difference == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+        memory_order_relaxed, memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      return NULL;
+    }
+    else
+    {
+      position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+  }
+
+  void *object = cell->object;
+  atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+  return object;
+}
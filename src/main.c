@@ -14,6 +14,7 @@
 
 #include "log.h"
 #include "util.h"
+#include "bufferpool.h"
 #include "crypto.h"
 #include "task.h"
 #include "net.h"
@@ -32,6 +33,11 @@ typedef enum Argument
   CMD_ARG_BIND_ADDRESS,
   CMD_ARG_BIND_PORT,
   CMD_ARG_NO_PORT_MAPPING,
+  CMD_ARG_EVENT_BACKEND,
+  CMD_ARG_NUM_REACTORS,
+  CMD_ARG_NUM_SCHEDULERS,
+  CMD_ARG_WIRE_FORMAT,
+  CMD_ARG_MAX_FRAME_SIZE,
   CMD_ARG_CONNECT,
 
   CMD_ARG_GEN_KEYPAIR,
@@ -56,6 +62,11 @@ static argument_map_t arguments_map[] = {
   {"bind-port", CMD_ARG_BIND_PORT, "<port> Sets the host bind port.", 1},
   {"allow-local-ip", CMD_ARG_ALLOW_LOCAL_IP, "Allow incoming LAN based peer connections.", 0},
   {"disable-port-mapping", CMD_ARG_NO_PORT_MAPPING, "Disables IGD port mapping via miniupnpc.", 0},
+  {"event-backend", CMD_ARG_EVENT_BACKEND, "<select, epoll, uring> Sets the network event backend.", 1},
+  {"reactors", CMD_ARG_NUM_REACTORS, "<count> Sets the number of network reactors, 0 for one per logical core.", 1},
+  {"schedulers", CMD_ARG_NUM_SCHEDULERS, "<count> Sets the number of task schedulers, 0 for one per logical core.", 1},
+  {"wire-format", CMD_ARG_WIRE_FORMAT, "<version> Sets the latest wire format version offered to peers.", 1},
+  {"max-frame-size", CMD_ARG_MAX_FRAME_SIZE, "<bytes> Sets the largest frame accepted from peers.", 1},
   {"connect", CMD_ARG_CONNECT, "<address, port> Attempts to connect to the specified peer.", 2},
 
   {"generate-keypair", CMD_ARG_GEN_KEYPAIR, "Generates a new cryptographically safe keypair and exports it.", 0},
@@ -153,6 +164,63 @@ bool parse_arguments(int argc, char **argv)
       case CMD_ARG_NO_PORT_MAPPING:
         net_set_want_port_mapping(false);
         break;
+      case CMD_ARG_EVENT_BACKEND:
+        {
+          i++;
+          const char *event_backend = argv[i];
+          if (string_equals(event_backend, "select"))
+          {
+            net_set_event_backend(DYAD_BACKEND_SELECT);
+          }
+          else if (string_equals(event_backend, "epoll"))
+          {
+            net_set_event_backend(DYAD_BACKEND_EPOLL);
+          }
+          else if (string_equals(event_backend, "uring"))
+          {
+            net_set_event_backend(DYAD_BACKEND_URING);
+          }
+          else
+          {
+            log_error("Unknown network event backend: <%s>!", event_backend);
+            return false;
+          }
+          break;
+        }
+      case CMD_ARG_NUM_REACTORS:
+        i++;
+        net_set_num_reactors(atoi(argv[i]));
+        break;
+      case CMD_ARG_NUM_SCHEDULERS:
+        i++;
+        taskmgr_set_num_schedulers(atoi(argv[i]));
+        break;
+      case CMD_ARG_WIRE_FORMAT:
+        {
+          i++;
+          int wire_version = atoi(argv[i]);
+          if (wire_version < WIRE_VERSION_1 || wire_version > WIRE_VERSION_LATEST)
+          {
+            log_error("Unknown wire format version: <%s>!", argv[i]);
+            return false;
+          }
+          net_set_max_wire_version(wire_version);
+          break;
+        }
+      case CMD_ARG_MAX_FRAME_SIZE:
+        {
+          // frames of the formats limited to 64 KiB are always accepted...
+          i++;
+          int max_frame_size = atoi(argv[i]);
+          int min_frame_size = WIRE_V1_ENCRYPTED_FRAME_HEADER_SIZE + UINT16_MAX;
+          if (max_frame_size < min_frame_size)
+          {
+            log_error("Maximum frame size <%s> must be at least <%d> bytes!", argv[i], min_frame_size);
+            return false;
+          }
+          net_set_max_frame_size(max_frame_size);
+          break;
+        }
       case CMD_ARG_CONNECT:
         {
           i++;
@@ -234,6 +302,7 @@ void terminate(int sig)
     log_error("Failed to shutdown taskmgr!");
     return;
   }
+  buffer_pool_clear();
   log_info("Core shutdown.");
 }
 
@@ -11,15 +11,16 @@
 #include <time.h>
 
 #include "log.h"
-#include "queue.h"
+#include "registry.h"
 #include "task.h"
 
 #include "msginterface.h"
 
 bool msginterface_init(void)
 {
-  msginterface_queue = queue_init();
-  msginterface_poll_task = add_task(poll_msginterface, 0);
+  msginterface_registry = registry_init();
+  msginterface_poll_task = add_task_ex(poll_msginterface, MSGINTERFACE_POLL_DELAY, TASK_PRIORITY_LOW, 0,
+    NULL, 0, NULL);
 
   log_info("Initialized msg interface.");
   return true;
@@ -28,7 +29,7 @@ bool msginterface_init(void)
 bool msginterface_shutdown(void)
 {
   remove_task(msginterface_poll_task);
-  queue_free(msginterface_queue);
+  registry_free(msginterface_registry);
 
   log_info("Shutdown msg interface.");
   return true;
@@ -36,7 +37,7 @@ bool msginterface_shutdown(void)
 
 bool has_msg(pending_msg_t *pending_msg)
 {
-  return queue_get_index(msginterface_queue, pending_msg) != -1;
+  return pending_msg && registry_get(msginterface_registry, pending_msg->id) == pending_msg;
 }
 
 bool has_msg_by_id(int id)
@@ -49,27 +50,51 @@ bool has_msg_by_checksum(const char *checksum)
   return get_msg_from_checksum(checksum) != NULL;
 }
 
+static pending_msg_t* find_msg_from_checksum(const char *checksum)
+{
+  for (int i = 0; i < registry_get_size(msginterface_registry); i++)
+  {
+    pending_msg_t *pending_msg = registry_get_at(msginterface_registry, i);
+    if (pending_msg && memcmp(pending_msg->checksum, checksum, MSG_CHECKSUM_SIZE) == 0)
+    {
+      return pending_msg;
+    }
+  }
+  return NULL;
+}
+
 pending_msg_t* add_msg(const char* checksum, int size, time_t timestamp)
 {
-  msginterface_next_id++;
+  // the same message may be relayed to us by several peers at once, only
+  // the first of them to get here adds it...
+  pthread_mutex_lock(&msginterface_mutex);
+  if (find_msg_from_checksum(checksum))
+  {
+    pthread_mutex_unlock(&msginterface_mutex);
+    return NULL;
+  }
 
   pending_msg_t *pending_msg = malloc(sizeof(pending_msg_t));
-  pending_msg->id = msginterface_next_id;
-  pending_msg->checksum = checksum;
+  pending_msg->id = atomic_fetch_add(&msginterface_next_id, 1) + 1;
+  memcpy(pending_msg->checksum, checksum, MSG_CHECKSUM_SIZE);
   pending_msg->size = size;
   pending_msg->timestamp = timestamp;
 
-  queue_push_right(msginterface_queue, pending_msg);
+  registry_add(msginterface_registry, pending_msg->id, pending_msg);
+  pthread_mutex_unlock(&msginterface_mutex);
   return pending_msg;
 }
 
 void remove_msg(pending_msg_t *pending_msg)
 {
+  pthread_mutex_lock(&msginterface_mutex);
   if (!has_msg(pending_msg))
   {
+    pthread_mutex_unlock(&msginterface_mutex);
     return;
   }
-  queue_remove_object(msginterface_queue, pending_msg);
+  registry_remove(msginterface_registry, pending_msg->id);
+  pthread_mutex_unlock(&msginterface_mutex);
   free_msg(pending_msg);
 }
 
@@ -85,15 +110,7 @@ void remove_msg_by_id(int id)
 
 pending_msg_t* get_msg_from_id(int id)
 {
-  for (int i = 0; i <= msginterface_queue->max_index; i++)
-  {
-    pending_msg_t *pending_msg = queue_get(msginterface_queue, i);
-    if (pending_msg->id == id)
-    {
-      return pending_msg;
-    }
-  }
-  return NULL;
+  return registry_get(msginterface_registry, id);
 }
 
 bool get_msg_has_expired(time_t timestamp)
@@ -104,21 +121,15 @@ bool get_msg_has_expired(time_t timestamp)
 
 pending_msg_t* get_msg_from_checksum(const char *checksum)
 {
-  for (int i = 0; i <= msginterface_queue->max_index; i++)
-  {
-    pending_msg_t *pending_msg = queue_get(msginterface_queue, i);
-    if (strcmp(pending_msg->checksum, checksum) == 0)
-    {
-      return pending_msg;
-    }
-  }
-  return NULL;
+  pthread_mutex_lock(&msginterface_mutex);
+  pending_msg_t *pending_msg = find_msg_from_checksum(checksum);
+  pthread_mutex_unlock(&msginterface_mutex);
+  return pending_msg;
 }
 
 void free_msg(pending_msg_t *pending_msg)
 {
   pending_msg->id = -1;
-  pending_msg->checksum = NULL;
   pending_msg->size = 0;
   pending_msg->timestamp = 0;
   free(pending_msg);
@@ -134,23 +145,23 @@ void free_msg_by_id(int id)
   free_msg(pending_msg);
 }
 
-task_result_t poll_msginterface(task_t *task, va_list args)
+task_result_t poll_msginterface(task_t *task)
 {
-  if (!queue_get_empty(msginterface_queue))
+  // messages only expire after several seconds, so rather than checking
+  // one message per run, check all of them every so often. walking them
+  // backwards, the message moved into a removed one's place has been
+  // checked already...
+  pthread_mutex_lock(&msginterface_mutex);
+  for (int i = registry_get_size(msginterface_registry) - 1; i >= 0; i--)
   {
-    pending_msg_t *pending_msg = queue_pop_left(msginterface_queue);
-    if (!pending_msg)
-    {
-      return TASK_RESULT_CONT;
-    }
-    if (!get_msg_has_expired(pending_msg->timestamp))
-    {
-      queue_push_right(msginterface_queue, pending_msg);
-    }
-    else
+    pending_msg_t *pending_msg = registry_get_at(msginterface_registry, i);
+    if (!pending_msg || !get_msg_has_expired(pending_msg->timestamp))
     {
-      free_msg(pending_msg);
+      continue;
     }
+    registry_remove(msginterface_registry, pending_msg->id);
+    free_msg(pending_msg);
   }
-  return TASK_RESULT_CONT;
+  pthread_mutex_unlock(&msginterface_mutex);
+  return TASK_RESULT_WAIT;
 }
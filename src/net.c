@@ -7,17 +7,23 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
 #include <miniupnpc/upnperrors.h>
 
 #include "log.h"
+#include "util.h"
 #include "dyad.h"
 #include "queue.h"
+#include "epoch.h"
 #include "crypto.h"
 #include "netbase.h"
 #include "buffer.h"
+#include "ringbuffer.h"
 #include "protocol.h"
 #include "version.h"
 
@@ -26,49 +32,160 @@
 bool net_init(int num_connection_entries, connection_entry_t connection_entries[])
 {
   dyad_init();
-  dyad_setTickInterval(DEFAULT_SOCKET_TIMEOUT);
-  dyad_setUpdateTimeout(DEFAULT_SOCKET_TIMEOUT);
 
   net_accept_queue = queue_init();
   net_connection_queue = queue_init();
+  net_init_connection_pool(CONNECTION_POOL_SIZE);
 
-  // initialize the socket
-  dyad_Stream *net_stream = dyad_newStream();
-  if (!net_open_tcp_server(net_stream, net_bind_address, net_bind_port, net_backlog))
+  net_num_connection_entries = num_connection_entries;
+  net_connection_entries = connection_entries;
+
+  if (net_want_port_mapping)
+  {
+    net_setup_portmapping(net_bind_port);
+  }
+
+  // the network streams are sharded across several reactors, one per
+  // logical core by default, each of which owns its streams. the first
+  // reactor is driven by the poll events task and the others by their
+  // own threads...
+  int num_reactors = net_num_reactors;
+  if (num_reactors <= 0)
+  {
+    num_reactors = get_num_logical_cores();
+  }
+  if (num_reactors <= 0)
+  {
+    num_reactors = 1;
+  }
+
+  net_reactors = calloc(num_reactors, sizeof(net_reactor_t));
+  net_num_running_reactors = num_reactors;
+  net_reactors_terminated = false;
+  for (int i = 0; i < num_reactors; i++)
+  {
+    net_reactor_t *net_reactor = &net_reactors[i];
+    net_reactor->id = i;
+    net_reactor->reactor = i == 0 ? dyad_getReactor() : dyad_newReactor();
+  }
+
+  if (!net_init_reactor(&net_reactors[0]))
   {
     return false;
   }
 
-  // initialize all connections
-  for (int i = 0; i < num_connection_entries; i++)
+  for (int i = 1; i < num_reactors; i++)
   {
-    connection_entry_t connection_entry = connection_entries[i];
-    dyad_Stream *conn_stream = dyad_newStream();
-    if (!net_open_tcp_connection(conn_stream, connection_entry.address, connection_entry.port))
+    net_reactor_t *net_reactor = &net_reactors[i];
+    if (pthread_create(&net_reactor->thread, NULL, net_reactor_run, net_reactor) != 0)
     {
-      continue;
+      log_error("Failed to initialize network reactor thread!");
+      return false;
     }
   }
 
-  net_poll_events_task = add_task(net_poll_events, 0);
-  net_poll_resync_task = add_task(net_poll_resync_peers, PEERLIST_RESYNC_DELAY);
-  log_info("Initialized net.");
+  // the task manager waits for network events on the first reactor
+  // while it has no tasks to run...
+  taskmgr_set_wait_func(net_wait_events, net_wake_events);
+  net_poll_resync_task = add_task_ex(net_poll_resync_peers, PEERLIST_RESYNC_DELAY, TASK_PRIORITY_LOW, 0,
+    NULL, 0, NULL);
+  log_info("Initialized net with %d reactor(s).", num_reactors);
   return true;
 }
 
 bool net_shutdown(void)
 {
-  remove_task(net_poll_events_task);
+  taskmgr_set_wait_func(NULL, NULL);
   remove_task(net_poll_resync_task);
 
+  // stop the reactor threads, then close the streams of their reactors
+  net_reactors_terminated = true;
+  for (int i = 1; i < net_num_running_reactors; i++)
+  {
+    net_reactor_t *net_reactor = &net_reactors[i];
+    dyad_wakeReactor(net_reactor->reactor);
+    pthread_join(net_reactor->thread, NULL);
+    dyad_destroyReactor(net_reactor->reactor);
+  }
+
+  free(net_reactors);
+  net_reactors = NULL;
+  net_num_running_reactors = 0;
+
+  dyad_shutdown();
+
+  // the reactors are gone, so nothing can still be using what was retired...
+  epoch_collect_all();
+
   queue_free(net_accept_queue);
   queue_free(net_connection_queue);
+  net_free_connection_pool();
 
-  dyad_shutdown();
   log_info("Shutdown net.");
   return true;
 }
 
+bool net_init_reactor(net_reactor_t *net_reactor)
+{
+  dyad_setReactor(net_reactor->reactor);
+  if (dyad_setBackend(net_event_backend) != 0)
+  {
+    log_warning("Network event backend <%d> is unavailable, falling back to select!", net_event_backend);
+    dyad_setBackend(DYAD_BACKEND_SELECT);
+  }
+
+  // the reactor blocks until it has network events or the timeout expires,
+  // other threads wake it up when they want something from it...
+  dyad_setTickInterval(DEFAULT_REACTOR_TIMEOUT);
+  dyad_setUpdateTimeout(DEFAULT_REACTOR_TIMEOUT);
+
+  // every reactor listens on the bind port with its own socket, and the
+  // kernel spreads the incoming connections across them. without
+  // SO_REUSEPORT only the first reactor can listen...
+  net_reactor->stream = dyad_newStream();
+  bool shared_port = dyad_setReusePort(net_reactor->stream, net_num_running_reactors > 1) == 0;
+  if (net_reactor->id == 0 || shared_port)
+  {
+    if (!net_open_tcp_server(net_reactor->stream, net_bind_address, net_bind_port, net_backlog))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    dyad_close(net_reactor->stream);
+    net_reactor->stream = NULL;
+  }
+
+  // initialize this reactor's share of the connections
+  for (int i = net_reactor->id; i < net_num_connection_entries; i += net_num_running_reactors)
+  {
+    connection_entry_t connection_entry = net_connection_entries[i];
+    dyad_Stream *conn_stream = dyad_newStream();
+    if (!net_open_tcp_connection(conn_stream, connection_entry.address, connection_entry.port))
+    {
+      continue;
+    }
+  }
+  return true;
+}
+
+void* net_reactor_run(void *arg)
+{
+  net_reactor_t *net_reactor = arg;
+  if (!net_init_reactor(net_reactor))
+  {
+    log_error("Failed to initialize network reactor <%d>!", net_reactor->id);
+    return NULL;
+  }
+
+  while (!net_reactors_terminated)
+  {
+    dyad_update();
+  }
+  return NULL;
+}
+
 void net_set_bind_address(const char *address)
 {
   net_bind_address = address;
@@ -109,14 +226,101 @@ bool net_get_want_port_mapping(void)
   return net_want_port_mapping;
 }
 
+void net_set_event_backend(int event_backend)
+{
+  net_event_backend = event_backend;
+}
+
+int net_get_event_backend(void)
+{
+  return net_event_backend;
+}
+
+void net_set_num_reactors(int num_reactors)
+{
+  net_num_reactors = num_reactors;
+}
+
+int net_get_num_reactors(void)
+{
+  return net_num_reactors;
+}
+
+void net_set_max_wire_version(int wire_version)
+{
+  net_max_wire_version = wire_version;
+}
+
+int net_get_max_wire_version(void)
+{
+  return net_max_wire_version;
+}
+
+void net_set_max_frame_size(size_t max_frame_size)
+{
+  net_max_frame_size = max_frame_size;
+}
+
+size_t net_get_max_frame_size(void)
+{
+  return net_max_frame_size;
+}
+
+void net_init_connection_pool(int size)
+{
+  // the connections are made up front, so that a burst of incoming
+  // connections doesn't have to allocate any...
+  for (int i = 0; i < size; i++)
+  {
+    connection_t *connection = malloc(sizeof(connection_t));
+    connection->recv_buffer = ring_buffer_init(RECV_BUFFER_SIZE);
+    connection->next = net_connection_pool;
+    net_connection_pool = connection;
+    net_connection_pool_size++;
+  }
+}
+
+void net_free_connection_pool(void)
+{
+  pthread_mutex_lock(&net_connection_pool_mutex);
+  while (net_connection_pool != NULL)
+  {
+    connection_t *connection = net_connection_pool;
+    net_connection_pool = connection->next;
+    ring_buffer_free(connection->recv_buffer);
+    free(connection);
+  }
+  net_connection_pool_size = 0;
+  pthread_mutex_unlock(&net_connection_pool_mutex);
+}
+
 connection_t* net_init_connection(dyad_Stream *stream, dyad_Stream *remote)
 {
-  connection_t *connection = malloc(sizeof(connection_t));
+  // the reactor threads share the pool of unused connections, and
+  // only allocate a new one once it runs out...
+  pthread_mutex_lock(&net_connection_pool_mutex);
+  connection_t *connection = net_connection_pool;
+  if (connection != NULL)
+  {
+    net_connection_pool = connection->next;
+    net_connection_pool_size--;
+  }
+  pthread_mutex_unlock(&net_connection_pool_mutex);
+
+  if (connection == NULL)
+  {
+    connection = malloc(sizeof(connection_t));
+    connection->recv_buffer = ring_buffer_init(RECV_BUFFER_SIZE);
+  }
+
   connection->stream = stream;
   connection->remote = remote;
+  connection->handle = dyad_getHandle(remote);
   connection->authenticated = false;
   connection->keypair_info = NULL;
   connection->encrypted = false;
+  connection->wire_version = WIRE_VERSION_1;
+  connection->next = NULL;
 
   queue_push_right(net_accept_queue, connection);
   return connection;
@@ -131,7 +335,33 @@ void net_free_connection(connection_t *connection)
   connection->keypair_info = NULL;
   connection->encrypted = false;
 
-  free(connection);
+  // the connection goes back to the pool, unless it's full, with an
+  // empty receive buffer which is no bigger than a new one's...
+  if (ring_buffer_get_capacity(connection->recv_buffer) > RECV_BUFFER_SIZE)
+  {
+    ring_buffer_free(connection->recv_buffer);
+    connection->recv_buffer = ring_buffer_init(RECV_BUFFER_SIZE);
+  }
+  else
+  {
+    ring_buffer_clear(connection->recv_buffer);
+  }
+
+  pthread_mutex_lock(&net_connection_pool_mutex);
+  if (net_connection_pool_size < CONNECTION_POOL_SIZE)
+  {
+    connection->next = net_connection_pool;
+    net_connection_pool = connection;
+    net_connection_pool_size++;
+    connection = NULL;
+  }
+  pthread_mutex_unlock(&net_connection_pool_mutex);
+
+  if (connection != NULL)
+  {
+    ring_buffer_free(connection->recv_buffer);
+    free(connection);
+  }
 }
 
 void net_setup_portmapping(int port)
@@ -200,47 +430,102 @@ void net_on_connect(dyad_Event *event)
   handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_CONNECT_REQ);
 }
 
-void net_on_data(dyad_Event *event)
+size_t net_get_frame_size(const unsigned char *header, size_t size, void *arg)
 {
-  connection_t *connection = event->udata;
-  buffer_t *buffer = buffer_init_data(0, (const unsigned char*)event->data, event->size);
-  uint16_t payload_size = buffer_read_uint16(buffer);
-  if (buffer_get_remaining_size(buffer) < payload_size)
+  // every frame starts with a header which gives the size of the rest,
+  // laid out the way the connection's wire version has it...
+  connection_t *connection = arg;
+  size_t frame_size = wire_get_frame_size(connection->wire_version, connection->encrypted, header, size);
+
+  // the memory for a frame is allocated as soon as its size is known, so
+  // refuse the ones which are too large before then...
+  if (frame_size > net_max_frame_size)
   {
-    return;
+    log_error("Incoming frame of <%zu> bytes is larger than the maximum of <%zu> bytes!",
+      frame_size, net_max_frame_size);
+    dyad_close(connection->remote);
+    return RING_BUFFER_INVALID_FRAME_SIZE;
+  }
+  return frame_size;
+}
+
+bool net_handle_frame(const unsigned char *frame, size_t size, void *arg)
+{
+  // the frame is only read from, so it can be wrapped in a buffer without
+  // copying it, it's either in the received data or the receive buffer...
+  connection_t *connection = arg;
+  buffer_t buffer = {(unsigned char*)frame, size, 0};
+  int payload_size = 0;
+  int raw_payload_size = 0;
+  if (!wire_read_frame_header(&buffer, connection->wire_version, connection->encrypted, &payload_size, &raw_payload_size))
+  {
+    log_error("Failed to read incoming frame header!");
+    dyad_close(connection->remote);
+    return false;
   }
 
   if (connection->encrypted)
   {
-    int raw_payload_size = buffer_read_uint16(buffer);
-    char *payload = buffer_read(buffer, payload_size);
+    const unsigned char *payload = buffer_get_remaining_data(&buffer);
 
     // attempt to decrypt the text, if we fail then disconnect them,
-    // otherwise handle the packet as we would normally.
-    unsigned char decrypted[raw_payload_size];
-    int result = crypto_box_open_easy(decrypted, (unsigned char*)payload, payload_size,
+    // otherwise handle the packet as we would normally. frames may be
+    // far larger than the stack, so it's decrypted into a buffer...
+    buffer_t *decrypted_buffer = buffer_init();
+    buffer_reserve(decrypted_buffer, raw_payload_size);
+    unsigned char *decrypted = buffer_claim(decrypted_buffer, raw_payload_size);
+    int result = crypto_box_open_easy(decrypted, payload, payload_size,
       connection->keypair_info->nonce, connection->keypair_info->our_public_key,
       connection->keypair_info->their_private_key);
 
     if (result != 0)
     {
+      // closing the stream frees the connection and its receive buffer,
+      // so stop reading any further frames...
       log_error("Failed to decrypt incoming packet data with error code <%d>!", result);
-      dyad_close(connection->stream);
-    }
-    else
-    {
-      buffer_t *buffer = buffer_init_data(0, (const unsigned char*)decrypted, raw_payload_size);
-      handle_incoming_packet(connection, buffer);
+      buffer_free(decrypted_buffer);
+      dyad_close(connection->remote);
+      return false;
     }
-    free(payload);
-    buffer_free(buffer);
+
+    buffer_t packet_buffer = {decrypted, raw_payload_size, 0};
+    handle_incoming_packet(connection, &packet_buffer);
+    buffer_free(decrypted_buffer);
   }
   else
   {
-    handle_incoming_packet(connection, buffer);
+    buffer_t packet_buffer = {(unsigned char*)buffer_get_remaining_data(&buffer), payload_size, 0};
+    handle_incoming_packet(connection, &packet_buffer);
+  }
+  return true;
+}
+
+void net_on_data(dyad_Event *event)
+{
+  // a read may end part way through a frame or contain several of them,
+  // so hand over every complete frame and keep the rest until the next read...
+  connection_t *connection = event->udata;
+  if (!ring_buffer_read_frames(connection->recv_buffer, (const unsigned char*)event->data, event->size,
+    net_get_frame_size, net_handle_frame, connection))
+  {
+    return;
+  }
+
+  // the receive buffer grows to the size of the largest frame, let go of
+  // it once a large one has been handled rather than holding on to it...
+  if (ring_buffer_get_empty(connection->recv_buffer) &&
+    ring_buffer_get_capacity(connection->recv_buffer) > RECV_BUFFER_MAX_IDLE_SIZE)
+  {
+    ring_buffer_free(connection->recv_buffer);
+    connection->recv_buffer = ring_buffer_init(RECV_BUFFER_SIZE);
   }
 }
 
+static void net_free_retired_connection(void *connection)
+{
+  net_free_connection(connection);
+}
+
 void net_on_close(dyad_Event *event)
 {
   const char *address = dyad_getAddress(event->stream);
@@ -261,7 +546,9 @@ void net_on_close(dyad_Event *event)
   queue_remove_object(net_accept_queue, connection);
   queue_remove_object(net_connection_queue, connection);
 
-  net_free_connection(connection);
+  // a relay on another thread may still have the connection from a peer
+  // snapshot, so it isn't reused until that's done with...
+  epoch_retire(connection, net_free_retired_connection);
 }
 
 void net_on_error(dyad_Event *event)
@@ -269,12 +556,29 @@ void net_on_error(dyad_Event *event)
   log_trace("An error has occurred: %s", event->msg);
 }
 
+void net_on_drain(dyad_Event *event)
+{
+  log_trace("Connection <%s:%d> has drained, resuming writes.",
+    dyad_getAddress(event->stream), dyad_getPort(event->stream));
+}
+
 void net_on_accept(dyad_Event *event)
 {
   connection_t *connection = net_init_connection(event->stream, event->remote);
 
   dyad_addListener(event->remote, DYAD_EVENT_DATA, net_on_data, connection);
   dyad_addListener(event->remote, DYAD_EVENT_CLOSE, net_on_close, connection);
+  dyad_addListener(event->remote, DYAD_EVENT_DRAIN, net_on_drain, connection);
+  dyad_setWatermarks(event->remote, CONNECTION_LOW_WATERMARK, CONNECTION_HIGH_WATERMARK);
+}
+
+bool net_get_connection_writable(connection_t *connection)
+{
+  // a connection which has more queued up than its high watermark
+  // isn't written to again until it has drained, nor is one whose stream
+  // has already gone...
+  dyad_Stream *stream = dyad_getStream(connection->handle);
+  return stream != NULL && dyad_getWritable(stream);
 }
 
 bool net_open_tcp_server(dyad_Stream *stream, const char *address, int port, size_t backlog)
@@ -285,11 +589,6 @@ bool net_open_tcp_server(dyad_Stream *stream, const char *address, int port, siz
     return false;
   }
 
-  if (net_want_port_mapping)
-  {
-    net_setup_portmapping(port);
-  }
-
   dyad_addListener(stream, DYAD_EVENT_ERROR, net_on_error, NULL);
   dyad_addListener(stream, DYAD_EVENT_ACCEPT, net_on_accept, NULL);
 
@@ -312,20 +611,31 @@ bool net_open_tcp_connection(dyad_Stream *stream, const char *address, int port)
   dyad_addListener(stream, DYAD_EVENT_CONNECT, net_on_connect, connection);
   dyad_addListener(stream, DYAD_EVENT_DATA, net_on_data, connection);
   dyad_addListener(stream, DYAD_EVENT_CLOSE, net_on_close, connection);
+  dyad_addListener(stream, DYAD_EVENT_DRAIN, net_on_drain, connection);
+  dyad_setWatermarks(stream, CONNECTION_LOW_WATERMARK, CONNECTION_HIGH_WATERMARK);
 
   dyad_setNoDelay(stream, 1);
   dyad_connect(stream, address, port);
   return true;
 }
 
-task_result_t net_poll_events(task_t *task, va_list args)
+void net_wait_events(double timeout)
 {
+  dyad_setUpdateTimeout(timeout);
   dyad_update();
-  return TASK_RESULT_CONT;
 }
 
-task_result_t net_poll_resync_peers(task_t *task, va_list args)
+void net_wake_events(void)
+{
+  dyad_wakeReactor(net_reactors[0].reactor);
+}
+
+task_result_t net_poll_resync_peers(task_t *task)
 {
+  // the task may run on any scheduler's thread, the connections are kept
+  // from being freed by the epoch while they're written to. the writes are
+  // handed over to the reactors which own the streams...
+  epoch_enter();
   for (int i = 0; i <= net_connection_queue->max_index; i++)
   {
     connection_t *connection = queue_get(net_connection_queue, i);
@@ -334,13 +644,15 @@ task_result_t net_poll_resync_peers(task_t *task, va_list args)
       continue;
     }
 
-    // ensure this connection has been authenticated before
-    // attempting to send peerlist request...
-    if (!connection->authenticated)
+    // ensure this connection has finished the handshake before attempting
+    // to send peerlist request, until then the reactor owning it is still
+    // switching its wire format...
+    if (!atomic_load(&connection->encrypted))
     {
       continue;
     }
     handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_PEERLIST_REQ);
   }
+  epoch_exit();
   return TASK_RESULT_WAIT;
 }
@@ -10,14 +10,14 @@
 #include <time.h>
 
 #include "log.h"
-#include "queue.h"
+#include "registry.h"
 #include "crypto.h"
 
 #include "netinterface.h"
 
 bool netinterface_init(void)
 {
-  netinterface_queue = queue_init();
+  netinterface_registry = registry_init();
 
   log_info("Initialized net interface.");
   return true;
@@ -25,7 +25,7 @@ bool netinterface_init(void)
 
 bool netinterface_shutdown(void)
 {
-  queue_free(netinterface_queue);
+  registry_free(netinterface_registry);
 
   log_info("Shutdown net interface.");
   return true;
@@ -33,7 +33,7 @@ bool netinterface_shutdown(void)
 
 bool has_transport_conn(transport_conn_t *transport_conn)
 {
-  return queue_get_index(netinterface_queue, transport_conn) != -1;
+  return transport_conn && registry_get(netinterface_registry, transport_conn->id) == transport_conn;
 }
 
 bool has_transport_conn_by_id(int id)
@@ -48,13 +48,22 @@ bool has_transport_conn_by_keypair(keypair_info_t *keypair_info)
 
 transport_conn_t* add_transport_conn(keypair_info_t *keypair_info)
 {
-  netinterface_next_id++;
+  // another thread may have added the keypair's transport in the meantime,
+  // in which case that one is returned instead...
+  pthread_mutex_lock(&netinterface_mutex);
+  transport_conn_t *transport_conn = get_transport_conn_from_keypair(keypair_info);
+  if (transport_conn)
+  {
+    pthread_mutex_unlock(&netinterface_mutex);
+    return transport_conn;
+  }
 
-  transport_conn_t *transport_conn = malloc(sizeof(transport_conn_t));
-  transport_conn->id = netinterface_next_id;
+  transport_conn = malloc(sizeof(transport_conn_t));
+  transport_conn->id = atomic_fetch_add(&netinterface_next_id, 1) + 1;
   transport_conn->keypair_info = keypair_info;
 
-  queue_push_right(netinterface_queue, transport_conn);
+  registry_add(netinterface_registry, transport_conn->id, transport_conn);
+  pthread_mutex_unlock(&netinterface_mutex);
   return transport_conn;
 }
 
@@ -64,7 +73,7 @@ void remove_transport_conn(transport_conn_t *transport_conn)
   {
     return;
   }
-  queue_remove_object(netinterface_queue, transport_conn);
+  registry_remove(netinterface_registry, transport_conn->id);
   free_transport_conn(transport_conn);
 }
 
@@ -80,23 +89,15 @@ void remove_transport_conn_by_id(int id)
 
 transport_conn_t* get_transport_conn_from_id(int id)
 {
-  for (int i = 0; i <= netinterface_queue->max_index; i++)
-  {
-    transport_conn_t *transport_conn = queue_get(netinterface_queue, i);
-    if (transport_conn->id == id)
-    {
-      return transport_conn;
-    }
-  }
-  return NULL;
+  return registry_get(netinterface_registry, id);
 }
 
 transport_conn_t* get_transport_conn_from_keypair(keypair_info_t *keypair_info)
 {
-  for (int i = 0; i <= netinterface_queue->max_index; i++)
+  for (int i = 0; i < registry_get_size(netinterface_registry); i++)
   {
-    transport_conn_t *transport_conn = queue_get(netinterface_queue, i);
-    if (transport_conn->keypair_info == keypair_info)
+    transport_conn_t *transport_conn = registry_get_at(netinterface_registry, i);
+    if (transport_conn && transport_conn->keypair_info == keypair_info)
     {
       return transport_conn;
     }
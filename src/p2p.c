@@ -6,11 +6,13 @@
  */
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include "log.h"
 #include "dyad.h"
-#include "queue.h"
+#include "registry.h"
+#include "epoch.h"
 #include "buffer.h"
 #include "netbase.h"
 #include "net.h"
@@ -18,16 +20,46 @@
 
 #include "p2p.h"
 
+static peer_snapshot_t* p2p_init_peer_snapshot(int num_peers)
+{
+  peer_snapshot_t *peer_snapshot = malloc(sizeof(peer_snapshot_t) + sizeof(peer_t*) * num_peers);
+  peer_snapshot->num_peers = num_peers;
+  return peer_snapshot;
+}
+
+static void p2p_free_peer_snapshot(void *peer_snapshot)
+{
+  free(peer_snapshot);
+}
+
+static void p2p_free_retired_peer(void *peer)
+{
+  free_peer(peer);
+}
+
+static void p2p_publish_peer_snapshot(peer_snapshot_t *peer_snapshot)
+{
+  // expects the peers to be locked, the readers of the old snapshot may
+  // still be iterating over it...
+  peer_snapshot_t *old_peer_snapshot = atomic_exchange(&p2p_peer_snapshot, peer_snapshot);
+  epoch_retire(old_peer_snapshot, p2p_free_peer_snapshot);
+}
+
 bool p2p_init(void)
 {
-  p2p_peer_queue = queue_init();
+  p2p_peer_registry = registry_init();
+  atomic_store(&p2p_peer_snapshot, p2p_init_peer_snapshot(0));
   log_info("Initialized p2p.");
   return true;
 }
 
 bool p2p_shutdown(void)
 {
-  queue_free(p2p_peer_queue);
+  pthread_mutex_lock(&p2p_peer_mutex);
+  p2p_publish_peer_snapshot(NULL);
+  registry_free(p2p_peer_registry);
+  p2p_peer_registry = NULL;
+  pthread_mutex_unlock(&p2p_peer_mutex);
   log_info("Shutdown p2p.");
   return true;
 }
@@ -49,7 +81,10 @@ int get_next_peer_id(void)
 
 int get_num_peers(void)
 {
-  return queue_get_size(p2p_peer_queue);
+  peer_snapshot_t *peer_snapshot = acquire_peer_snapshot();
+  int num_peers = peer_snapshot ? peer_snapshot->num_peers : 0;
+  release_peer_snapshot(peer_snapshot);
+  return num_peers;
 }
 
 bool load_peerlist_from_file(const char *filename)
@@ -69,7 +104,7 @@ bool load_peerlist_from_file(const char *filename)
   fread(data, fsize, 1, fp);
 
   buffer_t *buffer = buffer_init_data(0, data, fsize);
-  if (!deserialize_peerlist_from_buffer(buffer))
+  if (!deserialize_peerlist_from_buffer(buffer, WIRE_VERSION_1))
   {
     log_error("Failed to deserialize peerlist from buffer!");
     return false;
@@ -88,7 +123,7 @@ bool save_peerlist_to_file(const char *filename)
   FILE *fp;
   fp = fopen(filename, "w");
   buffer_t *buffer = buffer_init();
-  if (!serialize_peerlist_to_buffer(buffer))
+  if (!serialize_peerlist_to_buffer(buffer, WIRE_VERSION_1))
   {
     log_error("Failed to serialize peerlist to buffer!");
     return false;
@@ -106,7 +141,7 @@ bool save_peerlist_to_file(const char *filename)
 
 bool has_peer(peer_t *peer)
 {
-  return queue_get_index(p2p_peer_queue, peer) != -1;
+  return peer && get_peer_from_id(peer->id) == peer;
 }
 
 bool has_peer_by_id(int id)
@@ -121,6 +156,13 @@ bool has_peer_by_address(const char *address, int port)
 
 peer_t* add_peer(connection_t *connection, const char *address, int port)
 {
+  pthread_mutex_lock(&p2p_peer_mutex);
+  peer_snapshot_t *peer_snapshot = atomic_load(&p2p_peer_snapshot);
+  if (!peer_snapshot)
+  {
+    pthread_mutex_unlock(&p2p_peer_mutex);
+    return NULL;
+  }
   if (has_peer_by_address(address, port))
   {
     if (p2p_allow_local_ip && netbase_get_is_local_address(address))
@@ -129,6 +171,7 @@ peer_t* add_peer(connection_t *connection, const char *address, int port)
     }
     else
     {
+      pthread_mutex_unlock(&p2p_peer_mutex);
       return NULL;
     }
   }
@@ -141,18 +184,43 @@ peer_t* add_peer(connection_t *connection, const char *address, int port)
   peer->port = port;
   peer->connection = connection;
 
-  queue_push_right(p2p_peer_queue, peer);
+  registry_add(p2p_peer_registry, peer->id, peer);
+
+  peer_snapshot_t *new_peer_snapshot = p2p_init_peer_snapshot(peer_snapshot->num_peers + 1);
+  for (int i = 0; i < peer_snapshot->num_peers; i++)
+  {
+    new_peer_snapshot->peers[i] = peer_snapshot->peers[i];
+  }
+  new_peer_snapshot->peers[peer_snapshot->num_peers] = peer;
+  p2p_publish_peer_snapshot(new_peer_snapshot);
+  pthread_mutex_unlock(&p2p_peer_mutex);
   return peer;
 }
 
 void remove_peer(peer_t *peer)
 {
-  if (!has_peer(peer))
+  pthread_mutex_lock(&p2p_peer_mutex);
+  peer_snapshot_t *peer_snapshot = atomic_load(&p2p_peer_snapshot);
+  if (!peer_snapshot || !has_peer(peer))
   {
+    pthread_mutex_unlock(&p2p_peer_mutex);
     return;
   }
-  queue_remove_object(p2p_peer_queue, peer);
-  free_peer(peer);
+  registry_remove(p2p_peer_registry, peer->id);
+
+  // the peer is only freed once no reader can still be relaying to it...
+  peer_snapshot_t *new_peer_snapshot = p2p_init_peer_snapshot(peer_snapshot->num_peers - 1);
+  int num_peers = 0;
+  for (int i = 0; i < peer_snapshot->num_peers; i++)
+  {
+    if (peer_snapshot->peers[i] != peer)
+    {
+      new_peer_snapshot->peers[num_peers++] = peer_snapshot->peers[i];
+    }
+  }
+  p2p_publish_peer_snapshot(new_peer_snapshot);
+  epoch_retire(peer, p2p_free_retired_peer);
+  pthread_mutex_unlock(&p2p_peer_mutex);
 }
 
 void remove_peer_by_id(int id)
@@ -172,28 +240,38 @@ void remove_peer_by_address(const char *address, int port)
 
 peer_t* get_peer_from_id(int id)
 {
-  for (int i = 0; i <= p2p_peer_queue->max_index; i++)
-  {
-    peer_t *peer = queue_get(p2p_peer_queue, i);
-    if (peer->id == id)
-    {
-      return peer;
-    }
-  }
-  return NULL;
+  return p2p_peer_registry ? registry_get(p2p_peer_registry, id) : NULL;
 }
 
 peer_t* get_peer_from_address(const char *address, int port)
 {
-  for (int i = 0; i <= p2p_peer_queue->max_index; i++)
+  peer_t *found_peer = NULL;
+  peer_snapshot_t *peer_snapshot = acquire_peer_snapshot();
+  for (int i = 0; peer_snapshot && i < peer_snapshot->num_peers; i++)
   {
-    peer_t *peer = queue_get(p2p_peer_queue, i);
+    peer_t *peer = peer_snapshot->peers[i];
     if (string_equals(peer->address, address) && peer->port == port)
     {
-      return peer;
+      found_peer = peer;
+      break;
     }
   }
-  return NULL;
+  release_peer_snapshot(peer_snapshot);
+  return found_peer;
+}
+
+peer_snapshot_t* acquire_peer_snapshot(void)
+{
+  // the snapshot and the peers in it stay valid until it's released,
+  // even if they've been removed in the meantime. may return NULL once
+  // p2p has been shutdown...
+  epoch_enter();
+  return atomic_load(&p2p_peer_snapshot);
+}
+
+void release_peer_snapshot(peer_snapshot_t *peer_snapshot)
+{
+  epoch_exit();
 }
 
 void free_peer(peer_t *peer)
@@ -215,29 +293,43 @@ void free_peer_by_id(int id)
   free_peer(peer);
 }
 
-bool serialize_peerlist_to_buffer(buffer_t *buffer)
+bool serialize_peerlist_to_buffer(buffer_t *buffer, int wire_version)
 {
-  buffer_write_uint16(buffer, get_num_peers());
-  for (int i = 0; i <= p2p_next_peer_id; i++)
+  peer_snapshot_t *peer_snapshot = acquire_peer_snapshot();
+  wire_peerlist_resp_t peerlist;
+  peerlist.num_peers = peer_snapshot ? peer_snapshot->num_peers : 0;
+  wire_write_peerlist_resp(buffer, wire_version, &peerlist);
+  for (int i = 0; i < peerlist.num_peers; i++)
   {
-    peer_t *peer = get_peer_from_id(i);
-    if (!peer)
-    {
-      continue;
-    }
-    buffer_write_string(buffer, peer->address, strlen(peer->address));
-    buffer_write_uint32(buffer, peer->port);
+    peer_t *peer = peer_snapshot->peers[i];
+    wire_peer_t wire_peer;
+    snprintf(wire_peer.address, sizeof(wire_peer.address), "%s", peer->address);
+    wire_peer.port = peer->port;
+    wire_write_peer(buffer, wire_version, &wire_peer);
   }
+  release_peer_snapshot(peer_snapshot);
   return true;
 }
 
-bool deserialize_peerlist_from_buffer(buffer_t *buffer)
+bool deserialize_peerlist_from_buffer(buffer_t *buffer, int wire_version)
 {
-  uint16_t num_peers = buffer_read_uint16(buffer);
-  for (int i = 1; i <= num_peers; i++)
+  wire_peerlist_resp_t peerlist;
+  if (!wire_read_peerlist_resp(buffer, wire_version, &peerlist))
+  {
+    return false;
+  }
+
+  // the addresses are copied onto the stack, since they're only needed
+  // for as long as it takes to connect to them...
+  for (int i = 1; i <= peerlist.num_peers; i++)
   {
-    char *address = buffer_read_string(buffer);
-    uint32_t port = buffer_read_uint32(buffer);
+    wire_peer_t wire_peer;
+    if (!wire_read_peer(buffer, wire_version, &wire_peer))
+    {
+      return false;
+    }
+    const char *address = wire_peer.address;
+    uint32_t port = wire_peer.port;
 
     if (netbase_get_is_local_address(address) && port == net_get_bind_port())
     {
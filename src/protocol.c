@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <stdatomic.h>
 
 #include "sodium.h"
 #include "log.h"
@@ -28,63 +29,121 @@
 
 #include "protocol.h"
 
-bool write_connect_req(connection_t *connection, va_list args)
+// the second wire format leaves the sizes of the crypto fields out...
+_Static_assert(crypto_box_PUBLICKEYBYTES == WIRE_KEY_SIZE, "unexpected public key size");
+_Static_assert(crypto_box_SECRETKEYBYTES == WIRE_KEY_SIZE, "unexpected private key size");
+_Static_assert(crypto_box_NONCEBYTES == WIRE_NONCE_SIZE, "unexpected nonce size");
+_Static_assert(crypto_sign_BYTES == WIRE_SIGN_SIZE, "unexpected signature size");
+_Static_assert(crypto_box_MACBYTES == WIRE_MAC_SIZE, "unexpected mac size");
+
+static buffer_t* init_packet_buffer(pkt_type_t pkt_type, int size)
 {
+  // packets are sized up front from their schema, so that writing their
+  // fields never has to grow the buffer...
   buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_CONNECT_REQ);
-  buffer_write_string(buffer, APPLICATION_VERSION, strlen(APPLICATION_VERSION));
-  buffer_write_string(buffer, APPLICATION_RELEASE_NAME, strlen(APPLICATION_RELEASE_NAME));
-  buffer_write_uint32(buffer, net_get_bind_port());
+  buffer_reserve(buffer, sizeof(uint8_t) + size);
+  buffer_write_uint8(buffer, pkt_type);
+  return buffer;
+}
+
+bool write_connect_req(connection_t *connection, va_list args)
+{
+  wire_connect_req_t connect_req;
+  connect_req.version.data = (const unsigned char*)APPLICATION_VERSION;
+  connect_req.version.size = strlen(APPLICATION_VERSION);
+  connect_req.release.name.data = (const unsigned char*)APPLICATION_RELEASE_NAME;
+  connect_req.release.name.size = strlen(APPLICATION_RELEASE_NAME);
+  connect_req.release.wire_version = net_get_max_wire_version();
+  connect_req.port = net_get_bind_port();
+
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_CONNECT_REQ,
+    wire_get_connect_req_size(connection->wire_version, &connect_req));
+  wire_write_connect_req(buffer, connection->wire_version, &connect_req);
   handle_write_packet(connection, buffer);
   return true;
 }
 
 bool on_connect_req(connection_t *connection, buffer_t *buffer, va_list args)
 {
-  char *version_str = buffer_read_string(buffer);
-  char *release_name_str = buffer_read_string(buffer);
+  wire_connect_req_t connect_req;
+  if (!wire_read_connect_req(buffer, connection->wire_version, &connect_req) ||
+    connect_req.release.wire_version < WIRE_VERSION_1)
+  {
+    log_error("Failed to read invalid connect request!");
+    return false;
+  }
 
   const char *address = dyad_getAddress(connection->remote);
-  int port = buffer_read_uint32(buffer);
+  int port = connect_req.port;
 
   // verify client version info
-  if (!string_equals(version_str, APPLICATION_VERSION) || !string_equals(release_name_str, APPLICATION_RELEASE_NAME))
+  char version_str[MAX_VERSION_LENGTH];
+  char release_name_str[MAX_VERSION_LENGTH];
+  if (!buffer_slice_copy_string(&connect_req.version, version_str, sizeof(version_str)) ||
+    !buffer_slice_copy_string(&connect_req.release.name, release_name_str, sizeof(release_name_str)) ||
+    !string_equals(version_str, APPLICATION_VERSION) || !string_equals(release_name_str, APPLICATION_RELEASE_NAME))
   {
-    log_error("Failed to add new peer, invalid version info <version=%s, release_name=%s>!", version_str, release_name_str);
+    log_error("Failed to add new peer, invalid version info!");
     return false;
   }
 
-  // add the connection to our peer list
-  peer_t *peer = add_peer(connection, address, port);
-  if (!peer)
+  if (has_peer_by_address(address, port))
   {
     log_error("Failed to add already existant peer <%s:%d>!", address, port);
     return false;
   }
 
-  free(version_str);
-  free(release_name_str);
-
-  handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_CONNECT_RESP);
+  // settle on the latest wire format both of us know of, the response
+  // still goes out in the first and everything after it in the new one...
+  int wire_version = connect_req.release.wire_version;
+  if (wire_version > net_get_max_wire_version())
+  {
+    wire_version = net_get_max_wire_version();
+  }
+  handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_CONNECT_RESP, wire_version);
+  atomic_store(&connection->wire_version, wire_version);
   connection->authenticated = true;
+
+  // add the connection to our peer list only once it's been switched over,
+  // other threads may relay to it as soon as it's in there...
+  peer_t *peer = add_peer(connection, address, port);
+  if (!peer)
+  {
+    log_error("Failed to add already existant peer <%s:%d>!", address, port);
+    return false;
+  }
   return true;
 }
 
 bool write_connect_resp(connection_t *connection, va_list args)
 {
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_CONNECT_RESP);
-  buffer_write_uint32(buffer, net_get_bind_port());
+  wire_connect_resp_t connect_resp;
+  connect_resp.port = net_get_bind_port();
+  connect_resp.wire_version = va_arg(args, int);
+
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_CONNECT_RESP,
+    wire_get_connect_resp_size(connection->wire_version, &connect_resp));
+  wire_write_connect_resp(buffer, connection->wire_version, &connect_resp);
   handle_write_packet(connection, buffer);
   return true;
 }
 
 bool on_connect_resp(connection_t *connection, buffer_t *buffer, va_list args)
 {
+  wire_connect_resp_t connect_resp;
+  if (!wire_read_connect_resp(buffer, connection->wire_version, &connect_resp) ||
+    connect_resp.wire_version < WIRE_VERSION_1 || connect_resp.wire_version > net_get_max_wire_version())
+  {
+    log_error("Failed to read invalid connect response!");
+    return false;
+  }
+
   const char *address = dyad_getAddress(connection->remote);
-  int port = buffer_read_uint32(buffer);
+  int port = connect_resp.port;
 
-  // add the connection to our peer list
+  // switch over to the wire format the remote settled on before the
+  // connection is added to our peer list...
+  atomic_store(&connection->wire_version, connect_resp.wire_version);
   peer_t *peer = add_peer(connection, address, port);
   if (!peer)
   {
@@ -103,69 +162,85 @@ bool on_connect_resp(connection_t *connection, buffer_t *buffer, va_list args)
 
 bool write_keypair_req(connection_t *connection, va_list args)
 {
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_KEYPAIR_REQ);
-  buffer_write_string(buffer, (const char*)connection->keypair_info->our_public_key, sizeof(connection->keypair_info->our_public_key));
-  buffer_write_string(buffer, (const char*)connection->keypair_info->our_private_key, sizeof(connection->keypair_info->our_private_key));
-  buffer_write_string(buffer, (const char*)connection->keypair_info->nonce, sizeof(connection->keypair_info->nonce));
+  keypair_info_t *keypair_info = connection->keypair_info;
+  wire_keypair_req_t keypair_req;
+  keypair_req.public_key.data = keypair_info->our_public_key;
+  keypair_req.public_key.size = sizeof(keypair_info->our_public_key);
+  keypair_req.private_key.data = keypair_info->our_private_key;
+  keypair_req.private_key.size = sizeof(keypair_info->our_private_key);
+  keypair_req.nonce.data = keypair_info->nonce;
+  keypair_req.nonce.size = sizeof(keypair_info->nonce);
+
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_KEYPAIR_REQ,
+    wire_get_keypair_req_size(connection->wire_version, &keypair_req));
+  wire_write_keypair_req(buffer, connection->wire_version, &keypair_req);
   handle_write_packet(connection, buffer);
   return true;
 }
 
 bool on_keypair_req(connection_t *connection, buffer_t *buffer, va_list args)
 {
-  char *their_public_key = buffer_read_string(buffer);
-  char *their_private_key = buffer_read_string(buffer);
-  char *nonce = buffer_read_string(buffer);
+  wire_keypair_req_t keypair_req;
+  if (!wire_read_keypair_req(buffer, connection->wire_version, &keypair_req))
+  {
+    log_error("Failed to read truncated keypair request!");
+    return false;
+  }
 
   // generate our keypair
   connection->keypair_info = crypto_generate_keypair();
+  keypair_info_t *keypair_info = connection->keypair_info;
 
   // copy the keypair data to the struct
-  memcpy(connection->keypair_info->their_public_key, their_public_key, sizeof(connection->keypair_info->their_public_key));
-  memcpy(connection->keypair_info->their_private_key, their_private_key, sizeof(connection->keypair_info->their_private_key));
-  memcpy(connection->keypair_info->nonce, nonce, sizeof(connection->keypair_info->nonce));
-
-  free(their_public_key);
-  free(their_private_key);
-  free(nonce);
+  memcpy(keypair_info->their_public_key, keypair_req.public_key.data, sizeof(keypair_info->their_public_key));
+  memcpy(keypair_info->their_private_key, keypair_req.private_key.data, sizeof(keypair_info->their_private_key));
+  memcpy(keypair_info->nonce, keypair_req.nonce.data, sizeof(keypair_info->nonce));
 
+  // the response goes out unencrypted, anything queued after it by the
+  // reactor or by other threads once they see the switch is encrypted...
   handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_KEYPAIR_RESP);
-  connection->encrypted = true;
+  atomic_store(&connection->encrypted, true);
   return true;
 }
 
 bool write_keypair_resp(connection_t *connection, va_list args)
 {
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_KEYPAIR_RESP);
-  buffer_write_string(buffer, (const char*)connection->keypair_info->our_public_key, sizeof(connection->keypair_info->our_public_key));
-  buffer_write_string(buffer, (const char*)connection->keypair_info->our_private_key, sizeof(connection->keypair_info->our_private_key));
+  keypair_info_t *keypair_info = connection->keypair_info;
+  wire_keypair_resp_t keypair_resp;
+  keypair_resp.public_key.data = keypair_info->our_public_key;
+  keypair_resp.public_key.size = sizeof(keypair_info->our_public_key);
+  keypair_resp.private_key.data = keypair_info->our_private_key;
+  keypair_resp.private_key.size = sizeof(keypair_info->our_private_key);
+
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_KEYPAIR_RESP,
+    wire_get_keypair_resp_size(connection->wire_version, &keypair_resp));
+  wire_write_keypair_resp(buffer, connection->wire_version, &keypair_resp);
   handle_write_packet(connection, buffer);
   return true;
 }
 
 bool on_keypair_resp(connection_t *connection, buffer_t *buffer, va_list args)
 {
-  char *their_public_key = buffer_read_string(buffer);
-  char *their_private_key = buffer_read_string(buffer);
+  wire_keypair_resp_t keypair_resp;
+  keypair_info_t *keypair_info = connection->keypair_info;
+  if (!wire_read_keypair_resp(buffer, connection->wire_version, &keypair_resp))
+  {
+    log_error("Failed to read truncated keypair response!");
+    return false;
+  }
 
   // copy the keypair data to the struct
-  memcpy(connection->keypair_info->their_public_key, their_public_key, sizeof(connection->keypair_info->their_public_key));
-  memcpy(connection->keypair_info->their_private_key, their_private_key, sizeof(connection->keypair_info->their_private_key));
-
-  free(their_public_key);
-  free(their_private_key);
+  memcpy(keypair_info->their_public_key, keypair_resp.public_key.data, sizeof(keypair_info->their_public_key));
+  memcpy(keypair_info->their_private_key, keypair_resp.private_key.data, sizeof(keypair_info->their_private_key));
 
-  connection->encrypted = true;
+  atomic_store(&connection->encrypted, true);
   handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_PEERLIST_REQ);
   return true;
 }
 
 bool write_peerlist_req(connection_t *connection, va_list args)
 {
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_PEERLIST_REQ);
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_PEERLIST_REQ, 0);
   handle_write_packet(connection, buffer);
   return true;
 }
@@ -178,9 +253,8 @@ bool on_peerlist_req(connection_t *connection, buffer_t *buffer, va_list args)
 
 bool write_peerlist_resp(connection_t *connection, va_list args)
 {
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_PEERLIST_RESP);
-  if (!serialize_peerlist_to_buffer(buffer))
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_PEERLIST_RESP, 0);
+  if (!serialize_peerlist_to_buffer(buffer, connection->wire_version))
   {
     log_error("Failed to serialize peerlist to buffer!");
     return false;
@@ -191,7 +265,7 @@ bool write_peerlist_resp(connection_t *connection, va_list args)
 
 bool on_peerlist_resp(connection_t *connection, buffer_t *buffer, va_list args)
 {
-  if (!deserialize_peerlist_from_buffer(buffer))
+  if (!deserialize_peerlist_from_buffer(buffer, connection->wire_version))
   {
     log_error("Failed to deserialize peerlist from buffer!");
     return false;
@@ -199,6 +273,22 @@ bool on_peerlist_resp(connection_t *connection, buffer_t *buffer, va_list args)
   return true;
 }
 
+static bool get_relaymsg_fits_frame(int wire_version, const wire_relaymsg_t *relaymsg)
+{
+  // the packet has to fit in a frame of the wire format once encrypted,
+  // and in a frame no larger than we'd accept ourselves...
+  int body_size = crypto_get_cipher_size(sizeof(uint8_t) + wire_get_relaymsg_size(wire_version, relaymsg));
+  return body_size <= wire_get_max_body_size(wire_version) &&
+    wire_get_frame_header_size(wire_version, true) + (size_t)body_size <= net_get_max_frame_size();
+}
+
+static buffer_t* write_relaymsg_packet(int wire_version, const wire_relaymsg_t *relaymsg)
+{
+  buffer_t *buffer = init_packet_buffer(PKT_TYPE_RELAYMSG, wire_get_relaymsg_size(wire_version, relaymsg));
+  wire_write_relaymsg(buffer, wire_version, relaymsg);
+  return buffer;
+}
+
 bool write_relaymsg(connection_t *connection, va_list args)
 {
   keypair_info_t *keypair_info = va_arg(args, keypair_info_t*);
@@ -212,59 +302,114 @@ bool write_relaymsg(connection_t *connection, va_list args)
     return true;
   }
 
+  // the signed message and ciphertext are as large as the message, which
+  // may be far more than fits on the stack...
+  int signed_message_size = crypto_get_sign_size(data_size);
+  int cipher_size = crypto_get_cipher_size(data_size);
+  buffer_t *sealed_buffer = buffer_init();
+  buffer_reserve(sealed_buffer, signed_message_size + cipher_size);
+  unsigned char *signed_message = buffer_claim(sealed_buffer, signed_message_size);
+  unsigned char *ciphertext = buffer_claim(sealed_buffer, cipher_size);
+
   // sign the data so they can identify the data before,
   // attempting to decrypt it...
-  unsigned char signed_message[crypto_get_sign_size(data_size)];
   unsigned long long signed_message_len;
 
   if (crypto_sign(signed_message, &signed_message_len, (const unsigned char*)data,
     data_size, keypair_info->our_private_key) != 0)
   {
     log_error("Failed to sign message with private key!");
+    buffer_free(sealed_buffer);
     return false;
   }
 
   // encrypt the data
-  unsigned char ciphertext[crypto_get_cipher_size(data_size)];
-
   if (crypto_box_easy(ciphertext, (unsigned char*)data, data_size, keypair_info->nonce,
     keypair_info->our_public_key, keypair_info->our_private_key) != 0)
   {
     log_error("Failed to encrypt message with keypair!");
+    buffer_free(sealed_buffer);
     return false;
   }
-  buffer_t *buffer = buffer_init();
-  buffer_write_uint8(buffer, PKT_TYPE_RELAYMSG);
-  buffer_write_uint16(buffer, data_size);
-  buffer_write_string(buffer, (const char*)signed_message, sizeof(signed_message));
-  buffer_write_uint16(buffer, data_size);
-  buffer_write_string(buffer, (const char*)ciphertext, sizeof(ciphertext));
-  buffer_write_int32(buffer, timestamp);
-
-  for (int i = 0; i <= get_next_peer_id(); i++)
+  wire_relaymsg_t relaymsg;
+  relaymsg.message.data_size = data_size;
+  relaymsg.message.signed_message.data = signed_message;
+  relaymsg.message.signed_message.size = signed_message_size;
+  relaymsg.message.ciphertext.data = ciphertext;
+  relaymsg.message.ciphertext.size = cipher_size;
+  relaymsg.timestamp = timestamp;
+
+  // the packet is written once for each wire format in use, every peer is
+  // sent its own frame of it as the frames are encrypted with each peer's
+  // own keys...
+  buffer_t *packets[WIRE_VERSION_LATEST + 1] = {NULL};
+
+  // fan out over a snapshot of the peers, which doesn't block the peers
+  // being added or removed by other threads in the meantime...
+  peer_snapshot_t *peer_snapshot = acquire_peer_snapshot();
+  for (int i = 0; peer_snapshot && i < peer_snapshot->num_peers; i++)
   {
-    peer_t *peer = get_peer_from_id(i);
-    if (!peer)
+    peer_t *peer = peer_snapshot->peers[i];
+
+    // skip the peers which aren't keeping up rather than queueing up
+    // ever more for them, they're relayed to again once they've drained...
+    if (!net_get_connection_writable(peer->connection))
     {
+      log_trace("Skipped relaying message to slow peer <%s:%d>.", peer->address, peer->port);
       continue;
     }
 
-    buffer_t *other_buffer = buffer_init();
-    buffer_copy(other_buffer, buffer);
-    handle_write_packet(peer->connection, other_buffer);
+    // peers are only relayed to once they've finished the handshake, the
+    // wire format can't change after encryption has been switched on...
+    if (!atomic_load(&peer->connection->encrypted))
+    {
+      continue;
+    }
+
+    // peers on a wire format with smaller frames can't be sent messages
+    // which don't fit in them...
+    int wire_version = atomic_load(&peer->connection->wire_version);
+    if (!get_relaymsg_fits_frame(wire_version, &relaymsg))
+    {
+      log_trace("Skipped relaying message of <%d> bytes to peer <%s:%d> with wire format <%d>.",
+        data_size, peer->address, peer->port, wire_version);
+      continue;
+    }
+
+    if (!packets[wire_version])
+    {
+      packets[wire_version] = write_relaymsg_packet(wire_version, &relaymsg);
+    }
+    handle_write_packet_data(peer->connection, buffer_get_data(packets[wire_version]),
+      buffer_get_size(packets[wire_version]));
+  }
+  release_peer_snapshot(peer_snapshot);
+  for (int i = 0; i <= WIRE_VERSION_LATEST; i++)
+  {
+    if (packets[i])
+    {
+      buffer_free(packets[i]);
+    }
   }
+  buffer_free(sealed_buffer);
   return true;
 }
 
 bool on_relaymsg(connection_t *connection, buffer_t *buffer, va_list args)
 {
-  int signature_size = buffer_read_uint16(buffer);
-  char *signature = buffer_read_string(buffer);
-
-  int data_size = buffer_read_uint16(buffer);
-  char *data = buffer_read_string(buffer);
-
-  time_t timestamp = buffer_read_int32(buffer);
+  // the signature and data are read in place, they're only used until
+  // the message has been handled...
+  wire_relaymsg_t relaymsg;
+  if (!wire_read_relaymsg(buffer, connection->wire_version, &relaymsg))
+  {
+    log_error("Failed to read truncated relay message!");
+    return false;
+  }
+  int signature_size = relaymsg.message.data_size;
+  int data_size = relaymsg.message.data_size;
+  buffer_slice_t signature = relaymsg.message.signed_message;
+  buffer_slice_t data = relaymsg.message.ciphertext;
+  time_t timestamp = relaymsg.timestamp;
 
   // check to see if the msg has expired, if so don't unpack it...
   if (get_msg_has_expired(timestamp))
@@ -274,12 +419,14 @@ bool on_relaymsg(connection_t *connection, buffer_t *buffer, va_list args)
 
   // find the keypair that was used to sign this signature,
   // we will use that keypair to decrypt the data as well...
-  keypair_info_t *keypair_info = get_keypair_from_sig(signature_size, signature);
+  keypair_info_t *keypair_info = get_keypair_from_sig(signature_size, (const char*)signature.data);
   if (keypair_info)
   {
-    unsigned char decrypted[data_size];
+    buffer_t *decrypted_buffer = buffer_init();
+    buffer_reserve(decrypted_buffer, data_size);
+    unsigned char *decrypted = buffer_claim(decrypted_buffer, data_size);
 
-    if (crypto_box_open_easy(decrypted, (unsigned char*)data, crypto_get_cipher_size(data_size),
+    if (crypto_box_open_easy(decrypted, data.data, crypto_get_cipher_size(data_size),
       keypair_info->nonce, keypair_info->our_public_key, keypair_info->our_private_key) == 0)
     {
       transport_conn_t *transport_conn = get_transport_conn_from_keypair(keypair_info);
@@ -290,197 +437,147 @@ bool on_relaymsg(connection_t *connection, buffer_t *buffer, va_list args)
 
       if (!get_msg_has_expired(timestamp))
       {
-        unsigned char hash[crypto_generichash_BYTES];
+        unsigned char hash[MSG_CHECKSUM_SIZE];
         crypto_generichash(hash, sizeof(hash), decrypted, data_size, NULL, 0);
         const char *checksum = (const char*)hash;
 
-        if (!has_msg_by_checksum(checksum))
+        // the message is only handled by whichever thread adds it first...
+        if (add_msg(checksum, data_size, timestamp))
         {
-          pending_msg_t *pending_msg = add_msg(checksum, data_size, timestamp);
           buffer_t *buffer = buffer_init_data(0, (const unsigned char*)decrypted, data_size);
           msgprotocol_handle_incoming_packet(transport_conn, buffer);
         }
       }
     }
+    buffer_free(decrypted_buffer);
   }
 
   // always relay the message to our peers, in some cases we can decrypt the message,
   // which indicates the message is being sent to us. In order to reduce the chance that
   // one of our peers determine that we recv'd the msg, continue to relay it...
-  handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_RELAYMSG, data_size, data, timestamp);
-
-  free(data);
+  handle_packet(connection, PKT_DIRECTION_SEND, PKT_TYPE_RELAYMSG, data_size, data.data, timestamp);
   return true;
 }
 
 keypair_info_t* get_keypair_from_sig(int signature_size, const char* signature)
 {
-  for (int i = 0; i <= get_next_keypair_id(); i++)
+  buffer_t *unsigned_buffer = buffer_init();
+  buffer_reserve(unsigned_buffer, signature_size);
+  unsigned char *unsigned_message = buffer_claim(unsigned_buffer, signature_size);
+
+  keypair_info_t *found_keypair_info = NULL;
+  for (int i = 0; i < get_num_keypairs(); i++)
   {
-    keypair_storage_t *keypair_storage = get_keypair_from_id(i);
+    keypair_storage_t *keypair_storage = get_keypair_from_index(i);
     if (!keypair_storage)
     {
       continue;
     }
     keypair_info_t *keypair_info = keypair_storage->keypair_info;
 
-    unsigned char unsigned_message[signature_size];
     unsigned long long unsigned_message_len;
 
     if (crypto_sign_open(unsigned_message, &unsigned_message_len, (const unsigned char*)signature,
         crypto_get_sign_size(signature_size), keypair_info->our_public_key) == 0)
     {
-      return keypair_info;
+      found_keypair_info = keypair_info;
+      break;
     }
   }
-  return NULL;
+  buffer_free(unsigned_buffer);
+  return found_keypair_info;
 }
 
-bool handle_write_packet(connection_t *connection, buffer_t *other_buffer)
+static void handle_write_release_buffer(void *udata)
 {
+  buffer_free(udata);
+}
+
+bool handle_write_packet_data(connection_t *connection, const unsigned char *packet, int packet_size)
+{
+  // the wire state is read once so the whole frame is written the same way...
+  bool encrypted = atomic_load(&connection->encrypted);
+  int wire_version = atomic_load(&connection->wire_version);
+  if (crypto_get_cipher_size(packet_size) > wire_get_max_body_size(wire_version))
+  {
+    log_error("Failed to write outgoing packet of <%d> bytes, it doesn't fit in a frame!", packet_size);
+    return false;
+  }
+
+  // the packet is encrypted straight into the frame, which is queued up on
+  // the stream by reference and freed once it's been sent...
   buffer_t *buffer = buffer_init();
-  int payload_size = buffer_get_size(other_buffer);
-  const unsigned char *payload = buffer_get_data(other_buffer);
+  buffer_reserve(buffer, wire_get_frame_header_size(wire_version, encrypted) +
+    crypto_get_cipher_size(packet_size));
 
-  if (connection->encrypted)
+  if (encrypted)
   {
-    unsigned char ciphertext[crypto_get_cipher_size(payload_size)];
-    int result = crypto_box_easy(ciphertext, (unsigned char*)payload, payload_size, connection->keypair_info->nonce,
+    int cipher_size = crypto_get_cipher_size(packet_size);
+    wire_write_frame_header(buffer, wire_version, true, cipher_size, packet_size);
+    unsigned char *ciphertext = buffer_claim(buffer, cipher_size);
+    int result = crypto_box_easy(ciphertext, packet, packet_size, connection->keypair_info->nonce,
       connection->keypair_info->our_public_key, connection->keypair_info->their_private_key);
 
     if (result != 0)
     {
       log_error("Failed to encrypt outgoing packet data with error code <%d>!", result);
+      buffer_free(buffer);
       return false;
     }
-
-    buffer_write_uint16(buffer, crypto_get_cipher_size(payload_size));
-    buffer_write_uint16(buffer, payload_size);
-    buffer_write(buffer, ciphertext, crypto_get_cipher_size(payload_size));
   }
   else
   {
-    buffer_write_uint16(buffer, payload_size);
-    buffer_write(buffer, payload, payload_size);
+    wire_write_frame_header(buffer, wire_version, false, packet_size, packet_size);
+    buffer_write(buffer, packet, packet_size);
   }
 
-  dyad_write(connection->remote, buffer_get_data(buffer), buffer_get_size(buffer));
+  // the connection may be written to from another reactor's thread after
+  // its stream has been closed, in which case the handle no longer resolves
+  // and the packet is dropped...
+  if (dyad_writeRefHandle(connection->handle, buffer_get_data(buffer), buffer_get_size(buffer),
+    handle_write_release_buffer, buffer) != 0)
+  {
+    buffer_free(buffer);
+    return false;
+  }
+  return true;
+}
 
+bool handle_write_packet(connection_t *connection, buffer_t *other_buffer)
+{
+  bool written = handle_write_packet_data(connection, buffer_get_data(other_buffer), buffer_get_size(other_buffer));
   buffer_free(other_buffer);
-  buffer_free(buffer);
-  return true;
+  return written;
 }
 
 bool handle_packet_recv_authenticated(connection_t *connection, pkt_type_t pkt_type, buffer_t *buffer, va_list args)
 {
-  bool success = false;
-  switch (pkt_type)
+  if (pkt_type >= PKT_TYPE_COUNT || !pkt_handlers[pkt_type].authenticated)
   {
-    case PKT_TYPE_KEYPAIR_REQ:
-    {
-      success = on_keypair_req(connection, buffer, args);
-      break;
-    }
-    case PKT_TYPE_KEYPAIR_RESP:
-    {
-      success = on_keypair_resp(connection, buffer, args);
-      break;
-    }
-    case PKT_TYPE_PEERLIST_REQ:
-    {
-      success = on_peerlist_req(connection, buffer, args);
-      break;
-    }
-    case PKT_TYPE_PEERLIST_RESP:
-    {
-      success = on_peerlist_resp(connection, buffer, args);
-      break;
-    }
-    case PKT_TYPE_RELAYMSG:
-    {
-      success = on_relaymsg(connection, buffer, args);
-      break;
-    }
-    default:
-    {
-      handle_invalid_packet(PKT_DIRECTION_RECV, pkt_type);
-      break;
-    }
+    handle_invalid_packet(PKT_DIRECTION_RECV, pkt_type);
+    return false;
   }
-  return success;
+  return pkt_handlers[pkt_type].on_packet(connection, buffer, args);
 }
 
 bool handle_packet_recv_unauthenticated(connection_t *connection, pkt_type_t pkt_type, buffer_t *buffer, va_list args)
 {
-  bool success = false;
-  switch (pkt_type)
+  if (pkt_type >= PKT_TYPE_COUNT || pkt_handlers[pkt_type].authenticated)
   {
-    case PKT_TYPE_CONNECT_REQ:
-    {
-      success = on_connect_req(connection, buffer, args);
-      break;
-    }
-    case PKT_TYPE_CONNECT_RESP:
-    {
-      success = on_connect_resp(connection, buffer, args);
-      break;
-    }
-    default:
-    {
-      handle_invalid_packet(PKT_DIRECTION_RECV, pkt_type);
-      break;
-    }
+    handle_invalid_packet(PKT_DIRECTION_RECV, pkt_type);
+    return false;
   }
-  return success;
+  return pkt_handlers[pkt_type].on_packet(connection, buffer, args);
 }
 
 bool handle_packet_send(connection_t *connection, pkt_type_t pkt_type, va_list args)
 {
-  bool success = false;
-  switch (pkt_type)
+  if (pkt_type >= PKT_TYPE_COUNT)
   {
-    case PKT_TYPE_CONNECT_REQ:
-    {
-      success = write_connect_req(connection, args);
-      break;
-    }
-    case PKT_TYPE_CONNECT_RESP:
-    {
-      success = write_connect_resp(connection, args);
-      break;
-    }
-    case PKT_TYPE_KEYPAIR_REQ:
-    {
-      success = write_keypair_req(connection, args);
-      break;
-    }
-    case PKT_TYPE_KEYPAIR_RESP:
-    {
-      success = write_keypair_resp(connection, args);
-      break;
-    }
-    case PKT_TYPE_PEERLIST_REQ:
-    {
-      success = write_peerlist_req(connection, args);
-      break;
-    }
-    case PKT_TYPE_PEERLIST_RESP:
-    {
-      success = write_peerlist_resp(connection, args);
-      break;
-    }
-    case PKT_TYPE_RELAYMSG:
-    {
-      success = write_relaymsg(connection, args);
-      break;
-    }
-    default:
-    {
-      handle_invalid_packet(PKT_DIRECTION_SEND, pkt_type);
-      break;
-    }
+    handle_invalid_packet(PKT_DIRECTION_SEND, pkt_type);
+    return false;
   }
-  return success;
+  return pkt_handlers[pkt_type].write_packet(connection, args);
 }
 
 bool handle_packet(connection_t *connection, pkt_direction_t pkt_direction, pkt_type_t pkt_type, ...)
@@ -535,7 +632,6 @@ bool handle_incoming_packet(connection_t *connection, buffer_t *buffer)
       return false;
     }
   }
-  buffer_free(buffer);
   return true;
 }
 
@@ -554,23 +650,9 @@ const char* get_packet_direction_str(pkt_direction_t pkt_direction)
 
 const char* get_packet_type_str(pkt_type_t pkt_type)
 {
-  switch (pkt_type)
+  if (pkt_type >= PKT_TYPE_COUNT)
   {
-    case PKT_TYPE_CONNECT_REQ:
-      return "connect_req";
-    case PKT_TYPE_CONNECT_RESP:
-      return "connect_resp";
-    case PKT_TYPE_KEYPAIR_REQ:
-      return "keypair_req";
-    case PKT_TYPE_KEYPAIR_RESP:
-      return "keypair_resp";
-    case PKT_TYPE_PEERLIST_REQ:
-      return "peerlist_req";
-    case PKT_TYPE_PEERLIST_RESP:
-      return "peerlist_resp";
-    case PKT_TYPE_RELAYMSG:
-      return "relaymsg";
-    default:
-      return "unknown";
+    return "unknown";
   }
+  return pkt_handlers[pkt_type].name;
 }
@@ -11,11 +11,105 @@
 
 #include "queue.h"
 
+// the functions below expect the queue to be locked, the capacity is
+// always zero or a power of two...
+static void** queue_slot(queue_t *queue, int index)
+{
+  return &queue->queue_objects[(queue->head + index) & (queue->capacity - 1)];
+}
+
+static void queue_resize(queue_t *queue, int capacity)
+{
+  void **queue_objects = malloc(sizeof(void*) * capacity);
+  for (int i = 0; i < queue->num_objects; i++)
+  {
+    queue_objects[i] = *queue_slot(queue, i);
+  }
+  free(queue->queue_objects);
+  queue->queue_objects = queue_objects;
+  queue->capacity = capacity;
+  queue->head = 0;
+}
+
+static void queue_insert(queue_t *queue, int index, void *queue_object)
+{
+  if (queue->num_objects == queue->capacity)
+  {
+    queue_resize(queue, queue->capacity > 0 ? queue->capacity * 2 : QUEUE_MIN_CAPACITY);
+  }
+
+  // move whichever side of the index is shorter over by one...
+  if (index < queue->num_objects - index)
+  {
+    queue->head = (queue->head - 1) & (queue->capacity - 1);
+    for (int i = 0; i < index; i++)
+    {
+      *queue_slot(queue, i) = *queue_slot(queue, i + 1);
+    }
+  }
+  else
+  {
+    for (int i = queue->num_objects; i > index; i--)
+    {
+      *queue_slot(queue, i) = *queue_slot(queue, i - 1);
+    }
+  }
+  *queue_slot(queue, index) = queue_object;
+  queue->num_objects++;
+  queue->max_index = queue->num_objects - 1;
+}
+
+static void* queue_extract(queue_t *queue, int index)
+{
+  void *queue_object = *queue_slot(queue, index);
+
+  // close the gap from whichever side of it is shorter...
+  if (index < queue->num_objects - index - 1)
+  {
+    for (int i = index; i > 0; i--)
+    {
+      *queue_slot(queue, i) = *queue_slot(queue, i - 1);
+    }
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+  }
+  else
+  {
+    for (int i = index; i < queue->num_objects - 1; i++)
+    {
+      *queue_slot(queue, i) = *queue_slot(queue, i + 1);
+    }
+  }
+  queue->num_objects--;
+  queue->max_index = queue->num_objects - 1;
+
+  // give memory back once the queue has mostly emptied out...
+  if (queue->capacity > QUEUE_MIN_CAPACITY && queue->num_objects < queue->capacity / 4)
+  {
+    queue_resize(queue, queue->capacity / 2);
+  }
+  return queue_object;
+}
+
+static int queue_find(queue_t *queue, void *queue_object)
+{
+  for (int i = 0; i < queue->num_objects; i++)
+  {
+    if (*queue_slot(queue, i) == queue_object)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
 queue_t* queue_init(void)
 {
   queue_t *queue = malloc(sizeof(queue_t));
   queue->num_objects = 0;
   queue->max_index = -1;
+  queue->head = 0;
+  queue->capacity = 0;
+  queue->queue_objects = NULL;
 
   pthread_mutex_init(&queue->mutex, NULL);
   return queue;
@@ -23,12 +117,12 @@ queue_t* queue_init(void)
 
 void queue_free(queue_t *queue)
 {
-  for (int i = 0; i <= queue->max_index; i++)
-  {
-    queue_remove(queue, i);
-  }
+  free(queue->queue_objects);
+  queue->queue_objects = NULL;
   queue->num_objects = 0;
   queue->max_index = -1;
+  queue->head = 0;
+  queue->capacity = 0;
 
   pthread_mutex_destroy(&queue->mutex);
   free(queue);
@@ -36,41 +130,40 @@ void queue_free(queue_t *queue)
 
 int queue_get_size(queue_t *queue)
 {
-  return queue->num_objects;
+  pthread_mutex_lock(&queue->mutex);
+  int num_objects = queue->num_objects;
+  pthread_mutex_unlock(&queue->mutex);
+  return num_objects;
 }
 
 bool queue_get_empty(queue_t *queue)
 {
-  return queue->num_objects == 0;
+  return queue_get_size(queue) == 0;
 }
 
 int queue_get_max_index(queue_t *queue)
 {
-  return queue->max_index;
+  return queue_get_size(queue) - 1;
 }
 
 int queue_get_index(queue_t *queue, void *queue_object)
 {
-  int index = -1;
-  for (int i = 0; i <= queue->max_index; i++)
-  {
-    // find this objects index in the array
-    if (queue->queue_objects[i] == queue_object)
-    {
-      index = i;
-      break;
-    }
-  }
+  pthread_mutex_lock(&queue->mutex);
+  int index = queue_find(queue, queue_object);
+  pthread_mutex_unlock(&queue->mutex);
   return index;
 }
 
 void* queue_get(queue_t *queue, int index)
 {
-  if (index < 0)
+  void *queue_object = NULL;
+  pthread_mutex_lock(&queue->mutex);
+  if (index >= 0 && index < queue->num_objects)
   {
-    return NULL;
+    queue_object = *queue_slot(queue, index);
   }
-  return queue->queue_objects[index];
+  pthread_mutex_unlock(&queue->mutex);
+  return queue_object;
 }
 
 void queue_push(queue_t *queue, int index, void *queue_object)
@@ -79,45 +172,28 @@ void queue_push(queue_t *queue, int index, void *queue_object)
   {
     return;
   }
-  queue->queue_objects[index] = queue_object;
-  queue->num_objects++;
-  if (index > queue->max_index)
-  {
-    queue->max_index = index;
-  }
+  pthread_mutex_lock(&queue->mutex);
+  queue_insert(queue, index < queue->num_objects ? index : queue->num_objects, queue_object);
+  pthread_mutex_unlock(&queue->mutex);
 }
 
 void queue_push_left(queue_t *queue, void *queue_object)
 {
   pthread_mutex_lock(&queue->mutex);
-  for (int i = queue->max_index + 1; i >= 0; i--)
-  {
-    // shift all object over right by one index
-    queue->queue_objects[i] = queue->queue_objects[i - 1];
-  }
-  queue_push(queue, 0, queue_object);
+  queue_insert(queue, 0, queue_object);
   pthread_mutex_unlock(&queue->mutex);
 }
 
 void queue_push_right(queue_t *queue, void *queue_object)
 {
   pthread_mutex_lock(&queue->mutex);
-  queue_push(queue, queue->max_index + 1, queue_object);
+  queue_insert(queue, queue->num_objects, queue_object);
   pthread_mutex_unlock(&queue->mutex);
 }
 
 void queue_remove(queue_t *queue, int index)
 {
-  if (index < 0)
-  {
-    return;
-  }
-  if (index >= queue->max_index)
-  {
-    queue->max_index = index - 1;
-  }
-  queue->queue_objects[index] = NULL;
-  queue->num_objects--;
+  queue_pop(queue, index);
 }
 
 void queue_remove_object(queue_t *queue, void *queue_object)
@@ -127,46 +203,39 @@ void queue_remove_object(queue_t *queue, void *queue_object)
     return;
   }
   pthread_mutex_lock(&queue->mutex);
-  int index = queue_get_index(queue, queue_object);
-  pthread_mutex_unlock(&queue->mutex);
-  if (index == -1)
+  int index = queue_find(queue, queue_object);
+  if (index != -1)
   {
-    return;
+    queue_extract(queue, index);
   }
-  pthread_mutex_lock(&queue->mutex);
-  queue_remove(queue, index);
   pthread_mutex_unlock(&queue->mutex);
 }
 
 void* queue_pop(queue_t *queue, int index)
 {
-  void *queue_object = queue_get(queue, index);
-  queue_remove(queue, index);
-  return queue_object;
-}
-
-void* queue_pop_left(queue_t *queue)
-{
+  void *queue_object = NULL;
   pthread_mutex_lock(&queue->mutex);
-  void *queue_object = queue_pop(queue, 0);
-  for (int i = 1; i <= queue->max_index; i++)
+  if (index >= 0 && index < queue->num_objects)
   {
-    // shift all object over left by one index
-    queue->queue_objects[i - 1] = queue->queue_objects[i];
+    queue_object = queue_extract(queue, index);
   }
-
-  // when shifting objects over left, the maximum index in the queue
-  // will remain unused in memory until cleared
-  queue->queue_objects[queue->max_index] = NULL;
-  queue->max_index--;
   pthread_mutex_unlock(&queue->mutex);
   return queue_object;
 }
 
+void* queue_pop_left(queue_t *queue)
+{
+  return queue_pop(queue, 0);
+}
+
 void* queue_pop_right(queue_t *queue)
 {
+  void *queue_object = NULL;
   pthread_mutex_lock(&queue->mutex);
-  void *queue_object = queue_pop(queue, queue->max_index);
+  if (queue->num_objects > 0)
+  {
+    queue_object = queue_extract(queue, queue->num_objects - 1);
+  }
   pthread_mutex_unlock(&queue->mutex);
   return queue_object;
 }
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "registry.h"
+
+// the functions below expect the registry to be locked...
+static int registry_get_home(registry_t *registry, int id)
+{
+  // the ids are mostly handed out in sequence, so they're mixed up before
+  // they're spread over the table...
+  uint32_t hash = (uint32_t)id * 2654435769u;
+  hash ^= hash >> 16;
+  return (int)(hash & (uint32_t)(registry->capacity - 1));
+}
+
+static int registry_find_slot(registry_t *registry, int id)
+{
+  int mask = registry->capacity - 1;
+  for (int i = registry_get_home(registry, id);; i = (i + 1) & mask)
+  {
+    registry_slot_t *slot = &registry->slots[i];
+    if (slot->index == -1)
+    {
+      return -1;
+    }
+    if (slot->id == id)
+    {
+      return i;
+    }
+  }
+}
+
+static void registry_insert_slot(registry_t *registry, int id, int index)
+{
+  int mask = registry->capacity - 1;
+  int i = registry_get_home(registry, id);
+  while (registry->slots[i].index != -1)
+  {
+    i = (i + 1) & mask;
+  }
+  registry->slots[i].id = id;
+  registry->slots[i].index = index;
+}
+
+static void registry_resize(registry_t *registry, int capacity)
+{
+  free(registry->slots);
+  registry->slots = malloc(sizeof(registry_slot_t) * capacity);
+  registry->ids = realloc(registry->ids, sizeof(int) * (capacity / 2));
+  registry->objects = realloc(registry->objects, sizeof(void*) * (capacity / 2));
+  registry->capacity = capacity;
+
+  for (int i = 0; i < capacity; i++)
+  {
+    registry->slots[i].id = 0;
+    registry->slots[i].index = -1;
+  }
+  for (int i = 0; i < registry->num_objects; i++)
+  {
+    registry_insert_slot(registry, registry->ids[i], i);
+  }
+}
+
+static void registry_erase_slot(registry_t *registry, int i)
+{
+  // shift the slots after it back, so that none of them end up past an
+  // empty slot between them and their home...
+  int mask = registry->capacity - 1;
+  for (int j = (i + 1) & mask; registry->slots[j].index != -1; j = (j + 1) & mask)
+  {
+    int home = registry_get_home(registry, registry->slots[j].id);
+    bool in_place = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+    if (!in_place)
+    {
+      registry->slots[i] = registry->slots[j];
+      i = j;
+    }
+  }
+  registry->slots[i].index = -1;
+}
+
+registry_t* registry_init(void)
+{
+  registry_t *registry = malloc(sizeof(registry_t));
+  registry->num_objects = 0;
+  registry->capacity = 0;
+  registry->slots = NULL;
+  registry->ids = NULL;
+  registry->objects = NULL;
+  registry_resize(registry, REGISTRY_MIN_CAPACITY);
+
+  pthread_mutex_init(&registry->mutex, NULL);
+  return registry;
+}
+
+void registry_free(registry_t *registry)
+{
+  free(registry->slots);
+  free(registry->ids);
+  free(registry->objects);
+  registry->slots = NULL;
+  registry->ids = NULL;
+  registry->objects = NULL;
+  registry->num_objects = 0;
+  registry->capacity = 0;
+
+  pthread_mutex_destroy(&registry->mutex);
+  free(registry);
+}
+
+int registry_get_size(registry_t *registry)
+{
+  pthread_mutex_lock(&registry->mutex);
+  int num_objects = registry->num_objects;
+  pthread_mutex_unlock(&registry->mutex);
+  return num_objects;
+}
+
+bool registry_has(registry_t *registry, int id)
+{
+  return registry_get(registry, id) != NULL;
+}
+
+bool registry_add(registry_t *registry, int id, void *object)
+{
+  pthread_mutex_lock(&registry->mutex);
+  if (registry_find_slot(registry, id) != -1)
+  {
+    pthread_mutex_unlock(&registry->mutex);
+    return false;
+  }
+  if (registry->num_objects == registry->capacity / 2)
+  {
+    registry_resize(registry, registry->capacity * 2);
+  }
+
+  int index = registry->num_objects;
+  registry->ids[index] = id;
+  registry->objects[index] = object;
+  registry->num_objects++;
+  registry_insert_slot(registry, id, index);
+  pthread_mutex_unlock(&registry->mutex);
+  return true;
+}
+
+void* registry_get(registry_t *registry, int id)
+{
+  void *object = NULL;
+  pthread_mutex_lock(&registry->mutex);
+  int i = registry_find_slot(registry, id);
+  if (i != -1)
+  {
+    object = registry->objects[registry->slots[i].index];
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return object;
+}
+
+void* registry_get_at(registry_t *registry, int index)
+{
+  void *object = NULL;
+  pthread_mutex_lock(&registry->mutex);
+  if (index >= 0 && index < registry->num_objects)
+  {
+    object = registry->objects[index];
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return object;
+}
+
+void* registry_remove(registry_t *registry, int id)
+{
+  pthread_mutex_lock(&registry->mutex);
+  int i = registry_find_slot(registry, id);
+  if (i == -1)
+  {
+    pthread_mutex_unlock(&registry->mutex);
+    return NULL;
+  }
+
+  int index = registry->slots[i].index;
+  void *object = registry->objects[index];
+  registry_erase_slot(registry, i);
+
+  // fill the gap with the last object, so the dense arrays stay packed...
+  int last_index = registry->num_objects - 1;
+  if (index != last_index)
+  {
+    registry->ids[index] = registry->ids[last_index];
+    registry->objects[index] = registry->objects[last_index];
+    registry->slots[registry_find_slot(registry, registry->ids[index])].index = index;
+  }
+  registry->num_objects--;
+
+  // give memory back once the registry has mostly emptied out...
+  if (registry->capacity > REGISTRY_MIN_CAPACITY && registry->num_objects < registry->capacity / 8)
+  {
+    registry_resize(registry, registry->capacity / 2);
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return object;
+}
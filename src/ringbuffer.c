@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ringbuffer.h"
+
+ring_buffer_t* ring_buffer_init(size_t capacity)
+{
+  ring_buffer_t *ring_buffer = malloc(sizeof(ring_buffer_t));
+
+  // the memory is only allocated once something is written, most
+  // connections never have a partial frame left over...
+  ring_buffer->data = NULL;
+  ring_buffer->capacity = capacity;
+  ring_buffer->head = 0;
+  ring_buffer->size = 0;
+  return ring_buffer;
+}
+
+void ring_buffer_free(ring_buffer_t *ring_buffer)
+{
+  if (ring_buffer->data != NULL)
+  {
+    free(ring_buffer->data);
+    ring_buffer->data = NULL;
+  }
+  ring_buffer->capacity = 0;
+  ring_buffer->head = 0;
+  ring_buffer->size = 0;
+  free(ring_buffer);
+}
+
+void ring_buffer_clear(ring_buffer_t *ring_buffer)
+{
+  ring_buffer->head = 0;
+  ring_buffer->size = 0;
+}
+
+size_t ring_buffer_get_size(ring_buffer_t *ring_buffer)
+{
+  return ring_buffer->size;
+}
+
+size_t ring_buffer_get_capacity(ring_buffer_t *ring_buffer)
+{
+  return ring_buffer->capacity;
+}
+
+bool ring_buffer_get_empty(ring_buffer_t *ring_buffer)
+{
+  return ring_buffer->size == 0;
+}
+
+static void ring_buffer_realloc(ring_buffer_t *ring_buffer, size_t capacity)
+{
+  // copy the contents over so that they start at the beginning
+  // of the new memory...
+  unsigned char *data = malloc(capacity);
+  ring_buffer_peek(ring_buffer, data, ring_buffer->size);
+  free(ring_buffer->data);
+
+  ring_buffer->data = data;
+  ring_buffer->capacity = capacity;
+  ring_buffer->head = 0;
+}
+
+void ring_buffer_reserve(ring_buffer_t *ring_buffer, size_t size)
+{
+  size_t required_capacity = ring_buffer->size + size;
+  if (ring_buffer->data != NULL && required_capacity <= ring_buffer->capacity)
+  {
+    return;
+  }
+
+  size_t capacity = ring_buffer->capacity > 0 ? ring_buffer->capacity : 1;
+  while (capacity < required_capacity)
+  {
+    capacity <<= 1;
+  }
+  ring_buffer_realloc(ring_buffer, capacity);
+}
+
+void ring_buffer_write(ring_buffer_t *ring_buffer, const unsigned char *data, size_t size)
+{
+  if (size == 0)
+  {
+    return;
+  }
+
+  ring_buffer_reserve(ring_buffer, size);
+
+  // the free space may wrap around the end of the memory, in
+  // which case the data is written in two parts...
+  size_t tail = ring_buffer->head + ring_buffer->size;
+  if (tail >= ring_buffer->capacity)
+  {
+    tail -= ring_buffer->capacity;
+  }
+
+  size_t first_size = ring_buffer->capacity - tail;
+  if (first_size > size)
+  {
+    first_size = size;
+  }
+
+  memcpy(ring_buffer->data + tail, data, first_size);
+  memcpy(ring_buffer->data, data + first_size, size - first_size);
+  ring_buffer->size += size;
+}
+
+size_t ring_buffer_peek(ring_buffer_t *ring_buffer, unsigned char *data, size_t size)
+{
+  if (size > ring_buffer->size)
+  {
+    size = ring_buffer->size;
+  }
+
+  size_t first_size = ring_buffer->capacity - ring_buffer->head;
+  if (first_size > size)
+  {
+    first_size = size;
+  }
+
+  if (size > 0)
+  {
+    memcpy(data, ring_buffer->data + ring_buffer->head, first_size);
+    memcpy(data + first_size, ring_buffer->data, size - first_size);
+  }
+  return size;
+}
+
+const unsigned char* ring_buffer_get_data(ring_buffer_t *ring_buffer, size_t size)
+{
+  if (size > ring_buffer->size)
+  {
+    return NULL;
+  }
+
+  // the data is usually contiguous already, only when it wraps around the
+  // end of the memory does it need to be moved...
+  if (ring_buffer->head + size > ring_buffer->capacity)
+  {
+    ring_buffer_realloc(ring_buffer, ring_buffer->capacity);
+  }
+  return ring_buffer->data + ring_buffer->head;
+}
+
+void ring_buffer_consume(ring_buffer_t *ring_buffer, size_t size)
+{
+  if (size >= ring_buffer->size)
+  {
+    // start again from the beginning of the memory, so that the
+    // next frames are unlikely to wrap around...
+    ring_buffer_clear(ring_buffer);
+    return;
+  }
+
+  ring_buffer->head += size;
+  if (ring_buffer->head >= ring_buffer->capacity)
+  {
+    ring_buffer->head -= ring_buffer->capacity;
+  }
+  ring_buffer->size -= size;
+}
+
+static void ring_buffer_reserve_frame(ring_buffer_t *ring_buffer, size_t frame_size)
+{
+  // once the size of a partial frame is known the memory for all of it is
+  // allocated in one go, rather than growing as the rest of it arrives...
+  if (frame_size > 0 && (ring_buffer->data == NULL || frame_size > ring_buffer->capacity))
+  {
+    ring_buffer_realloc(ring_buffer, frame_size > ring_buffer->capacity ? frame_size : ring_buffer->capacity);
+  }
+}
+
+bool ring_buffer_read_frames(ring_buffer_t *ring_buffer, const unsigned char *data, size_t size,
+  ring_buffer_frame_size_func_t frame_size_func, ring_buffer_frame_func_t frame_func, void *arg)
+{
+  // when nothing is buffered the complete frames are handed over straight
+  // from the data, and only a trailing partial frame is buffered...
+  if (ring_buffer_get_empty(ring_buffer))
+  {
+    size_t frame_size = 0;
+    while (size > 0)
+    {
+      size_t header_size = size < RING_BUFFER_MAX_HEADER_SIZE ? size : RING_BUFFER_MAX_HEADER_SIZE;
+      frame_size = frame_size_func(data, header_size, arg);
+      if (frame_size == RING_BUFFER_INVALID_FRAME_SIZE)
+      {
+        return false;
+      }
+
+      if (frame_size == 0 || frame_size > size)
+      {
+        break;
+      }
+
+      if (!frame_func(data, frame_size, arg))
+      {
+        return false;
+      }
+
+      data += frame_size;
+      size -= frame_size;
+      frame_size = 0;
+    }
+
+    ring_buffer_reserve_frame(ring_buffer, frame_size);
+    ring_buffer_write(ring_buffer, data, size);
+    return true;
+  }
+
+  ring_buffer_write(ring_buffer, data, size);
+  while (!ring_buffer_get_empty(ring_buffer))
+  {
+    unsigned char header[RING_BUFFER_MAX_HEADER_SIZE];
+    size_t header_size = ring_buffer_peek(ring_buffer, header, sizeof(header));
+    size_t frame_size = frame_size_func(header, header_size, arg);
+    if (frame_size == RING_BUFFER_INVALID_FRAME_SIZE)
+    {
+      return false;
+    }
+
+    if (frame_size == 0 || frame_size > ring_buffer_get_size(ring_buffer))
+    {
+      ring_buffer_reserve_frame(ring_buffer, frame_size);
+      break;
+    }
+
+    const unsigned char *frame = ring_buffer_get_data(ring_buffer, frame_size);
+    if (!frame_func(frame, frame_size, arg))
+    {
+      return false;
+    }
+
+    ring_buffer_consume(ring_buffer, frame_size);
+  }
+  return true;
+}
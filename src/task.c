@@ -5,9 +5,13 @@
  * Written by Caleb Marshall <anythingtechpro@gmail.com>, November 2nd, 2018
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
 #include <stdbool.h>
-#include <stdarg.h>
-#include <sched.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "log.h"
@@ -15,86 +19,884 @@
 
 #include "task.h"
 
-bool taskmgr_init(void)
+static void task_deque_init(task_deque_t *deque)
 {
-  taskmgr_task_queue = queue_init();
-  taskmgr_scheduler_queue = queue_init();
+  deque->tasks = malloc(sizeof(task_t*) * TASKMGR_DEQUE_SIZE);
+  deque->capacity = TASKMGR_DEQUE_SIZE;
+  deque->head = 0;
+  deque->size = 0;
+}
 
-  log_info("Initialized taskmgr.");
-  return true;
+static void task_deque_free(task_deque_t *deque)
+{
+  free(deque->tasks);
+  deque->tasks = NULL;
+  deque->capacity = 0;
+  deque->head = 0;
+  deque->size = 0;
 }
 
-void taskmgr_run(void)
+// the functions below expect the deque's scheduler to be locked, the
+// capacity is always a power of two...
+static void task_deque_push_back(task_deque_t *deque, task_t *task)
 {
-  while (!taskmgr_terminated)
+  if (deque->size == deque->capacity)
   {
-    if (!queue_get_empty(taskmgr_task_queue))
+    task_t **tasks = malloc(sizeof(task_t*) * deque->capacity * 2);
+    for (size_t i = 0; i < deque->size; i++)
     {
-      task_t *task = queue_pop_left(taskmgr_task_queue);
-      if (!task)
+      tasks[i] = deque->tasks[(deque->head + i) & (deque->capacity - 1)];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity *= 2;
+    deque->head = 0;
+  }
+  deque->tasks[(deque->head + deque->size) & (deque->capacity - 1)] = task;
+  deque->size++;
+}
+
+static task_t* task_deque_pop_back(task_deque_t *deque)
+{
+  if (deque->size == 0)
+  {
+    return NULL;
+  }
+  deque->size--;
+  return deque->tasks[(deque->head + deque->size) & (deque->capacity - 1)];
+}
+
+static task_t* task_deque_pop_front(task_deque_t *deque)
+{
+  if (deque->size == 0)
+  {
+    return NULL;
+  }
+  task_t *task = deque->tasks[deque->head];
+  deque->head = (deque->head + 1) & (deque->capacity - 1);
+  deque->size--;
+  return task;
+}
+
+static void taskmgr_push_deadline(task_t *task)
+{
+  // expects the task manager to be locked, the list is kept in deadline
+  // order, which a task with the same deadline as others goes after...
+  task->due_by = task->due + task->deadline;
+  task_t **next = &taskmgr_deadline_head;
+  while (*next && (*next)->due_by <= task->due_by)
+  {
+    next = &(*next)->ready_next;
+  }
+  task->ready_next = *next;
+  *next = task;
+
+  atomic_store(&taskmgr_next_due_by, taskmgr_deadline_head->due_by);
+  atomic_fetch_add(&taskmgr_num_deadline_ready, 1);
+  atomic_fetch_add(&taskmgr_num_ready, 1);
+}
+
+static void taskmgr_push_ready(task_t *task)
+{
+  // expects the task manager to be locked...
+  if (task->deadline > 0)
+  {
+    taskmgr_push_deadline(task);
+    return;
+  }
+
+  task_priority_t priority = task->priority;
+  task->ready_next = NULL;
+  if (taskmgr_ready_tail[priority])
+  {
+    taskmgr_ready_tail[priority]->ready_next = task;
+  }
+  else
+  {
+    taskmgr_ready_head[priority] = task;
+  }
+  taskmgr_ready_tail[priority] = task;
+  atomic_fetch_add(&taskmgr_num_ready_by_priority[priority], 1);
+  atomic_fetch_add(&taskmgr_num_ready, 1);
+}
+
+static task_t* taskmgr_pop_ready(task_priority_t priority)
+{
+  // expects the task manager to be locked...
+  task_t *task = taskmgr_ready_head[priority];
+  if (!task)
+  {
+    return NULL;
+  }
+
+  taskmgr_ready_head[priority] = task->ready_next;
+  if (!taskmgr_ready_head[priority])
+  {
+    taskmgr_ready_tail[priority] = NULL;
+  }
+  task->ready_next = NULL;
+  atomic_fetch_sub(&taskmgr_num_ready_by_priority[priority], 1);
+  atomic_fetch_sub(&taskmgr_num_ready, 1);
+  return task;
+}
+
+static task_t* taskmgr_pop_deadline(void)
+{
+  // expects the task manager to be locked...
+  task_t *task = taskmgr_deadline_head;
+  if (!task)
+  {
+    return NULL;
+  }
+
+  taskmgr_deadline_head = task->ready_next;
+  task->ready_next = NULL;
+  atomic_store(&taskmgr_next_due_by, taskmgr_deadline_head ? taskmgr_deadline_head->due_by : UINT64_MAX);
+  atomic_fetch_sub(&taskmgr_num_deadline_ready, 1);
+  atomic_fetch_sub(&taskmgr_num_ready, 1);
+  return task;
+}
+
+static uint64_t taskmgr_get_delay_ns(double delay)
+{
+  return delay > 0 ? (uint64_t)(delay * TASKMGR_NSEC_PER_SEC) : 0;
+}
+
+static uint64_t taskmgr_get_next_due(task_t *task, uint64_t now)
+{
+  switch (task->period_mode)
+  {
+    case TASK_PERIOD_FIXED_RATE:
+      {
+        // keep to the times the task was first scheduled at, a task which
+        // has fallen behind runs once for the periods it has missed...
+        uint64_t due = task->due + task->period;
+        if (due < now)
+        {
+          due += (now - due) / task->period * task->period;
+        }
+        return due;
+      }
+    case TASK_PERIOD_FIXED_DELAY:
+      return now + task->period;
+    case TASK_PERIOD_NONE:
+    default:
+      return now + taskmgr_get_delay_ns(task->delay);
+  }
+}
+
+static void taskmgr_schedule_task(task_t *task)
+{
+  // expects the task manager to be locked...
+  timer_wheel_add(taskmgr_timer_wheel, &task->timer, (double)task->due / TASKMGR_NSEC_PER_SEC);
+}
+
+static void taskmgr_on_task_due(timer_wheel_timer_t *timer, void *arg)
+{
+  // called while advancing the timer wheel, with the task manager locked...
+  task_t *task = arg;
+  atomic_store(&task->state, TASK_STATE_QUEUED);
+  taskmgr_push_ready(task);
+}
+
+static task_scheduler_t* taskmgr_get_current_scheduler(void)
+{
+  // threads which aren't schedulers run tasks as the main scheduler...
+  return taskmgr_current_scheduler ? taskmgr_current_scheduler : taskmgr_main_scheduler;
+}
+
+static void taskmgr_push_local(task_scheduler_t *scheduler, task_t **tasks, int num_tasks)
+{
+  // the tasks are pushed in reverse, so that the first of them is the
+  // first to be popped again...
+  pthread_mutex_lock(&scheduler->deque_mutex);
+  for (int i = num_tasks - 1; i >= 0; i--)
+  {
+    task_deque_push_back(&scheduler->deques[tasks[i]->priority], tasks[i]);
+  }
+  pthread_mutex_unlock(&scheduler->deque_mutex);
+}
+
+static task_t* taskmgr_take_local(task_scheduler_t *scheduler, task_priority_t priority)
+{
+  pthread_mutex_lock(&scheduler->deque_mutex);
+  task_t *task = task_deque_pop_back(&scheduler->deques[priority]);
+  pthread_mutex_unlock(&scheduler->deque_mutex);
+  return task;
+}
+
+static void taskmgr_drain_inbox(task_scheduler_t *scheduler)
+{
+  // the inbox has a single consumer, whichever scheduler gets here first
+  // while the others go on to their own tasks...
+  if (mpsc_queue_get_size(taskmgr_inbox) == 0 || atomic_flag_test_and_set(&taskmgr_inbox_draining))
+  {
+    return;
+  }
+
+  task_t *tasks[TASKMGR_MAX_BATCH];
+  int num_tasks = 0;
+  while (num_tasks < TASKMGR_MAX_BATCH && (tasks[num_tasks] = mpsc_queue_pop(taskmgr_inbox)))
+  {
+    num_tasks++;
+  }
+  atomic_flag_clear(&taskmgr_inbox_draining);
+
+  if (num_tasks == 0)
+  {
+    return;
+  }
+  taskmgr_push_local(scheduler, tasks, num_tasks);
+  atomic_fetch_sub(&taskmgr_num_ready, num_tasks);
+  if (num_tasks > 1)
+  {
+    taskmgr_wake();
+  }
+}
+
+static task_t* taskmgr_take_ready(task_scheduler_t *scheduler, task_priority_t priority)
+{
+  if (atomic_load(&taskmgr_num_ready_by_priority[priority]) == 0)
+  {
+    return NULL;
+  }
+
+  // take a share of the other ready tasks along with the first one, so
+  // that the ready list isn't locked for every task that gets run...
+  task_t *tasks[TASKMGR_MAX_BATCH];
+  int num_tasks = 0;
+  pthread_mutex_lock(&taskmgr_mutex);
+  int num_wanted = 1 + atomic_load(&taskmgr_num_ready_by_priority[priority]) /
+    (atomic_load(&taskmgr_num_running_schedulers) + 1);
+  while (num_tasks < num_wanted && num_tasks < TASKMGR_MAX_BATCH)
+  {
+    task_t *task = taskmgr_pop_ready(priority);
+    if (!task)
+    {
+      break;
+    }
+    tasks[num_tasks++] = task;
+  }
+  pthread_mutex_unlock(&taskmgr_mutex);
+
+  if (num_tasks == 0)
+  {
+    return NULL;
+  }
+  if (num_tasks > 1)
+  {
+    taskmgr_push_local(scheduler, tasks + 1, num_tasks - 1);
+    taskmgr_wake();
+  }
+  return tasks[0];
+}
+
+static task_t* taskmgr_take_deadline(bool urgent_only)
+{
+  // the tasks with a deadline aren't taken early unless there's nothing
+  // else to run...
+  if (atomic_load(&taskmgr_num_deadline_ready) == 0)
+  {
+    return NULL;
+  }
+  uint64_t now = taskmgr_get_time_ns();
+  uint64_t slack = (uint64_t)(TASKMGR_DEADLINE_SLACK * TASKMGR_NSEC_PER_SEC);
+  if (urgent_only && atomic_load(&taskmgr_next_due_by) > now + slack)
+  {
+    return NULL;
+  }
+
+  task_t *task = NULL;
+  pthread_mutex_lock(&taskmgr_mutex);
+  if (taskmgr_deadline_head && (!urgent_only || taskmgr_deadline_head->due_by <= now + slack))
+  {
+    task = taskmgr_pop_deadline();
+  }
+  pthread_mutex_unlock(&taskmgr_mutex);
+  return task;
+}
+
+static task_t* taskmgr_steal(task_scheduler_t *scheduler)
+{
+  // take half the tasks of the highest priority of the first other
+  // scheduler found with any, starting from a random one...
+  task_t *tasks[TASKMGR_MAX_BATCH];
+  int num_tasks = 0;
+  pthread_mutex_lock(&taskmgr_scheduler_mutex);
+  int num_schedulers = atomic_load(&taskmgr_num_running_schedulers);
+  if (num_schedulers > 1)
+  {
+    scheduler->seed ^= scheduler->seed << 13;
+    scheduler->seed ^= scheduler->seed >> 17;
+    scheduler->seed ^= scheduler->seed << 5;
+    int start = scheduler->seed % num_schedulers;
+    for (int i = 0; i < num_schedulers && num_tasks == 0; i++)
+    {
+      task_scheduler_t *victim = taskmgr_schedulers[(start + i) % num_schedulers];
+      if (victim == scheduler)
       {
         continue;
       }
-      if (task->delayable)
+
+      pthread_mutex_lock(&victim->deque_mutex);
+      for (int priority = 0; priority < TASK_PRIORITY_COUNT && num_tasks == 0; priority++)
       {
-        if (time(NULL) - task->timestamp < task->delay)
+        task_deque_t *deque = &victim->deques[priority];
+        size_t num_wanted = (deque->size + 1) / 2;
+        while (num_tasks < num_wanted && num_tasks < TASKMGR_MAX_BATCH)
         {
-          // put the task back into the queue since it's not
-          // time yet to call it...
-          queue_push_right(taskmgr_task_queue, task);
-          continue;
+          tasks[num_tasks++] = task_deque_pop_front(deque);
         }
       }
-      pthread_mutex_lock(&task->mutex);
-      va_list args;
-      va_copy(args, *task->args);
-      task_result_t result = task->func(task, args);
-      va_end(args);
-      pthread_mutex_unlock(&task->mutex);
-
-      // process the task result and determine what the
-      // task should do next...
-      switch (result)
+      pthread_mutex_unlock(&victim->deque_mutex);
+    }
+  }
+  pthread_mutex_unlock(&taskmgr_scheduler_mutex);
+
+  if (num_tasks == 0)
+  {
+    return NULL;
+  }
+  if (num_tasks > 1)
+  {
+    taskmgr_push_local(scheduler, tasks + 1, num_tasks - 1);
+  }
+  return tasks[0];
+}
+
+static int taskmgr_get_priority_order(task_scheduler_t *scheduler, task_priority_t *priorities)
+{
+  // with weighted priorities the classes which have runs left come first,
+  // otherwise it's simply the highest first...
+  int num_priorities = 0;
+  bool weighted = taskmgr_priority_policy == TASK_PRIORITY_POLICY_WEIGHTED;
+  if (weighted)
+  {
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+      if (scheduler->credits[priority] > 0)
       {
-        case TASK_RESULT_CONT:
-          task->delayable = false;
-          queue_push_right(taskmgr_task_queue, task);
-          break;
-        case TASK_RESULT_WAIT:
-          task->delayable = true;
-          task->timestamp = time(NULL);
-          queue_push_right(taskmgr_task_queue, task);
-          break;
-        case TASK_RESULT_DONE:
-        default:
-          free_task(task);
-          break;
+        priorities[num_priorities++] = priority;
       }
     }
-    sched_yield();
   }
+  for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+  {
+    if (!weighted || scheduler->credits[priority] <= 0)
+    {
+      priorities[num_priorities++] = priority;
+    }
+  }
+  return num_priorities;
+}
+
+static void taskmgr_charge_priority(task_scheduler_t *scheduler, task_priority_t priority)
+{
+  // a class without runs left only gets to run when none of the classes
+  // which have some have anything ready, which starts a new round...
+  if (scheduler->credits[priority] <= 0)
+  {
+    for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+    {
+      scheduler->credits[i] = taskmgr_priority_weights[i];
+    }
+  }
+  scheduler->credits[priority]--;
 }
 
-void* taskmgr_scheduler_run()
+static task_t* taskmgr_get_next_task(task_scheduler_t *scheduler)
 {
-  taskmgr_run();
+  // tasks whose deadline is close go first, then by priority the
+  // scheduler's own tasks, which those drained from the inbox join, and the
+  // ready list which due tasks are queued on, then the other schedulers...
+  for (;;)
+  {
+    taskmgr_drain_inbox(scheduler);
+    task_t *task = taskmgr_take_deadline(true);
+    if (!task)
+    {
+      task_priority_t priorities[TASK_PRIORITY_COUNT];
+      int num_priorities = taskmgr_get_priority_order(scheduler, priorities);
+      for (int i = 0; i < num_priorities && !task; i++)
+      {
+        task = taskmgr_take_local(scheduler, priorities[i]);
+        if (!task)
+        {
+          task = taskmgr_take_ready(scheduler, priorities[i]);
+        }
+      }
+    }
+    if (!task)
+    {
+      task = taskmgr_take_deadline(false);
+    }
+    if (!task)
+    {
+      task = taskmgr_steal(scheduler);
+    }
+    if (!task)
+    {
+      return NULL;
+    }
+
+    int state = TASK_STATE_QUEUED;
+    if (atomic_compare_exchange_strong(&task->state, &state, TASK_STATE_RUNNING))
+    {
+      taskmgr_charge_priority(scheduler, task->priority);
+      return task;
+    }
+
+    // it was removed while it was queued, which leaves it to us...
+    free_task(task);
+  }
+}
+
+static int taskmgr_unlink_task(task_t *task)
+{
+  // takes the task out of the registry and off the timer wheel, returns
+  // the state it was in before...
+  pthread_mutex_lock(&taskmgr_mutex);
+  if (taskmgr_task_registry && registry_get(taskmgr_task_registry, task->id) == task)
+  {
+    registry_remove(taskmgr_task_registry, task->id);
+  }
+
+  if (taskmgr_timer_wheel)
+  {
+    timer_wheel_remove(taskmgr_timer_wheel, &task->timer);
+  }
+  int state = atomic_exchange(&task->state, TASK_STATE_REMOVED);
+  pthread_mutex_unlock(&taskmgr_mutex);
+  return state;
+}
+
+static void taskmgr_run_task(task_scheduler_t *scheduler, task_t *task)
+{
+  // how late the task is, going by when it was due or was queued...
+  uint64_t now = taskmgr_get_time_ns();
+  uint64_t lag = now > task->due ? now - task->due : 0;
+  atomic_store(&task->lag, lag);
+  if (lag > atomic_load(&task->max_lag))
+  {
+    atomic_store(&task->max_lag, lag);
+  }
+  if (task->deadline > 0 && now > task->due_by)
+  {
+    atomic_fetch_add(&task->num_missed_deadlines, 1);
+  }
+
+  pthread_mutex_lock(&task->mutex);
+  task_result_t result = task->func(task);
+  pthread_mutex_unlock(&task->mutex);
+
+  // process the task result and determine what the task should do next,
+  // unless it was removed while it ran in which case it's freed...
+  int state = TASK_STATE_RUNNING;
+  switch (result)
+  {
+    case TASK_RESULT_CONT:
+      // back of the ready list, behind the tasks that are waiting...
+      if (atomic_compare_exchange_strong(&task->state, &state, TASK_STATE_QUEUED))
+      {
+        task->due = taskmgr_get_time_ns();
+        pthread_mutex_lock(&taskmgr_mutex);
+        taskmgr_push_ready(task);
+        pthread_mutex_unlock(&taskmgr_mutex);
+        taskmgr_wake();
+        task = NULL;
+      }
+      break;
+    case TASK_RESULT_WAIT:
+      pthread_mutex_lock(&taskmgr_mutex);
+      if (taskmgr_timer_wheel && atomic_compare_exchange_strong(&task->state, &state, TASK_STATE_WAITING))
+      {
+        task->due = taskmgr_get_next_due(task, taskmgr_get_time_ns());
+        taskmgr_schedule_task(task);
+        task = NULL;
+      }
+      pthread_mutex_unlock(&taskmgr_mutex);
+      break;
+    case TASK_RESULT_DONE:
+    default:
+      taskmgr_unlink_task(task);
+      break;
+  }
+
+  if (task)
+  {
+    free_task(task);
+  }
+}
+
+static task_scheduler_t* taskmgr_init_scheduler(void)
+{
+  task_scheduler_t *task_scheduler = malloc(sizeof(task_scheduler_t));
+  pthread_mutex_lock(&taskmgr_scheduler_mutex);
+  int num_schedulers = atomic_load(&taskmgr_num_running_schedulers);
+  if (num_schedulers >= TASKMGR_MAX_SCHEDULERS)
+  {
+    pthread_mutex_unlock(&taskmgr_scheduler_mutex);
+    free(task_scheduler);
+    return NULL;
+  }
+
+  taskmgr_next_scheduler_id++;
+  task_scheduler->id = taskmgr_next_scheduler_id;
+  task_scheduler->has_thread = false;
+  atomic_init(&task_scheduler->terminated, false);
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    task_deque_init(&task_scheduler->deques[i]);
+    task_scheduler->credits[i] = 0;
+  }
+  pthread_mutex_init(&task_scheduler->deque_mutex, NULL);
+  task_scheduler->seed = 2463534242u + task_scheduler->id * 2654435761u;
+
+  taskmgr_schedulers[num_schedulers] = task_scheduler;
+  registry_add(taskmgr_scheduler_registry, task_scheduler->id, task_scheduler);
+  atomic_store(&taskmgr_num_running_schedulers, num_schedulers + 1);
+  pthread_mutex_unlock(&taskmgr_scheduler_mutex);
+  return task_scheduler;
+}
+
+uint64_t taskmgr_get_time_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * TASKMGR_NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+double taskmgr_get_time(void)
+{
+  return (double)taskmgr_get_time_ns() / TASKMGR_NSEC_PER_SEC;
+}
+
+void taskmgr_set_num_schedulers(int num_schedulers)
+{
+  taskmgr_num_schedulers = num_schedulers;
+}
+
+int taskmgr_get_num_schedulers(void)
+{
+  return taskmgr_num_schedulers;
+}
+
+void taskmgr_set_priority_policy(task_priority_policy_t priority_policy)
+{
+  taskmgr_priority_policy = priority_policy;
+}
+
+task_priority_policy_t taskmgr_get_priority_policy(void)
+{
+  return taskmgr_priority_policy;
+}
+
+void taskmgr_set_priority_weight(task_priority_t priority, int weight)
+{
+  if (priority < 0 || priority >= TASK_PRIORITY_COUNT)
+  {
+    return;
+  }
+  taskmgr_priority_weights[priority] = weight > 0 ? weight : 1;
+}
+
+int taskmgr_get_priority_weight(task_priority_t priority)
+{
+  if (priority < 0 || priority >= TASK_PRIORITY_COUNT)
+  {
+    return 0;
+  }
+  return taskmgr_priority_weights[priority];
+}
+
+bool taskmgr_init(void)
+{
+  taskmgr_task_registry = registry_init();
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    taskmgr_ready_head[i] = NULL;
+    taskmgr_ready_tail[i] = NULL;
+    atomic_store(&taskmgr_num_ready_by_priority[i], 0);
+  }
+  taskmgr_deadline_head = NULL;
+  atomic_store(&taskmgr_num_deadline_ready, 0);
+  atomic_store(&taskmgr_next_due_by, UINT64_MAX);
+  atomic_store(&taskmgr_num_ready, 0);
+  taskmgr_inbox = mpsc_queue_init(TASKMGR_INBOX_SIZE);
+  atomic_flag_clear(&taskmgr_inbox_draining);
+  taskmgr_timer_wheel = timer_wheel_init(TASKMGR_TIMER_RESOLUTION, taskmgr_get_time());
+  pthread_mutex_init(&taskmgr_mutex, NULL);
+  atomic_store(&taskmgr_terminated, false);
+
+  taskmgr_wake_pending = false;
+  taskmgr_num_idle = 0;
+  atomic_store(&taskmgr_main_idle, false);
+  pthread_mutex_init(&taskmgr_wait_mutex, NULL);
+  pthread_cond_init(&taskmgr_wait_cond, NULL);
+
+  // the thread which runs the task manager is a scheduler of its own, the
+  // others get a thread each, one per logical core by default...
+  int num_schedulers = taskmgr_num_schedulers;
+  if (num_schedulers <= 0)
+  {
+    num_schedulers = get_num_logical_cores();
+  }
+  if (num_schedulers <= 0)
+  {
+    num_schedulers = 1;
+  }
+  if (num_schedulers > TASKMGR_MAX_SCHEDULERS)
+  {
+    num_schedulers = TASKMGR_MAX_SCHEDULERS;
+  }
+
+  taskmgr_next_scheduler_id = -1;
+  atomic_store(&taskmgr_num_running_schedulers, 0);
+  pthread_mutex_init(&taskmgr_scheduler_mutex, NULL);
+  taskmgr_scheduler_registry = registry_init();
+  taskmgr_main_scheduler = taskmgr_init_scheduler();
+  for (int i = 1; i < num_schedulers; i++)
+  {
+    if (!add_scheduler())
+    {
+      return false;
+    }
+  }
+
+  log_info("Initialized taskmgr with %d scheduler(s).", num_schedulers);
+  return true;
+}
+
+void taskmgr_run(void)
+{
+  // run the tasks that are due, then sleep until the next one is due or
+  // until something else wakes us up...
+  taskmgr_current_scheduler = taskmgr_main_scheduler;
+  while (!atomic_load(&taskmgr_terminated))
+  {
+    double timeout = taskmgr_run_pending();
+    if (atomic_load(&taskmgr_terminated))
+    {
+      break;
+    }
+    taskmgr_wait(timeout);
+  }
+}
+
+double taskmgr_run_pending(void)
+{
+  task_scheduler_t *scheduler = taskmgr_get_current_scheduler();
+  if (atomic_load(&taskmgr_terminated))
+  {
+    return 0;
+  }
+
+  // move the tasks which have become due over to the ready list, only one
+  // scheduler does so at a time while the others carry on...
+  if (pthread_mutex_trylock(&taskmgr_mutex) == 0)
+  {
+    size_t num_due = timer_wheel_advance(taskmgr_timer_wheel, taskmgr_get_time());
+    pthread_mutex_unlock(&taskmgr_mutex);
+    if (num_due > 1)
+    {
+      taskmgr_wake();
+    }
+  }
+
+  // run a limited number of tasks before coming back, so that the thread
+  // gets to wait on other events too...
+  for (int i = 0; i < TASKMGR_MAX_RUN && !atomic_load(&taskmgr_terminated); i++)
+  {
+    task_t *task = taskmgr_get_next_task(scheduler);
+    if (!task)
+    {
+      break;
+    }
+    taskmgr_run_task(scheduler, task);
+  }
+  if (atomic_load(&taskmgr_terminated))
+  {
+    return 0;
+  }
+
+  // wait until the next task is due, without waiting at all if there are
+  // tasks ready to run already...
+  size_t num_local = 0;
+  pthread_mutex_lock(&scheduler->deque_mutex);
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    num_local += scheduler->deques[i].size;
+  }
+  pthread_mutex_unlock(&scheduler->deque_mutex);
+  if (num_local > 0 || atomic_load(&taskmgr_num_ready) > 0)
+  {
+    return 0;
+  }
+
+  double timeout = TASKMGR_MAX_WAIT;
+  pthread_mutex_lock(&taskmgr_mutex);
+  double deadline = timer_wheel_get_next_deadline(taskmgr_timer_wheel);
+  if (deadline >= 0 && deadline - taskmgr_get_time() < timeout)
+  {
+    timeout = deadline - taskmgr_get_time();
+  }
+  pthread_mutex_unlock(&taskmgr_mutex);
+  return timeout > 0 ? timeout : 0;
+}
+
+void* taskmgr_scheduler_run(void *arg)
+{
+  task_scheduler_t *task_scheduler = arg;
+  taskmgr_current_scheduler = task_scheduler;
+  while (!atomic_load(&taskmgr_terminated) && !atomic_load(&task_scheduler->terminated))
+  {
+    double timeout = taskmgr_run_pending();
+    if (atomic_load(&taskmgr_terminated) || atomic_load(&task_scheduler->terminated))
+    {
+      break;
+    }
+    taskmgr_wait(timeout);
+  }
   return NULL;
 }
 
 bool taskmgr_shutdown(void)
 {
-  taskmgr_terminated = true;
+  // stop the scheduler threads before anything is freed...
+  atomic_store(&taskmgr_terminated, true);
+  pthread_mutex_lock(&taskmgr_wait_mutex);
+  pthread_cond_broadcast(&taskmgr_wait_cond);
+  pthread_mutex_unlock(&taskmgr_wait_mutex);
+
+  while (atomic_load(&taskmgr_num_running_schedulers) > 0)
+  {
+    pthread_mutex_lock(&taskmgr_scheduler_mutex);
+    task_scheduler_t *task_scheduler = taskmgr_schedulers[atomic_load(&taskmgr_num_running_schedulers) - 1];
+    pthread_mutex_unlock(&taskmgr_scheduler_mutex);
+    remove_scheduler(task_scheduler);
+  }
+  taskmgr_main_scheduler = NULL;
+  registry_free(taskmgr_scheduler_registry);
+  taskmgr_scheduler_registry = NULL;
+  pthread_mutex_destroy(&taskmgr_scheduler_mutex);
+
+  // the tasks are left to their owners, only the timer wheel goes...
+  pthread_mutex_lock(&taskmgr_mutex);
+  timer_wheel_free(taskmgr_timer_wheel);
+  taskmgr_timer_wheel = NULL;
+  registry_free(taskmgr_task_registry);
+  taskmgr_task_registry = NULL;
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    taskmgr_ready_head[i] = NULL;
+    taskmgr_ready_tail[i] = NULL;
+    atomic_store(&taskmgr_num_ready_by_priority[i], 0);
+  }
+  taskmgr_deadline_head = NULL;
+  atomic_store(&taskmgr_num_deadline_ready, 0);
+  atomic_store(&taskmgr_next_due_by, UINT64_MAX);
+  atomic_store(&taskmgr_num_ready, 0);
+  pthread_mutex_unlock(&taskmgr_mutex);
+
+  while (mpsc_queue_pop(taskmgr_inbox))
+  {
+  }
+  mpsc_queue_free(taskmgr_inbox);
+  taskmgr_inbox = NULL;
+
+  pthread_mutex_lock(&taskmgr_task_pool_mutex);
+  while (taskmgr_task_pool)
+  {
+    task_t *task = taskmgr_task_pool;
+    taskmgr_task_pool = task->ready_next;
+    pthread_mutex_destroy(&task->mutex);
+    free(task);
+  }
+  taskmgr_task_pool_size = 0;
+  pthread_mutex_unlock(&taskmgr_task_pool_mutex);
 
-  queue_free(taskmgr_task_queue);
-  queue_free(taskmgr_scheduler_queue);
+  taskmgr_wait_func = NULL;
+  taskmgr_wake_func = NULL;
 
   log_info("Shutdown taskmgr.");
   return true;
 }
 
+void taskmgr_set_wait_func(taskmgr_wait_func_t wait_func, taskmgr_wake_func_t wake_func)
+{
+  taskmgr_wait_func = wait_func;
+  taskmgr_wake_func = wake_func;
+}
+
+void taskmgr_wait(double timeout)
+{
+  if (timeout <= 0)
+  {
+    return;
+  }
+
+  // the main scheduler waits with the wait function if there is one,
+  // tasks that become ready meanwhile wake it up if no other scheduler
+  // is idle...
+  if (taskmgr_wait_func && taskmgr_get_current_scheduler() == taskmgr_main_scheduler)
+  {
+    atomic_store(&taskmgr_main_idle, true);
+    if (atomic_load(&taskmgr_num_ready) == 0)
+    {
+      taskmgr_wait_func(timeout);
+    }
+    atomic_store(&taskmgr_main_idle, false);
+    return;
+  }
+
+  // otherwise sleep on the condition variable which is signaled when a
+  // task becomes ready...
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += (time_t)timeout;
+  deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+  if (deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&taskmgr_wait_mutex);
+  taskmgr_num_idle++;
+  while (!taskmgr_wake_pending && !atomic_load(&taskmgr_terminated) && atomic_load(&taskmgr_num_ready) == 0)
+  {
+    if (pthread_cond_timedwait(&taskmgr_wait_cond, &taskmgr_wait_mutex, &deadline) != 0)
+    {
+      break;
+    }
+  }
+  taskmgr_num_idle--;
+  taskmgr_wake_pending = false;
+  pthread_mutex_unlock(&taskmgr_wait_mutex);
+}
+
+void taskmgr_wake(void)
+{
+  // wake up one of the idle schedulers, or the main scheduler if it's
+  // the only one waiting...
+  pthread_mutex_lock(&taskmgr_wait_mutex);
+  bool woken = taskmgr_num_idle > 0;
+  if (woken)
+  {
+    taskmgr_wake_pending = true;
+    pthread_cond_signal(&taskmgr_wait_cond);
+  }
+  pthread_mutex_unlock(&taskmgr_wait_mutex);
+
+  if (!woken && taskmgr_wake_func && atomic_load(&taskmgr_main_idle))
+  {
+    taskmgr_wake_func();
+  }
+}
+
 bool has_task(task_t *task)
 {
-  return queue_get_index(taskmgr_task_queue, task) != -1;
+  return task && get_task_by_id(task->id) == task;
 }
 
 bool has_task_by_id(int id)
@@ -102,43 +904,159 @@ bool has_task_by_id(int id)
   return get_task_by_id(id) != NULL;
 }
 
-task_t* add_task(callable_func_t func, double delay, ...)
+static task_t* taskmgr_alloc_task(void)
 {
-  va_list args;
-  va_start(args, delay);
+  pthread_mutex_lock(&taskmgr_task_pool_mutex);
+  task_t *task = taskmgr_task_pool;
+  if (task)
+  {
+    taskmgr_task_pool = task->ready_next;
+    taskmgr_task_pool_size--;
+  }
+  pthread_mutex_unlock(&taskmgr_task_pool_mutex);
 
-  taskmgr_next_task_id++;
+  // the pooled tasks keep their mutex initialized...
+  if (!task)
+  {
+    task = malloc(sizeof(task_t));
+    pthread_mutex_init(&task->mutex, NULL);
+  }
+  return task;
+}
 
-  task_t* task = malloc(sizeof(task_t));
-  task->id = taskmgr_next_task_id;
+static task_t* taskmgr_add_task(callable_func_t func, double delay, uint64_t period,
+  task_period_t period_mode, task_priority_t priority, double deadline, const void *payload, size_t size,
+  task_payload_free_func_t free_func)
+{
+  task_t* task = taskmgr_alloc_task();
   task->func = func;
-  task->args = &args;
-  task->delayable = true;
+  task->payload_data = NULL;
+  task->payload_size = size;
+  task->payload_free_func = free_func;
+  if (size > 0)
+  {
+    task->payload_data = size <= TASK_PAYLOAD_SIZE ? task->payload.data : malloc(size);
+    if (payload)
+    {
+      memcpy(task->payload_data, payload, size);
+    }
+    else
+    {
+      memset(task->payload_data, 0, size);
+    }
+  }
   task->delay = delay;
-  task->timestamp = time(NULL);
+  task->due = taskmgr_get_time_ns() + taskmgr_get_delay_ns(delay);
+  task->period = period;
+  task->period_mode = period_mode;
+  task->priority = priority >= 0 && priority < TASK_PRIORITY_COUNT ? priority : TASK_PRIORITY_NORMAL;
+  task->deadline = taskmgr_get_delay_ns(deadline);
+  task->due_by = 0;
+  atomic_init(&task->num_missed_deadlines, 0);
+  atomic_init(&task->lag, 0);
+  atomic_init(&task->max_lag, 0);
+  atomic_init(&task->state, delay > 0 ? TASK_STATE_WAITING : TASK_STATE_QUEUED);
+  task->ready_next = NULL;
+  timer_wheel_timer_init(&task->timer, taskmgr_on_task_due, task);
+
+  // a task added by a scheduler's own task is queued on that scheduler,
+  // any other goes through the inbox, while those with a deadline go on
+  // the ready list...
+  task_scheduler_t *task_scheduler = task->deadline > 0 ? NULL : taskmgr_current_scheduler;
+  bool use_inbox = delay <= 0 && !task_scheduler && task->deadline == 0 && taskmgr_inbox;
+  pthread_mutex_lock(&taskmgr_mutex);
+  taskmgr_next_task_id++;
+  task->id = taskmgr_next_task_id;
+  registry_add(taskmgr_task_registry, task->id, task);
 
-  pthread_mutex_init(&task->mutex, NULL);
-  queue_push_right(taskmgr_task_queue, task);
+  if (delay > 0)
+  {
+    taskmgr_schedule_task(task);
+  }
+  else if (!task_scheduler && !use_inbox)
+  {
+    taskmgr_push_ready(task);
+  }
+  pthread_mutex_unlock(&taskmgr_mutex);
+
+  if (delay <= 0 && task_scheduler)
+  {
+    taskmgr_push_local(task_scheduler, &task, 1);
+  }
+  else if (use_inbox)
+  {
+    // counted first so that no scheduler goes to sleep on it, the ready
+    // list takes it if the inbox is full...
+    atomic_fetch_add(&taskmgr_num_ready, 1);
+    if (!mpsc_queue_push(taskmgr_inbox, task))
+    {
+      atomic_fetch_sub(&taskmgr_num_ready, 1);
+      pthread_mutex_lock(&taskmgr_mutex);
+      taskmgr_push_ready(task);
+      pthread_mutex_unlock(&taskmgr_mutex);
+    }
+  }
+
+  // a scheduler may be waiting on a later task, or have nothing to do...
+  taskmgr_wake();
   return task;
 }
 
-task_t* get_task_by_id(int id)
+task_t* add_task(callable_func_t func, double delay)
 {
-  for (int i = 0; i <= taskmgr_task_queue->max_index; i++)
+  return add_task_ex(func, delay, TASK_PRIORITY_NORMAL, 0, NULL, 0, NULL);
+}
+
+task_t* add_task_with_payload(callable_func_t func, double delay, const void *payload, size_t size,
+  task_payload_free_func_t free_func)
+{
+  return add_task_ex(func, delay, TASK_PRIORITY_NORMAL, 0, payload, size, free_func);
+}
+
+task_t* add_periodic_task(callable_func_t func, double period, task_period_t period_mode)
+{
+  return add_periodic_task_ex(func, period, period_mode, TASK_PRIORITY_NORMAL, 0, NULL, 0, NULL);
+}
+
+task_t* add_periodic_task_with_payload(callable_func_t func, double period, task_period_t period_mode,
+  const void *payload, size_t size, task_payload_free_func_t free_func)
+{
+  return add_periodic_task_ex(func, period, period_mode, TASK_PRIORITY_NORMAL, 0, payload, size, free_func);
+}
+
+task_t* add_task_ex(callable_func_t func, double delay, task_priority_t priority, double deadline,
+  const void *payload, size_t size, task_payload_free_func_t free_func)
+{
+  return taskmgr_add_task(func, delay, 0, TASK_PERIOD_NONE, priority, deadline, payload, size, free_func);
+}
+
+task_t* add_periodic_task_ex(callable_func_t func, double period, task_period_t period_mode,
+  task_priority_t priority, double deadline, const void *payload, size_t size,
+  task_payload_free_func_t free_func)
+{
+  // the first run is a period from now, the task is then scheduled by
+  // its period for as long as it returns TASK_RESULT_WAIT...
+  uint64_t period_ns = taskmgr_get_delay_ns(period);
+  if (period_ns == 0)
   {
-    task_t *task = queue_get(taskmgr_task_queue, i);
-    if (task->id == id)
-    {
-      return task;
-    }
+    period_ns = 1;
   }
-  return NULL;
+  return taskmgr_add_task(func, period, period_ns, period_mode, priority, deadline, payload, size, free_func);
+}
+
+task_t* get_task_by_id(int id)
+{
+  return taskmgr_task_registry ? registry_get(taskmgr_task_registry, id) : NULL;
 }
 
 void remove_task(task_t *task)
 {
-  queue_remove_object(taskmgr_task_queue, task);
-  free_task(task);
+  // a task which is queued or running is freed by its scheduler once it
+  // comes across it...
+  if (taskmgr_unlink_task(task) == TASK_STATE_WAITING)
+  {
+    free_task(task);
+  }
 }
 
 void remove_task_by_id(int id)
@@ -151,17 +1069,63 @@ void remove_task_by_id(int id)
   remove_task(task);
 }
 
+void* task_get_payload(task_t *task)
+{
+  return task->payload_data;
+}
+
+size_t task_get_payload_size(task_t *task)
+{
+  return task->payload_size;
+}
+
+double task_get_lag(task_t *task)
+{
+  return (double)atomic_load(&task->lag) / TASKMGR_NSEC_PER_SEC;
+}
+
+double task_get_max_lag(task_t *task)
+{
+  return (double)atomic_load(&task->max_lag) / TASKMGR_NSEC_PER_SEC;
+}
+
+int task_get_missed_deadlines(task_t *task)
+{
+  return atomic_load(&task->num_missed_deadlines);
+}
+
 void free_task(task_t *task)
 {
-  va_end(*task->args);
+  if (task->payload_free_func)
+  {
+    task->payload_free_func(task->payload_data);
+  }
+  if (task->payload_data && task->payload_data != task->payload.data)
+  {
+    free(task->payload_data);
+  }
+  task->payload_data = NULL;
+  task->payload_size = 0;
+  task->payload_free_func = NULL;
 
   task->id = -1;
-  task->delayable = false;
   task->delay = 0;
-  task->timestamp = 0;
 
-  pthread_mutex_destroy(&task->mutex);
-  free(task);
+  pthread_mutex_lock(&taskmgr_task_pool_mutex);
+  if (taskmgr_task_pool_size < TASKMGR_TASK_POOL_SIZE)
+  {
+    task->ready_next = taskmgr_task_pool;
+    taskmgr_task_pool = task;
+    taskmgr_task_pool_size++;
+    task = NULL;
+  }
+  pthread_mutex_unlock(&taskmgr_task_pool_mutex);
+
+  if (task)
+  {
+    pthread_mutex_destroy(&task->mutex);
+    free(task);
+  }
 }
 
 void free_task_by_id(int id)
@@ -176,7 +1140,18 @@ void free_task_by_id(int id)
 
 bool has_scheduler(task_scheduler_t *task_scheduler)
 {
-  return queue_get_index(taskmgr_scheduler_queue, task_scheduler) != -1;
+  bool found = false;
+  pthread_mutex_lock(&taskmgr_scheduler_mutex);
+  for (int i = 0; i < atomic_load(&taskmgr_num_running_schedulers); i++)
+  {
+    if (taskmgr_schedulers[i] == task_scheduler)
+    {
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&taskmgr_scheduler_mutex);
+  return found;
 }
 
 bool has_scheduler_by_id(int id)
@@ -186,43 +1161,83 @@ bool has_scheduler_by_id(int id)
 
 task_scheduler_t* add_scheduler(void)
 {
-  taskmgr_next_scheduler_id++;
-
-  task_scheduler_t* task_scheduler = malloc(sizeof(task_scheduler_t));
-  task_scheduler->id = taskmgr_next_scheduler_id;
+  task_scheduler_t* task_scheduler = taskmgr_init_scheduler();
+  if (!task_scheduler)
+  {
+    log_error("Failed to add scheduler, the maximum of %d has been reached!", TASKMGR_MAX_SCHEDULERS);
+    return NULL;
+  }
 
   if (pthread_attr_init(&task_scheduler->thread_attr) != 0)
   {
     log_error("Failed to initialize thread attribute!");
+    remove_scheduler(task_scheduler);
     return NULL;
   }
+  task_scheduler->has_thread = true;
   if (pthread_create(&task_scheduler->thread, &task_scheduler->thread_attr,
-    taskmgr_scheduler_run, NULL) != 0)
+    taskmgr_scheduler_run, task_scheduler) != 0)
   {
     log_error("Failed to initialize thread!");
+    task_scheduler->has_thread = false;
+    pthread_attr_destroy(&task_scheduler->thread_attr);
+    remove_scheduler(task_scheduler);
     return NULL;
   }
-  queue_push_right(taskmgr_scheduler_queue, task_scheduler);
   return task_scheduler;
 }
 
 task_scheduler_t* get_scheduler_by_id(int id)
 {
-  for (int i = 0; i <= taskmgr_scheduler_queue->max_index; i++)
+  return taskmgr_scheduler_registry ? registry_get(taskmgr_scheduler_registry, id) : NULL;
+}
+
+void remove_scheduler(task_scheduler_t *task_scheduler)
+{
+  // stop the scheduler's thread, once it has finished the task it's
+  // running...
+  if (task_scheduler->has_thread)
   {
-    task_scheduler_t *task_scheduler = queue_get(taskmgr_scheduler_queue, i);
-    if (task_scheduler->id == id)
+    atomic_store(&task_scheduler->terminated, true);
+    pthread_mutex_lock(&taskmgr_wait_mutex);
+    pthread_cond_broadcast(&taskmgr_wait_cond);
+    pthread_mutex_unlock(&taskmgr_wait_mutex);
+    pthread_join(task_scheduler->thread, NULL);
+  }
+
+  pthread_mutex_lock(&taskmgr_scheduler_mutex);
+  int num_schedulers = atomic_load(&taskmgr_num_running_schedulers);
+  for (int i = 0; i < num_schedulers; i++)
+  {
+    if (taskmgr_schedulers[i] == task_scheduler)
     {
-      return task_scheduler;
+      taskmgr_schedulers[i] = taskmgr_schedulers[num_schedulers - 1];
+      taskmgr_schedulers[num_schedulers - 1] = NULL;
+      registry_remove(taskmgr_scheduler_registry, task_scheduler->id);
+      atomic_store(&taskmgr_num_running_schedulers, num_schedulers - 1);
+      break;
     }
   }
-  return NULL;
-}
+  pthread_mutex_unlock(&taskmgr_scheduler_mutex);
 
-void remove_scheduler(task_scheduler_t *task_scheduler)
-{
-  queue_remove_object(taskmgr_scheduler_queue, task_scheduler);
+  // the tasks it had queued go to the ready list for the others...
+  pthread_mutex_lock(&taskmgr_mutex);
+  task_t *task = NULL;
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    while ((task = task_deque_pop_front(&task_scheduler->deques[i])))
+    {
+      taskmgr_push_ready(task);
+    }
+  }
+  pthread_mutex_unlock(&taskmgr_mutex);
+
+  if (taskmgr_main_scheduler == task_scheduler)
+  {
+    taskmgr_main_scheduler = NULL;
+  }
   free_scheduler(task_scheduler);
+  taskmgr_wake();
 }
 
 void remove_scheduler_by_id(int id)
@@ -238,7 +1253,15 @@ void remove_scheduler_by_id(int id)
 void free_scheduler(task_scheduler_t *task_scheduler)
 {
   task_scheduler->id = -1;
-  pthread_attr_destroy(&task_scheduler->thread_attr);
+  if (task_scheduler->has_thread)
+  {
+    pthread_attr_destroy(&task_scheduler->thread_attr);
+  }
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+  {
+    task_deque_free(&task_scheduler->deques[i]);
+  }
+  pthread_mutex_destroy(&task_scheduler->deque_mutex);
   free(task_scheduler);
 }
 
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "timerwheel.h"
+
+#define TIMER_WHEEL_MAX_DELTA ((uint64_t)1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_NUM_LEVELS))
+
+static uint64_t timer_wheel_get_tick(timer_wheel_t *timer_wheel, double time, bool round_up)
+{
+  double tick = time / timer_wheel->resolution;
+  if (tick <= 0)
+  {
+    return 0;
+  }
+  uint64_t whole_tick = (uint64_t)tick;
+  if (round_up && whole_tick < tick)
+  {
+    whole_tick++;
+  }
+  return whole_tick;
+}
+
+static void timer_wheel_link(timer_wheel_timer_t *head, timer_wheel_timer_t *timer)
+{
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void timer_wheel_unlink(timer_wheel_timer_t *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = timer;
+  timer->prev = timer;
+}
+
+static void timer_wheel_place(timer_wheel_t *timer_wheel, timer_wheel_timer_t *timer)
+{
+  // timers beyond the reach of the top level wait in its furthest slot
+  // and are placed again once it comes around...
+  uint64_t expires = timer->expires;
+  if (expires < timer_wheel->current)
+  {
+    timer->slot = TIMER_WHEEL_EXPIRED_SLOT;
+    timer_wheel_link(&timer_wheel->slots[timer->slot], timer);
+    return;
+  }
+
+  uint64_t delta = expires - timer_wheel->current;
+  if (delta >= TIMER_WHEEL_MAX_DELTA)
+  {
+    delta = TIMER_WHEEL_MAX_DELTA - 1;
+    expires = timer_wheel->current + delta;
+  }
+
+  int level = 0;
+  while (delta >> (TIMER_WHEEL_SLOT_BITS * (level + 1)))
+  {
+    level++;
+  }
+
+  int index = (expires >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+  timer->slot = level * TIMER_WHEEL_NUM_SLOTS + index;
+  timer_wheel_link(&timer_wheel->slots[timer->slot], timer);
+  timer_wheel->occupied[level] |= (uint64_t)1 << index;
+}
+
+static void timer_wheel_take_slot(timer_wheel_t *timer_wheel, int slot, timer_wheel_timer_t *head)
+{
+  // move the slot's timers over to the given list head...
+  timer_wheel_timer_t *slot_head = &timer_wheel->slots[slot];
+  head->next = head;
+  head->prev = head;
+  if (slot_head->next != slot_head)
+  {
+    head->next = slot_head->next;
+    head->prev = slot_head->prev;
+    head->next->prev = head;
+    head->prev->next = head;
+    slot_head->next = slot_head;
+    slot_head->prev = slot_head;
+  }
+  if (slot != TIMER_WHEEL_EXPIRED_SLOT)
+  {
+    timer_wheel->occupied[slot / TIMER_WHEEL_NUM_SLOTS] &= ~((uint64_t)1 << (slot % TIMER_WHEEL_NUM_SLOTS));
+  }
+}
+
+static size_t timer_wheel_expire(timer_wheel_t *timer_wheel, int slot)
+{
+  timer_wheel_timer_t head;
+  timer_wheel_take_slot(timer_wheel, slot, &head);
+
+  // the timers are disarmed before their function is called, any of
+  // them may add or remove other timers...
+  size_t num_expired = 0;
+  while (head.next != &head)
+  {
+    timer_wheel_timer_t *timer = head.next;
+    timer_wheel_unlink(timer);
+    timer->slot = -1;
+    timer_wheel->num_timers--;
+    num_expired++;
+    timer->func(timer, timer->arg);
+  }
+  return num_expired;
+}
+
+static void timer_wheel_cascade(timer_wheel_t *timer_wheel)
+{
+  // the lowest level has come around, so move the timers of the next slot
+  // of each level above it down, for as long as those come around too...
+  for (int level = 1; level < TIMER_WHEEL_NUM_LEVELS; level++)
+  {
+    int index = (timer_wheel->current >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+    timer_wheel_timer_t head;
+    timer_wheel_take_slot(timer_wheel, level * TIMER_WHEEL_NUM_SLOTS + index, &head);
+    while (head.next != &head)
+    {
+      timer_wheel_timer_t *timer = head.next;
+      timer_wheel_unlink(timer);
+      timer_wheel_place(timer_wheel, timer);
+    }
+
+    if (index != 0)
+    {
+      break;
+    }
+  }
+}
+
+timer_wheel_t* timer_wheel_init(double resolution, double now)
+{
+  timer_wheel_t *timer_wheel = malloc(sizeof(timer_wheel_t));
+  timer_wheel->resolution = resolution;
+  timer_wheel->current = timer_wheel_get_tick(timer_wheel, now, false);
+  timer_wheel->num_timers = 0;
+
+  for (int i = 0; i < TIMER_WHEEL_NUM_LEVELS; i++)
+  {
+    timer_wheel->occupied[i] = 0;
+  }
+  for (int i = 0; i <= TIMER_WHEEL_EXPIRED_SLOT; i++)
+  {
+    timer_wheel->slots[i].next = &timer_wheel->slots[i];
+    timer_wheel->slots[i].prev = &timer_wheel->slots[i];
+  }
+  return timer_wheel;
+}
+
+void timer_wheel_free(timer_wheel_t *timer_wheel)
+{
+  // the timers belong to their owners, they are only disarmed here...
+  for (int i = 0; i <= TIMER_WHEEL_EXPIRED_SLOT; i++)
+  {
+    timer_wheel_timer_t *head = &timer_wheel->slots[i];
+    while (head->next != head)
+    {
+      timer_wheel_timer_t *timer = head->next;
+      timer_wheel_unlink(timer);
+      timer->slot = -1;
+    }
+  }
+  timer_wheel->num_timers = 0;
+  free(timer_wheel);
+}
+
+size_t timer_wheel_get_size(timer_wheel_t *timer_wheel)
+{
+  return timer_wheel->num_timers;
+}
+
+bool timer_wheel_get_empty(timer_wheel_t *timer_wheel)
+{
+  return timer_wheel->num_timers == 0;
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_func_t func, void *arg)
+{
+  timer->next = timer;
+  timer->prev = timer;
+  timer->expires = 0;
+  timer->slot = -1;
+  timer->func = func;
+  timer->arg = arg;
+}
+
+bool timer_wheel_timer_get_armed(timer_wheel_timer_t *timer)
+{
+  return timer->slot != -1;
+}
+
+void timer_wheel_add(timer_wheel_t *timer_wheel, timer_wheel_timer_t *timer, double deadline)
+{
+  if (timer_wheel_timer_get_armed(timer))
+  {
+    timer_wheel_remove(timer_wheel, timer);
+  }
+
+  // round the deadline up so that the timer never expires early...
+  timer->expires = timer_wheel_get_tick(timer_wheel, deadline, true);
+  timer_wheel_place(timer_wheel, timer);
+  timer_wheel->num_timers++;
+}
+
+void timer_wheel_remove(timer_wheel_t *timer_wheel, timer_wheel_timer_t *timer)
+{
+  if (!timer_wheel_timer_get_armed(timer))
+  {
+    return;
+  }
+
+  timer_wheel_unlink(timer);
+
+  timer_wheel_timer_t *head = &timer_wheel->slots[timer->slot];
+  if (timer->slot != TIMER_WHEEL_EXPIRED_SLOT && head->next == head)
+  {
+    timer_wheel->occupied[timer->slot / TIMER_WHEEL_NUM_SLOTS] &=
+      ~((uint64_t)1 << (timer->slot % TIMER_WHEEL_NUM_SLOTS));
+  }
+
+  timer->slot = -1;
+  timer_wheel->num_timers--;
+}
+
+size_t timer_wheel_advance(timer_wheel_t *timer_wheel, double now)
+{
+  uint64_t now_tick = timer_wheel_get_tick(timer_wheel, now, false);
+  size_t num_expired = timer_wheel_expire(timer_wheel, TIMER_WHEEL_EXPIRED_SLOT);
+  while (timer_wheel->current <= now_tick)
+  {
+    if (timer_wheel->num_timers == 0)
+    {
+      timer_wheel->current = now_tick + 1;
+      break;
+    }
+
+    int index = timer_wheel->current & TIMER_WHEEL_SLOT_MASK;
+    if (index == 0)
+    {
+      timer_wheel_cascade(timer_wheel);
+    }
+
+    // skip straight to the next slot of the lowest level which has timers in
+    // it, without going past the start of the next turn, where the levels
+    // above need to be cascaded...
+    uint64_t pending = timer_wheel->occupied[0] >> index;
+    uint64_t skip = pending ? (uint64_t)__builtin_ctzll(pending) : (uint64_t)(TIMER_WHEEL_NUM_SLOTS - index);
+    if (skip > now_tick - timer_wheel->current)
+    {
+      timer_wheel->current = now_tick + 1;
+      break;
+    }
+
+    timer_wheel->current += skip;
+    if (!pending)
+    {
+      continue;
+    }
+
+    timer_wheel->current++;
+    num_expired += timer_wheel_expire(timer_wheel, index + (int)skip);
+  }
+  return num_expired;
+}
+
+double timer_wheel_get_next_deadline(timer_wheel_t *timer_wheel)
+{
+  if (timer_wheel->num_timers == 0)
+  {
+    return -1;
+  }
+
+  // the first occupied slot of each level after its current position tells
+  // when it comes around next, for the lowest level that is exactly when
+  // its timers expire and for those above it that is the earliest they
+  // could expire...
+  if (timer_wheel->slots[TIMER_WHEEL_EXPIRED_SLOT].next != &timer_wheel->slots[TIMER_WHEEL_EXPIRED_SLOT])
+  {
+    // these are due already, which the time of the last advance tells...
+    return timer_wheel->current > 0 ? (timer_wheel->current - 1) * timer_wheel->resolution : 0;
+  }
+
+  uint64_t next_tick = UINT64_MAX;
+  for (int level = 0; level < TIMER_WHEEL_NUM_LEVELS; level++)
+  {
+    uint64_t occupied = timer_wheel->occupied[level];
+    if (occupied == 0)
+    {
+      continue;
+    }
+
+    int shift = TIMER_WHEEL_SLOT_BITS * level;
+    uint64_t granularity = (uint64_t)1 << shift;
+    uint64_t start = (timer_wheel->current + granularity - 1) & ~(granularity - 1);
+    int position = (start >> shift) & TIMER_WHEEL_SLOT_MASK;
+    if (position != 0)
+    {
+      occupied = (occupied >> position) | (occupied << (TIMER_WHEEL_NUM_SLOTS - position));
+    }
+
+    uint64_t tick = start + ((uint64_t)__builtin_ctzll(occupied) << shift);
+    if (tick < next_tick)
+    {
+      next_tick = tick;
+    }
+  }
+  return next_tick * timer_wheel->resolution;
+}
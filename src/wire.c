@@ -0,0 +1,698 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "buffer.h"
+
+#include "wire.h"
+
+#define WIRE_PEER_IPV4 4
+#define WIRE_PEER_NAME 0
+
+// strings in the handshake and the first format have a pointer's worth of
+// padding after them...
+#define WIRE_PADDING_SIZE ((int)sizeof(unsigned char*))
+
+static bool wire_read_string_v1(buffer_t *buffer, buffer_slice_t *slice)
+{
+  // the padding after the string is left out...
+  if (!buffer_read_string_slice(buffer, slice))
+  {
+    return false;
+  }
+  const unsigned char *end = memchr(slice->data, '\0', slice->size);
+  if (end)
+  {
+    slice->size = (int)(end - slice->data);
+  }
+  return true;
+}
+
+static void wire_write_bytes_v2(buffer_t *buffer, const buffer_slice_t *slice)
+{
+  buffer_write_varint(buffer, slice->size);
+  buffer_write(buffer, slice->data, slice->size);
+}
+
+static bool wire_read_bytes_v2(buffer_t *buffer, buffer_slice_t *slice)
+{
+  int offset = buffer_get_offset(buffer);
+  uint64_t size = 0;
+  if (!buffer_read_varint(buffer, &size) || size > INT32_MAX || !buffer_read_slice(buffer, (int)size, slice))
+  {
+    buffer_set_offset(buffer, offset);
+    return false;
+  }
+  return true;
+}
+
+static void wire_format_ipv4(const unsigned char *address_bytes, char *address)
+{
+  // formats the address by hand, it's read for every peer in a peerlist
+  // and inet_ntop takes several times as long...
+  for (int i = 0; i < 4; i++)
+  {
+    int value = address_bytes[i];
+    if (value >= 100)
+    {
+      *address++ = '0' + value / 100;
+    }
+    if (value >= 10)
+    {
+      *address++ = '0' + (value / 10) % 10;
+    }
+    *address++ = '0' + value % 10;
+    *address++ = i < 3 ? '.' : '\0';
+  }
+}
+
+static bool wire_read_uint16_v1(buffer_t *buffer, uint16_t *value)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_slice(buffer, sizeof(uint16_t), &slice))
+  {
+    return false;
+  }
+  memcpy(value, slice.data, sizeof(uint16_t));
+  return true;
+}
+
+static bool wire_read_uint32_v1(buffer_t *buffer, uint32_t *value)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_slice(buffer, sizeof(uint32_t), &slice))
+  {
+    return false;
+  }
+  memcpy(value, slice.data, sizeof(uint32_t));
+  return true;
+}
+
+static bool wire_read_key_v1(buffer_t *buffer, int size, buffer_slice_t *slice)
+{
+  // keys are written as strings, of which only the start is the key...
+  if (!buffer_read_string_slice(buffer, slice) || slice->size < size)
+  {
+    return false;
+  }
+  slice->size = size;
+  return true;
+}
+
+int wire_get_frame_header_size(int wire_version, bool encrypted)
+{
+  if (wire_version >= WIRE_VERSION_3)
+  {
+    return WIRE_V3_FRAME_HEADER_SIZE;
+  }
+  else if (wire_version >= WIRE_VERSION_2)
+  {
+    return WIRE_V2_FRAME_HEADER_SIZE;
+  }
+  return encrypted ? WIRE_V1_ENCRYPTED_FRAME_HEADER_SIZE : WIRE_V1_FRAME_HEADER_SIZE;
+}
+
+int wire_get_max_body_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_3 ? WIRE_V3_MAX_BODY_SIZE : UINT16_MAX;
+}
+
+size_t wire_get_frame_size(int wire_version, bool encrypted, const unsigned char *header, size_t size)
+{
+  // the size of the whole frame, or zero until enough of its header is
+  // there to tell...
+  size_t header_size = wire_get_frame_header_size(wire_version, encrypted);
+  if (size < header_size)
+  {
+    return 0;
+  }
+
+  size_t body_size;
+  if (wire_version >= WIRE_VERSION_3)
+  {
+    body_size = (size_t)header[0] | ((size_t)header[1] << 8) | ((size_t)header[2] << 16) | ((size_t)header[3] << 24);
+  }
+  else if (wire_version >= WIRE_VERSION_2)
+  {
+    body_size = (size_t)(header[0] | (header[1] << 8));
+  }
+  else
+  {
+    uint16_t size;
+    memcpy(&size, header, sizeof(uint16_t));
+    body_size = size;
+  }
+  return header_size + body_size;
+}
+
+void wire_write_frame_header(buffer_t *buffer, int wire_version, bool encrypted, int body_size, int payload_size)
+{
+  if (wire_version >= WIRE_VERSION_3)
+  {
+    buffer_write_uint32_le(buffer, body_size);
+    return;
+  }
+  else if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write_uint16_le(buffer, body_size);
+    return;
+  }
+  buffer_write_uint16(buffer, body_size);
+  if (encrypted)
+  {
+    buffer_write_uint16(buffer, payload_size);
+  }
+}
+
+bool wire_read_frame_header(buffer_t *buffer, int wire_version, bool encrypted, int *body_size, int *payload_size)
+{
+  if (wire_version >= WIRE_VERSION_3)
+  {
+    uint32_t size = 0;
+    if (!buffer_read_uint32_le(buffer, &size) || size > WIRE_V3_MAX_BODY_SIZE || (encrypted && size < WIRE_MAC_SIZE))
+    {
+      return false;
+    }
+    *body_size = (int)size;
+    *payload_size = encrypted ? (int)size - WIRE_MAC_SIZE : (int)size;
+    return true;
+  }
+
+  uint16_t size = 0;
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    if (!buffer_read_uint16_le(buffer, &size) || (encrypted && size < WIRE_MAC_SIZE))
+    {
+      return false;
+    }
+    *body_size = size;
+    *payload_size = encrypted ? size - WIRE_MAC_SIZE : size;
+    return true;
+  }
+
+  if (!wire_read_uint16_v1(buffer, &size))
+  {
+    return false;
+  }
+  *body_size = size;
+  *payload_size = size;
+  if (encrypted)
+  {
+    if (!wire_read_uint16_v1(buffer, &size) || size + WIRE_MAC_SIZE != *body_size)
+    {
+      return false;
+    }
+    *payload_size = size;
+  }
+  return true;
+}
+
+// the handshake kinds, which are the same in every wire format...
+static int wire_get_string_size(int wire_version, const wire_string_t *string)
+{
+  return sizeof(uint16_t) + string->size + WIRE_PADDING_SIZE;
+}
+
+static int wire_get_string_min_size(int wire_version)
+{
+  return sizeof(uint16_t);
+}
+
+static void wire_write_string(buffer_t *buffer, int wire_version, const wire_string_t *string)
+{
+  buffer_write_string(buffer, (const char*)string->data, string->size);
+}
+
+static bool wire_read_string(buffer_t *buffer, int wire_version, wire_string_t *string)
+{
+  return wire_read_string_v1(buffer, string);
+}
+
+static int wire_get_release_size(int wire_version, const wire_release_t *release)
+{
+  return wire_get_string_size(wire_version, &release->name) + (release->wire_version > WIRE_VERSION_1);
+}
+
+static int wire_get_release_min_size(int wire_version)
+{
+  return sizeof(uint16_t);
+}
+
+static void wire_write_release(buffer_t *buffer, int wire_version, const wire_release_t *release)
+{
+  if (release->wire_version <= WIRE_VERSION_1)
+  {
+    wire_write_string(buffer, wire_version, &release->name);
+    return;
+  }
+
+  // the wire version goes after the padding, where nodes which only know
+  // of the first format don't look...
+  buffer_write_uint16(buffer, release->name.size + WIRE_PADDING_SIZE + sizeof(uint8_t));
+  buffer_write(buffer, release->name.data, release->name.size);
+  memset(buffer_claim(buffer, WIRE_PADDING_SIZE), 0, WIRE_PADDING_SIZE);
+  buffer_write_uint8(buffer, release->wire_version);
+}
+
+static bool wire_read_release(buffer_t *buffer, int wire_version, wire_release_t *release)
+{
+  buffer_slice_t slice;
+  if (!buffer_read_string_slice(buffer, &slice))
+  {
+    return false;
+  }
+
+  // a name with no more than its padding after it comes from a node which
+  // only knows of the first format...
+  const unsigned char *end = memchr(slice.data, '\0', slice.size);
+  int size = end ? (int)(end - slice.data) : slice.size;
+  release->name.data = slice.data;
+  release->name.size = size;
+  release->wire_version = WIRE_VERSION_1;
+  if (slice.size - size > WIRE_PADDING_SIZE)
+  {
+    release->wire_version = slice.data[slice.size - 1];
+  }
+  return true;
+}
+
+static int wire_get_uint32_size(int wire_version, const wire_uint32_t *value)
+{
+  return sizeof(uint32_t);
+}
+
+static int wire_get_uint32_min_size(int wire_version)
+{
+  return sizeof(uint32_t);
+}
+
+static void wire_write_uint32(buffer_t *buffer, int wire_version, const wire_uint32_t *value)
+{
+  buffer_write_uint32(buffer, *value);
+}
+
+static bool wire_read_uint32(buffer_t *buffer, int wire_version, wire_uint32_t *value)
+{
+  return wire_read_uint32_v1(buffer, value);
+}
+
+static int wire_get_version_size(int wire_version, const wire_version_t *version)
+{
+  return *version > WIRE_VERSION_1 ? sizeof(uint8_t) : 0;
+}
+
+static int wire_get_version_min_size(int wire_version)
+{
+  return 0;
+}
+
+static void wire_write_version(buffer_t *buffer, int wire_version, const wire_version_t *version)
+{
+  // left out for the first format, which nodes without support expect...
+  if (*version > WIRE_VERSION_1)
+  {
+    buffer_write_uint8(buffer, *version);
+  }
+}
+
+static bool wire_read_version(buffer_t *buffer, int wire_version, wire_version_t *version)
+{
+  *version = WIRE_VERSION_1;
+  if (buffer_get_remaining_size(buffer) > 0)
+  {
+    *version = buffer_read_uint8(buffer);
+  }
+  return true;
+}
+
+// keys and nonces are strings in the first format, of which only the start
+// is the key, and their bytes alone in the second...
+static int wire_get_fixed_size(int wire_version, int size)
+{
+  return wire_version >= WIRE_VERSION_2 ? size : sizeof(uint16_t) + size + WIRE_PADDING_SIZE;
+}
+
+static void wire_write_fixed(buffer_t *buffer, int wire_version, const buffer_slice_t *slice, int size)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write(buffer, slice->data, size);
+    return;
+  }
+  buffer_write_string(buffer, (const char*)slice->data, size);
+}
+
+static bool wire_read_fixed(buffer_t *buffer, int wire_version, buffer_slice_t *slice, int size)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    return buffer_read_slice(buffer, size, slice);
+  }
+  return wire_read_key_v1(buffer, size, slice);
+}
+
+static int wire_get_key_size(int wire_version, const wire_key_t *key)
+{
+  return wire_get_fixed_size(wire_version, WIRE_KEY_SIZE);
+}
+
+static int wire_get_key_min_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_2 ? WIRE_KEY_SIZE : sizeof(uint16_t) + WIRE_KEY_SIZE;
+}
+
+static void wire_write_key(buffer_t *buffer, int wire_version, const wire_key_t *key)
+{
+  wire_write_fixed(buffer, wire_version, key, WIRE_KEY_SIZE);
+}
+
+static bool wire_read_key(buffer_t *buffer, int wire_version, wire_key_t *key)
+{
+  return wire_read_fixed(buffer, wire_version, key, WIRE_KEY_SIZE);
+}
+
+static int wire_get_nonce_size(int wire_version, const wire_nonce_t *nonce)
+{
+  return wire_get_fixed_size(wire_version, WIRE_NONCE_SIZE);
+}
+
+static int wire_get_nonce_min_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_2 ? WIRE_NONCE_SIZE : sizeof(uint16_t) + WIRE_NONCE_SIZE;
+}
+
+static void wire_write_nonce(buffer_t *buffer, int wire_version, const wire_nonce_t *nonce)
+{
+  wire_write_fixed(buffer, wire_version, nonce, WIRE_NONCE_SIZE);
+}
+
+static bool wire_read_nonce(buffer_t *buffer, int wire_version, wire_nonce_t *nonce)
+{
+  return wire_read_fixed(buffer, wire_version, nonce, WIRE_NONCE_SIZE);
+}
+
+static int wire_get_count_size(int wire_version, const wire_count_t *count)
+{
+  return wire_version >= WIRE_VERSION_2 ? buffer_get_varint_size(*count) : sizeof(uint16_t);
+}
+
+static int wire_get_count_min_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_2 ? sizeof(uint8_t) : sizeof(uint16_t);
+}
+
+static void wire_write_count(buffer_t *buffer, int wire_version, const wire_count_t *count)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write_varint(buffer, *count);
+    return;
+  }
+  buffer_write_uint16(buffer, *count);
+}
+
+static bool wire_read_count(buffer_t *buffer, int wire_version, wire_count_t *count)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    uint64_t value = 0;
+    if (!buffer_read_varint(buffer, &value) || value > UINT16_MAX)
+    {
+      return false;
+    }
+    *count = (int)value;
+    return true;
+  }
+
+  uint16_t value = 0;
+  if (!wire_read_uint16_v1(buffer, &value))
+  {
+    return false;
+  }
+  *count = value;
+  return true;
+}
+
+// addresses go out as their four bytes in the second format when they
+// can, and are otherwise left as they are...
+static int wire_get_address_size(int wire_version, const wire_address_t *address)
+{
+  int size = strlen(*address);
+  if (wire_version < WIRE_VERSION_2)
+  {
+    return sizeof(uint16_t) + size + WIRE_PADDING_SIZE;
+  }
+
+  unsigned char address_bytes[4];
+  if (inet_pton(AF_INET, *address, address_bytes) == 1)
+  {
+    return sizeof(uint8_t) + sizeof(address_bytes);
+  }
+  return sizeof(uint8_t) + buffer_get_varint_size(size) + size;
+}
+
+static int wire_get_address_min_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_2 ? sizeof(uint8_t) * 2 : sizeof(uint16_t);
+}
+
+static void wire_write_address(buffer_t *buffer, int wire_version, const wire_address_t *address)
+{
+  if (wire_version < WIRE_VERSION_2)
+  {
+    buffer_write_string(buffer, *address, strlen(*address));
+    return;
+  }
+
+  unsigned char address_bytes[4];
+  if (inet_pton(AF_INET, *address, address_bytes) == 1)
+  {
+    buffer_write_uint8(buffer, WIRE_PEER_IPV4);
+    buffer_write(buffer, address_bytes, sizeof(address_bytes));
+  }
+  else
+  {
+    buffer_slice_t address_slice = {(const unsigned char*)*address, (int)strlen(*address)};
+    buffer_write_uint8(buffer, WIRE_PEER_NAME);
+    wire_write_bytes_v2(buffer, &address_slice);
+  }
+}
+
+static bool wire_read_address(buffer_t *buffer, int wire_version, wire_address_t *address)
+{
+  buffer_slice_t address_slice;
+  if (wire_version < WIRE_VERSION_2)
+  {
+    return buffer_read_string_slice(buffer, &address_slice) &&
+      buffer_slice_copy_string(&address_slice, *address, sizeof(*address));
+  }
+
+  if (buffer_get_remaining_size(buffer) < sizeof(uint8_t))
+  {
+    return false;
+  }
+  switch (buffer_read_uint8(buffer))
+  {
+    case WIRE_PEER_IPV4:
+      if (!buffer_read_slice(buffer, 4, &address_slice))
+      {
+        return false;
+      }
+      wire_format_ipv4(address_slice.data, *address);
+      return true;
+    case WIRE_PEER_NAME:
+      return wire_read_bytes_v2(buffer, &address_slice) &&
+        buffer_slice_copy_string(&address_slice, *address, sizeof(*address));
+    default:
+      return false;
+  }
+}
+
+static int wire_get_port_size(int wire_version, const wire_port_t *port)
+{
+  return wire_version >= WIRE_VERSION_2 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+static int wire_get_port_min_size(int wire_version)
+{
+  return wire_get_port_size(wire_version, NULL);
+}
+
+static void wire_write_port(buffer_t *buffer, int wire_version, const wire_port_t *port)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write_uint16_le(buffer, *port);
+    return;
+  }
+  buffer_write_uint32(buffer, *port);
+}
+
+static bool wire_read_port(buffer_t *buffer, int wire_version, wire_port_t *port)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    uint16_t value = 0;
+    if (!buffer_read_uint16_le(buffer, &value))
+    {
+      return false;
+    }
+    *port = value;
+    return true;
+  }
+  return wire_read_uint32_v1(buffer, port);
+}
+
+// the first format writes the data size ahead of both the signed message
+// and the ciphertext, the second once, with the sizes following from it...
+static int wire_get_sealed_size(int wire_version, const wire_sealed_t *sealed)
+{
+  int size = sealed->signed_message.size + sealed->ciphertext.size;
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    return buffer_get_varint_size(sealed->data_size) + size;
+  }
+  return ((sizeof(uint16_t) * 2) + WIRE_PADDING_SIZE) * 2 + size;
+}
+
+static int wire_get_sealed_min_size(int wire_version)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    return sizeof(uint8_t) + WIRE_SIGN_SIZE + WIRE_MAC_SIZE;
+  }
+  return (sizeof(uint16_t) * 4) + WIRE_SIGN_SIZE + WIRE_MAC_SIZE;
+}
+
+static void wire_write_sealed(buffer_t *buffer, int wire_version, const wire_sealed_t *sealed)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write_varint(buffer, sealed->data_size);
+    buffer_write(buffer, sealed->signed_message.data, sealed->signed_message.size);
+    buffer_write(buffer, sealed->ciphertext.data, sealed->ciphertext.size);
+    return;
+  }
+  buffer_write_uint16(buffer, sealed->data_size);
+  buffer_write_string(buffer, (const char*)sealed->signed_message.data, sealed->signed_message.size);
+  buffer_write_uint16(buffer, sealed->data_size);
+  buffer_write_string(buffer, (const char*)sealed->ciphertext.data, sealed->ciphertext.size);
+}
+
+static bool wire_read_sealed(buffer_t *buffer, int wire_version, wire_sealed_t *sealed)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    // the data has to fit in a frame along with its signature and mac...
+    uint64_t data_size = 0;
+    if (!buffer_read_varint(buffer, &data_size) ||
+      data_size > (uint64_t)wire_get_max_body_size(wire_version) - WIRE_SIGN_SIZE - WIRE_MAC_SIZE)
+    {
+      return false;
+    }
+    sealed->data_size = (int)data_size;
+    return buffer_read_slice(buffer, WIRE_SIGN_SIZE + sealed->data_size, &sealed->signed_message) &&
+      buffer_read_slice(buffer, WIRE_MAC_SIZE + sealed->data_size, &sealed->ciphertext);
+  }
+
+  uint16_t data_size = 0;
+  uint16_t other_data_size = 0;
+  if (!wire_read_uint16_v1(buffer, &data_size) ||
+    !wire_read_key_v1(buffer, WIRE_SIGN_SIZE + data_size, &sealed->signed_message) ||
+    !wire_read_uint16_v1(buffer, &other_data_size) || other_data_size != data_size ||
+    !wire_read_key_v1(buffer, WIRE_MAC_SIZE + data_size, &sealed->ciphertext))
+  {
+    return false;
+  }
+  sealed->data_size = data_size;
+  return true;
+}
+
+static int wire_get_timestamp_size(int wire_version, const wire_timestamp_t *timestamp)
+{
+  return wire_version >= WIRE_VERSION_2 ? buffer_get_varint_size((uint64_t)*timestamp) : sizeof(int32_t);
+}
+
+static int wire_get_timestamp_min_size(int wire_version)
+{
+  return wire_version >= WIRE_VERSION_2 ? sizeof(uint8_t) : sizeof(int32_t);
+}
+
+static void wire_write_timestamp(buffer_t *buffer, int wire_version, const wire_timestamp_t *timestamp)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    buffer_write_varint(buffer, (uint64_t)*timestamp);
+    return;
+  }
+  buffer_write_int32(buffer, *timestamp);
+}
+
+static bool wire_read_timestamp(buffer_t *buffer, int wire_version, wire_timestamp_t *timestamp)
+{
+  if (wire_version >= WIRE_VERSION_2)
+  {
+    uint64_t value = 0;
+    if (!buffer_read_varint(buffer, &value))
+    {
+      return false;
+    }
+    *timestamp = (int64_t)value;
+    return true;
+  }
+
+  uint32_t value = 0;
+  if (!wire_read_uint32_v1(buffer, &value))
+  {
+    return false;
+  }
+  *timestamp = (int32_t)value;
+  return true;
+}
+
+// the records themselves are put together from their fields' kinds...
+#define WIRE_FIELD_SIZE(kind, name) + wire_get_##kind##_size(wire_version, &record->name)
+#define WIRE_FIELD_MIN_SIZE(kind, name) + wire_get_##kind##_min_size(wire_version)
+#define WIRE_FIELD_WRITE(kind, name) wire_write_##kind(buffer, wire_version, &record->name);
+#define WIRE_FIELD_READ(kind, name) && wire_read_##kind(buffer, wire_version, &record->name)
+
+#define WIRE_RECORD_DEFINE(name, NAME, Name) \
+  int wire_get_##name##_size(int wire_version, const wire_##name##_t *record) \
+  { \
+    return 0 WIRE_##NAME##_FIELDS(WIRE_FIELD_SIZE); \
+  } \
+  \
+  int wire_get_##name##_min_size(int wire_version) \
+  { \
+    return 0 WIRE_##NAME##_FIELDS(WIRE_FIELD_MIN_SIZE); \
+  } \
+  \
+  void wire_write_##name(buffer_t *buffer, int wire_version, const wire_##name##_t *record) \
+  { \
+    WIRE_##NAME##_FIELDS(WIRE_FIELD_WRITE) \
+  } \
+  \
+  bool wire_read_##name(buffer_t *buffer, int wire_version, wire_##name##_t *record) \
+  { \
+    int offset = buffer_get_offset(buffer); \
+    if (buffer_get_remaining_size(buffer) < wire_get_##name##_min_size(wire_version) \
+      || !(true WIRE_##NAME##_FIELDS(WIRE_FIELD_READ))) \
+    { \
+      buffer_set_offset(buffer, offset); \
+      return false; \
+    } \
+    return true; \
+  }
+
+WIRE_RECORDS(WIRE_RECORD_DEFINE)
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures how fast dyad accepts a storm of connections, like the one a node
+ * sees from its peers reconnecting after a restart: a batch of connections
+ * is completed by the kernel and left waiting in the listen queue, then the
+ * reactor is updated until it has accepted all of them. Only the updates
+ * are timed, the connections are closed in between batches.
+ *
+ * usage: bench_accept [connections] [accept budget]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dyad.h"
+
+#define BENCH_PORT 17300
+#define BENCH_BATCH_SIZE 2000
+
+static const char *bench_backend_names[] = {"select", "epoll", "uring"};
+
+static int bench_connections = 50000;
+static int bench_budget = 0;
+static int bench_accepted = 0;
+static int bench_errors = 0;
+
+static void bench_data(dyad_Event *e)
+{
+}
+
+static void bench_close(dyad_Event *e)
+{
+}
+
+static void bench_accept(dyad_Event *e)
+{
+  // the same as a node does for every connection it accepts
+  bench_accepted++;
+  dyad_addListener(e->remote, DYAD_EVENT_DATA, bench_data, NULL);
+  dyad_addListener(e->remote, DYAD_EVENT_CLOSE, bench_close, NULL);
+}
+
+static void bench_error(dyad_Event *e)
+{
+  bench_errors++;
+}
+
+static int bench_connect(int port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd == -1)
+  {
+    return -1;
+  }
+  if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  {
+    close(sockfd);
+    return -1;
+  }
+  return sockfd;
+}
+
+static int bench_run(int backend)
+{
+  int port = BENCH_PORT + backend;
+
+  dyad_init();
+  if (dyad_setBackend(backend) != 0)
+  {
+    dyad_shutdown();
+    printf("  backend unavailable\n");
+    return 0;
+  }
+
+  // select can't watch descriptors at or above FD_SETSIZE, so it gets
+  // smaller batches...
+  int batch_size = BENCH_BATCH_SIZE;
+  if (backend == DYAD_BACKEND_SELECT && batch_size * 2 + 32 > FD_SETSIZE)
+  {
+    batch_size = (FD_SETSIZE - 32) / 2;
+  }
+
+  dyad_setUpdateTimeout(0);
+  if (bench_budget > 0)
+  {
+    dyad_setAcceptBudget(bench_budget);
+  }
+
+  dyad_Stream *server = dyad_newStream();
+  dyad_addListener(server, DYAD_EVENT_ACCEPT, bench_accept, NULL);
+  dyad_addListener(server, DYAD_EVENT_ERROR, bench_error, NULL);
+  if (dyad_listenEx(server, "127.0.0.1", port, BENCH_BATCH_SIZE * 2) != 0)
+  {
+    dyad_shutdown();
+    printf("  failed to listen on port %d\n", port);
+    return 1;
+  }
+
+  int *clients = calloc(batch_size, sizeof(int));
+  double accept_time = 0;
+  long num_updates = 0;
+  while (bench_accepted < bench_connections)
+  {
+    int num_clients = bench_connections - bench_accepted;
+    if (num_clients > batch_size)
+    {
+      num_clients = batch_size;
+    }
+
+    for (int i = 0; i < num_clients; i++)
+    {
+      clients[i] = bench_connect(port);
+      if (clients[i] == -1)
+      {
+        dyad_shutdown();
+        free(clients);
+        printf("  failed to connect\n");
+        return 1;
+      }
+    }
+
+    // accept the whole batch...
+    int target = bench_accepted + num_clients;
+    double start_time = dyad_getTime();
+    while (bench_accepted < target && bench_errors == 0)
+    {
+      dyad_update();
+      num_updates++;
+    }
+    accept_time += dyad_getTime() - start_time;
+
+    // ...then close it, which isn't timed
+    for (int i = 0; i < num_clients; i++)
+    {
+      close(clients[i]);
+    }
+    while (dyad_getStreamCount() > 1 && bench_errors == 0)
+    {
+      dyad_update();
+    }
+
+    if (bench_errors > 0)
+    {
+      dyad_shutdown();
+      free(clients);
+      printf("  failed to accept the connections\n");
+      return 1;
+    }
+  }
+
+  printf("  %d connections in batches of %d: %10.0f accepts/sec, %6.1f accepts per update\n",
+    bench_accepted, batch_size, bench_accepted / accept_time, (double)bench_accepted / num_updates);
+
+  dyad_shutdown();
+  free(clients);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_connections = atoi(argv[1]);
+  }
+  if (argc > 2)
+  {
+    bench_budget = atoi(argv[2]);
+  }
+
+  // both ends of every connection take a descriptor
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < BENCH_BATCH_SIZE * 2 + 64)
+  {
+    printf("not enough descriptors for batches of %d connections\n", BENCH_BATCH_SIZE);
+    return 1;
+  }
+
+  int result = 0;
+  for (int backend = DYAD_BACKEND_SELECT; backend <= DYAD_BACKEND_URING; backend++)
+  {
+    printf("%s:\n", bench_backend_names[backend]);
+    bench_accepted = 0;
+    bench_errors = 0;
+    result |= bench_run(backend);
+  }
+
+  return result;
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Compares the dyad network event backends by running an echo server on
+ * each backend and measuring how quickly a client process can complete a
+ * number of request/response rounds over 1k and 10k connections. The client
+ * process always uses the same backend, so only the server side differs.
+ *
+ * usage: bench_dyad [rounds]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "dyad.h"
+
+#define BENCH_PORT 17100
+#define BENCH_MESSAGE_SIZE 64
+#define BENCH_CONNECT_BATCH 256
+#define BENCH_TIME_LIMIT 120.0
+
+typedef struct BenchClient
+{
+  int received;
+  int rounds;
+} bench_client_t;
+
+static const char *bench_backend_names[] = {"select", "epoll", "uring"};
+static const int bench_connection_counts[] = {1000, 10000};
+
+static char bench_message[BENCH_MESSAGE_SIZE];
+static int bench_rounds = 20;
+static int bench_connected = 0;
+static int bench_finished = 0;
+static int bench_errors = 0;
+
+static void bench_server_data(dyad_Event *e)
+{
+  dyad_write(e->stream, e->data, e->size);
+}
+
+static void bench_server_accept(dyad_Event *e)
+{
+  dyad_addListener(e->remote, DYAD_EVENT_DATA, bench_server_data, NULL);
+}
+
+static void bench_client_connect(dyad_Event *e)
+{
+  bench_connected++;
+  dyad_write(e->stream, bench_message, BENCH_MESSAGE_SIZE);
+}
+
+static void bench_client_data(dyad_Event *e)
+{
+  bench_client_t *client = e->udata;
+  client->received += e->size;
+  if (client->received < BENCH_MESSAGE_SIZE)
+  {
+    return;
+  }
+
+  client->received -= BENCH_MESSAGE_SIZE;
+  client->rounds++;
+  if (client->rounds < bench_rounds)
+  {
+    dyad_write(e->stream, bench_message, BENCH_MESSAGE_SIZE);
+  }
+  else
+  {
+    bench_finished++;
+    dyad_end(e->stream);
+  }
+}
+
+static void bench_client_error(dyad_Event *e)
+{
+  bench_errors++;
+}
+
+static int bench_client_backend(void)
+{
+  if (dyad_setBackend(DYAD_BACKEND_EPOLL) == 0)
+  {
+    return DYAD_BACKEND_EPOLL;
+  }
+
+  return DYAD_BACKEND_SELECT;
+}
+
+static int bench_run_clients(int port, int num_connections)
+{
+  dyad_init();
+  bench_client_backend();
+  dyad_setUpdateTimeout(0.001);
+
+  bench_client_t *clients = calloc(num_connections, sizeof(bench_client_t));
+  int num_started = 0;
+
+  double start_time = dyad_getTime();
+  double connect_time = 0;
+  while (bench_finished + bench_errors < num_connections)
+  {
+    // open the connections in batches so the listen backlog doesn't overflow
+    for (int i = 0; i < BENCH_CONNECT_BATCH && num_started < num_connections; i++)
+    {
+      dyad_Stream *stream = dyad_newStream();
+      bench_client_t *client = &clients[num_started++];
+      dyad_addListener(stream, DYAD_EVENT_CONNECT, bench_client_connect, client);
+      dyad_addListener(stream, DYAD_EVENT_DATA, bench_client_data, client);
+      dyad_addListener(stream, DYAD_EVENT_ERROR, bench_client_error, client);
+      dyad_connect(stream, "127.0.0.1", port);
+    }
+
+    dyad_update();
+    if (connect_time == 0 && bench_connected == num_connections)
+    {
+      connect_time = dyad_getTime() - start_time;
+    }
+
+    if (dyad_getTime() - start_time > BENCH_TIME_LIMIT)
+    {
+      break;
+    }
+  }
+
+  double elapsed = dyad_getTime() - start_time;
+  double total_rounds = (double)bench_finished * bench_rounds;
+  printf("  %6d connections: connect %8.3fs, total %8.3fs, %10.0f rounds/s, errors %d\n",
+    num_connections, connect_time, elapsed, total_rounds / elapsed, bench_errors);
+
+  dyad_shutdown();
+  free(clients);
+  return bench_finished == num_connections ? 0 : 1;
+}
+
+static int bench_serve(int backend, int port, int num_connections)
+{
+  dyad_init();
+  if (dyad_setBackend(backend) != 0)
+  {
+    dyad_shutdown();
+    printf("  %6d connections: backend unavailable\n", num_connections);
+    return -1;
+  }
+
+  // select can't watch descriptors at or above FD_SETSIZE
+  if (backend == DYAD_BACKEND_SELECT && num_connections + 16 > FD_SETSIZE)
+  {
+    dyad_shutdown();
+    printf("  %6d connections: skipped, over FD_SETSIZE (%d)\n", num_connections, FD_SETSIZE);
+    return -1;
+  }
+
+  dyad_setUpdateTimeout(0.001);
+  dyad_Stream *server = dyad_newStream();
+  dyad_addListener(server, DYAD_EVENT_ACCEPT, bench_server_accept, NULL);
+  if (dyad_listenEx(server, "127.0.0.1", port, 4096) != 0)
+  {
+    dyad_shutdown();
+    printf("  %6d connections: failed to listen on port %d\n", num_connections, port);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int bench_run(int backend, int num_connections)
+{
+  int port = BENCH_PORT + backend;
+  int ready_pipe[2];
+  if (pipe(ready_pipe) != 0)
+  {
+    return 1;
+  }
+
+  // fork before dyad is initialized, so the client process doesn't inherit
+  // the server's streams
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    char ready = 0;
+    close(ready_pipe[1]);
+    if (read(ready_pipe[0], &ready, 1) != 1 || !ready)
+    {
+      exit(0);
+    }
+
+    exit(bench_run_clients(port, num_connections));
+  }
+
+  close(ready_pipe[0]);
+  char ready = bench_serve(backend, port, num_connections) == 0;
+  if (write(ready_pipe[1], &ready, 1) != 1)
+  {
+    ready = 0;
+  }
+
+  close(ready_pipe[1]);
+  int status = 0;
+  if (ready)
+  {
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+      dyad_update();
+    }
+
+    dyad_shutdown();
+  }
+  else
+  {
+    waitpid(pid, &status, 0);
+  }
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_rounds = atoi(argv[1]);
+  }
+
+  memset(bench_message, 'x', BENCH_MESSAGE_SIZE);
+
+  // each connection takes a descriptor in both the server and client process
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  int result = 0;
+  for (int backend = DYAD_BACKEND_SELECT; backend <= DYAD_BACKEND_URING; backend++)
+  {
+    printf("%s:\n", bench_backend_names[backend]);
+    for (int i = 0; i < sizeof(bench_connection_counts) / sizeof(int); i++)
+    {
+      int num_connections = bench_connection_counts[i];
+      if (num_connections + 64 > limit.rlim_cur)
+      {
+        num_connections = limit.rlim_cur - 64;
+      }
+
+      result |= bench_run(backend, num_connections);
+    }
+  }
+
+  return result;
+}
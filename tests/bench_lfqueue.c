@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures the throughput of the lock-free queues against queue_t, which
+ * locks a mutex for every push and pop: objects are handed from 1 to N
+ * producers to one consumer through the MPSC queue, from one producer to
+ * one consumer through the SPSC queue, and from one producer to 1 to N
+ * consumers through the SPMC queue, N being twice the logical cores.
+ *
+ * usage: bench_lfqueue [objects per producer]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "lfqueue.h"
+#include "queue.h"
+#include "util.h"
+
+#define BENCH_CAPACITY 1024
+#define BENCH_MAX_THREADS 64
+
+typedef enum BenchKind
+{
+  BENCH_KIND_MPSC = 0,
+  BENCH_KIND_SPSC,
+  BENCH_KIND_SPMC,
+  BENCH_KIND_LOCKED
+} bench_kind_t;
+
+static int bench_num_objects = 1000000;
+
+static bench_kind_t bench_kind;
+static mpsc_queue_t *bench_mpsc_queue = NULL;
+static spsc_queue_t *bench_spsc_queue = NULL;
+static spmc_queue_t *bench_spmc_queue = NULL;
+static queue_t *bench_locked_queue = NULL;
+static atomic_long bench_num_popped = 0;
+static long bench_num_total = 0;
+
+static double bench_get_time(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench_push(void *object)
+{
+  // the locked queue is kept to the same bound as the others...
+  switch (bench_kind)
+  {
+    case BENCH_KIND_MPSC:
+      while (!mpsc_queue_push(bench_mpsc_queue, object))
+      {
+        sched_yield();
+      }
+      break;
+    case BENCH_KIND_SPSC:
+      while (!spsc_queue_push(bench_spsc_queue, object))
+      {
+        sched_yield();
+      }
+      break;
+    case BENCH_KIND_SPMC:
+      while (!spmc_queue_push(bench_spmc_queue, object))
+      {
+        sched_yield();
+      }
+      break;
+    case BENCH_KIND_LOCKED:
+    default:
+      while (queue_get_size(bench_locked_queue) >= BENCH_CAPACITY)
+      {
+        sched_yield();
+      }
+      queue_push_right(bench_locked_queue, object);
+      break;
+  }
+}
+
+static void* bench_pop(void)
+{
+  switch (bench_kind)
+  {
+    case BENCH_KIND_MPSC:
+      return mpsc_queue_pop(bench_mpsc_queue);
+    case BENCH_KIND_SPSC:
+      return spsc_queue_pop(bench_spsc_queue);
+    case BENCH_KIND_SPMC:
+      return spmc_queue_pop(bench_spmc_queue);
+    case BENCH_KIND_LOCKED:
+    default:
+      return queue_pop_left(bench_locked_queue);
+  }
+}
+
+static void* bench_producer(void *arg)
+{
+  for (intptr_t i = 0; i < bench_num_objects; i++)
+  {
+    bench_push((void*)(i + 1));
+  }
+  return NULL;
+}
+
+static void* bench_consumer(void *arg)
+{
+  while (atomic_load_explicit(&bench_num_popped, memory_order_relaxed) < bench_num_total)
+  {
+    if (bench_pop())
+    {
+      atomic_fetch_add_explicit(&bench_num_popped, 1, memory_order_relaxed);
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static double bench_run(bench_kind_t kind, int num_producers, int num_consumers)
+{
+  bench_kind = kind;
+  bench_mpsc_queue = mpsc_queue_init(BENCH_CAPACITY);
+  bench_spsc_queue = spsc_queue_init(BENCH_CAPACITY);
+  bench_spmc_queue = spmc_queue_init(BENCH_CAPACITY);
+  bench_locked_queue = queue_init();
+  bench_num_total = (long)bench_num_objects * num_producers;
+  atomic_store(&bench_num_popped, 0);
+
+  pthread_t threads[BENCH_MAX_THREADS * 2];
+  int num_threads = 0;
+  double start_time = bench_get_time();
+  for (int i = 0; i < num_consumers; i++)
+  {
+    pthread_create(&threads[num_threads++], NULL, bench_consumer, NULL);
+  }
+  for (int i = 0; i < num_producers; i++)
+  {
+    pthread_create(&threads[num_threads++], NULL, bench_producer, NULL);
+  }
+  for (int i = 0; i < num_threads; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+  double run_time = bench_get_time() - start_time;
+
+  mpsc_queue_free(bench_mpsc_queue);
+  spsc_queue_free(bench_spsc_queue);
+  spmc_queue_free(bench_spmc_queue);
+  queue_free(bench_locked_queue);
+  return bench_num_total / run_time;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_num_objects = atoi(argv[1]);
+  }
+
+  int num_cores = get_num_logical_cores();
+  int max_threads = num_cores * 2 < BENCH_MAX_THREADS ? num_cores * 2 : BENCH_MAX_THREADS;
+  printf("%d objects per producer, %d logical core(s), in objects/sec:\n", bench_num_objects, num_cores);
+
+  double spsc_rate = bench_run(BENCH_KIND_SPSC, 1, 1);
+  double locked_rate = bench_run(BENCH_KIND_LOCKED, 1, 1);
+  printf("  spsc, 1 producer:     %12.0f (queue_t %12.0f)\n", spsc_rate, locked_rate);
+
+  for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+  {
+    double mpsc_rate = bench_run(BENCH_KIND_MPSC, num_threads, 1);
+    locked_rate = bench_run(BENCH_KIND_LOCKED, num_threads, 1);
+    printf("  mpsc, %2d producer(s): %12.0f (queue_t %12.0f)\n", num_threads, mpsc_rate, locked_rate);
+  }
+
+  for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+  {
+    double spmc_rate = bench_run(BENCH_KIND_SPMC, 1, num_threads);
+    locked_rate = bench_run(BENCH_KIND_LOCKED, 1, num_threads);
+    printf("  spmc, %2d consumer(s): %12.0f (queue_t %12.0f)\n", num_threads, spmc_rate, locked_rate);
+  }
+  return 0;
+}
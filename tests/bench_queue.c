@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures queue_t against the fixed array queue it replaced, which is kept
+ * here as the baseline: the queue is filled to a given depth, then objects
+ * are popped from the left and pushed back on the right, the way a work
+ * queue is used, and pushed on the left and popped from the right.
+ *
+ * usage: bench_queue [operations]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "queue.h"
+
+#define BENCH_ARRAY_QUEUE_SIZE 100000
+
+static const int bench_depths[] = {16, 1000, 50000};
+
+static int bench_operations = 200000;
+
+// the previous queue, one fixed array which is shifted over on every push
+// or pop at the left...
+typedef struct BenchArrayQueue
+{
+  int num_objects;
+  int max_index;
+  void *queue_objects[BENCH_ARRAY_QUEUE_SIZE];
+  pthread_mutex_t mutex;
+} bench_array_queue_t;
+
+static void bench_array_push_left(bench_array_queue_t *queue, void *queue_object)
+{
+  pthread_mutex_lock(&queue->mutex);
+  for (int i = queue->max_index + 1; i > 0; i--)
+  {
+    queue->queue_objects[i] = queue->queue_objects[i - 1];
+  }
+  queue->queue_objects[0] = queue_object;
+  queue->num_objects++;
+  queue->max_index++;
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+static void bench_array_push_right(bench_array_queue_t *queue, void *queue_object)
+{
+  pthread_mutex_lock(&queue->mutex);
+  queue->max_index++;
+  queue->queue_objects[queue->max_index] = queue_object;
+  queue->num_objects++;
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+static void* bench_array_pop_left(bench_array_queue_t *queue)
+{
+  pthread_mutex_lock(&queue->mutex);
+  void *queue_object = queue->queue_objects[0];
+  for (int i = 1; i <= queue->max_index; i++)
+  {
+    queue->queue_objects[i - 1] = queue->queue_objects[i];
+  }
+  queue->queue_objects[queue->max_index] = NULL;
+  queue->max_index--;
+  queue->num_objects--;
+  pthread_mutex_unlock(&queue->mutex);
+  return queue_object;
+}
+
+static void* bench_array_pop_right(bench_array_queue_t *queue)
+{
+  pthread_mutex_lock(&queue->mutex);
+  void *queue_object = queue->queue_objects[queue->max_index];
+  queue->queue_objects[queue->max_index] = NULL;
+  queue->max_index--;
+  queue->num_objects--;
+  pthread_mutex_unlock(&queue->mutex);
+  return queue_object;
+}
+
+static double bench_get_time(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench_run(int depth)
+{
+  // the array queue is shifted over on every operation, so it gets fewer
+  // of them at the larger depths...
+  int array_operations = bench_operations;
+  if ((long)array_operations * depth > 2000000000L)
+  {
+    array_operations = (int)(2000000000L / depth);
+  }
+
+  bench_array_queue_t *array_queue = calloc(1, sizeof(bench_array_queue_t));
+  array_queue->max_index = -1;
+  pthread_mutex_init(&array_queue->mutex, NULL);
+  for (intptr_t i = 0; i < depth; i++)
+  {
+    bench_array_push_right(array_queue, (void*)(i + 1));
+  }
+
+  double start_time = bench_get_time();
+  for (int i = 0; i < array_operations; i++)
+  {
+    bench_array_push_right(array_queue, bench_array_pop_left(array_queue));
+  }
+  double array_fifo_time = (bench_get_time() - start_time) / array_operations;
+
+  start_time = bench_get_time();
+  for (int i = 0; i < array_operations; i++)
+  {
+    bench_array_push_left(array_queue, bench_array_pop_right(array_queue));
+  }
+  double array_lifo_time = (bench_get_time() - start_time) / array_operations;
+
+  queue_t *queue = queue_init();
+  for (intptr_t i = 0; i < depth; i++)
+  {
+    queue_push_right(queue, (void*)(i + 1));
+  }
+
+  start_time = bench_get_time();
+  for (int i = 0; i < bench_operations; i++)
+  {
+    queue_push_right(queue, queue_pop_left(queue));
+  }
+  double fifo_time = (bench_get_time() - start_time) / bench_operations;
+
+  start_time = bench_get_time();
+  for (int i = 0; i < bench_operations; i++)
+  {
+    queue_push_left(queue, queue_pop_right(queue));
+  }
+  double lifo_time = (bench_get_time() - start_time) / bench_operations;
+
+  printf("  depth %6d: pop left/push right %9.1fns (array %11.1fns), push left/pop right %9.1fns (array %11.1fns)\n",
+    depth, fifo_time * 1e9, array_fifo_time * 1e9, lifo_time * 1e9, array_lifo_time * 1e9);
+
+  queue_free(queue);
+  pthread_mutex_destroy(&array_queue->mutex);
+  free(array_queue);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_operations = atoi(argv[1]);
+  }
+
+  printf("queue_t against the fixed array queue, %d operations:\n", bench_operations);
+  for (size_t i = 0; i < sizeof(bench_depths) / sizeof(bench_depths[0]); i++)
+  {
+    bench_run(bench_depths[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures what dyad's update loop costs with 10k streams open, nearly all
+ * of them idle: a few connections bounce a message back and forth while the
+ * rest only sit on their reactor. Also measures the same with a tick every
+ * millisecond, which visits every stream, and creating and destroying
+ * streams.
+ *
+ * usage: bench_streams [updates]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+
+#include "dyad.h"
+
+#define BENCH_PORT 17200
+#define BENCH_NUM_STREAMS 10000
+#define BENCH_NUM_ACTIVE 16
+#define BENCH_CONNECT_BATCH 256
+#define BENCH_TIME_LIMIT 60.0
+
+static const char *bench_backend_names[] = {"select", "epoll", "uring"};
+
+static int bench_updates = 20000;
+static int bench_connected = 0;
+static int bench_accepted = 0;
+static int bench_errors = 0;
+static int bench_ticks = 0;
+
+static void bench_data(dyad_Event *e)
+{
+  dyad_write(e->stream, e->data, e->size);
+}
+
+static void bench_accept(dyad_Event *e)
+{
+  bench_accepted++;
+  dyad_addListener(e->remote, DYAD_EVENT_DATA, bench_data, NULL);
+}
+
+static void bench_connect(dyad_Event *e)
+{
+  bench_connected++;
+}
+
+static void bench_error(dyad_Event *e)
+{
+  bench_errors++;
+}
+
+static void bench_tick(dyad_Event *e)
+{
+  bench_ticks++;
+}
+
+static int bench_run(int backend)
+{
+  int port = BENCH_PORT + backend;
+  int num_connections = BENCH_NUM_STREAMS / 2;
+
+  dyad_init();
+  if (dyad_setBackend(backend) != 0)
+  {
+    dyad_shutdown();
+    printf("  backend unavailable\n");
+    return 0;
+  }
+
+  // select can't watch descriptors at or above FD_SETSIZE
+  if (backend == DYAD_BACKEND_SELECT && BENCH_NUM_STREAMS + 16 > FD_SETSIZE)
+  {
+    dyad_shutdown();
+    printf("  skipped, over FD_SETSIZE (%d)\n", FD_SETSIZE);
+    return 0;
+  }
+
+  // creating and destroying streams which are never opened
+  dyad_setUpdateTimeout(0);
+  double start_time = dyad_getTime();
+  for (int i = 0; i < BENCH_NUM_STREAMS; i++)
+  {
+    dyad_newStream();
+  }
+  dyad_update();
+  double churn_time = dyad_getTime() - start_time;
+
+  dyad_Stream *server = dyad_newStream();
+  dyad_addListener(server, DYAD_EVENT_ACCEPT, bench_accept, NULL);
+  if (dyad_listenEx(server, "127.0.0.1", port, 4096) != 0)
+  {
+    dyad_shutdown();
+    printf("  failed to listen on port %d\n", port);
+    return 1;
+  }
+
+  // both ends of every connection are streams of this reactor, so there are
+  // two streams per connection...
+  dyad_Stream **clients = calloc(num_connections, sizeof(dyad_Stream*));
+  int num_started = 0;
+  start_time = dyad_getTime();
+  while (bench_accepted < num_connections || bench_connected < num_connections)
+  {
+    for (int i = 0; i < BENCH_CONNECT_BATCH && num_started < num_connections; i++)
+    {
+      dyad_Stream *stream = dyad_newStream();
+      dyad_addListener(stream, DYAD_EVENT_CONNECT, bench_connect, NULL);
+      dyad_addListener(stream, DYAD_EVENT_ERROR, bench_error, NULL);
+      dyad_connect(stream, "127.0.0.1", port);
+      clients[num_started++] = stream;
+    }
+
+    dyad_update();
+    if (bench_errors > 0 || dyad_getTime() - start_time > BENCH_TIME_LIMIT)
+    {
+      dyad_shutdown();
+      free(clients);
+      printf("  failed to open the connections, errors %d\n", bench_errors);
+      return 1;
+    }
+  }
+
+  // keep a message bouncing on a few connections while the rest stay idle
+  for (int i = 0; i < BENCH_NUM_ACTIVE; i++)
+  {
+    dyad_addListener(clients[i], DYAD_EVENT_DATA, bench_data, NULL);
+    dyad_write(clients[i], "ping", 4);
+  }
+
+  start_time = dyad_getTime();
+  for (int i = 0; i < bench_updates; i++)
+  {
+    dyad_update();
+  }
+  double update_time = dyad_getTime() - start_time;
+
+  // the same again with a tick every millisecond
+  dyad_addListener(server, DYAD_EVENT_TICK, bench_tick, NULL);
+  dyad_setTickInterval(0.001);
+  start_time = dyad_getTime();
+  for (int i = 0; i < bench_updates; i++)
+  {
+    dyad_update();
+  }
+  double tick_time = dyad_getTime() - start_time;
+
+  printf("  %d streams: %7.2fus per update, %7.2fus per update with %d ticks, %6.3fus to create and destroy a stream\n",
+    dyad_getStreamCount(), update_time * 1e6 / bench_updates, tick_time * 1e6 / bench_updates,
+    bench_ticks, churn_time * 1e6 / BENCH_NUM_STREAMS);
+
+  dyad_shutdown();
+  free(clients);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_updates = atoi(argv[1]);
+  }
+
+  // every stream takes a descriptor
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < BENCH_NUM_STREAMS + 64)
+  {
+    printf("not enough descriptors for %d streams\n", BENCH_NUM_STREAMS);
+    return 1;
+  }
+
+  int result = 0;
+  for (int backend = DYAD_BACKEND_SELECT; backend <= DYAD_BACKEND_URING; backend++)
+  {
+    printf("%s:\n", bench_backend_names[backend]);
+    bench_connected = 0;
+    bench_accepted = 0;
+    bench_errors = 0;
+    bench_ticks = 0;
+    result |= bench_run(backend);
+  }
+
+  return result;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures how the task manager's throughput scales with the number of
+ * schedulers: a batch of independent tasks, each doing a fixed amount of
+ * work on the seed it's given as its payload, is added from outside the
+ * schedulers, then the same again with the
+ * tasks added by a few tasks which are already running, so that the other
+ * schedulers have to steal them.
+ *
+ * usage: bench_tasks [tasks] [work per task]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "task.h"
+#include "util.h"
+
+#define BENCH_NUM_SPAWNERS 4
+
+static int bench_num_tasks = 100000;
+static int bench_work = 2000;
+static atomic_int bench_num_done = 0;
+static atomic_uint bench_checksum = 0;
+
+static task_result_t bench_task(task_t *task)
+{
+  uint32_t value = *(uint32_t*)task_get_payload(task);
+  for (int i = 0; i < bench_work; i++)
+  {
+    value = value * 1103515245 + 12345;
+  }
+  atomic_fetch_add(&bench_checksum, value);
+  atomic_fetch_add(&bench_num_done, 1);
+  return TASK_RESULT_DONE;
+}
+
+static task_result_t bench_spawn_task(task_t *task)
+{
+  for (uint32_t i = 0; i < bench_num_tasks / BENCH_NUM_SPAWNERS; i++)
+  {
+    add_task_with_payload(bench_task, 0, &i, sizeof(i), NULL);
+  }
+  return TASK_RESULT_DONE;
+}
+
+static double bench_run(int num_schedulers, bool spawn)
+{
+  taskmgr_set_num_schedulers(num_schedulers);
+  taskmgr_init();
+  atomic_store(&bench_num_done, 0);
+
+  double start_time = taskmgr_get_time();
+  int num_tasks = bench_num_tasks;
+  if (spawn)
+  {
+    num_tasks = (bench_num_tasks / BENCH_NUM_SPAWNERS) * BENCH_NUM_SPAWNERS;
+    for (int i = 0; i < BENCH_NUM_SPAWNERS; i++)
+    {
+      add_task(bench_spawn_task, 0);
+    }
+  }
+  else
+  {
+    for (uint32_t i = 0; i < num_tasks; i++)
+    {
+      add_task_with_payload(bench_task, 0, &i, sizeof(i), NULL);
+    }
+  }
+
+  // the calling thread is a scheduler too...
+  while (atomic_load(&bench_num_done) < num_tasks)
+  {
+    taskmgr_wait(taskmgr_run_pending());
+  }
+  double run_time = taskmgr_get_time() - start_time;
+
+  taskmgr_shutdown();
+  return num_tasks / run_time;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_num_tasks = atoi(argv[1]);
+  }
+  if (argc > 2)
+  {
+    bench_work = atoi(argv[2]);
+  }
+
+  int num_cores = get_num_logical_cores();
+  printf("%d tasks of %d steps, %d logical core(s):\n", bench_num_tasks, bench_work, num_cores);
+  for (int num_schedulers = 1; num_schedulers <= num_cores * 2; num_schedulers *= 2)
+  {
+    double added_rate = bench_run(num_schedulers, false);
+    double spawned_rate = bench_run(num_schedulers, true);
+    printf("  %2d scheduler(s): %10.0f tasks/sec added, %10.0f tasks/sec spawned\n",
+      num_schedulers, added_rate, spawned_rate);
+  }
+  return 0;
+}
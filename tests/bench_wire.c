@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+/*
+ * Measures the second wire format against the first: every packet type is
+ * written into a fresh buffer and read back again, the way each one is sent
+ * and received, and the size of the packet in both formats is reported
+ * alongside the time it takes to encode and decode it.
+ *
+ * usage: bench_wire [operations]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "bufferpool.h"
+#include "wire.h"
+
+#define BENCH_NUM_PEERS 16
+#define BENCH_RELAYMSG_SIZE 256
+
+static int bench_operations = 200000;
+
+static unsigned char bench_key[WIRE_KEY_SIZE];
+static unsigned char bench_nonce[WIRE_NONCE_SIZE];
+static unsigned char bench_signed_message[WIRE_SIGN_SIZE + BENCH_RELAYMSG_SIZE];
+static unsigned char bench_ciphertext[WIRE_MAC_SIZE + BENCH_RELAYMSG_SIZE];
+static wire_peer_t bench_peers[BENCH_NUM_PEERS];
+
+typedef struct BenchPacket
+{
+  const char *name;
+  void (*write)(buffer_t *buffer, int wire_version);
+  bool (*read)(buffer_t *buffer, int wire_version);
+} bench_packet_t;
+
+static double bench_get_time(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void bench_write_connect_req(buffer_t *buffer, int wire_version)
+{
+  wire_connect_req_t connect_req;
+  connect_req.version.data = (const unsigned char*)"0.0.1";
+  connect_req.version.size = 5;
+  connect_req.release.name.data = (const unsigned char*)"alpha";
+  connect_req.release.name.size = 5;
+  connect_req.release.wire_version = wire_version;
+  connect_req.port = 7777;
+  buffer_reserve(buffer, wire_get_connect_req_size(wire_version, &connect_req));
+  wire_write_connect_req(buffer, wire_version, &connect_req);
+}
+
+static bool bench_read_connect_req(buffer_t *buffer, int wire_version)
+{
+  wire_connect_req_t connect_req;
+  return wire_read_connect_req(buffer, wire_version, &connect_req) && connect_req.release.wire_version == wire_version;
+}
+
+static void bench_write_keypair_req(buffer_t *buffer, int wire_version)
+{
+  wire_keypair_req_t keypair_req;
+  keypair_req.public_key.data = bench_key;
+  keypair_req.public_key.size = sizeof(bench_key);
+  keypair_req.private_key.data = bench_key;
+  keypair_req.private_key.size = sizeof(bench_key);
+  keypair_req.nonce.data = bench_nonce;
+  keypair_req.nonce.size = sizeof(bench_nonce);
+  buffer_reserve(buffer, wire_get_keypair_req_size(wire_version, &keypair_req));
+  wire_write_keypair_req(buffer, wire_version, &keypair_req);
+}
+
+static bool bench_read_keypair_req(buffer_t *buffer, int wire_version)
+{
+  wire_keypair_req_t keypair_req;
+  return wire_read_keypair_req(buffer, wire_version, &keypair_req) &&
+    memcmp(keypair_req.nonce.data, bench_nonce, sizeof(bench_nonce)) == 0;
+}
+
+static void bench_write_keypair_resp(buffer_t *buffer, int wire_version)
+{
+  wire_keypair_resp_t keypair_resp;
+  keypair_resp.public_key.data = bench_key;
+  keypair_resp.public_key.size = sizeof(bench_key);
+  keypair_resp.private_key.data = bench_key;
+  keypair_resp.private_key.size = sizeof(bench_key);
+  buffer_reserve(buffer, wire_get_keypair_resp_size(wire_version, &keypair_resp));
+  wire_write_keypair_resp(buffer, wire_version, &keypair_resp);
+}
+
+static bool bench_read_keypair_resp(buffer_t *buffer, int wire_version)
+{
+  wire_keypair_resp_t keypair_resp;
+  return wire_read_keypair_resp(buffer, wire_version, &keypair_resp) &&
+    memcmp(keypair_resp.public_key.data, bench_key, sizeof(bench_key)) == 0;
+}
+
+static void bench_write_peerlist_resp(buffer_t *buffer, int wire_version)
+{
+  wire_peerlist_resp_t peerlist;
+  peerlist.num_peers = BENCH_NUM_PEERS;
+  wire_write_peerlist_resp(buffer, wire_version, &peerlist);
+  for (int i = 0; i < BENCH_NUM_PEERS; i++)
+  {
+    wire_write_peer(buffer, wire_version, &bench_peers[i]);
+  }
+}
+
+static bool bench_read_peerlist_resp(buffer_t *buffer, int wire_version)
+{
+  wire_peerlist_resp_t peerlist;
+  if (!wire_read_peerlist_resp(buffer, wire_version, &peerlist) || peerlist.num_peers != BENCH_NUM_PEERS)
+  {
+    return false;
+  }
+  for (int i = 0; i < peerlist.num_peers; i++)
+  {
+    wire_peer_t peer;
+    if (!wire_read_peer(buffer, wire_version, &peer) || peer.port != bench_peers[i].port ||
+      strcmp(peer.address, bench_peers[i].address) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void bench_write_relaymsg(buffer_t *buffer, int wire_version)
+{
+  wire_relaymsg_t relaymsg;
+  relaymsg.message.data_size = BENCH_RELAYMSG_SIZE;
+  relaymsg.message.signed_message.data = bench_signed_message;
+  relaymsg.message.signed_message.size = sizeof(bench_signed_message);
+  relaymsg.message.ciphertext.data = bench_ciphertext;
+  relaymsg.message.ciphertext.size = sizeof(bench_ciphertext);
+  relaymsg.timestamp = 1546000000;
+  buffer_reserve(buffer, wire_get_relaymsg_size(wire_version, &relaymsg));
+  wire_write_relaymsg(buffer, wire_version, &relaymsg);
+}
+
+static bool bench_read_relaymsg(buffer_t *buffer, int wire_version)
+{
+  wire_relaymsg_t relaymsg;
+  return wire_read_relaymsg(buffer, wire_version, &relaymsg) &&
+    relaymsg.message.data_size == BENCH_RELAYMSG_SIZE && relaymsg.timestamp == 1546000000;
+}
+
+static const bench_packet_t bench_packets[] = {
+  {"connect req", bench_write_connect_req, bench_read_connect_req},
+  {"keypair req", bench_write_keypair_req, bench_read_keypair_req},
+  {"keypair resp", bench_write_keypair_resp, bench_read_keypair_resp},
+  {"peerlist resp", bench_write_peerlist_resp, bench_read_peerlist_resp},
+  {"relaymsg", bench_write_relaymsg, bench_read_relaymsg},
+};
+
+static int bench_run_version(const bench_packet_t *packet, int wire_version, double *encode_time, double *decode_time)
+{
+  double start_time = bench_get_time();
+  for (int i = 0; i < bench_operations; i++)
+  {
+    buffer_t *buffer = buffer_init();
+    packet->write(buffer, wire_version);
+    buffer_free(buffer);
+  }
+  *encode_time = (bench_get_time() - start_time) / bench_operations;
+
+  buffer_t *buffer = buffer_init();
+  packet->write(buffer, wire_version);
+  int size = buffer_get_size(buffer);
+
+  start_time = bench_get_time();
+  for (int i = 0; i < bench_operations; i++)
+  {
+    buffer_t *read_buffer = buffer_init_data(0, buffer_get_data(buffer), size);
+    bool result = packet->read(read_buffer, wire_version);
+    assert(result && buffer_get_remaining_size(read_buffer) == 0);
+    (void)result;
+    buffer_free(read_buffer);
+  }
+  *decode_time = (bench_get_time() - start_time) / bench_operations;
+
+  buffer_free(buffer);
+  return size;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    bench_operations = atoi(argv[1]);
+  }
+
+  memset(bench_key, 0x5a, sizeof(bench_key));
+  memset(bench_nonce, 0xa5, sizeof(bench_nonce));
+  memset(bench_signed_message, 0x3c, sizeof(bench_signed_message));
+  memset(bench_ciphertext, 0xc3, sizeof(bench_ciphertext));
+  for (int i = 0; i < BENCH_NUM_PEERS; i++)
+  {
+    snprintf(bench_peers[i].address, sizeof(bench_peers[i].address), "192.168.%d.%d", i, 100 + i * 9);
+    bench_peers[i].port = 7777 + i;
+  }
+
+  printf("wire format %d against %d, %d operations:\n", WIRE_VERSION_2, WIRE_VERSION_1, bench_operations);
+  for (size_t i = 0; i < sizeof(bench_packets) / sizeof(bench_packets[0]); i++)
+  {
+    double encode_time, decode_time, v1_encode_time, v1_decode_time;
+    int v1_size = bench_run_version(&bench_packets[i], WIRE_VERSION_1, &v1_encode_time, &v1_decode_time);
+    int size = bench_run_version(&bench_packets[i], WIRE_VERSION_2, &encode_time, &decode_time);
+    printf("  %-14s %5d bytes (v1 %5d), encode %7.1fns (v1 %7.1fns), decode %7.1fns (v1 %7.1fns)\n",
+      bench_packets[i].name, size, v1_size, encode_time * 1e9, v1_encode_time * 1e9,
+      decode_time * 1e9, v1_decode_time * 1e9);
+  }
+
+  buffer_pool_clear();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "buffer.h"
+#include "bufferpool.h"
+
+#define TEST_NUM_PACKETS 10000
+#define TEST_NUM_BUFFERS 1000
+#define TEST_RELAYMSG_SIZE 4096
+
+static unsigned char test_relaymsg[TEST_RELAYMSG_SIZE];
+static buffer_t *test_buffers[TEST_NUM_BUFFERS];
+
+static void test_send_packet(int payload_size)
+{
+  // the way a packet is written, copied for a peer and then framed...
+  buffer_t *buffer = buffer_init();
+  buffer_write_uint8(buffer, 7);
+  buffer_write_uint16(buffer, payload_size);
+  buffer_write(buffer, test_relaymsg, payload_size);
+
+  buffer_t *other_buffer = buffer_init();
+  buffer_copy(other_buffer, buffer);
+
+  buffer_t *frame_buffer = buffer_init();
+  buffer_reserve(frame_buffer, sizeof(uint16_t) + buffer_get_size(other_buffer));
+  buffer_write_uint16(frame_buffer, buffer_get_size(other_buffer));
+  buffer_write(frame_buffer, buffer_get_data(other_buffer), buffer_get_size(other_buffer));
+  assert(buffer_get_size(frame_buffer) == sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint16_t) + payload_size);
+
+  buffer_free(other_buffer);
+  buffer_free(frame_buffer);
+  buffer_free(buffer);
+}
+
+static void* test_alloc_buffers(void *arg)
+{
+  for (int i = 0; i < TEST_NUM_BUFFERS; i++)
+  {
+    test_buffers[i] = buffer_init_size(0, TEST_RELAYMSG_SIZE);
+  }
+  return NULL;
+}
+
+static void* test_free_buffers(void *arg)
+{
+  for (int i = 0; i < TEST_NUM_BUFFERS; i++)
+  {
+    buffer_free(test_buffers[i]);
+    test_buffers[i] = NULL;
+  }
+  return NULL;
+}
+
+static void test_run_thread(void* (*func)(void*))
+{
+  pthread_t thread;
+  pthread_create(&thread, NULL, func, NULL);
+  pthread_join(thread, NULL);
+}
+
+int main(int argc, char **argv)
+{
+  memset(test_relaymsg, 0xbe, sizeof(test_relaymsg));
+
+  // sizes are rounded up to their class, large ones are left alone...
+  assert(buffer_pool_get_block_size(1) == BUFFER_POOL_MIN_BLOCK_SIZE);
+  assert(buffer_pool_get_block_size(BUFFER_POOL_MIN_BLOCK_SIZE) == BUFFER_POOL_MIN_BLOCK_SIZE);
+  assert(buffer_pool_get_block_size(BUFFER_POOL_MIN_BLOCK_SIZE + 1) == BUFFER_POOL_MIN_BLOCK_SIZE * 2);
+  assert(buffer_pool_get_block_size(65536) == 65536);
+  assert(buffer_pool_get_block_size(65537) == 65537);
+
+  // once warmed up, sending control packets and relayed messages doesn't
+  // touch the heap at all...
+  for (int i = 0; i < 16; i++)
+  {
+    test_send_packet(16);
+    test_send_packet(TEST_RELAYMSG_SIZE);
+  }
+
+  long num_hits = buffer_pool_get_num_hits();
+  long num_misses = buffer_pool_get_num_misses();
+  for (int i = 0; i < TEST_NUM_PACKETS; i++)
+  {
+    test_send_packet(i % 2 ? 16 : TEST_RELAYMSG_SIZE);
+  }
+  assert(buffer_pool_get_num_misses() == num_misses);
+  assert(buffer_pool_get_num_hits() - num_hits >= TEST_NUM_PACKETS * 3);
+
+  // buffers freed on another thread end up in the depot, where a third
+  // thread picks them up again...
+  test_run_thread(test_alloc_buffers);
+  test_run_thread(test_free_buffers);
+  num_hits = buffer_pool_get_num_hits();
+  test_run_thread(test_alloc_buffers);
+  assert(buffer_pool_get_num_hits() - num_hits >= BUFFER_POOL_DEPOT_SIZE);
+  test_run_thread(test_free_buffers);
+
+  buffer_pool_clear();
+  printf("buffer pool tests passed, %ld hits, %ld misses.\n",
+    buffer_pool_get_num_hits(), buffer_pool_get_num_misses());
+  return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "epoch.h"
+
+#define TEST_NUM_READERS 4
+#define TEST_NUM_WRITERS 2
+#define TEST_NUM_UPDATES 20000
+#define TEST_NUM_VALUES 16
+#define TEST_MAGIC 0x5eed
+
+// stands in for a peer snapshot, the values are checked by the readers
+// and wiped when it's freed...
+typedef struct TestSnapshot
+{
+  int magic;
+  int values[TEST_NUM_VALUES];
+} test_snapshot_t;
+
+static _Atomic(test_snapshot_t*) test_snapshot = NULL;
+static pthread_mutex_t test_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool test_done = false;
+static atomic_int test_num_retired = 0;
+static atomic_int test_num_freed = 0;
+static atomic_long test_num_reads = 0;
+
+static test_snapshot_t* test_init_snapshot(int value)
+{
+  test_snapshot_t *snapshot = malloc(sizeof(test_snapshot_t));
+  snapshot->magic = TEST_MAGIC;
+  for (int i = 0; i < TEST_NUM_VALUES; i++)
+  {
+    snapshot->values[i] = value;
+  }
+  return snapshot;
+}
+
+static void test_free_snapshot(void *object)
+{
+  test_snapshot_t *snapshot = object;
+  snapshot->magic = 0;
+  for (int i = 0; i < TEST_NUM_VALUES; i++)
+  {
+    snapshot->values[i] = -1;
+  }
+  free(snapshot);
+  atomic_fetch_add(&test_num_freed, 1);
+}
+
+static void* test_reader(void *arg)
+{
+  while (!atomic_load(&test_done))
+  {
+    epoch_enter();
+    test_snapshot_t *snapshot = atomic_load(&test_snapshot);
+
+    // a nested critical section doesn't end the outer one...
+    epoch_enter();
+    epoch_exit();
+
+    assert(snapshot->magic == TEST_MAGIC);
+    for (int i = 1; i < TEST_NUM_VALUES; i++)
+    {
+      assert(snapshot->values[i] == snapshot->values[0]);
+    }
+    epoch_exit();
+    atomic_fetch_add(&test_num_reads, 1);
+  }
+  return NULL;
+}
+
+static void* test_writer(void *arg)
+{
+  for (int i = 0; i < TEST_NUM_UPDATES; i++)
+  {
+    pthread_mutex_lock(&test_writer_mutex);
+    test_snapshot_t *old_snapshot = atomic_exchange(&test_snapshot, test_init_snapshot(i));
+    epoch_retire(old_snapshot, test_free_snapshot);
+    atomic_fetch_add(&test_num_retired, 1);
+    pthread_mutex_unlock(&test_writer_mutex);
+    if (i % 64 == 0)
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  atomic_store(&test_snapshot, test_init_snapshot(0));
+
+  pthread_t readers[TEST_NUM_READERS];
+  pthread_t writers[TEST_NUM_WRITERS];
+  for (int i = 0; i < TEST_NUM_READERS; i++)
+  {
+    pthread_create(&readers[i], NULL, test_reader, NULL);
+  }
+  for (int i = 0; i < TEST_NUM_WRITERS; i++)
+  {
+    pthread_create(&writers[i], NULL, test_writer, NULL);
+  }
+  for (int i = 0; i < TEST_NUM_WRITERS; i++)
+  {
+    pthread_join(writers[i], NULL);
+  }
+
+  // most of what was retired is freed while the readers carry on...
+  int num_freed = atomic_load(&test_num_freed);
+  assert(num_freed > 0 && num_freed <= atomic_load(&test_num_retired));
+  atomic_store(&test_done, true);
+  for (int i = 0; i < TEST_NUM_READERS; i++)
+  {
+    pthread_join(readers[i], NULL);
+  }
+
+  // with the readers gone, the rest goes too...
+  epoch_collect_all();
+  assert(atomic_load(&test_num_freed) == atomic_load(&test_num_retired));
+  assert(atomic_load(&test_num_retired) == TEST_NUM_WRITERS * TEST_NUM_UPDATES);
+  test_free_snapshot(atomic_load(&test_snapshot));
+
+  printf("epoch tests passed, %d retired, %d freed while reading, %ld reads.\n",
+    TEST_NUM_WRITERS * TEST_NUM_UPDATES, num_freed, atomic_load(&test_num_reads));
+  return 0;
+}
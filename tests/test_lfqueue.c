@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "lfqueue.h"
+
+#define TEST_NUM_THREADS 4
+#define TEST_NUM_OBJECTS 200000
+#define TEST_CAPACITY 64
+
+// every object says which thread pushed it and in which order, counting
+// from one so that none of them are NULL...
+static void* test_make_object(int thread, int index)
+{
+  return (void*)((uintptr_t)thread * TEST_NUM_OBJECTS + index + 1);
+}
+
+static int test_get_thread(void *object)
+{
+  return (int)(((uintptr_t)object - 1) / TEST_NUM_OBJECTS);
+}
+
+static int test_get_index(void *object)
+{
+  return (int)(((uintptr_t)object - 1) % TEST_NUM_OBJECTS);
+}
+
+static mpsc_queue_t *test_mpsc_queue = NULL;
+static spsc_queue_t *test_spsc_queue = NULL;
+static spmc_queue_t *test_spmc_queue = NULL;
+static atomic_int test_num_popped = 0;
+static atomic_uchar *test_seen = NULL;
+
+static void* test_mpsc_producer(void *arg)
+{
+  int thread = (int)(intptr_t)arg;
+  for (int i = 0; i < TEST_NUM_OBJECTS; i++)
+  {
+    while (!mpsc_queue_push(test_mpsc_queue, test_make_object(thread, i)))
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void* test_spsc_producer(void *arg)
+{
+  for (int i = 0; i < TEST_NUM_OBJECTS; i++)
+  {
+    while (!spsc_queue_push(test_spsc_queue, test_make_object(0, i)))
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void* test_spmc_consumer(void *arg)
+{
+  while (atomic_load(&test_num_popped) < TEST_NUM_OBJECTS)
+  {
+    void *object = spmc_queue_pop(test_spmc_queue);
+    if (!object)
+    {
+      sched_yield();
+      continue;
+    }
+    assert(atomic_fetch_add(&test_seen[test_get_index(object)], 1) == 0);
+    atomic_fetch_add(&test_num_popped, 1);
+  }
+  return NULL;
+}
+
+static void test_single_thread(void)
+{
+  // the capacity is rounded up, and a full queue turns pushes away...
+  mpsc_queue_t *mpsc_queue = mpsc_queue_init(5);
+  spsc_queue_t *spsc_queue = spsc_queue_init(5);
+  spmc_queue_t *spmc_queue = spmc_queue_init(5);
+  assert(mpsc_queue_get_capacity(mpsc_queue) == 8);
+  assert(spsc_queue_get_capacity(spsc_queue) == 8);
+  assert(spmc_queue_get_capacity(spmc_queue) == 8);
+  assert(mpsc_queue_pop(mpsc_queue) == NULL);
+  assert(spsc_queue_pop(spsc_queue) == NULL);
+  assert(spmc_queue_pop(spmc_queue) == NULL);
+
+  // several times around the ring...
+  for (int round = 0; round < 5; round++)
+  {
+    for (int i = 0; i < 8; i++)
+    {
+      assert(mpsc_queue_push(mpsc_queue, test_make_object(0, i)));
+      assert(spsc_queue_push(spsc_queue, test_make_object(0, i)));
+      assert(spmc_queue_push(spmc_queue, test_make_object(0, i)));
+    }
+    assert(!mpsc_queue_push(mpsc_queue, test_make_object(0, 8)));
+    assert(!spsc_queue_push(spsc_queue, test_make_object(0, 8)));
+    assert(!spmc_queue_push(spmc_queue, test_make_object(0, 8)));
+    assert(mpsc_queue_get_size(mpsc_queue) == 8);
+    assert(spsc_queue_get_size(spsc_queue) == 8);
+    assert(spmc_queue_get_size(spmc_queue) == 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+      assert(mpsc_queue_pop(mpsc_queue) == test_make_object(0, i));
+      assert(spsc_queue_pop(spsc_queue) == test_make_object(0, i));
+      assert(spmc_queue_pop(spmc_queue) == test_make_object(0, i));
+    }
+    assert(mpsc_queue_pop(mpsc_queue) == NULL);
+    assert(spsc_queue_pop(spsc_queue) == NULL);
+    assert(spmc_queue_pop(spmc_queue) == NULL);
+    assert(mpsc_queue_get_size(mpsc_queue) == 0);
+  }
+
+  mpsc_queue_free(mpsc_queue);
+  spsc_queue_free(spsc_queue);
+  spmc_queue_free(spmc_queue);
+}
+
+static void test_mpsc(void)
+{
+  // every producer's objects come out in the order it pushed them...
+  test_mpsc_queue = mpsc_queue_init(TEST_CAPACITY);
+  pthread_t threads[TEST_NUM_THREADS];
+  for (intptr_t i = 0; i < TEST_NUM_THREADS; i++)
+  {
+    pthread_create(&threads[i], NULL, test_mpsc_producer, (void*)i);
+  }
+
+  int next_index[TEST_NUM_THREADS] = {0};
+  int num_popped = 0;
+  while (num_popped < TEST_NUM_THREADS * TEST_NUM_OBJECTS)
+  {
+    void *object = mpsc_queue_pop(test_mpsc_queue);
+    if (!object)
+    {
+      sched_yield();
+      continue;
+    }
+    int thread = test_get_thread(object);
+    assert(thread >= 0 && thread < TEST_NUM_THREADS);
+    assert(test_get_index(object) == next_index[thread]);
+    next_index[thread]++;
+    num_popped++;
+  }
+
+  for (int i = 0; i < TEST_NUM_THREADS; i++)
+  {
+    pthread_join(threads[i], NULL);
+    assert(next_index[i] == TEST_NUM_OBJECTS);
+  }
+  assert(mpsc_queue_pop(test_mpsc_queue) == NULL);
+  mpsc_queue_free(test_mpsc_queue);
+}
+
+static void test_spsc(void)
+{
+  test_spsc_queue = spsc_queue_init(TEST_CAPACITY);
+  pthread_t thread;
+  pthread_create(&thread, NULL, test_spsc_producer, NULL);
+
+  int next_index = 0;
+  while (next_index < TEST_NUM_OBJECTS)
+  {
+    void *object = spsc_queue_pop(test_spsc_queue);
+    if (!object)
+    {
+      sched_yield();
+      continue;
+    }
+    assert(object == test_make_object(0, next_index));
+    next_index++;
+  }
+
+  pthread_join(thread, NULL);
+  assert(spsc_queue_pop(test_spsc_queue) == NULL);
+  spsc_queue_free(test_spsc_queue);
+}
+
+static void test_spmc(void)
+{
+  // every object is popped by exactly one of the consumers...
+  test_spmc_queue = spmc_queue_init(TEST_CAPACITY);
+  test_seen = calloc(TEST_NUM_OBJECTS, sizeof(atomic_uchar));
+  atomic_store(&test_num_popped, 0);
+  pthread_t threads[TEST_NUM_THREADS];
+  for (int i = 0; i < TEST_NUM_THREADS; i++)
+  {
+    pthread_create(&threads[i], NULL, test_spmc_consumer, NULL);
+  }
+
+  for (int i = 0; i < TEST_NUM_OBJECTS; i++)
+  {
+    while (!spmc_queue_push(test_spmc_queue, test_make_object(0, i)))
+    {
+      sched_yield();
+    }
+  }
+
+  for (int i = 0; i < TEST_NUM_THREADS; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+  assert(atomic_load(&test_num_popped) == TEST_NUM_OBJECTS);
+  for (int i = 0; i < TEST_NUM_OBJECTS; i++)
+  {
+    assert(atomic_load(&test_seen[i]) == 1);
+  }
+  assert(spmc_queue_pop(test_spmc_queue) == NULL);
+  free(test_seen);
+  spmc_queue_free(test_spmc_queue);
+}
+
+int main(int argc, char **argv)
+{
+  test_single_thread();
+  test_mpsc();
+  test_spsc();
+  test_spmc();
+  printf("lfqueue tests passed.\n");
+  return 0;
+}
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "queue.h"
@@ -47,6 +48,49 @@ int main(int argc, char **argv)
   assert(queue_get_size(queue) == 0);
   assert(queue_get_max_index(queue) == -1);
 
+  // well past the size the queue used to be limited to, and all the way
+  // back down again...
+  for (intptr_t i = 0; i < 300000; i++)
+  {
+    queue_push_right(queue, (void*)(i + 1));
+  }
+  assert(queue_get_size(queue) == 300000);
+  assert(queue_get_max_index(queue) == 299999);
+  assert(queue_get(queue, 123456) == (void*)123457);
+  for (intptr_t i = 0; i < 300000; i++)
+  {
+    assert(queue_pop_left(queue) == (void*)(i + 1));
+  }
+  assert(queue_get_empty(queue));
+  assert(queue_pop_left(queue) == NULL);
+  assert(queue_pop_right(queue) == NULL);
+
+  // wrapping around the ring from both ends
+  for (intptr_t i = 0; i < 100; i++)
+  {
+    queue_push_left(queue, (void*)(i + 1));
+    queue_push_right(queue, (void*)(i + 1001));
+  }
+  for (intptr_t i = 0; i < 100; i++)
+  {
+    assert(queue_get(queue, 99 - i) == (void*)(i + 1));
+    assert(queue_get(queue, 100 + i) == (void*)(i + 1001));
+  }
+
+  // removing from the middle closes the gap
+  queue_remove_object(queue, (void*)50);
+  assert(queue_get_size(queue) == 199);
+  assert(queue_get_index(queue, (void*)50) == -1);
+  assert(queue_get(queue, 49) == (void*)51);
+  assert(queue_get(queue, 50) == (void*)49);
+  queue_remove(queue, 150);
+  assert(queue_get(queue, 150) == (void*)1053);
+  queue_push(queue, 150, (void*)7);
+  assert(queue_get(queue, 150) == (void*)7);
+  assert(queue_get(queue, 151) == (void*)1053);
+  assert(queue_get(queue, queue_get_max_index(queue)) == (void*)1100);
+  assert(queue_get(queue, 199) == NULL);
+
   free(test_queue_object);
   queue_free(queue);
   return 0;
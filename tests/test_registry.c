@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "registry.h"
+
+#define TEST_NUM_OBJECTS 100000
+
+static void* test_make_object(int id)
+{
+  return (void*)((intptr_t)id + 1);
+}
+
+static void test_check(registry_t *registry, const unsigned char *present)
+{
+  // every object present is found by its id, and exactly once when
+  // walking the registry by index...
+  int num_present = 0;
+  unsigned char *seen = calloc(TEST_NUM_OBJECTS, 1);
+  for (int id = 0; id < TEST_NUM_OBJECTS; id++)
+  {
+    if (present[id])
+    {
+      assert(registry_get(registry, id) == test_make_object(id));
+      num_present++;
+    }
+    else
+    {
+      assert(registry_get(registry, id) == NULL);
+    }
+  }
+  assert(registry_get_size(registry) == num_present);
+  for (int i = 0; i < num_present; i++)
+  {
+    int id = (int)((intptr_t)registry_get_at(registry, i) - 1);
+    assert(id >= 0 && id < TEST_NUM_OBJECTS && present[id] && !seen[id]);
+    seen[id] = 1;
+  }
+  assert(registry_get_at(registry, num_present) == NULL);
+  assert(registry_get_at(registry, -1) == NULL);
+  free(seen);
+}
+
+int main(int argc, char **argv)
+{
+  registry_t *registry = registry_init();
+  unsigned char *present = calloc(TEST_NUM_OBJECTS, 1);
+
+  assert(registry_get_size(registry) == 0);
+  assert(registry_get(registry, 0) == NULL);
+  assert(registry_remove(registry, 0) == NULL);
+
+  // an id can only be added once...
+  assert(registry_add(registry, 7, test_make_object(7)));
+  assert(!registry_add(registry, 7, test_make_object(8)));
+  assert(registry_has(registry, 7));
+  assert(registry_remove(registry, 7) == test_make_object(7));
+  assert(!registry_has(registry, 7));
+
+  // ids in sequence, the way the interfaces hand them out...
+  for (int id = 0; id < TEST_NUM_OBJECTS; id++)
+  {
+    assert(registry_add(registry, id, test_make_object(id)));
+    present[id] = 1;
+  }
+  test_check(registry, present);
+
+  // removing from the middle, from both ends and at random...
+  for (int id = TEST_NUM_OBJECTS / 4; id < TEST_NUM_OBJECTS / 2; id++)
+  {
+    assert(registry_remove(registry, id) == test_make_object(id));
+    present[id] = 0;
+  }
+  assert(registry_remove(registry, 0) == test_make_object(0));
+  present[0] = 0;
+  assert(registry_remove(registry, TEST_NUM_OBJECTS - 1) == test_make_object(TEST_NUM_OBJECTS - 1));
+  present[TEST_NUM_OBJECTS - 1] = 0;
+  test_check(registry, present);
+
+  srand(1);
+  for (int i = 0; i < TEST_NUM_OBJECTS * 4; i++)
+  {
+    int id = rand() % TEST_NUM_OBJECTS;
+    if (present[id])
+    {
+      assert(registry_remove(registry, id) == test_make_object(id));
+      present[id] = 0;
+    }
+    else
+    {
+      assert(registry_add(registry, id, test_make_object(id)));
+      present[id] = 1;
+    }
+  }
+  test_check(registry, present);
+
+  // and all the way back down again...
+  for (int id = 0; id < TEST_NUM_OBJECTS; id++)
+  {
+    if (present[id])
+    {
+      assert(registry_remove(registry, id) == test_make_object(id));
+      present[id] = 0;
+    }
+  }
+  test_check(registry, present);
+  assert(registry->capacity == REGISTRY_MIN_CAPACITY);
+
+  free(present);
+  registry_free(registry);
+  printf("registry tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ringbuffer.h"
+
+#define TEST_NUM_FRAMES 500
+#define TEST_NUM_ROUNDS 40
+#define TEST_LARGE_FRAME_SIZE (1024 * 1024)
+#define TEST_MAX_FRAME_SIZE (4 * 1024 * 1024)
+
+typedef struct TestFrames
+{
+  const unsigned char *stream;
+  size_t offset;
+  int num_frames;
+  int stop_after;
+} test_frames_t;
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_random(void)
+{
+  test_seed = test_seed * 1103515245 + 12345;
+  return (test_seed >> 8) & 0xffffff;
+}
+
+static size_t test_get_frame_size(const unsigned char *header, size_t size, void *arg)
+{
+  if (size < sizeof(uint16_t))
+  {
+    return 0;
+  }
+
+  uint16_t payload_size;
+  memcpy(&payload_size, header, sizeof(uint16_t));
+  return sizeof(uint16_t) + payload_size;
+}
+
+static size_t test_get_large_frame_size(const unsigned char *header, size_t size, void *arg)
+{
+  if (size < sizeof(uint32_t))
+  {
+    return 0;
+  }
+
+  uint32_t payload_size;
+  memcpy(&payload_size, header, sizeof(uint32_t));
+  if (sizeof(uint32_t) + (size_t)payload_size > TEST_MAX_FRAME_SIZE)
+  {
+    return RING_BUFFER_INVALID_FRAME_SIZE;
+  }
+  return sizeof(uint32_t) + payload_size;
+}
+
+static bool test_handle_frame(const unsigned char *frame, size_t size, void *arg)
+{
+  // every frame must be handed over whole and in order
+  test_frames_t *frames = arg;
+  assert(memcmp(frames->stream + frames->offset, frame, size) == 0);
+  frames->offset += size;
+  frames->num_frames++;
+  return frames->num_frames != frames->stop_after;
+}
+
+static size_t test_write_frames(unsigned char *stream, int num_frames)
+{
+  size_t size = 0;
+  for (int i = 0; i < num_frames; i++)
+  {
+    // mostly small frames with the occasional empty or maximum sized one
+    uint16_t payload_size = test_random() % 512;
+    switch (test_random() % 16)
+    {
+      case 0: payload_size = 0; break;
+      case 1: payload_size = UINT16_MAX; break;
+      case 2: payload_size = test_random() % UINT16_MAX; break;
+    }
+
+    memcpy(stream + size, &payload_size, sizeof(uint16_t));
+    size += sizeof(uint16_t);
+    for (int j = 0; j < payload_size; j++)
+    {
+      stream[size++] = test_random();
+    }
+  }
+  return size;
+}
+
+static void test_random_fragmentation(unsigned char *stream, size_t stream_size, size_t max_fragment_size)
+{
+  ring_buffer_t *ring_buffer = ring_buffer_init(16);
+  test_frames_t frames = {stream, 0, 0, -1};
+
+  size_t offset = 0;
+  while (offset < stream_size)
+  {
+    size_t fragment_size = 1 + test_random() % max_fragment_size;
+    if (fragment_size > stream_size - offset)
+    {
+      fragment_size = stream_size - offset;
+    }
+
+    assert(ring_buffer_read_frames(ring_buffer, stream + offset, fragment_size,
+      test_get_frame_size, test_handle_frame, &frames));
+
+    offset += fragment_size;
+
+    // only the bytes of an incomplete frame may be left over
+    assert(frames.offset + ring_buffer_get_size(ring_buffer) == offset);
+  }
+
+  assert(frames.num_frames == TEST_NUM_FRAMES);
+  assert(frames.offset == stream_size);
+  assert(ring_buffer_get_empty(ring_buffer));
+  ring_buffer_free(ring_buffer);
+}
+
+int main(int argc, char **argv)
+{
+  static unsigned char stream[TEST_NUM_FRAMES * (sizeof(uint16_t) + UINT16_MAX)];
+
+  // wrapping around the end of the memory
+  ring_buffer_t *ring_buffer = ring_buffer_init(8);
+  unsigned char data[8];
+  ring_buffer_write(ring_buffer, (const unsigned char*)"abcdef", 6);
+  ring_buffer_consume(ring_buffer, 4);
+  ring_buffer_write(ring_buffer, (const unsigned char*)"ghij", 4);
+  assert(ring_buffer_get_capacity(ring_buffer) == 8);
+  assert(ring_buffer_get_size(ring_buffer) == 6);
+  assert(ring_buffer_peek(ring_buffer, data, sizeof(data)) == 6);
+  assert(memcmp(data, "efghij", 6) == 0);
+  assert(memcmp(ring_buffer_get_data(ring_buffer, 6), "efghij", 6) == 0);
+
+  // growing while wrapped
+  ring_buffer_consume(ring_buffer, 2);
+  ring_buffer_write(ring_buffer, (const unsigned char*)"klmnop", 6);
+  assert(ring_buffer_get_capacity(ring_buffer) == 16);
+  assert(memcmp(ring_buffer_get_data(ring_buffer, 10), "ghijklmnop", 10) == 0);
+  ring_buffer_consume(ring_buffer, 10);
+  assert(ring_buffer_get_empty(ring_buffer));
+  ring_buffer_free(ring_buffer);
+
+  // the same frames split up at random, from single bytes up to many
+  // frames per read...
+  for (int i = 0; i < TEST_NUM_ROUNDS; i++)
+  {
+    test_seed = i + 1;
+    size_t stream_size = test_write_frames(stream, TEST_NUM_FRAMES);
+
+    size_t max_fragment_size = 1;
+    switch (i % 4)
+    {
+      case 1: max_fragment_size = 16; break;
+      case 2: max_fragment_size = 8192; break;
+      case 3: max_fragment_size = 200000; break;
+    }
+    test_random_fragmentation(stream, stream_size, max_fragment_size);
+  }
+
+  // a frame handler which stops the reading, for example after closing the
+  // connection, doesn't get handed any more frames
+  test_seed = 1;
+  size_t stream_size = test_write_frames(stream, 10);
+  ring_buffer = ring_buffer_init(16);
+  test_frames_t frames = {stream, 0, 0, 3};
+  assert(!ring_buffer_read_frames(ring_buffer, stream, stream_size,
+    test_get_frame_size, test_handle_frame, &frames));
+  assert(frames.num_frames == 3);
+  ring_buffer_free(ring_buffer);
+
+  // a large frame is buffered into memory of exactly its size as soon as
+  // its header is in, which the rest of it then streams into...
+  static unsigned char large_stream[TEST_LARGE_FRAME_SIZE];
+  uint32_t payload_size = TEST_LARGE_FRAME_SIZE - sizeof(uint32_t);
+  memcpy(large_stream, &payload_size, sizeof(uint32_t));
+  for (size_t i = sizeof(uint32_t); i < sizeof(large_stream); i++)
+  {
+    large_stream[i] = test_random();
+  }
+
+  ring_buffer = ring_buffer_init(16);
+  frames = (test_frames_t){large_stream, 0, 0, -1};
+  for (size_t offset = 0; offset < sizeof(large_stream); offset += 1000)
+  {
+    size_t fragment_size = sizeof(large_stream) - offset < 1000 ? sizeof(large_stream) - offset : 1000;
+    assert(ring_buffer_read_frames(ring_buffer, large_stream + offset, fragment_size,
+      test_get_large_frame_size, test_handle_frame, &frames));
+    assert(frames.num_frames == 1 || ring_buffer_get_capacity(ring_buffer) == TEST_LARGE_FRAME_SIZE);
+  }
+  assert(frames.num_frames == 1);
+  assert(ring_buffer_get_empty(ring_buffer));
+  ring_buffer_free(ring_buffer);
+
+  // a frame which is refused stops the reading before anything of it is
+  // buffered...
+  payload_size = TEST_MAX_FRAME_SIZE;
+  memcpy(large_stream, &payload_size, sizeof(uint32_t));
+  ring_buffer = ring_buffer_init(16);
+  frames = (test_frames_t){large_stream, 0, 0, -1};
+  assert(!ring_buffer_read_frames(ring_buffer, large_stream, 1000,
+    test_get_large_frame_size, test_handle_frame, &frames));
+  assert(frames.num_frames == 0);
+  assert(ring_buffer_get_empty(ring_buffer));
+  assert(ring_buffer_get_capacity(ring_buffer) == 16);
+  ring_buffer_free(ring_buffer);
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "timerwheel.h"
+
+#define TEST_NUM_TIMERS 2000
+#define TEST_NUM_STEPS 20000
+#define TEST_RESOLUTION (1.0 / 1024)
+
+typedef struct TestTimer
+{
+  timer_wheel_timer_t timer;
+  uint64_t deadline;
+  int num_expired;
+} test_timer_t;
+
+static uint32_t test_seed = 1;
+static uint64_t test_now = 0;
+static test_timer_t test_timers[TEST_NUM_TIMERS];
+
+static uint32_t test_random(void)
+{
+  test_seed = test_seed * 1103515245 + 12345;
+  return (test_seed >> 8) & 0xffffff;
+}
+
+static uint64_t test_random_delay(void)
+{
+  // mostly short delays which stay in the lowest levels, with some
+  // reaching the top level or beyond it...
+  switch (test_random() % 8)
+  {
+    case 0: return 0;
+    case 1: return ((uint64_t)test_random() << 8) | (test_random() & 0xff);
+    case 2: return test_random() % 300000;
+    default: return test_random() % 5000;
+  }
+}
+
+static double test_get_time(uint64_t tick)
+{
+  return tick * TEST_RESOLUTION;
+}
+
+static void test_on_expired(timer_wheel_timer_t *timer, void *arg)
+{
+  // the timer must expire on the first advance past its deadline
+  test_timer_t *test_timer = arg;
+  assert(!timer_wheel_timer_get_armed(timer));
+  assert(test_timer->deadline <= test_now);
+  test_timer->num_expired++;
+}
+
+static void test_arm(timer_wheel_t *timer_wheel, test_timer_t *test_timer, uint64_t deadline)
+{
+  test_timer->deadline = deadline;
+  test_timer->num_expired = 0;
+  timer_wheel_add(timer_wheel, &test_timer->timer, test_get_time(deadline));
+}
+
+static void test_on_rearm(timer_wheel_timer_t *timer, void *arg)
+{
+  // adding the timer again from its own function
+  timer_wheel_t *timer_wheel = arg;
+  timer_wheel_add(timer_wheel, timer, test_get_time(test_now + 10));
+}
+
+int main(int argc, char **argv)
+{
+  // start close to a turn of the top level, so that it gets crossed
+  test_now = ((uint64_t)1 << 36) - 100000;
+  timer_wheel_t *timer_wheel = timer_wheel_init(TEST_RESOLUTION, test_get_time(test_now));
+  assert(timer_wheel_get_empty(timer_wheel));
+  assert(timer_wheel_get_next_deadline(timer_wheel) < 0);
+
+  for (int i = 0; i < TEST_NUM_TIMERS; i++)
+  {
+    timer_wheel_timer_init(&test_timers[i].timer, test_on_expired, &test_timers[i]);
+    test_arm(timer_wheel, &test_timers[i], test_now + test_random_delay());
+  }
+  assert(timer_wheel_get_size(timer_wheel) == TEST_NUM_TIMERS);
+
+  for (int step = 0; step < TEST_NUM_STEPS; step++)
+  {
+    // the next deadline is never later than the earliest timer
+    uint64_t earliest = UINT64_MAX;
+    for (int i = 0; i < TEST_NUM_TIMERS; i++)
+    {
+      if (timer_wheel_timer_get_armed(&test_timers[i].timer) && test_timers[i].deadline < earliest)
+      {
+        earliest = test_timers[i].deadline;
+      }
+    }
+    if (earliest != UINT64_MAX)
+    {
+      assert(timer_wheel_get_next_deadline(timer_wheel) <= test_get_time(earliest) + TEST_RESOLUTION / 2);
+    }
+
+    // re-arm or cancel a few timers, then move time along...
+    for (int i = 0; i < 4; i++)
+    {
+      test_timer_t *test_timer = &test_timers[test_random() % TEST_NUM_TIMERS];
+      if (test_random() % 4 == 0)
+      {
+        timer_wheel_remove(timer_wheel, &test_timer->timer);
+      }
+      else
+      {
+        test_arm(timer_wheel, test_timer, test_now + test_random_delay());
+      }
+    }
+
+    uint64_t step_size = test_random() % 8 == 0 ? test_random() % 20000 : test_random() % 50;
+    test_now += step_size;
+    timer_wheel_advance(timer_wheel, test_get_time(test_now));
+
+    for (int i = 0; i < TEST_NUM_TIMERS; i++)
+    {
+      test_timer_t *test_timer = &test_timers[i];
+      bool armed = timer_wheel_timer_get_armed(&test_timer->timer);
+      assert(test_timer->num_expired <= 1);
+      assert(!armed || test_timer->deadline > test_now);
+      assert(!armed || test_timer->num_expired == 0);
+    }
+  }
+
+  // the timers beyond the top level expire once time reaches them
+  for (int i = 0; i < TEST_NUM_TIMERS; i++)
+  {
+    timer_wheel_remove(timer_wheel, &test_timers[i].timer);
+  }
+  assert(timer_wheel_get_empty(timer_wheel));
+  test_arm(timer_wheel, &test_timers[0], test_now + ((uint64_t)1 << 30));
+  for (int i = 0; i < 64; i++)
+  {
+    test_now += (uint64_t)1 << 24;
+    timer_wheel_advance(timer_wheel, test_get_time(test_now));
+    assert(test_timers[0].num_expired == (i == 63 ? 1 : 0));
+  }
+
+  // a timer which adds itself again keeps expiring
+  timer_wheel_timer_t timer;
+  timer_wheel_timer_init(&timer, test_on_rearm, timer_wheel);
+  timer_wheel_add(timer_wheel, &timer, test_get_time(test_now + 10));
+  for (int i = 0; i < 100; i++)
+  {
+    test_now += 10;
+    assert(timer_wheel_advance(timer_wheel, test_get_time(test_now)) == 1);
+    assert(timer_wheel_timer_get_armed(&timer));
+  }
+  timer_wheel_remove(timer_wheel, &timer);
+  assert(timer_wheel_get_empty(timer_wheel));
+
+  timer_wheel_free(timer_wheel);
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) Caleb Marshall - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Caleb Marshall <anythingtechpro@gmail.com>, December 28th, 2018
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "buffer.h"
+#include "bufferpool.h"
+#include "wire.h"
+
+#define TEST_RELAYMSG_SIZE 300
+#define TEST_LARGE_RELAYMSG_SIZE (256 * 1024)
+
+static unsigned char test_key[WIRE_KEY_SIZE];
+static unsigned char test_nonce[WIRE_NONCE_SIZE];
+static unsigned char test_signed_message[WIRE_SIGN_SIZE + TEST_RELAYMSG_SIZE];
+static unsigned char test_ciphertext[WIRE_MAC_SIZE + TEST_RELAYMSG_SIZE];
+
+// writes the record into a buffer sized up front from the schema, which it
+// has to fill exactly without growing, then reads it back into other from
+// read_buffer, which other points into until it's freed. the prefixes of it
+// short of its optional trailing bytes are rejected...
+#define TEST_ROUND_TRIP(name, wire_version, record, other, optional_size, read_buffer) \
+  do \
+  { \
+    int size = wire_get_##name##_size(wire_version, record); \
+    assert(size >= wire_get_##name##_min_size(wire_version)); \
+    buffer_t *buffer = buffer_init(); \
+    buffer_reserve(buffer, size); \
+    long num_allocations = buffer_get_num_allocations(); \
+    wire_write_##name(buffer, wire_version, record); \
+    assert(buffer_get_size(buffer) == size); \
+    assert(buffer_get_num_allocations() == num_allocations); \
+    for (int i = 0; i < size - (optional_size); i++) \
+    { \
+      buffer_t *short_buffer = buffer_init_data(0, buffer_get_data(buffer), i); \
+      assert(!wire_read_##name(short_buffer, wire_version, other)); \
+      assert(buffer_get_remaining_size(short_buffer) == i); \
+      buffer_free(short_buffer); \
+    } \
+    read_buffer = buffer_init_data(0, buffer_get_data(buffer), size); \
+    assert(wire_read_##name(read_buffer, wire_version, other)); \
+    assert(buffer_get_remaining_size(read_buffer) == 0); \
+    buffer_free(buffer); \
+  } while (0)
+
+static bool test_slice_equals(const buffer_slice_t *slice, const unsigned char *data, int size)
+{
+  return slice->size == size && memcmp(slice->data, data, size) == 0;
+}
+
+static void test_connect(int wire_version)
+{
+  buffer_t *read_buffer;
+  wire_connect_req_t connect_req, other_connect_req;
+  connect_req.version.data = (const unsigned char*)"0.0.1";
+  connect_req.version.size = 5;
+  connect_req.release.name.data = (const unsigned char*)"lightning";
+  connect_req.release.name.size = 9;
+  connect_req.release.wire_version = wire_version;
+  connect_req.port = 7777;
+  TEST_ROUND_TRIP(connect_req, WIRE_VERSION_1, &connect_req, &other_connect_req, 0, read_buffer);
+  assert(test_slice_equals(&other_connect_req.version, connect_req.version.data, 5));
+  assert(test_slice_equals(&other_connect_req.release.name, connect_req.release.name.data, 9));
+  assert(other_connect_req.release.wire_version == wire_version);
+  assert(other_connect_req.port == 7777);
+  buffer_free(read_buffer);
+
+  wire_connect_resp_t connect_resp, other_connect_resp;
+  connect_resp.port = 7778;
+  connect_resp.wire_version = wire_version;
+  TEST_ROUND_TRIP(connect_resp, WIRE_VERSION_1, &connect_resp, &other_connect_resp, wire_version > WIRE_VERSION_1, read_buffer);
+  assert(other_connect_resp.port == 7778);
+  assert(other_connect_resp.wire_version == wire_version);
+  buffer_free(read_buffer);
+}
+
+static void test_keypair(int wire_version)
+{
+  buffer_t *read_buffer;
+  wire_keypair_req_t keypair_req, other_keypair_req;
+  keypair_req.public_key.data = test_key;
+  keypair_req.public_key.size = sizeof(test_key);
+  keypair_req.private_key.data = test_key;
+  keypair_req.private_key.size = sizeof(test_key);
+  keypair_req.nonce.data = test_nonce;
+  keypair_req.nonce.size = sizeof(test_nonce);
+  TEST_ROUND_TRIP(keypair_req, wire_version, &keypair_req, &other_keypair_req, 0, read_buffer);
+  assert(test_slice_equals(&other_keypair_req.public_key, test_key, sizeof(test_key)));
+  assert(test_slice_equals(&other_keypair_req.private_key, test_key, sizeof(test_key)));
+  assert(test_slice_equals(&other_keypair_req.nonce, test_nonce, sizeof(test_nonce)));
+  buffer_free(read_buffer);
+
+  wire_keypair_resp_t keypair_resp, other_keypair_resp;
+  keypair_resp.public_key = keypair_req.public_key;
+  keypair_resp.private_key = keypair_req.private_key;
+  TEST_ROUND_TRIP(keypair_resp, wire_version, &keypair_resp, &other_keypair_resp, 0, read_buffer);
+  assert(test_slice_equals(&other_keypair_resp.public_key, test_key, sizeof(test_key)));
+  buffer_free(read_buffer);
+}
+
+static void test_peerlist(int wire_version)
+{
+  buffer_t *read_buffer;
+  wire_peerlist_resp_t peerlist, other_peerlist;
+  peerlist.num_peers = 300;
+  TEST_ROUND_TRIP(peerlist_resp, wire_version, &peerlist, &other_peerlist, 0, read_buffer);
+  assert(other_peerlist.num_peers == 300);
+  buffer_free(read_buffer);
+
+  // addresses which aren't four bytes are sent as they are...
+  static const char *addresses[] = {"0.0.0.0", "10.1.22.255", "seed.example.org"};
+  for (int i = 0; i < sizeof(addresses) / sizeof(addresses[0]); i++)
+  {
+    wire_peer_t peer, other_peer;
+    snprintf(peer.address, sizeof(peer.address), "%s", addresses[i]);
+    peer.port = 7777 + i;
+    TEST_ROUND_TRIP(peer, wire_version, &peer, &other_peer, 0, read_buffer);
+    assert(strcmp(other_peer.address, addresses[i]) == 0);
+    assert(other_peer.port == 7777 + i);
+    buffer_free(read_buffer);
+  }
+}
+
+static void test_frame_header(int wire_version, bool encrypted, int body_size)
+{
+  int payload_size = encrypted ? body_size - WIRE_MAC_SIZE : body_size;
+  int header_size = wire_get_frame_header_size(wire_version, encrypted);
+  buffer_t *buffer = buffer_init();
+  wire_write_frame_header(buffer, wire_version, encrypted, body_size, payload_size);
+  assert(buffer_get_size(buffer) == header_size);
+  assert(wire_get_frame_size(wire_version, encrypted, buffer_get_data(buffer), header_size - 1) == 0);
+  assert(wire_get_frame_size(wire_version, encrypted, buffer_get_data(buffer), header_size) == header_size + (size_t)body_size);
+
+  int other_body_size, other_payload_size;
+  buffer_set_offset(buffer, 0);
+  assert(wire_read_frame_header(buffer, wire_version, encrypted, &other_body_size, &other_payload_size));
+  assert(other_body_size == body_size && other_payload_size == payload_size);
+  buffer_free(buffer);
+}
+
+static void test_large_relaymsg(void)
+{
+  // only the third format has frames large enough for the message, the
+  // second refuses the size before reading any of it...
+  static unsigned char signed_message[WIRE_SIGN_SIZE + TEST_LARGE_RELAYMSG_SIZE];
+  static unsigned char ciphertext[WIRE_MAC_SIZE + TEST_LARGE_RELAYMSG_SIZE];
+  memset(signed_message, 0x3c, sizeof(signed_message));
+  memset(ciphertext, 0xc3, sizeof(ciphertext));
+
+  buffer_t *read_buffer;
+  wire_relaymsg_t relaymsg, other_relaymsg;
+  relaymsg.message.data_size = TEST_LARGE_RELAYMSG_SIZE;
+  relaymsg.message.signed_message.data = signed_message;
+  relaymsg.message.signed_message.size = sizeof(signed_message);
+  relaymsg.message.ciphertext.data = ciphertext;
+  relaymsg.message.ciphertext.size = sizeof(ciphertext);
+  relaymsg.timestamp = 1546000000;
+  assert(wire_get_relaymsg_size(WIRE_VERSION_3, &relaymsg) > wire_get_max_body_size(WIRE_VERSION_2));
+
+  int size = wire_get_relaymsg_size(WIRE_VERSION_3, &relaymsg);
+  buffer_t *buffer = buffer_init();
+  buffer_reserve(buffer, size);
+  wire_write_relaymsg(buffer, WIRE_VERSION_3, &relaymsg);
+  assert(buffer_get_size(buffer) == size);
+
+  read_buffer = buffer_init_data(0, buffer_get_data(buffer), size);
+  assert(!wire_read_relaymsg(read_buffer, WIRE_VERSION_2, &other_relaymsg));
+  assert(buffer_get_remaining_size(read_buffer) == size);
+  assert(wire_read_relaymsg(read_buffer, WIRE_VERSION_3, &other_relaymsg));
+  assert(buffer_get_remaining_size(read_buffer) == 0);
+  assert(other_relaymsg.message.data_size == TEST_LARGE_RELAYMSG_SIZE);
+  assert(test_slice_equals(&other_relaymsg.message.ciphertext, ciphertext, sizeof(ciphertext)));
+  buffer_free(read_buffer);
+  buffer_free(buffer);
+}
+
+static void test_relaymsg(int wire_version)
+{
+  buffer_t *read_buffer;
+  wire_relaymsg_t relaymsg, other_relaymsg;
+  relaymsg.message.data_size = TEST_RELAYMSG_SIZE;
+  relaymsg.message.signed_message.data = test_signed_message;
+  relaymsg.message.signed_message.size = sizeof(test_signed_message);
+  relaymsg.message.ciphertext.data = test_ciphertext;
+  relaymsg.message.ciphertext.size = sizeof(test_ciphertext);
+  relaymsg.timestamp = 1546000000;
+  TEST_ROUND_TRIP(relaymsg, wire_version, &relaymsg, &other_relaymsg, 0, read_buffer);
+  assert(other_relaymsg.message.data_size == TEST_RELAYMSG_SIZE);
+  assert(test_slice_equals(&other_relaymsg.message.signed_message, test_signed_message, sizeof(test_signed_message)));
+  assert(test_slice_equals(&other_relaymsg.message.ciphertext, test_ciphertext, sizeof(test_ciphertext)));
+  assert(other_relaymsg.timestamp == 1546000000);
+  buffer_free(read_buffer);
+}
+
+int main(int argc, char **argv)
+{
+  memset(test_key, 0x5a, sizeof(test_key));
+  memset(test_nonce, 0xa5, sizeof(test_nonce));
+  for (int i = 0; i < sizeof(test_signed_message); i++)
+  {
+    test_signed_message[i] = (unsigned char)i;
+  }
+  memset(test_ciphertext, 0xc3, sizeof(test_ciphertext));
+
+  for (int wire_version = WIRE_VERSION_1; wire_version <= WIRE_VERSION_LATEST; wire_version++)
+  {
+    test_connect(wire_version);
+    test_keypair(wire_version);
+    test_peerlist(wire_version);
+    test_relaymsg(wire_version);
+    test_frame_header(wire_version, false, UINT16_MAX);
+    test_frame_header(wire_version, true, WIRE_MAC_SIZE + 100);
+  }
+
+  // frames of the third format go past 64 KiB...
+  test_frame_header(WIRE_VERSION_3, false, 16 * 1024 * 1024);
+  test_frame_header(WIRE_VERSION_3, true, WIRE_V3_MAX_BODY_SIZE);
+  test_large_relaymsg();
+
+  // peers shrink to their four address bytes and a 16 bit port...
+  wire_peer_t peer = {"192.168.1.100", 7777};
+  assert(wire_get_peer_size(WIRE_VERSION_2, &peer) == sizeof(uint8_t) + 4 + sizeof(uint16_t));
+
+  buffer_pool_clear();
+  printf("wire tests passed.\n");
+  return 0;
+}
@@ -11,8 +11,236 @@
 #include "buffer.h"
 #include "util.h"
 
+#define TEST_KEY_SIZE 32
+#define TEST_NONCE_SIZE 24
+#define TEST_RELAYMSG_SIZE 4096
+
+// strings are written with a pointer's worth of trailing bytes, so the
+// fields below are padded to allow for it...
+static unsigned char test_key[TEST_KEY_SIZE + sizeof(unsigned char*)];
+static unsigned char test_nonce[TEST_NONCE_SIZE + sizeof(unsigned char*)];
+static unsigned char test_relaymsg[TEST_RELAYMSG_SIZE + sizeof(unsigned char*)];
+static const char test_version[16] = "0.0.1";
+static const char test_release_name[24] = "lightning";
+
+static long test_count_allocations(buffer_t* (*write_packet)(void), int *size)
+{
+  long num_allocations = buffer_get_num_allocations();
+  buffer_t *buffer = write_packet();
+  num_allocations = buffer_get_num_allocations() - num_allocations;
+  *size = buffer_get_size(buffer);
+  buffer_free(buffer);
+  return num_allocations;
+}
+
+// the packets below are laid out the same way the protocol writes them...
+static buffer_t* test_write_connect_req(void)
+{
+  buffer_t *buffer = buffer_init();
+  buffer_write_uint8(buffer, 1);
+  buffer_write_string(buffer, test_version, strlen(test_version));
+  buffer_write_string(buffer, test_release_name, strlen(test_release_name));
+  buffer_write_uint32(buffer, 7681);
+  return buffer;
+}
+
+static buffer_t* test_write_keypair_req(void)
+{
+  buffer_t *buffer = buffer_init();
+  buffer_write_uint8(buffer, 3);
+  buffer_write_string(buffer, (const char*)test_key, TEST_KEY_SIZE);
+  buffer_write_string(buffer, (const char*)test_key, TEST_KEY_SIZE);
+  buffer_write_string(buffer, (const char*)test_nonce, TEST_NONCE_SIZE);
+  return buffer;
+}
+
+static buffer_t* test_write_peerlist_req(void)
+{
+  buffer_t *buffer = buffer_init();
+  buffer_write_uint8(buffer, 5);
+  return buffer;
+}
+
+static void test_write_relaymsg_fields(buffer_t *buffer)
+{
+  buffer_write_uint8(buffer, 7);
+  buffer_write_uint16(buffer, TEST_RELAYMSG_SIZE);
+  buffer_write_string(buffer, (const char*)test_relaymsg, TEST_RELAYMSG_SIZE);
+  buffer_write_int32(buffer, 0);
+}
+
+static buffer_t* test_write_relaymsg(void)
+{
+  buffer_t *buffer = buffer_init();
+  test_write_relaymsg_fields(buffer);
+  return buffer;
+}
+
+static buffer_t* test_write_relaymsg_reserved(void)
+{
+  buffer_t *buffer = buffer_init();
+  buffer_reserve(buffer, sizeof(uint8_t) + sizeof(uint16_t) * 2 + sizeof(unsigned char*) +
+    TEST_RELAYMSG_SIZE + sizeof(int32_t));
+  test_write_relaymsg_fields(buffer);
+  return buffer;
+}
+
+static buffer_t* test_write_bytes(void)
+{
+  buffer_t *buffer = buffer_init();
+  for (int i = 0; i < 1 << 16; i++)
+  {
+    buffer_write_uint8(buffer, (uint8_t)i);
+  }
+  return buffer;
+}
+
+static void test_allocations(void)
+{
+  // control packets stay within the inline storage...
+  int size = 0;
+  assert(test_count_allocations(test_write_connect_req, &size) == 0);
+  assert(size < BUFFER_INLINE_SIZE);
+  assert(test_count_allocations(test_write_keypair_req, &size) == 0);
+  assert(size < BUFFER_INLINE_SIZE);
+  assert(test_count_allocations(test_write_peerlist_req, &size) == 0);
+  assert(size == 1);
+
+  // a relayed message is sized once when reserved, and otherwise only
+  // grows a couple of times...
+  assert(test_count_allocations(test_write_relaymsg_reserved, &size) == 1);
+  assert(test_count_allocations(test_write_relaymsg, &size) <= 2);
+
+  // and growth is geometric, not a block per write...
+  assert(test_count_allocations(test_write_bytes, &size) <= 10);
+  assert(size == 1 << 16);
+
+  // copying a buffer sizes it once...
+  buffer_t *buffer = test_write_relaymsg();
+  buffer_t *other_buffer = buffer_init();
+  long num_allocations = buffer_get_num_allocations();
+  buffer_copy(other_buffer, buffer);
+  assert(buffer_get_num_allocations() - num_allocations == 1);
+  assert(buffer_get_size(other_buffer) == buffer_get_size(buffer));
+  assert(memcmp(buffer_get_data(other_buffer), buffer_get_data(buffer), buffer_get_size(buffer)) == 0);
+  buffer_free(other_buffer);
+  buffer_free(buffer);
+
+  // writing after reading part way in only extends the data as far as
+  // it was written...
+  const unsigned char data[10] = {0};
+  buffer = buffer_init_data(0, data, sizeof(data));
+  buffer_read_uint64(buffer);
+  buffer_write_uint32(buffer, 1);
+  assert(buffer_get_size(buffer) == 12);
+  assert(buffer_get_capacity(buffer) == BUFFER_INLINE_SIZE);
+  buffer_free(buffer);
+}
+
+static void test_slices(void)
+{
+  buffer_t *buffer = test_write_keypair_req();
+  buffer_t *other_buffer = buffer_init_data(0, buffer_get_data(buffer), buffer_get_size(buffer));
+  buffer_free(buffer);
+
+  // the slices point into the buffer itself, nothing is allocated...
+  long num_allocations = buffer_get_num_allocations();
+  buffer_slice_t public_key;
+  buffer_slice_t private_key;
+  buffer_slice_t nonce;
+  assert(buffer_read_uint8(other_buffer) == 3);
+  assert(buffer_read_string_slice(other_buffer, &public_key));
+  assert(buffer_read_string_slice(other_buffer, &private_key));
+  assert(buffer_read_string_slice(other_buffer, &nonce));
+  assert(buffer_get_num_allocations() == num_allocations);
+  assert(public_key.size == TEST_KEY_SIZE + sizeof(unsigned char*));
+  assert(memcmp(public_key.data, test_key, TEST_KEY_SIZE) == 0);
+  assert(public_key.data > buffer_get_data(other_buffer));
+  assert(nonce.data + nonce.size == buffer_get_data(other_buffer) + buffer_get_size(other_buffer));
+  assert(buffer_get_remaining_size(other_buffer) == 0);
+
+  // reading past the end fails, and leaves the offset where it was...
+  assert(!buffer_read_string_slice(other_buffer, &nonce));
+  assert(!buffer_read_slice(other_buffer, 1, &nonce));
+  other_buffer->offset = 1;
+  assert(buffer_read_slice(other_buffer, buffer_get_size(other_buffer) - 1, &nonce));
+
+  buffer = buffer_init_data(0, buffer_get_data(other_buffer), sizeof(uint8_t) + sizeof(uint16_t) + TEST_KEY_SIZE);
+  buffer->offset = sizeof(uint8_t);
+  assert(!buffer_read_string_slice(buffer, &public_key));
+  assert(buffer_get_remaining_size(buffer) == sizeof(uint16_t) + TEST_KEY_SIZE);
+  buffer_free(buffer);
+  buffer_free(other_buffer);
+
+  // strings are copied out up to their terminator, when they fit...
+  buffer = test_write_connect_req();
+  buffer->offset = sizeof(uint8_t);
+  char version[16];
+  buffer_slice_t version_slice;
+  assert(buffer_read_string_slice(buffer, &version_slice));
+  assert(buffer_slice_copy_string(&version_slice, version, sizeof(version)));
+  assert(string_equals(version, test_version));
+  assert(!buffer_slice_copy_string(&version_slice, version, strlen(test_version)));
+  buffer_free(buffer);
+}
+
+static void test_varints(void)
+{
+  static const uint64_t values[] = {0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, UINT64_MAX};
+  static const int sizes[] = {1, 1, 1, 2, 2, 2, 3, 5, BUFFER_MAX_VARINT_SIZE};
+
+  buffer_t *buffer = buffer_init();
+  for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    int size = buffer_get_size(buffer);
+    buffer_write_varint(buffer, values[i]);
+    assert(buffer_get_size(buffer) - size == sizes[i]);
+  }
+  buffer_write_uint16_le(buffer, 0x1234);
+  buffer_write_uint32_le(buffer, 0x12345678);
+  buffer_write_uint64_le(buffer, 0x123456789abcdef0);
+
+  // little endian fields read back the same whatever the host's order...
+  const unsigned char *data = buffer_get_data(buffer) + buffer_get_size(buffer) - 14;
+  assert(data[0] == 0x34 && data[1] == 0x12 && data[2] == 0x78 && data[6] == 0xf0);
+
+  buffer_t *other_buffer = buffer_init_data(0, buffer_get_data(buffer), buffer_get_size(buffer));
+  for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    uint64_t value = 0;
+    assert(buffer_read_varint(other_buffer, &value));
+    assert(value == values[i]);
+  }
+  uint16_t value16 = 0;
+  uint32_t value32 = 0;
+  uint64_t value64 = 0;
+  assert(buffer_read_uint16_le(other_buffer, &value16) && value16 == 0x1234);
+  assert(buffer_read_uint32_le(other_buffer, &value32) && value32 == 0x12345678);
+  assert(buffer_read_uint64_le(other_buffer, &value64) && value64 == 0x123456789abcdef0);
+  assert(!buffer_read_uint16_le(other_buffer, &value16));
+  assert(!buffer_read_varint(other_buffer, &value64));
+  buffer_free(other_buffer);
+  buffer_free(buffer);
+
+  // truncated and overlong varints are rejected...
+  static const unsigned char truncated[] = {0x80, 0x80};
+  static const unsigned char overlong[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02};
+  uint64_t value = 0;
+  buffer = buffer_init_data(0, truncated, sizeof(truncated));
+  assert(!buffer_read_varint(buffer, &value));
+  assert(buffer_get_remaining_size(buffer) == sizeof(truncated));
+  buffer_free(buffer);
+  buffer = buffer_init_data(0, overlong, sizeof(overlong));
+  assert(!buffer_read_varint(buffer, &value));
+  buffer_free(buffer);
+}
+
 int main(int argc, char **argv)
 {
+  test_allocations();
+  test_slices();
+  test_varints();
+
   // pack
   buffer_t *buffer = buffer_init();
 
@@ -6,6 +6,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "log.h"
@@ -23,6 +25,34 @@ task_result_t delayed_task_func(task_t *task)
   return TASK_RESULT_DONE;
 }
 
+typedef struct TestPayload
+{
+  int count;
+  char *name;
+} test_payload_t;
+
+void test_payload_free(void *payload)
+{
+  test_payload_t *test_payload = payload;
+  log_info("Freeing payload <%s>...", test_payload->name);
+  free(test_payload->name);
+}
+
+task_result_t payload_task_func(task_t *task)
+{
+  test_payload_t *test_payload = task_get_payload(task);
+  test_payload->count++;
+  log_info("Task with id <%d>, running payload <%s> <%d times>...", task->id, test_payload->name,
+    test_payload->count);
+  return test_payload->count < 3 ? TASK_RESULT_CONT : TASK_RESULT_DONE;
+}
+
+task_result_t periodic_task_func(task_t *task)
+{
+  log_info("Task with id <%d>, running periodic <lag %f seconds>...", task->id, task_get_lag(task));
+  return TASK_RESULT_WAIT;
+}
+
 int main(int argc, char **argv)
 {
   taskmgr_init();
@@ -33,6 +63,14 @@ int main(int argc, char **argv)
   task_t *delayed_task0 = add_task(delayed_task_func, 5);
   task_t *delayed_task1 = add_task(delayed_task_func, 5);
 
+  test_payload_t test_payload = {0, malloc(sizeof("payload0"))};
+  strcpy(test_payload.name, "payload0");
+  task_t *payload_task0 = add_task_with_payload(payload_task_func, 0, &test_payload, sizeof(test_payload),
+    test_payload_free);
+
+  task_t *periodic_task0 = add_periodic_task(periodic_task_func, 0.25, TASK_PERIOD_FIXED_RATE);
+  task_t *periodic_task1 = add_periodic_task(periodic_task_func, 0.5, TASK_PERIOD_FIXED_DELAY);
+
   taskmgr_run();
   taskmgr_shutdown();
   return 0;